@@ -27,59 +27,368 @@
 #include "config.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
 #include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "log.h"
 #include "status.h"
 #include "datastructure.h"
 
+/**
+ * Slab file slots start with a header: the next slot in the chain of the
+ * member (SLAB_END if last) and the number of data bytes in the slot.
+ *
+ */
+#define SLAB_END UINT32_MAX
+#define SLAB_HEADER 8
+#define SLAB_MINSLOTS 1024
+
+static const char* slab_str = "slab";
+
+struct slab_struct {
+    pthread_mutex_t lock;
+    char* fname;
+    int fd;
+    uint8_t* base;
+    size_t slotsize;
+    uint32_t nslots; /** slots in the file */
+    uint32_t used; /** slots below this have been handed out */
+    uint32_t live; /** slots in use */
+    uint32_t freelist;
+    struct collection_instance_struct* instances;
+    uint8_t* buffer; /** scratch buffer for encoding and decoding */
+    size_t buffersize;
+};
+
 struct collection_class_struct {
-    FILE* store;
     void* cargo;
     int (*member_destroy)(void* cargo, void* member);
-    int (*member_dispose)(void* cargo, void* member, FILE*);
-    int (*member_restore)(void* cargo, void* member, FILE*);
+    int (*member_encode)(void* cargo, void* member, uint8_t* buf, size_t size);
+    int (*member_decode)(void* cargo, void* member, const uint8_t* buf, size_t len);
+    struct slab_struct* slab;
 };
 
 struct collection_instance_struct {
     struct collection_class_struct* method;
-    char* array; /** array with members */
+    char* array; /** array with members, for a slab only while iterating */
     size_t size; /** member size */
     int iterator;
     int count; /** number of members in array */
-    long location;
+    uint32_t* slots; /** first slot of each member in the slab */
+    struct collection_instance_struct* prev; /** instances of the slab */
+    struct collection_instance_struct* next;
 };
 
+static uint8_t*
+slab_slot(struct slab_struct* slab, uint32_t slot)
+{
+    return slab->base + (size_t) slot * slab->slotsize;
+}
+
+static uint32_t
+slab_slot_next(struct slab_struct* slab, uint32_t slot)
+{
+    uint32_t next;
+    memcpy(&next, slab_slot(slab, slot), sizeof(next));
+    return next;
+}
+
+static uint16_t
+slab_slot_len(struct slab_struct* slab, uint32_t slot)
+{
+    uint16_t len;
+    memcpy(&len, slab_slot(slab, slot) + sizeof(uint32_t), sizeof(len));
+    return len;
+}
+
+static void
+slab_slot_set(struct slab_struct* slab, uint32_t slot, uint32_t next,
+    uint16_t len)
+{
+    memcpy(slab_slot(slab, slot), &next, sizeof(next));
+    memcpy(slab_slot(slab, slot) + sizeof(uint32_t), &len, sizeof(len));
+}
+
+/**
+ * Create a slab file of nslots slots. The file is unlinked right away,
+ * it only lives as long as the mapping.
+ *
+ */
 static int
+slab_map(struct slab_struct* slab, uint32_t nslots, int* fd, uint8_t** base)
+{
+    size_t length = (size_t) nslots * slab->slotsize;
+    *fd = open(slab->fname, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (*fd < 0) {
+        ods_log_error("[%s] unable to create %s: %s", slab_str,
+            slab->fname, strerror(errno));
+        return 1;
+    }
+    (void) unlink(slab->fname);
+#ifdef HAVE_POSIX_FALLOCATE
+    /* allocate the blocks, writing to a hole on a full disk is SIGBUS */
+    errno = posix_fallocate(*fd, 0, length);
+    if (errno) {
+#else
+    if (ftruncate(*fd, length)) {
+#endif
+        ods_log_error("[%s] unable to size %s to %lu bytes: %s", slab_str,
+            slab->fname, (unsigned long) length, strerror(errno));
+        close(*fd);
+        return 1;
+    }
+    *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+    if (*base == MAP_FAILED) {
+        ods_log_error("[%s] unable to map %s: %s", slab_str, slab->fname,
+            strerror(errno));
+        close(*fd);
+        return 1;
+    }
+    return 0;
+}
+
+static void
+slab_unmap(struct slab_struct* slab)
+{
+    if (slab->base) {
+        munmap(slab->base, (size_t) slab->nslots * slab->slotsize);
+        close(slab->fd);
+        slab->base = NULL;
+    }
+}
+
+/**
+ * Grow the slab file. Slots keep their number, so only the mapping moves.
+ *
+ */
+static void
+slab_grow(struct slab_struct* slab)
+{
+    uint32_t nslots = slab->nslots * 2;
+    size_t length = (size_t) nslots * slab->slotsize;
+    uint8_t* base;
+    munmap(slab->base, (size_t) slab->nslots * slab->slotsize);
+#ifdef HAVE_POSIX_FALLOCATE
+    errno = posix_fallocate(slab->fd, 0, length);
+    if (errno) {
+#else
+    if (ftruncate(slab->fd, length)) {
+#endif
+        ods_fatal_exit("[%s] unable to grow %s to %lu bytes: %s", slab_str,
+            slab->fname, (unsigned long) length, strerror(errno));
+    }
+    base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+        slab->fd, 0);
+    if (base == MAP_FAILED) {
+        ods_fatal_exit("[%s] unable to map %s: %s", slab_str, slab->fname,
+            strerror(errno));
+    }
+    slab->base = base;
+    slab->nslots = nslots;
+}
+
+static uint32_t
+slab_alloc(struct slab_struct* slab)
+{
+    uint32_t slot;
+    if (slab->freelist != SLAB_END) {
+        slot = slab->freelist;
+        slab->freelist = slab_slot_next(slab, slot);
+    } else {
+        if (slab->used == slab->nslots) {
+            slab_grow(slab);
+        }
+        slot = slab->used++;
+    }
+    slab->live++;
+    return slot;
+}
+
+/**
+ * Rewrite the members of all instances to a new slab file, in order and
+ * without holes, and drop the old file.
+ *
+ */
+static void
+slab_compact(struct slab_struct* slab)
+{
+    struct collection_instance_struct* instance;
+    uint32_t nslots = slab->live + slab->live / 2;
+    uint32_t pos = 0;
+    uint32_t slot;
+    uint8_t* base;
+    int fd;
+    int i;
+    if (nslots < SLAB_MINSLOTS) {
+        nslots = SLAB_MINSLOTS;
+    }
+    if (slab_map(slab, nslots, &fd, &base)) {
+        ods_log_warning("[%s] unable to compact %s", slab_str, slab->fname);
+        return;
+    }
+    for (instance = slab->instances; instance; instance = instance->next) {
+        for (i = 0; i < instance->count; i++) {
+            slot = instance->slots[i];
+            instance->slots[i] = pos;
+            while (slot != SLAB_END) {
+                memcpy(base + (size_t) pos * slab->slotsize,
+                    slab_slot(slab, slot), slab->slotsize);
+                slot = slab_slot_next(slab, slot);
+                pos++;
+                if (slot != SLAB_END) {
+                    memcpy(base + (size_t) (pos - 1) * slab->slotsize, &pos,
+                        sizeof(pos));
+                }
+            }
+        }
+    }
+    ods_log_debug("[%s] compacted %s from %u to %u slots", slab_str,
+        slab->fname, slab->used, pos);
+    slab_unmap(slab);
+    slab->fd = fd;
+    slab->base = base;
+    slab->nslots = nslots;
+    slab->used = pos;
+    slab->live = pos;
+    slab->freelist = SLAB_END;
+}
+
+/**
+ * Return the slots of a member to the free list.
+ *
+ */
+static void
+slab_free(struct slab_struct* slab, uint32_t slot)
+{
+    uint32_t next;
+    while (slot != SLAB_END) {
+        next = slab_slot_next(slab, slot);
+        slab_slot_set(slab, slot, slab->freelist, 0);
+        slab->freelist = slot;
+        slab->live--;
+        slot = next;
+    }
+}
+
+/**
+ * Compact the file when less than a quarter of the handed out slots is
+ * still in use. Only call this when the slots of all instances are
+ * consistent.
+ *
+ */
+static void
+slab_shrink(struct slab_struct* slab)
+{
+    if (slab->used > SLAB_MINSLOTS && slab->live < slab->used / 4) {
+        slab_compact(slab);
+    }
+}
+
+/**
+ * Store a member in a chain of slots.
+ *
+ */
+static uint32_t
+slab_store(struct collection_class_struct* klass, void* member)
+{
+    struct slab_struct* slab = klass->slab;
+    size_t datasize = slab->slotsize - SLAB_HEADER;
+    size_t len, off, chunk;
+    uint32_t head, slot, next;
+    int ret;
+    ret = klass->member_encode(klass->cargo, member, slab->buffer,
+        slab->buffersize);
+    if (ret >= 0 && (size_t) ret > slab->buffersize) {
+        slab->buffersize = (size_t) ret;
+        CHECKALLOC(slab->buffer = realloc(slab->buffer, slab->buffersize));
+        ret = klass->member_encode(klass->cargo, member, slab->buffer,
+            slab->buffersize);
+    }
+    if (ret < 0) {
+        ods_fatal_exit("[%s] unable to encode member for %s", slab_str,
+            slab->fname);
+    }
+    len = (size_t) ret;
+    head = slot = slab_alloc(slab);
+    off = 0;
+    do {
+        chunk = (len - off > datasize ? datasize : len - off);
+        memcpy(slab_slot(slab, slot) + SLAB_HEADER, slab->buffer + off,
+            chunk);
+        off += chunk;
+        next = (off < len ? slab_alloc(slab) : SLAB_END);
+        slab_slot_set(slab, slot, next, (uint16_t) chunk);
+        slot = next;
+    } while (slot != SLAB_END);
+    return head;
+}
+
+/**
+ * Restore a member from its chain of slots.
+ *
+ */
+static void
+slab_load(struct collection_class_struct* klass, uint32_t slot, void* member)
+{
+    struct slab_struct* slab = klass->slab;
+    size_t len = 0;
+    uint16_t chunk;
+    while (slot != SLAB_END) {
+        chunk = slab_slot_len(slab, slot);
+        if (len + chunk > slab->buffersize) {
+            slab->buffersize = (len + chunk) * 2;
+            CHECKALLOC(slab->buffer = realloc(slab->buffer,
+                slab->buffersize));
+        }
+        memcpy(slab->buffer + len, slab_slot(slab, slot) + SLAB_HEADER,
+            chunk);
+        len += chunk;
+        slot = slab_slot_next(slab, slot);
+    }
+    if (klass->member_decode(klass->cargo, member, slab->buffer, len)) {
+        ods_fatal_exit("[%s] unable to decode member from %s", slab_str,
+            slab->fname);
+    }
+}
+
+/**
+ * Restore all members of a collection for iteration.
+ *
+ */
+static void
 swapin(collection_t collection)
 {
+    struct collection_class_struct* klass = collection->method;
     int i;
-    if(collection->count > 0) {
-        if(fseek(collection->method->store, collection->location, SEEK_SET))
-            return 1;
-        for(i=0; i<collection->count; i++) {
-            if(collection->method->member_restore(collection->method->cargo,
-                    collection->array + collection->size * i, collection->method->store))
-                return 1;
+    if (collection->count > 0) {
+        CHECKALLOC(collection->array = malloc(collection->count * collection->size));
+        pthread_mutex_lock(&klass->slab->lock);
+        for (i=0; i < collection->count; i++) {
+            slab_load(klass, collection->slots[i],
+                collection->array + collection->size * i);
         }
+        pthread_mutex_unlock(&klass->slab->lock);
     }
-    return 0;
 }
 
-static int
+/**
+ * Drop the restored members after iteration. They are still in the slab.
+ *
+ */
+static void
 swapout(collection_t collection)
 {
     int i;
-    if(collection->count > 0) {
-        if(fseek(collection->method->store, 0, SEEK_END))
-            return 1;
-        collection->location = ftell(collection->method->store);
-        for(i=0; i<collection->count; i++) {
-            if(collection->method->member_dispose(collection->method->cargo,
-                    collection->array + collection->size * i, collection->method->store))
-                return 1;
-        }
+    for (i=0; i < collection->count; i++) {
+        collection->method->member_destroy(collection->method->cargo,
+            collection->array + collection->size * i);
     }
-    return 0;
+    free(collection->array);
+    collection->array = NULL;
 }
 
 void
@@ -89,34 +398,113 @@ collection_class_allocated(collection_class* klass, void *cargo,
     CHECKALLOC(*klass = malloc(sizeof(struct collection_class_struct)));
     (*klass)->cargo = cargo;
     (*klass)->member_destroy = member_destroy;
-    (*klass)->member_dispose = NULL;
-    (*klass)->member_restore = NULL;
-    (*klass)->store = NULL;
+    (*klass)->member_encode = NULL;
+    (*klass)->member_decode = NULL;
+    (*klass)->slab = NULL;
 }
 
-void
-collection_class_backed(collection_class* klass, char* fname, void *cargo,
+int
+collection_class_slab(collection_class* klass, const char* fname,
+        size_t slotsize, void *cargo,
         int (*member_destroy)(void* cargo, void* member),
-        int (*member_dispose)(void* cargo, void* member, FILE*),
-        int (*member_restore)(void* cargo, void* member, FILE*))
+        int (*member_encode)(void* cargo, void* member, uint8_t* buf, size_t size),
+        int (*member_decode)(void* cargo, void* member, const uint8_t* buf, size_t len))
 {
+    struct slab_struct* slab;
+    if (slotsize <= SLAB_HEADER || slotsize - SLAB_HEADER > UINT16_MAX) {
+        return 1;
+    }
+    CHECKALLOC(slab = calloc(1, sizeof(struct slab_struct)));
+    CHECKALLOC(slab->fname = strdup(fname));
+    slab->slotsize = slotsize;
+    if (slab_map(slab, SLAB_MINSLOTS, &slab->fd, &slab->base)) {
+        free(slab->fname);
+        free(slab);
+        return 1;
+    }
+    pthread_mutex_init(&slab->lock, NULL);
+    slab->nslots = SLAB_MINSLOTS;
+    slab->freelist = SLAB_END;
+    slab->buffersize = slotsize;
+    CHECKALLOC(slab->buffer = malloc(slab->buffersize));
     CHECKALLOC(*klass = malloc(sizeof(struct collection_class_struct)));
     (*klass)->cargo = cargo;
     (*klass)->member_destroy = member_destroy;
-    (*klass)->member_dispose = member_dispose;
-    (*klass)->member_restore = member_restore;
-    (*klass)->store = fopen(fname, "w+");
+    (*klass)->member_encode = member_encode;
+    (*klass)->member_decode = member_decode;
+    (*klass)->slab = slab;
+    return 0;
 }
 
 void
 collection_class_destroy(collection_class* klass)
 {
-    if (klass == NULL)
+    if (klass == NULL || *klass == NULL)
         return;
+    if ((*klass)->slab) {
+        ods_log_assert(!(*klass)->slab->instances);
+        slab_unmap((*klass)->slab);
+        pthread_mutex_destroy(&(*klass)->slab->lock);
+        free((*klass)->slab->buffer);
+        free((*klass)->slab->fname);
+        free((*klass)->slab);
+    }
     free(*klass);
     *klass = NULL;
 }
 
+/**
+ * Attach a collection to a class. If the class is a slab, store the
+ * members in it, the caller drops the restored members afterwards.
+ *
+ */
+static void
+collection_attach(collection_t collection, collection_class klass)
+{
+    struct slab_struct* slab = klass->slab;
+    int i;
+    collection->method = klass;
+    collection->prev = NULL;
+    collection->next = NULL;
+    if (slab) {
+        if (collection->count > 0)
+            CHECKALLOC(collection->slots = malloc(collection->count * sizeof(uint32_t)));
+        pthread_mutex_lock(&slab->lock);
+        for (i=0; i < collection->count; i++) {
+            collection->slots[i] = slab_store(klass,
+                collection->array + collection->size * i);
+        }
+        collection->next = slab->instances;
+        if (collection->next)
+            collection->next->prev = collection;
+        slab->instances = collection;
+        pthread_mutex_unlock(&slab->lock);
+    }
+}
+
+static void
+collection_detach(collection_t collection)
+{
+    struct slab_struct* slab = collection->method->slab;
+    int i;
+    if (slab) {
+        pthread_mutex_lock(&slab->lock);
+        if (collection->prev)
+            collection->prev->next = collection->next;
+        else
+            slab->instances = collection->next;
+        if (collection->next)
+            collection->next->prev = collection->prev;
+        for (i=0; i < collection->count; i++) {
+            slab_free(slab, collection->slots[i]);
+        }
+        slab_shrink(slab);
+        pthread_mutex_unlock(&slab->lock);
+        free(collection->slots);
+        collection->slots = NULL;
+    }
+}
+
 void
 collection_create_array(collection_t* collection, size_t membsize,
         collection_class klass)
@@ -126,7 +514,22 @@ collection_create_array(collection_t* collection, size_t membsize,
     (*collection)->count = 0;
     (*collection)->array = NULL;
     (*collection)->iterator = -1;
-    (*collection)->method = klass;
+    (*collection)->slots = NULL;
+    collection_attach(*collection, klass);
+}
+
+void
+collection_move(collection_t collection, collection_class klass)
+{
+    if (collection->method == klass)
+        return;
+    ods_log_assert(collection->iterator < 0);
+    if (collection->method->slab)
+        swapin(collection);
+    collection_detach(collection);
+    collection_attach(collection, klass);
+    if (klass->slab && collection->array)
+        swapout(collection);
 }
 
 void
@@ -135,12 +538,14 @@ collection_destroy(collection_t* collection)
     int i;
     if(collection == NULL)
         return;
-    for (i=0; i < (*collection)->count; i++) {
-        (*collection)->method->member_destroy((*collection)->method->cargo,
-                &(*collection)->array[(*collection)->size * i]);
-    }
-    if((*collection)->array)
+    if ((*collection)->array) {
+        for (i=0; i < (*collection)->count; i++) {
+            (*collection)->method->member_destroy((*collection)->method->cargo,
+                    &(*collection)->array[(*collection)->size * i]);
+        }
         free((*collection)->array);
+    }
+    collection_detach(*collection);
     free(*collection);
     *collection = NULL;
 }
@@ -149,26 +554,52 @@ void
 collection_add(collection_t collection, void *data)
 {
     void* ptr;
-    if(collection->method->store)
-        swapin(collection);
+    struct slab_struct* slab = collection->method->slab;
+    if (slab) {
+        /* compaction rewrites the slots of every instance, so the slots
+         * and count only change under the lock */
+        pthread_mutex_lock(&slab->lock);
+        CHECKALLOC(ptr = realloc(collection->slots, (collection->count+1)*sizeof(uint32_t)));
+        collection->slots = ptr;
+        collection->slots[collection->count] = slab_store(collection->method, data);
+        collection->count += 1;
+        pthread_mutex_unlock(&slab->lock);
+        if (!collection->array) {
+            /* not iterating, the slab has its own copy */
+            collection->method->member_destroy(collection->method->cargo, data);
+            return;
+        }
+        CHECKALLOC(ptr = realloc(collection->array, collection->count*collection->size));
+        collection->array = ptr;
+        memcpy(&collection->array[collection->size * (collection->count-1)], data, collection->size);
+        return;
+    }
     CHECKALLOC(ptr = realloc(collection->array, (collection->count+1)*collection->size));
     collection->array = ptr;
     memcpy(&collection->array[collection->size * collection->count], data, collection->size);
     collection->count += 1;
-    if(collection->method->store)
-        swapout(collection);
 }
 
 void
 collection_del_index(collection_t collection, int index)
 {
     void* ptr;
+    struct slab_struct* slab = collection->method->slab;
     if (index<0 || index >= collection->count)
         return;
-    if(collection->method->store)
-        swapin(collection);
+    if (slab) {
+        pthread_mutex_lock(&slab->lock);
+        slab_free(slab, collection->slots[index]);
+        memmove(&collection->slots[index], &collection->slots[index + 1], (collection->count - index - 1) * sizeof(uint32_t));
+        collection->count -= 1;
+        slab_shrink(slab);
+        pthread_mutex_unlock(&slab->lock);
+        if (!collection->array)
+            return;
+    } else {
+        collection->count -= 1;
+    }
     collection->method->member_destroy(collection->method->cargo, &collection->array[collection->size * index]);
-    collection->count -= 1;
     memmove(&collection->array[collection->size * index], &collection->array[collection->size * (index + 1)], (collection->count - index) * collection->size);
     if (collection->count > 0) {
         CHECKALLOC(ptr = realloc(collection->array, collection->count * collection->size));
@@ -177,8 +608,6 @@ collection_del_index(collection_t collection, int index)
         free(collection->array);
         collection->array = NULL;
     }
-    if(collection->method->store)
-        swapout(collection);
 }
 
 void
@@ -191,7 +620,7 @@ void*
 collection_iterator(collection_t collection)
 {
     if(collection->iterator < 0) {
-        if(collection->method->store)
+        if(collection->method->slab)
             swapin(collection);
         collection->iterator = collection->count;
     }
@@ -199,7 +628,7 @@ collection_iterator(collection_t collection)
     if(collection->iterator >= 0) {
         return &collection->array[collection->iterator * collection->size];
     } else {
-        if(collection->method->store)
+        if(collection->method->slab)
             swapout(collection);
         return NULL;
     }
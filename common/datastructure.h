@@ -28,6 +28,8 @@
 #define UTIL_DATASTRUCTURE_H
 
 #include "config.h"
+#include <stdint.h>
+#include <stddef.h>
 
 struct collection_class_struct;
 typedef struct collection_class_struct* collection_class;
@@ -45,14 +47,37 @@ void collection_create_array(collection_t* collection, size_t membsize, collecti
 void collection_class_allocated(collection_class* klass, void *cargo,
         int (*member_destroy)(void* cargo, void* member));
 
-void collection_class_backed(collection_class* klass, char* fname, void *cargo,
+/**
+ * Creates a collection class that keeps its members off-heap, in a memory
+ * mapped slab file of fixed size slots. A member is encoded into a chain
+ * of slots when added, and only decoded while iterating over its
+ * collection. Freed slots are reused, and the file is compacted when most
+ * of it is free.
+ * \param[out] klass the class
+ * \param[in] fname the slab file, it is unlinked once created
+ * \param[in] slotsize size of a slot in bytes, including an 8 byte header
+ * \param[in] member_encode encodes a member into buf, returns the encoded
+ *            length, which may be larger than size, or -1 on error
+ * \param[in] member_decode decodes a member, returns 0 on success
+ * \return 0 on success, 1 if the slab file could not be created
+ */
+int collection_class_slab(collection_class* klass, const char* fname,
+        size_t slotsize, void *cargo,
         int (*member_destroy)(void* cargo, void* member),
-        int (*member_dispose)(void* cargo, void* member, FILE*),
-        int (*member_restore)(void* cargo, void* member, FILE*));
+        int (*member_encode)(void* cargo, void* member, uint8_t* buf, size_t size),
+        int (*member_decode)(void* cargo, void* member, const uint8_t* buf, size_t len));
 
 void collection_class_destroy(collection_class* klass);
 
 void collection_destroy(collection_t* collection);
+
+/**
+ * Moves the members of a collection to another class.
+ * \param[in] collection the collection, which must not be iterated over
+ * \param[in] klass the class to move to
+ */
+void collection_move(collection_t collection, collection_class klass);
+
 void collection_add(collection_t collection, void* data);
 void collection_del_index(collection_t collection, int index);
 void collection_del_cursor(collection_t collection);
@@ -44,11 +44,13 @@ static int logging_to_syslog = 0;
 #include <stdlib.h> /* exit() */
 #include <string.h> /* strlen() */
 #include <pthread.h>
+#include <signal.h> /* pthread_sigmask() */
+#include <time.h> /* clock_gettime() */
 
 #define LOG_DEEEBUG 8 /* ods_log_deeebug */
 
 static FILE* logfile = NULL;
-static int log_level = LOG_CRIT;
+int ods_log_level = LOG_CRIT;
 
 #define CTIME_LENGTH 26
 
@@ -76,6 +78,44 @@ struct syslog_data sdata = SYSLOG_DATA_INIT;
 static const char* log_str = "log";
 static char* log_ident = NULL;
 
+/**
+ * Asynchronous logging. Callers format their message straight into a slot
+ * of a shared ring and a single writer thread does the syslog or file I/O.
+ * Slots carry a sequence number like the fifoq cells, so claiming one takes
+ * no lock. When the ring is full, messages below warning level are dropped
+ * and more severe ones wait for the writer to make room.
+ *
+ */
+#define LOG_RING_SIZE 256
+#define LOG_REPORT_INTERVAL 60
+
+struct log_slot {
+    size_t seq;
+    int priority;
+    const char* label;
+    time_t when;
+    char message[ODS_SE_MAXLINE];
+};
+
+static struct log_slot log_ring[LOG_RING_SIZE];
+static size_t log_head = 0; /* next slot to claim */
+static size_t log_tail = 0; /* next slot to write, under log_io_lock */
+static int log_ring_ready = 0;
+static int log_async = 0;
+static int log_running = 0;
+static int log_stopping = 0;
+static int log_sleeping = 0;
+static int log_waiting = 0;
+static unsigned long log_dropped = 0;
+static unsigned long log_blocked = 0;
+static pthread_t log_writer;
+/* log_lock protects the writer's sleep and waiters for free slots */
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t log_space = PTHREAD_COND_INITIALIZER;
+/* log_io_lock serializes draining the ring and swapping log targets */
+static pthread_mutex_t log_io_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Initialize logging.
  */
@@ -86,14 +126,19 @@ ods_log_init(const char *programname, int use_syslog, const char *targetname, in
     int facility;
     int error = 0;
 #endif /* HAVE_SYSLOG_H */
+    FILE* target = NULL;
+
+    /* the writer thread may be busy with the old target */
+    pthread_mutex_lock(&log_io_lock);
     if(logfile && logfile != stderr && logfile != stdout) {
             ods_fclose(logfile);
     }
+    logfile = NULL;
     if(log_ident) {
         free(log_ident);
         log_ident = NULL;
     }
-    log_level = verbosity + 2;
+    ods_log_level = verbosity + 2;
 
 #ifdef HAVE_SYSLOG_H
     if(logging_to_syslog) {
@@ -113,6 +158,7 @@ ods_log_init(const char *programname, int use_syslog, const char *targetname, in
 #endif
        log_ident = strdup(programname);
        logging_to_syslog = 1;
+       pthread_mutex_unlock(&log_io_lock);
        if (error == 1) {
         ods_log_warning("[%s] syslog facility %s not supported, logging to "
                    "log_daemon", log_str, targetname);
@@ -122,18 +168,24 @@ ods_log_init(const char *programname, int use_syslog, const char *targetname, in
        return;
     }
 #endif /* HAVE_SYSLOG_H */
+    pthread_mutex_unlock(&log_io_lock);
 
+    /* opening the file logs itself, so do it outside the lock */
     if(targetname && targetname[0]) {
-        logfile = ods_fopen(targetname, NULL, "a");
-        if (logfile) {
+        target = ods_fopen(targetname, NULL, "a");
+    }
+    pthread_mutex_lock(&log_io_lock);
+    logfile = target ? target : stderr;
+    pthread_mutex_unlock(&log_io_lock);
+
+    if(targetname && targetname[0]) {
+        if (target) {
             ods_log_debug("[%s] new logfile %s", log_str, targetname);
             return;
         }
-        logfile = stderr;
         ods_log_warning("[%s] cannot open %s for appending, logging to "
             "stderr", log_str, targetname);
     } else {
-        logfile = stderr;
         targetname = "stderr";
     }
     ods_log_verbose("[%s] switching log to %s verbosity %i (log level %i)",
@@ -144,13 +196,13 @@ ods_log_init(const char *programname, int use_syslog, const char *targetname, in
 int
 ods_log_verbosity(void)
 {
-	return log_level-2;
+	return ods_log_level-2;
 }
 
 void
 ods_log_setverbosity(int verbosity)
 {
-    log_level = verbosity + 2;
+    ods_log_level = verbosity + 2;
 }
 
 /**
@@ -161,6 +213,7 @@ void
 ods_log_close(void)
 {
     ods_log_debug("[%s] close log", log_str);
+    ods_log_async(0);
     ods_log_init("", 0, NULL, 0);
 }
 
@@ -230,21 +283,18 @@ ods_log_get_facility(const char* facility, int* error)
 int
 ods_log_get_level()
 {
-    return log_level;
+    return ods_log_level;
 }
 
 /**
- * Log message wrapper.
+ * Write a formatted message to syslog or the log file.
  *
  */
 static void
-ods_log_vmsg(int priority, const char* t, const char* s, va_list args)
+ods_log_write(int priority, const char* t, time_t when, const char* message,
+    int flush)
 {
-    char message[ODS_SE_MAXLINE];
-    static char nowstr[CTIME_LENGTH];
-    time_t now = time_now();
-
-    vsnprintf(message, sizeof(message), s, args);
+    char nowstr[CTIME_LENGTH];
 
 #ifdef HAVE_SYSLOG_H
     if (logging_to_syslog) {
@@ -262,12 +312,332 @@ ods_log_vmsg(int priority, const char* t, const char* s, va_list args)
         return;
     }
 
-    (void) ctime_r(&now, nowstr);
+    (void) ctime_r(&when, nowstr);
     nowstr[CTIME_LENGTH-2] = '\0'; /* remove trailing linefeed */
 
     fprintf(logfile, "[%s] %s[%i] %s: %s\n", nowstr,
         log_ident, priority, t, message);
-    fflush(logfile);
+    if (flush) {
+        fflush(logfile);
+    }
+}
+
+
+/**
+ * Write out all published slots. Caller holds log_io_lock.
+ *
+ */
+static size_t
+ods_log_drain(void)
+{
+    struct log_slot* slot;
+    size_t tail = log_tail;
+    size_t n = 0;
+
+    for (;;) {
+        slot = &log_ring[tail % LOG_RING_SIZE];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) != tail + 1) {
+            break;
+        }
+        ods_log_write(slot->priority, slot->label, slot->when,
+            slot->message, 0);
+        __atomic_store_n(&slot->seq, tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        __atomic_store_n(&log_tail, ++tail, __ATOMIC_RELEASE);
+        n++;
+    }
+    if (n) {
+        if (logfile) {
+            fflush(logfile);
+        }
+        pthread_mutex_lock(&log_lock);
+        if (log_waiting) {
+            pthread_cond_broadcast(&log_space);
+        }
+        pthread_mutex_unlock(&log_lock);
+    }
+    return n;
+}
+
+
+/**
+ * Write out the ring from the calling thread.
+ *
+ */
+static void
+ods_log_flush(void)
+{
+    if (!log_ring_ready) {
+        return;
+    }
+    pthread_mutex_lock(&log_io_lock);
+    (void) ods_log_drain();
+    pthread_mutex_unlock(&log_io_lock);
+}
+
+
+/**
+ * Whether the next slot to write has been published.
+ *
+ */
+static int
+ods_log_pending(void)
+{
+    size_t tail = __atomic_load_n(&log_tail, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&log_ring[tail % LOG_RING_SIZE].seq,
+        __ATOMIC_SEQ_CST) == tail + 1;
+}
+
+
+/**
+ * Claim a slot in the ring. Returns NULL if the message is dropped.
+ *
+ */
+static struct log_slot*
+ods_log_claim(int priority, size_t* claimed)
+{
+    struct log_slot* slot;
+    size_t pos, seq;
+
+    pos = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &log_ring[pos % LOG_RING_SIZE];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&log_head, &pos, pos + 1, 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *claimed = pos;
+                return slot;
+            }
+            continue; /* pos was reloaded by the failed exchange */
+        }
+        if ((long)(seq - pos) < 0) {
+            /* ring is full */
+            if (priority > LOG_WARNING) {
+                __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+                return NULL;
+            }
+            __atomic_add_fetch(&log_blocked, 1, __ATOMIC_RELAXED);
+            if (!__atomic_load_n(&log_async, __ATOMIC_SEQ_CST)) {
+                /* writer is gone, make room ourselves */
+                ods_log_flush();
+            } else {
+                pthread_mutex_lock(&log_lock);
+                log_waiting++;
+                pthread_cond_signal(&log_wakeup);
+                while (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == seq &&
+                    __atomic_load_n(&log_async, __ATOMIC_SEQ_CST)) {
+                    pthread_cond_wait(&log_space, &log_lock);
+                }
+                log_waiting--;
+                pthread_mutex_unlock(&log_lock);
+            }
+        }
+        pos = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+    }
+}
+
+
+/**
+ * Hand a filled slot to the writer.
+ *
+ */
+static void
+ods_log_publish(struct log_slot* slot, size_t pos)
+{
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&log_sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&log_lock);
+        pthread_cond_signal(&log_wakeup);
+        pthread_mutex_unlock(&log_lock);
+    }
+    if (!__atomic_load_n(&log_async, __ATOMIC_SEQ_CST)) {
+        /* the writer stopped while we were filling the slot */
+        ods_log_flush();
+    }
+}
+
+
+/**
+ * Log writer thread.
+ *
+ */
+static void*
+ods_log_writer(void* arg)
+{
+    char message[ODS_SE_MAXLINE];
+    unsigned long dropped, blocked;
+    unsigned long rdropped = 0, rblocked = 0;
+    time_t now, reported = 0;
+    struct timespec ts;
+    (void) arg;
+
+    for (;;) {
+        pthread_mutex_lock(&log_io_lock);
+        (void) ods_log_drain();
+        dropped = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+        blocked = __atomic_load_n(&log_blocked, __ATOMIC_RELAXED);
+        now = time_now();
+        if ((dropped != rdropped || blocked != rblocked) &&
+            ods_log_level >= LOG_WARNING &&
+            (now >= reported + LOG_REPORT_INTERVAL ||
+            __atomic_load_n(&log_stopping, __ATOMIC_RELAXED))) {
+            snprintf(message, sizeof(message), "[%s] log ring full: dropped "
+                "%lu messages, held up %lu callers", log_str,
+                dropped - rdropped, blocked - rblocked);
+            ods_log_write(LOG_WARNING, "warning", now, message, 1);
+            rdropped = dropped;
+            rblocked = blocked;
+            reported = now;
+        }
+        pthread_mutex_unlock(&log_io_lock);
+
+        pthread_mutex_lock(&log_lock);
+        if (log_stopping && !ods_log_pending()) {
+            pthread_mutex_unlock(&log_lock);
+            break;
+        }
+        __atomic_store_n(&log_sleeping, 1, __ATOMIC_SEQ_CST);
+        if (!ods_log_pending() && !log_stopping) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 1;
+            (void) pthread_cond_timedwait(&log_wakeup, &log_lock, &ts);
+        }
+        __atomic_store_n(&log_sleeping, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&log_lock);
+    }
+    return NULL;
+}
+
+
+/**
+ * Write out what is queued when the process exits.
+ *
+ */
+static void
+ods_log_atexit(void)
+{
+    __atomic_store_n(&log_async, 0, __ATOMIC_SEQ_CST);
+    ods_log_flush();
+}
+
+
+/**
+ * In a forked child there is no writer thread and the ring belongs to the
+ * parent: log synchronously, drop the inherited slots and locks.
+ *
+ */
+static void
+ods_log_atfork_child(void)
+{
+    size_t i;
+
+    log_async = 0;
+    log_running = 0;
+    log_stopping = 0;
+    log_sleeping = 0;
+    log_waiting = 0;
+    for (i = 0; i < LOG_RING_SIZE; i++) {
+        log_ring[i].seq = i;
+    }
+    log_head = 0;
+    log_tail = 0;
+    pthread_mutex_init(&log_lock, NULL);
+    pthread_mutex_init(&log_io_lock, NULL);
+    pthread_cond_init(&log_wakeup, NULL);
+    pthread_cond_init(&log_space, NULL);
+}
+
+
+/**
+ * Start or stop asynchronous logging.
+ *
+ */
+void
+ods_log_async(int enable)
+{
+    sigset_t all, old;
+    size_t i;
+
+    if (enable && !log_running) {
+        if (!log_ring_ready) {
+            for (i = 0; i < LOG_RING_SIZE; i++) {
+                log_ring[i].seq = i;
+            }
+            log_head = 0;
+            log_tail = 0;
+            log_ring_ready = 1;
+            atexit(ods_log_atexit);
+            pthread_atfork(NULL, NULL, ods_log_atfork_child);
+        }
+        log_stopping = 0;
+        /* signals are for the main thread */
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        if (pthread_create(&log_writer, NULL, ods_log_writer, NULL) == 0) {
+            log_running = 1;
+            __atomic_store_n(&log_async, 1, __ATOMIC_SEQ_CST);
+        }
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        if (log_running) {
+            ods_log_debug("[%s] logging through writer thread", log_str);
+        } else {
+            ods_log_warning("[%s] unable to start log writer, logging "
+                "synchronously", log_str);
+        }
+    } else if (!enable && log_running) {
+        __atomic_store_n(&log_async, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&log_lock);
+        __atomic_store_n(&log_stopping, 1, __ATOMIC_RELAXED);
+        pthread_cond_signal(&log_wakeup);
+        pthread_cond_broadcast(&log_space);
+        pthread_mutex_unlock(&log_lock);
+        pthread_join(log_writer, NULL);
+        log_running = 0;
+        ods_log_flush();
+    }
+}
+
+
+/**
+ * Get the asynchronous logging counters.
+ *
+ */
+void
+ods_log_async_counters(unsigned long* dropped, unsigned long* blocked)
+{
+    if (dropped) {
+        *dropped = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+    }
+    if (blocked) {
+        *blocked = __atomic_load_n(&log_blocked, __ATOMIC_RELAXED);
+    }
+}
+
+
+/**
+ * Log message wrapper.
+ *
+ */
+static void
+ods_log_vmsg(int priority, const char* t, const char* s, va_list args)
+{
+    char message[ODS_SE_MAXLINE];
+    struct log_slot* slot;
+    size_t pos;
+
+    if (__atomic_load_n(&log_async, __ATOMIC_ACQUIRE)) {
+        if ((slot = ods_log_claim(priority, &pos)) != NULL) {
+            slot->priority = priority;
+            slot->label = t;
+            slot->when = time_now();
+            vsnprintf(slot->message, sizeof(slot->message), s, args);
+            ods_log_publish(slot, pos);
+        }
+        return;
+    }
+
+    vsnprintf(message, sizeof(message), s, args);
+    ods_log_write(priority, t, time_now(), message, 1);
 }
 
 
@@ -276,11 +646,11 @@ ods_log_vmsg(int priority, const char* t, const char* s, va_list args)
  *
  */
 void
-ods_log_deeebug(const char *format, ...)
+(ods_log_deeebug)(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    if (log_level >= LOG_DEEEBUG) {
+    if (ods_log_level >= LOG_DEEEBUG) {
         ods_log_vmsg(LOG_DEBUG, "debug  ", format, args);
     }
     va_end(args);
@@ -292,11 +662,11 @@ ods_log_deeebug(const char *format, ...)
  *
  */
 void
-ods_log_debug(const char *format, ...)
+(ods_log_debug)(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    if (log_level >= LOG_DEBUG) {
+    if (ods_log_level >= LOG_DEBUG) {
         ods_log_vmsg(LOG_DEBUG, "debug  ", format, args);
     }
     va_end(args);
@@ -308,11 +678,11 @@ ods_log_debug(const char *format, ...)
  *
  */
 void
-ods_log_verbose(const char *format, ...)
+(ods_log_verbose)(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    if (log_level >= LOG_INFO) {
+    if (ods_log_level >= LOG_INFO) {
         ods_log_vmsg(LOG_INFO, "verbose", format, args);
     }
     va_end(args);
@@ -324,11 +694,11 @@ ods_log_verbose(const char *format, ...)
  *
  */
 void
-ods_log_info(const char *format, ...)
+(ods_log_info)(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    if (log_level >= LOG_NOTICE) {
+    if (ods_log_level >= LOG_NOTICE) {
         ods_log_vmsg(LOG_NOTICE, "msg    ", format, args);
     }
     va_end(args);
@@ -344,7 +714,7 @@ ods_log_warning(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    if (log_level >= LOG_WARNING) {
+    if (ods_log_level >= LOG_WARNING) {
         ods_log_vmsg(LOG_WARNING, "warning", format, args);
     }
     va_end(args);
@@ -360,7 +730,7 @@ ods_log_error(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    if (log_level >= LOG_ERR) {
+    if (ods_log_level >= LOG_ERR) {
         ods_log_vmsg(LOG_ERR, "error  ", format, args);
     }
     va_end(args);
@@ -373,7 +743,7 @@ ods_log_error(const char *format, ...)
 void
 ods_log_verror(const char *format, va_list args)
 {
-    if (log_level >= LOG_ERR) {
+    if (ods_log_level >= LOG_ERR) {
         ods_log_vmsg(LOG_ERR, "error  ", format, args);
     }
 }
@@ -387,7 +757,7 @@ ods_log_crit(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    if (log_level >= LOG_CRIT) {
+    if (ods_log_level >= LOG_CRIT) {
         ods_log_vmsg(LOG_CRIT, "crit   ", format, args);
     }
     va_end(args);
@@ -403,7 +773,7 @@ ods_log_alert(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    if (log_level >= LOG_ALERT) {
+    if (ods_log_level >= LOG_ALERT) {
         ods_log_vmsg(LOG_ALERT, "alert  ", format, args);
     }
     va_end(args);
@@ -419,9 +789,10 @@ ods_fatal_exit(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    if (log_level >= LOG_CRIT) {
+    if (ods_log_level >= LOG_CRIT) {
         ods_log_vmsg(LOG_CRIT, "fatal  ", format, args);
     }
     va_end(args);
+    ods_log_flush();
     abort();
 }
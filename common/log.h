@@ -75,6 +75,24 @@ void ods_log_setverbosity(int verbosity);
  */
 void ods_log_close(void);
 
+/**
+ * Start or stop asynchronous logging. While started, messages are
+ * formatted by the caller and written out by a separate thread. Stopping
+ * writes out whatever is still queued. Call from the main thread, after
+ * any fork().
+ * \param[in] enable nonzero to start, zero to stop
+ *
+ */
+void ods_log_async(int enable);
+
+/**
+ * Get the asynchronous logging counters.
+ * \param[out] dropped messages dropped because the queue was full
+ * \param[out] blocked callers that had to wait for the queue
+ *
+ */
+void ods_log_async_counters(unsigned long* dropped, unsigned long* blocked);
+
 /**
  * Get the facility by string.
  * \param[in] facility string based facility
@@ -197,6 +215,29 @@ void ods_fatal_exit(const char *format, ...)
 #endif
      ;
 
+/**
+ * Current log level, for ods_log_enabled().
+ *
+ */
+extern int ods_log_level;
+
+/**
+ * Check if messages of the given level are logged. The wrappers below use
+ * it so that disabled levels do not evaluate their arguments or make a
+ * call. Use it to guard building costly log output as well.
+ *
+ */
+#define ods_log_enabled(level) (ods_log_level >= (level))
+
+#define ods_log_deeebug(...) (ods_log_enabled(LOG_DEEEBUG) ? \
+    (ods_log_deeebug)(__VA_ARGS__) : (void)0)
+#define ods_log_debug(...) (ods_log_enabled(LOG_DEBUG) ? \
+    (ods_log_debug)(__VA_ARGS__) : (void)0)
+#define ods_log_verbose(...) (ods_log_enabled(LOG_INFO) ? \
+    (ods_log_verbose)(__VA_ARGS__) : (void)0)
+#define ods_log_info(...) (ods_log_enabled(LOG_NOTICE) ? \
+    (ods_log_info)(__VA_ARGS__) : (void)0)
+
 /**
  * Log assertion.
  *
@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Metrics.
+ *
+ * Each metric keeps a set of counters per shard. A thread picks a shard
+ * the first time it counts something and sticks to it, so that threads
+ * do not share cache lines unless there are more of them than shards.
+ * Counting is a relaxed atomic add on the shard. Exporting sums the
+ * shards. Metrics are registered once and live until the process exits.
+ *
+ */
+
+#include "config.h"
+#include "clientpipe.h"
+#include "log.h"
+#include "metrics.h"
+#include "status.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define METRICS_CACHELINE 64
+
+static const char* metrics_str = "metrics";
+
+enum metrics_kind {
+    METRICS_COUNTER = 0,
+    METRICS_HISTOGRAM
+};
+
+struct metrics_shard {
+    unsigned long count; /* counters only, histograms sum the buckets */
+    uint64_t sum;
+    unsigned long buckets[METRICS_BUCKETS];
+    char pad[METRICS_CACHELINE];
+};
+
+struct metrics_struct {
+    metrics_type* next;
+    enum metrics_kind kind;
+    char* name;
+    char* help;
+    char* label;
+    char* value;
+    struct metrics_shard shards[METRICS_SHARDS];
+};
+
+static const uint64_t metrics_bounds[METRICS_BUCKETS-1] = METRICS_BOUNDS;
+static metrics_type* metrics_list = NULL;
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+static pthread_key_t metrics_key;
+static unsigned int metrics_threads = 0;
+
+
+/**
+ * Create the key that holds the shard of a thread.
+ *
+ */
+static void
+metrics_key_create(void)
+{
+    (void) pthread_key_create(&metrics_key, NULL);
+}
+
+
+/**
+ * Get the shard of the calling thread.
+ *
+ */
+static unsigned int
+metrics_shard(void)
+{
+    uintptr_t shard;
+    (void) pthread_once(&metrics_once, metrics_key_create);
+    shard = (uintptr_t) pthread_getspecific(metrics_key);
+    if (!shard) {
+        /* stored plus one, NULL means none picked yet */
+        shard = __atomic_fetch_add(&metrics_threads, 1, __ATOMIC_RELAXED)
+            % METRICS_SHARDS + 1;
+        (void) pthread_setspecific(metrics_key, (void*) shard);
+    }
+    return (unsigned int) shard - 1;
+}
+
+
+/**
+ * Look up or register a metric.
+ *
+ */
+static metrics_type*
+metrics_register(enum metrics_kind kind, const char* name, const char* help,
+    const char* label, const char* value)
+{
+    metrics_type* metric;
+    metrics_type* last = NULL;
+    metrics_type** link;
+
+    if (!name) {
+        return NULL;
+    }
+    pthread_mutex_lock(&metrics_lock);
+    for (link = &metrics_list; *link; link = &(*link)->next) {
+        metric = *link;
+        if (strcmp(metric->name, name)) {
+            continue;
+        }
+        if ((!label && !metric->label) || (label && metric->label &&
+            !strcmp(metric->label, label) &&
+            !strcmp(metric->value, value ? value : ""))) {
+            pthread_mutex_unlock(&metrics_lock);
+            if (metric->kind != kind) {
+                ods_log_error("[%s] %s registered as another type",
+                    metrics_str, name);
+                return NULL;
+            }
+            return metric;
+        }
+        last = metric;
+    }
+    CHECKALLOC(metric = (metrics_type*) calloc(1, sizeof(metrics_type)));
+    metric->kind = kind;
+    CHECKALLOC(metric->name = strdup(name));
+    CHECKALLOC(metric->help = strdup(help ? help : name));
+    if (label) {
+        CHECKALLOC(metric->label = strdup(label));
+        CHECKALLOC(metric->value = strdup(value ? value : ""));
+    }
+    /* series of one metric have to be listed together */
+    if (last) {
+        metric->next = last->next;
+        last->next = metric;
+    } else {
+        *link = metric;
+    }
+    pthread_mutex_unlock(&metrics_lock);
+    return metric;
+}
+
+
+/**
+ * Get a counter.
+ *
+ */
+metrics_type*
+metrics_counter(const char* name, const char* help, const char* label,
+    const char* value)
+{
+    return metrics_register(METRICS_COUNTER, name, help, label, value);
+}
+
+
+/**
+ * Get a latency histogram.
+ *
+ */
+metrics_type*
+metrics_histogram(const char* name, const char* help, const char* label,
+    const char* value)
+{
+    return metrics_register(METRICS_HISTOGRAM, name, help, label, value);
+}
+
+
+/**
+ * Add to a counter.
+ *
+ */
+void
+metrics_count(metrics_type* metric, unsigned long n)
+{
+    if (!metric) {
+        return;
+    }
+    __atomic_add_fetch(&metric->shards[metrics_shard()].count, n,
+        __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Add a latency to a histogram.
+ *
+ */
+void
+metrics_observe(metrics_type* metric, uint64_t usec)
+{
+    struct metrics_shard* shard;
+    size_t i;
+
+    if (!metric) {
+        return;
+    }
+    for (i = 0; i < METRICS_BUCKETS-1; i++) {
+        if (usec <= metrics_bounds[i]) {
+            break;
+        }
+    }
+    shard = &metric->shards[metrics_shard()];
+    __atomic_add_fetch(&shard->buckets[i], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shard->sum, usec, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Add the time passed since start to a histogram.
+ *
+ */
+void
+metrics_since(metrics_type* metric, uint64_t start)
+{
+    uint64_t now;
+    if (!metric) {
+        return;
+    }
+    now = metrics_clock();
+    metrics_observe(metric, now > start ? now - start : 0);
+}
+
+
+/**
+ * Monotonic clock for latencies.
+ *
+ */
+uint64_t
+metrics_clock(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+        return 0;
+    }
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/**
+ * Write the label of a series, escaped as the format requires.
+ *
+ */
+static void
+metrics_labels(char* buf, size_t size, metrics_type* metric, const char* le)
+{
+    size_t n = 0;
+    const char* s;
+
+    buf[0] = '\0';
+    if (!metric->label && !le) {
+        return;
+    }
+    buf[n++] = '{';
+    if (metric->label) {
+        n += snprintf(buf + n, size - n, "%s=\"", metric->label);
+        if (n >= size) {
+            n = size - 1;
+        }
+        for (s = metric->value; *s && n + 4 < size; s++) {
+            if (*s == '\\' || *s == '"') {
+                buf[n++] = '\\';
+                buf[n++] = *s;
+            } else if (*s == '\n') {
+                buf[n++] = '\\';
+                buf[n++] = 'n';
+            } else {
+                buf[n++] = *s;
+            }
+        }
+        buf[n] = '\0';
+        n += snprintf(buf + n, size - n, "\"%s", le ? "," : "");
+    }
+    if (le && n < size) {
+        n += snprintf(buf + n, size - n, "le=\"%s\"", le);
+    }
+    if (n < size) {
+        snprintf(buf + n, size - n, "}");
+    }
+}
+
+
+/**
+ * Values of one metric, summed over the shards.
+ *
+ */
+struct metrics_snapshot {
+    metrics_type* metric;
+    unsigned long count;
+    uint64_t sum;
+    unsigned long buckets[METRICS_BUCKETS];
+};
+
+
+/**
+ * Write all registered metrics.
+ *
+ * The values are copied while holding the lock, so registering is not
+ * held up by a slow client. Names and labels do not change once
+ * registered and metrics are never freed, they can be read after.
+ *
+ */
+void
+metrics_export(int sockfd)
+{
+    metrics_type* metric;
+    struct metrics_snapshot* snapshot;
+    struct metrics_snapshot* snap;
+    const char* family = NULL;
+    char labels[ODS_SE_MAXLINE];
+    char le[32];
+    unsigned long cumulative;
+    unsigned long dropped = 0, blocked = 0;
+    size_t i, j, n = 0, nmetrics = 0;
+
+    pthread_mutex_lock(&metrics_lock);
+    for (metric = metrics_list; metric; metric = metric->next) {
+        nmetrics++;
+    }
+    snapshot = (struct metrics_snapshot*) calloc(nmetrics ? nmetrics : 1,
+        sizeof(struct metrics_snapshot));
+    if (!snapshot) {
+        pthread_mutex_unlock(&metrics_lock);
+        ods_log_error("[%s] unable to export metrics: calloc() failed",
+            metrics_str);
+        return;
+    }
+    for (metric = metrics_list; metric; metric = metric->next) {
+        snap = &snapshot[n++];
+        snap->metric = metric;
+        for (i = 0; i < METRICS_SHARDS; i++) {
+            snap->count += __atomic_load_n(&metric->shards[i].count,
+                __ATOMIC_RELAXED);
+            snap->sum += __atomic_load_n(&metric->shards[i].sum,
+                __ATOMIC_RELAXED);
+            for (j = 0; j < METRICS_BUCKETS; j++) {
+                snap->buckets[j] += __atomic_load_n(
+                    &metric->shards[i].buckets[j], __ATOMIC_RELAXED);
+            }
+        }
+    }
+    pthread_mutex_unlock(&metrics_lock);
+
+    for (snap = snapshot; snap < snapshot + n; snap++) {
+        metric = snap->metric;
+        if (!family || strcmp(family, metric->name)) {
+            client_printf(sockfd, "# HELP %s %s\n", metric->name,
+                metric->help);
+            client_printf(sockfd, "# TYPE %s %s\n", metric->name,
+                metric->kind == METRICS_HISTOGRAM ? "histogram" : "counter");
+            family = metric->name;
+        }
+        if (metric->kind == METRICS_COUNTER) {
+            metrics_labels(labels, sizeof(labels), metric, NULL);
+            client_printf(sockfd, "%s%s %lu\n", metric->name, labels,
+                snap->count);
+            continue;
+        }
+        /* buckets are cumulative, the count is that of the last */
+        cumulative = 0;
+        for (j = 0; j < METRICS_BUCKETS; j++) {
+            cumulative += snap->buckets[j];
+            if (j < METRICS_BUCKETS-1) {
+                snprintf(le, sizeof(le), "%g",
+                    (double) metrics_bounds[j] / 1000000.0);
+            } else {
+                snprintf(le, sizeof(le), "+Inf");
+            }
+            metrics_labels(labels, sizeof(labels), metric, le);
+            client_printf(sockfd, "%s_bucket%s %lu\n", metric->name, labels,
+                cumulative);
+        }
+        metrics_labels(labels, sizeof(labels), metric, NULL);
+        client_printf(sockfd, "%s_sum%s %.6f\n", metric->name, labels,
+            (double) snap->sum / 1000000.0);
+        client_printf(sockfd, "%s_count%s %lu\n", metric->name, labels,
+            cumulative);
+    }
+    free(snapshot);
+    ods_log_async_counters(&dropped, &blocked);
+    metrics_export_value(sockfd, "ods_log_dropped_total",
+        "Log messages dropped because the log queue was full.", "counter",
+        (double) dropped);
+    metrics_export_value(sockfd, "ods_log_blocked_total",
+        "Log calls that waited for room in the log queue.", "counter",
+        (double) blocked);
+}
+
+
+/**
+ * Write a single value.
+ *
+ */
+void
+metrics_export_value(int sockfd, const char* name, const char* help,
+    const char* type, double value)
+{
+    client_printf(sockfd, "# HELP %s %s\n", name, help);
+    client_printf(sockfd, "# TYPE %s %s\n", name, type);
+    client_printf(sockfd, "%s %.17g\n", name, value);
+}
+
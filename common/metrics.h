@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Metrics.
+ *
+ */
+
+#ifndef SHARED_METRICS_H
+#define SHARED_METRICS_H
+
+#include "config.h"
+#include <stdint.h>
+
+/**
+ * Upper bounds of the latency histogram buckets, in microseconds. The
+ * last bucket takes everything above.
+ *
+ */
+#define METRICS_BOUNDS { 50, 100, 250, 500, 1000, 2500, 5000, 10000, \
+    25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, \
+    10000000 }
+#define METRICS_BUCKETS 18
+
+/* Threads are spread over this many sets of counters. */
+#define METRICS_SHARDS 16
+
+typedef struct metrics_struct metrics_type;
+
+/**
+ * Get a counter, registering it on first use. The same name, label and
+ * label value give the same counter. Registering takes a lock, so look a
+ * counter up once and keep it.
+ * \param[in] name metric name, Prometheus style
+ * \param[in] help one line description
+ * \param[in] label label name, or NULL
+ * \param[in] value label value, if label is set
+ * \return metrics_type* counter
+ *
+ */
+metrics_type* metrics_counter(const char* name, const char* help,
+    const char* label, const char* value);
+
+/**
+ * Get a latency histogram, registering it on first use.
+ * \param[in] name metric name, Prometheus style
+ * \param[in] help one line description
+ * \param[in] label label name, or NULL
+ * \param[in] value label value, if label is set
+ * \return metrics_type* histogram
+ *
+ */
+metrics_type* metrics_histogram(const char* name, const char* help,
+    const char* label, const char* value);
+
+/**
+ * Add to a counter. Takes no lock.
+ * \param[in] metric counter, may be NULL
+ * \param[in] n amount to add
+ *
+ */
+void metrics_count(metrics_type* metric, unsigned long n);
+
+/**
+ * Add a latency to a histogram. Takes no lock.
+ * \param[in] metric histogram, may be NULL
+ * \param[in] usec latency in microseconds
+ *
+ */
+void metrics_observe(metrics_type* metric, uint64_t usec);
+
+/**
+ * Add the time passed since start to a histogram.
+ * \param[in] metric histogram, may be NULL
+ * \param[in] start earlier result of metrics_clock()
+ *
+ */
+void metrics_since(metrics_type* metric, uint64_t start);
+
+/**
+ * Monotonic clock for latencies.
+ * \return uint64_t microseconds
+ *
+ */
+uint64_t metrics_clock(void);
+
+/**
+ * Write all registered metrics in the Prometheus text format.
+ * \param[in] sockfd client socket
+ *
+ */
+void metrics_export(int sockfd);
+
+/**
+ * Write a single value in the Prometheus text format, for values that
+ * are read when exporting rather than counted.
+ * \param[in] sockfd client socket
+ * \param[in] name metric name
+ * \param[in] help one line description
+ * \param[in] type "gauge" or "counter"
+ * \param[in] value current value
+ *
+ */
+void metrics_export_value(int sockfd, const char* name, const char* help,
+    const char* type, double value);
+
+#endif /* SHARED_METRICS_H */
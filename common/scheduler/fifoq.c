@@ -33,11 +33,29 @@
 #include "scheduler/fifoq.h"
 #include "log.h"
 
+#include <sched.h>
 #include <ldns/ldns.h>
 
 static const char* fifoq_str = "fifo";
 
 
+/**
+ * Let another thread finish its claim on a slot.
+ *
+ */
+static void
+fifoq_await(size_t* seq, size_t value)
+{
+    int spins = 0;
+    while (__atomic_load_n(seq, __ATOMIC_ACQUIRE) != value) {
+        if (++spins > 64) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+}
+
+
 /**
  * Create new FIFO queue.
  *
@@ -48,6 +66,8 @@ fifoq_create()
     fifoq_type* fifoq;
     CHECKALLOC(fifoq = (fifoq_type*) malloc(sizeof(fifoq_type)));
     fifoq_wipe(fifoq);
+    fifoq->nconsumers = 0;
+    fifoq->nproducers = 0;
     pthread_mutex_init(&fifoq->q_lock, NULL);
     pthread_cond_init(&fifoq->q_threshold, NULL);
     pthread_cond_init(&fifoq->q_nonfull, NULL);
@@ -64,10 +84,139 @@ fifoq_wipe(fifoq_type* q)
 {
     size_t i = 0;
     for (i=0; i < FIFOQ_MAX_COUNT; i++) {
-        q->blob[i] = NULL;
-        q->owner[i] = NULL;
+        q->cell[i].seq = i;
+        q->cell[i].blob = NULL;
+        q->cell[i].owner = NULL;
+    }
+    q->head = 0;
+    q->tail = 0;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+
+/**
+ * Number of items in queue.
+ *
+ */
+size_t
+fifoq_count(fifoq_type* q)
+{
+    size_t head, tail;
+    if (!q) {
+        return 0;
+    }
+    head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    return tail > head ? tail - head : 0;
+}
+
+
+/**
+ * Pop items from queue.
+ *
+ */
+size_t
+fifoq_pop_batch(fifoq_type* q, void** items, void** owners, size_t max)
+{
+    size_t pos, tail, avail, n, i;
+    struct fifoq_cell_struct* cell;
+    if (!q || !max) {
+        return 0;
+    }
+    pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    do {
+        tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        if (tail <= pos) {
+            return 0;
+        }
+        avail = tail - pos;
+        n = avail / FIFOQ_BATCH_SHARE;
+        if (n < 1) n = 1;
+        if (n > max) n = max;
+    } while (!__atomic_compare_exchange_n(&q->head, &pos, pos + n, 1,
+        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    /**
+     * Positions pos up to pos+n are ours. A producer may still be
+     * filling one of them, wait for it to publish the item.
+     */
+    for (i = 0; i < n; i++) {
+        cell = &q->cell[(pos + i) & FIFOQ_MASK];
+        fifoq_await(&cell->seq, pos + i + 1);
+        items[i] = cell->blob;
+        owners[i] = cell->owner;
+        __atomic_store_n(&cell->seq, pos + i + FIFOQ_MAX_COUNT,
+            __ATOMIC_RELEASE);
     }
-    q->count = 0;
+    /**
+     * Notify waiting producers that they can start queuing again
+     * once the queue drained to 10%.
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->nproducers, __ATOMIC_RELAXED) > 0 &&
+        fifoq_count(q) <= FIFOQ_NONFULL_COUNT) {
+        pthread_mutex_lock(&q->q_lock);
+        pthread_cond_broadcast(&q->q_nonfull);
+        pthread_mutex_unlock(&q->q_lock);
+    }
+    return n;
+}
+
+
+/**
+ * Push items to queue.
+ *
+ */
+size_t
+fifoq_push_batch(fifoq_type* q, void** items, size_t count, void* owner)
+{
+    size_t pos, head, room, n, i;
+    struct fifoq_cell_struct* cell;
+    if (!q || !items || !count) {
+        return 0;
+    }
+    pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    while (1) {
+        head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        if (head > pos) {
+            /* consumers went past our stale view of tail */
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (pos - head >= FIFOQ_MAX_COUNT) {
+            return 0;
+        }
+        room = FIFOQ_MAX_COUNT - (pos - head);
+        n = (count < room ? count : room);
+        if (__atomic_compare_exchange_n(&q->tail, &pos, pos + n, 1,
+            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    /**
+     * Positions pos up to pos+n are ours. A consumer may still be
+     * reading the previous item of a slot, wait for it to let go.
+     */
+    for (i = 0; i < n; i++) {
+        cell = &q->cell[(pos + i) & FIFOQ_MASK];
+        fifoq_await(&cell->seq, pos + i);
+        cell->blob = items[i];
+        cell->owner = owner;
+        __atomic_store_n(&cell->seq, pos + i + 1, __ATOMIC_RELEASE);
+    }
+    /* If no drudgers are waiting, there is no need to notify them. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->nconsumers, __ATOMIC_RELAXED) > 0) {
+        ods_log_deeebug("[%s] %lu items queued, notify drudgers",
+            fifoq_str, (unsigned long) n);
+        pthread_mutex_lock(&q->q_lock);
+        if (n > 1) {
+            pthread_cond_broadcast(&q->q_threshold);
+        } else {
+            pthread_cond_signal(&q->q_threshold);
+        }
+        pthread_mutex_unlock(&q->q_lock);
+    }
+    return n;
 }
 
 
@@ -79,24 +228,9 @@ void*
 fifoq_pop(fifoq_type* q, void** context)
 {
     void* pop = NULL;
-    size_t i = 0;
-    if (!q || q->count <= 0) {
+    if (fifoq_pop_batch(q, &pop, context, 1) == 0) {
         return NULL;
     }
-    pop = q->blob[0];
-    *context = q->owner[0];
-    for (i = 0; i < q->count-1; i++) {
-        q->blob[i] = q->blob[i+1];
-        q->owner[i] = q->owner[i+1];
-    }
-    q->count -= 1;
-    if (q->count <= (size_t) FIFOQ_MAX_COUNT * 0.1) {
-        /**
-         * Notify waiting workers that they can start queuing again
-         * If no workers are waiting, this call has no effect.
-         */
-        pthread_cond_broadcast(&q->q_nonfull);
-    }
     return pop;
 }
 
@@ -106,62 +240,135 @@ fifoq_pop(fifoq_type* q, void** context)
  *
  */
 ods_status
-fifoq_push(fifoq_type* q, void* item, void* context, int* tries)
+fifoq_push(fifoq_type* q, void* item, void* context)
 {
     if (!q || !item) {
         return ODS_STATUS_ASSERT_ERR;
     }
-    if (q->count >= FIFOQ_MAX_COUNT) {
-        /**
-         * #262:
-         * If drudgers remain on hold, do additional broadcast.
-         * If no drudgers are waiting, this call has no effect.
-         */
-        if (*tries > FIFOQ_TRIES_COUNT) {
-            pthread_cond_broadcast(&q->q_threshold);
-            ods_log_debug("[%s] queue full, notify drudgers again", fifoq_str);
-            /* reset tries */
-            *tries = 0;
-        }
+    if (fifoq_push_batch(q, &item, 1, context) == 0) {
         return ODS_STATUS_UNCHANGED;
     }
-    q->blob[q->count] = item;
-    q->owner[q->count] = context;
-    q->count += 1;
-    if (q->count == 1) {
-        ods_log_deeebug("[%s] threshold %lu reached, notify drudgers",
-            fifoq_str, (unsigned long) q->count);
-        /* If no drudgers are waiting, this call has no effect. */
-        pthread_cond_broadcast(&q->q_threshold);
-    }
     return ODS_STATUS_OK;
 }
 
+
+/**
+ * Wait until the queue has items.
+ *
+ */
 void
-fifoq_report(fifoq_type* q, worker_type* superior, ods_status subtaskstatus)
+fifoq_wait_nonempty(fifoq_type* q, worker_type* worker)
 {
     pthread_mutex_lock(&q->q_lock);
+    __atomic_add_fetch(&q->nconsumers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    /**
+     * Producers check nconsumers after publishing, and take the lock
+     * to notify. Checking for items after registering and while
+     * holding the lock means no wakeup is lost.
+     */
+    if (fifoq_count(q) == 0 && !worker->need_to_exit) {
+        pthread_cond_wait(&q->q_threshold, &q->q_lock);
+    }
+    __atomic_sub_fetch(&q->nconsumers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&q->q_lock);
+}
+
+
+/**
+ * Wait until the queue has drained.
+ *
+ */
+void
+fifoq_wait_nonfull(fifoq_type* q, worker_type* worker)
+{
+    pthread_mutex_lock(&q->q_lock);
+    __atomic_add_fetch(&q->nproducers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (fifoq_count(q) > FIFOQ_NONFULL_COUNT && !worker->need_to_exit) {
+        ods_thread_wait(&q->q_nonfull, &q->q_lock, 5);
+    }
+    __atomic_sub_fetch(&q->nproducers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&q->q_lock);
+}
+
+
+/**
+ * Report that a subtask has finished.
+ *
+ * The counters live in the superior and are updated atomically. Only
+ * the report of the last outstanding subtask, or the one a throttled
+ * superior waits for, takes the lock of the superior to wake it up.
+ *
+ */
+void
+fifoq_report(fifoq_type* q, worker_type* superior, ods_status subtaskstatus)
+{
+    int outstanding;
+    (void) q;
     if (subtaskstatus != ODS_STATUS_OK) {
-        superior->tasksFailed += 1;
+        __atomic_add_fetch(&superior->tasksFailed, 1, __ATOMIC_RELAXED);
     }
-    superior->tasksOutstanding -= 1;
-    if (superior->tasksOutstanding == 0) {
+    outstanding = __atomic_sub_fetch(&superior->tasksOutstanding, 1,
+        __ATOMIC_SEQ_CST);
+    if (outstanding == 0 || outstanding ==
+        __atomic_load_n(&superior->tasksWakeup, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&superior->tasksLock);
         pthread_cond_signal(&superior->tasksBlocker);
+        pthread_mutex_unlock(&superior->tasksLock);
     }
-    pthread_mutex_unlock(&q->q_lock);
 }
 
+
+/**
+ * Wait until all subtasks have been reported.
+ *
+ * Subtasks may already have been reported before the worker adds
+ * nsubtasks, so the counter can be negative meanwhile.
+ *
+ */
 void
 fifoq_waitfor(fifoq_type* q, worker_type* worker, long nsubtasks, long* nsubtasksfailed)
 {
-    pthread_mutex_lock(&q->q_lock);
-    worker->tasksOutstanding += nsubtasks;
-    while (worker->tasksOutstanding > 0 && !worker->need_to_exit) {
-        pthread_cond_wait(&worker->tasksBlocker, &q->q_lock);
+    (void) q;
+    pthread_mutex_lock(&worker->tasksLock);
+    __atomic_add_fetch(&worker->tasksOutstanding, (int) nsubtasks,
+        __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&worker->tasksOutstanding, __ATOMIC_ACQUIRE) > 0
+        && !worker->need_to_exit) {
+        pthread_cond_wait(&worker->tasksBlocker, &worker->tasksLock);
     }
-    *nsubtasksfailed = worker->tasksFailed;
-    worker->tasksFailed = 0;
-    pthread_mutex_unlock(&q->q_lock);
+    *nsubtasksfailed = __atomic_exchange_n(&worker->tasksFailed, 0,
+        __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&worker->tasksLock);
+}
+
+
+/**
+ * Throttle a worker that is still queuing subtasks.
+ *
+ * Until fifoq_waitfor() adds nsubtasks, the counter of the worker is
+ * minus the number of subtasks reported. The report that brings it down
+ * to the wakeup level signals the worker.
+ *
+ */
+void
+fifoq_waitfor_share(fifoq_type* q, worker_type* worker, long nsubtasks, long max)
+{
+    int wakeup = (int) (max / 2 - nsubtasks);
+    (void) q;
+    if (__atomic_load_n(&worker->tasksOutstanding, __ATOMIC_ACQUIRE) <=
+        (int) (max - nsubtasks)) {
+        return;
+    }
+    pthread_mutex_lock(&worker->tasksLock);
+    __atomic_store_n(&worker->tasksWakeup, wakeup, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&worker->tasksOutstanding, __ATOMIC_SEQ_CST) >
+        wakeup && !worker->need_to_exit) {
+        pthread_cond_wait(&worker->tasksBlocker, &worker->tasksLock);
+    }
+    __atomic_store_n(&worker->tasksWakeup, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&worker->tasksLock);
 }
 
 
@@ -50,16 +50,49 @@ typedef struct fifoq_struct fifoq_type;
 #include "locks.h"
 #include "status.h"
 
-#define FIFOQ_MAX_COUNT 1000
-#define FIFOQ_TRIES_COUNT 10
+/* Number of slots in the ring, must be a power of two. */
+#define FIFOQ_MAX_COUNT 1024
+#define FIFOQ_MASK (FIFOQ_MAX_COUNT - 1)
+/* Producers blocked on a full queue resume once it is at this level. */
+#define FIFOQ_NONFULL_COUNT (FIFOQ_MAX_COUNT / 10)
+/* Largest number of items moved by a single batch push or pop. */
+#define FIFOQ_BATCH_COUNT 16
+/* A batch pop takes no more than this share of the queued items. */
+#define FIFOQ_BATCH_SHARE 8
+#define FIFOQ_CACHELINE 64
+
+/**
+ * FIFO Queue slot.
+ *
+ * The sequence number tells whose turn it is: a slot at position pos
+ * is free for the producer of pos when seq equals pos, and holds an
+ * item for the consumer of pos when seq equals pos + 1.
+ *
+ */
+struct fifoq_cell_struct {
+    size_t seq;
+    void* blob;
+    void* owner;
+};
 
 /**
  * FIFO Queue.
+ *
+ * A bounded multi-producer multi-consumer ring. Producers and consumers
+ * claim positions with a compare-and-swap on tail and head, so pushing
+ * and popping never take a lock. The lock and condition variables are
+ * only used to put threads to sleep on an empty or full queue.
+ *
  */
 struct fifoq_struct {
-    void* blob[FIFOQ_MAX_COUNT];
-    void* owner[FIFOQ_MAX_COUNT];
-    size_t count;
+    struct fifoq_cell_struct cell[FIFOQ_MAX_COUNT];
+    char pad0[FIFOQ_CACHELINE];
+    size_t head;
+    char pad1[FIFOQ_CACHELINE - sizeof(size_t)];
+    size_t tail;
+    char pad2[FIFOQ_CACHELINE - sizeof(size_t)];
+    int nconsumers;
+    int nproducers;
     pthread_mutex_t q_lock;
     pthread_cond_t q_threshold;
     pthread_cond_t q_nonfull;
@@ -67,24 +100,55 @@ struct fifoq_struct {
 
 /**
  * Create new FIFO queue.
- * \param[in] allocator memory allocator
  * \return fifoq_type* created queue
  *
  */
 fifoq_type* fifoq_create(void);
 
 /**
- * Wipe queue.
+ * Wipe queue. No other thread may use the queue meanwhile.
  * \param[in] q queue to be wiped
  *
  */
 void fifoq_wipe(fifoq_type* q);
 
+/**
+ * Number of items in queue. Only a snapshot when other threads are
+ * pushing or popping.
+ * \param[in] q queue
+ * \return size_t number of items
+ *
+ */
+size_t fifoq_count(fifoq_type* q);
+
+/**
+ * Pop items from queue, without blocking.
+ * \param[in] q queue
+ * \param[out] items popped items
+ * \param[out] owners workers that own the popped items
+ * \param[in] max maximum number of items to pop
+ * \return size_t number of popped items, 0 if the queue is empty
+ *
+ */
+size_t fifoq_pop_batch(fifoq_type* q, void** items, void** owners, size_t max);
+
+/**
+ * Push items to queue, without blocking.
+ * \param[in] q queue
+ * \param[in] items items
+ * \param[in] count number of items
+ * \param[in] owner owner of the items
+ * \return size_t number of pushed items, less than count if the queue
+ *         is full
+ *
+ */
+size_t fifoq_push_batch(fifoq_type* q, void** items, size_t count, void* owner);
+
 /**
  * Pop item from queue.
  * \param[in] q queue
  * \param[out] worker worker that owns the item
- * \return void* popped item
+ * \return void* popped item, NULL if the queue is empty
  *
  */
 void* fifoq_pop(fifoq_type* q, void** worker);
@@ -94,11 +158,26 @@ void* fifoq_pop(fifoq_type* q, void** worker);
  * \param[in] q queue
  * \param[in] item item
  * \param[in] worker owner of item
- * \param[out] tries number of tries
- * \return ods_status status
+ * \return ods_status ODS_STATUS_UNCHANGED if the queue is full
+ *
+ */
+ods_status fifoq_push(fifoq_type* q, void* item, void* worker);
+
+/**
+ * Wait until the queue has items, or until fifoq_notifyall().
+ * \param[in] q queue
+ * \param[in] worker consumer waiting
+ *
+ */
+void fifoq_wait_nonempty(fifoq_type* q, worker_type* worker);
+
+/**
+ * Wait until the queue has drained, or at most a few seconds.
+ * \param[in] q queue
+ * \param[in] worker producer waiting
  *
  */
-ods_status fifoq_push(fifoq_type* q, void* item, void* worker, int* tries);
+void fifoq_wait_nonfull(fifoq_type* q, worker_type* worker);
 
 /**
  * Clean up queue.
@@ -107,8 +186,41 @@ ods_status fifoq_push(fifoq_type* q, void* item, void* worker, int* tries);
  */
 void fifoq_cleanup(fifoq_type* q);
 
+/**
+ * Report that a subtask of the superior has finished.
+ * \param[in] q queue
+ * \param[in] superior worker that queued the subtask
+ * \param[in] subtaskstatus status of the subtask
+ *
+ */
 void fifoq_report(fifoq_type* q, worker_type* superior, ods_status subtaskstatus);
+
+/**
+ * Wait until all subtasks queued by the worker have been reported.
+ * \param[in] q queue
+ * \param[in] worker worker that queued the subtasks
+ * \param[in] nsubtasks number of subtasks queued
+ * \param[out] nsubtasksfailed number of subtasks that failed
+ *
+ */
 void fifoq_waitfor(fifoq_type* q, worker_type* worker, long nsubtasks, long* nsubtasksfailed);
+
+/**
+ * Throttle a worker that is still queuing subtasks. If more than max of
+ * them are outstanding, wait until no more than half of max are.
+ * \param[in] q queue
+ * \param[in] worker worker that queued the subtasks
+ * \param[in] nsubtasks number of subtasks queued so far
+ * \param[in] max number of subtasks that may be outstanding
+ *
+ */
+void fifoq_waitfor_share(fifoq_type* q, worker_type* worker, long nsubtasks, long max);
+
+/**
+ * Wake up all threads waiting on the queue.
+ * \param[in] q queue
+ *
+ */
 void fifoq_notifyall(fifoq_type* q);
 
 #endif /* SCHEDULER_FIFOQ_H */
@@ -33,13 +33,22 @@
  *
  * In principle the calling function should never need to lock the
  * scheduler.
+ *
+ * Tasks that are not due yet are kept in a hierarchical timer wheel,
+ * tasks the wheel has passed in a heap ordered by due date. Tasks that
+ * are due move on to a heap ordered by deadline, so that of the due
+ * tasks the one with the earliest deadline runs first. Finding a task by
+ * its ttuple goes through a hash table on owner and class, split in
+ * shards that are locked on their own. Idle workers wait on their own
+ * condition, so that a new task wakes only one of them.
  */
 
 #include "config.h"
 
-#include <ldns/ldns.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "scheduler/schedule.h"
 #include "scheduler/task.h"
@@ -47,139 +56,642 @@
 #include "duration.h"
 #include "log.h"
 #include "locks.h"
+#include "metrics.h"
 #include "util.h"
 
 static const char* schedule_str = "scheduler";
 
+#define SCHEDULE_WHEEL_MASK (SCHEDULE_WHEEL_SLOTS - 1)
+/* When the wheel lags behind more than this many seconds, it is rebuilt
+ * instead of being run second by second. */
+#define SCHEDULE_WHEEL_MAXSTEP 4096
+#define SCHEDULE_SHARD_BUCKETS 16
+#define SCHEDULE_BUCKET(hash, n) (((hash) / SCHEDULE_SHARDS) % (n))
+
+/**
+ * Lock shared by all tasks with the same owner and class.
+ *
+ */
+struct schedule_lock_struct {
+    struct schedule_lock_struct* next;
+    unsigned int hash;
+    char* owner;
+    task_id class;
+    pthread_mutex_t lock;
+};
+
 /**
- * Convert task to a tree node.
- * NULL on malloc failure
+ * Idle worker.
+ *
+ */
+struct schedule_waiter_struct {
+    struct schedule_waiter_struct* next;
+    pthread_cond_t cond;
+    time_t deadline;
+    int woken;
+};
+
+/**
+ * Hash of owner and class, all tasks of an owner and class end up in
+ * the same bucket.
+ *
  */
-static ldns_rbnode_t*
-task2node(task_type* task)
+static unsigned int
+schedule_hash(const char* owner, const char* class)
 {
-    ldns_rbnode_t* node = (ldns_rbnode_t*) malloc(sizeof(ldns_rbnode_t));
-    if (node) {
-        node->key = task;
-        node->data = task;
+    unsigned int hash = 2166136261u;
+    while (*owner) {
+        hash = (hash ^ (unsigned char) *owner++) * 16777619u;
     }
-    return node;
+    hash = (hash ^ 0xffu) * 16777619u;
+    while (*class) {
+        hash = (hash ^ (unsigned char) *class++) * 16777619u;
+    }
+    return hash;
+}
+
+static struct schedule_shard*
+schedule_shard(schedule_type* schedule, unsigned int hash)
+{
+    return &schedule->shards[hash % SCHEDULE_SHARDS];
 }
 
 /**
- * Get the first scheduled task. As long as return value is used
- * caller should hold schedule->schedule_lock.
+ * Double the number of buckets of a shard. Caller holds shard lock.
+ *
+ */
+static void
+shard_grow(struct schedule_shard* shard)
+{
+    size_t nbuckets = shard->nbuckets * 2;
+    size_t i, bucket;
+    task_type** tasks;
+    task_type* task;
+    struct schedule_lock_struct** locks;
+    struct schedule_lock_struct* lock;
+
+    CHECKALLOC(tasks = (task_type**) calloc(nbuckets, sizeof(task_type*)));
+    CHECKALLOC(locks = (struct schedule_lock_struct**) calloc(nbuckets,
+        sizeof(struct schedule_lock_struct*)));
+    for (i = 0; i < shard->nbuckets; i++) {
+        while ((task = shard->tasks[i]) != NULL) {
+            shard->tasks[i] = task->hash_next;
+            bucket = SCHEDULE_BUCKET(task->hash, nbuckets);
+            task->hash_next = tasks[bucket];
+            tasks[bucket] = task;
+        }
+        while ((lock = shard->locks[i]) != NULL) {
+            shard->locks[i] = lock->next;
+            bucket = SCHEDULE_BUCKET(lock->hash, nbuckets);
+            lock->next = locks[bucket];
+            locks[bucket] = lock;
+        }
+    }
+    free(shard->tasks);
+    free(shard->locks);
+    shard->tasks = tasks;
+    shard->locks = locks;
+    shard->nbuckets = nbuckets;
+}
+
+/**
+ * Find scheduled task with the same ttuple. Caller holds shard lock.
  *
- * \param[in] schedule schedule
- * \return task_type* first scheduled task, NULL on no task or error.
  */
 static task_type*
-schedule_get_first_task(schedule_type* schedule)
+shard_find(struct schedule_shard* shard, task_type* match, unsigned int hash)
 {
-    ldns_rbnode_t* first_node = LDNS_RBTREE_NULL;
-    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
-    task_type* pop = NULL;
-    if (!schedule || !schedule->tasks) {
+    task_type* task;
+    task = shard->tasks[SCHEDULE_BUCKET(hash, shard->nbuckets)];
+    for (; task; task = task->hash_next) {
+        if (task->hash == hash && !task_compare_ttuple(task, match)) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static void
+shard_insert(struct schedule_shard* shard, task_type* task)
+{
+    size_t bucket;
+    if (shard->ntasks >= 2 * shard->nbuckets) {
+        shard_grow(shard);
+    }
+    bucket = SCHEDULE_BUCKET(task->hash, shard->nbuckets);
+    task->hash_next = shard->tasks[bucket];
+    shard->tasks[bucket] = task;
+    shard->ntasks++;
+}
+
+static void
+shard_remove(struct schedule_shard* shard, task_type* task)
+{
+    task_type** link;
+    link = &shard->tasks[SCHEDULE_BUCKET(task->hash, shard->nbuckets)];
+    for (; *link; link = &(*link)->hash_next) {
+        if (*link == task) {
+            *link = task->hash_next;
+            task->hash_next = NULL;
+            shard->ntasks--;
+            return;
+        }
+    }
+}
+
+/**
+ * Get the lock for all tasks of owner and class, create it when this is
+ * the first of them. Caller holds shard lock.
+ *
+ */
+static pthread_mutex_t*
+shard_lock(struct schedule_shard* shard, task_type* task)
+{
+    struct schedule_lock_struct* lock;
+    size_t bucket = SCHEDULE_BUCKET(task->hash, shard->nbuckets);
+    for (lock = shard->locks[bucket]; lock; lock = lock->next) {
+        if (lock->hash == task->hash && !strcmp(lock->owner, task->owner)
+            && !strcmp(lock->class, task->class)) {
+            return &lock->lock;
+        }
+    }
+    lock = (struct schedule_lock_struct*) malloc(sizeof(*lock));
+    if (!lock) {
         return NULL;
     }
-    first_node = ldns_rbtree_first(schedule->tasks);
-    if (!first_node) {
+    if (pthread_mutex_init(&lock->lock, NULL)) {
+        free(lock);
         return NULL;
     }
-    /* no more tasks to be flushed, return first task in schedule */
-    pop = (task_type*) first_node->data;
-    return pop;
+    if (shard->nlocks >= 2 * shard->nbuckets) {
+        shard_grow(shard);
+        bucket = SCHEDULE_BUCKET(task->hash, shard->nbuckets);
+    }
+    lock->hash = task->hash;
+    lock->owner = strdup(task->owner);
+    lock->class = task->class;
+    lock->next = shard->locks[bucket];
+    shard->locks[bucket] = lock;
+    shard->nlocks++;
+    return &lock->lock;
+}
+
+static void
+shard_free_locks(struct schedule_shard* shard)
+{
+    struct schedule_lock_struct* lock;
+    size_t i;
+    for (i = 0; i < shard->nbuckets; i++) {
+        while ((lock = shard->locks[i]) != NULL) {
+            shard->locks[i] = lock->next;
+            pthread_mutex_destroy(&lock->lock);
+            free(lock->owner);
+            free(lock);
+        }
+    }
+    shard->nlocks = 0;
 }
 
 /**
- * pop the first scheduled task. Caller must hold
- * schedule->schedule_lock. Result is safe to use outside lock.
- * 
- * \param[in] schedule schedule
- * \return task_type* first scheduled task, NULL on no task or error.
+ * Task a is due before task b.
+ *
  */
-static task_type*
-pop_first_task(schedule_type* schedule)
-{
-    ldns_rbnode_t *node, *delnode;
-    task_type *task;
-
-    if (!schedule || !schedule->tasks) return NULL;
-    node = ldns_rbtree_first(schedule->tasks);
-    if (!node) return NULL;
-    delnode = ldns_rbtree_delete(schedule->tasks, node->data);
-    /* delnode == node, but we don't free it just yet, data is shared
-     * with tasks_by_name tree */
-    if (!delnode) return NULL;
-    delnode = ldns_rbtree_delete(schedule->tasks_by_name, node->data);
-    free(node);
-    if (!delnode) return NULL;
-    task = (task_type*) delnode->data;
-    free(delnode); /* this delnode != node */
-    pthread_cond_signal(&schedule->schedule_cond);
-    return task;
+static int
+task_before(task_type* a, task_type* b)
+{
+    if (a->due_date != b->due_date) {
+        return a->due_date < b->due_date;
+    }
+    return a->seq < b->seq;
 }
 
 /**
- * Internal task cleanup function.
+ * Task a has an earlier deadline than task b.
  *
  */
+static int
+task_urgent(task_type* a, task_type* b)
+{
+    time_t da = a->deadline ? a->deadline : a->due_date;
+    time_t db = b->deadline ? b->deadline : b->due_date;
+    if (da != db) {
+        return da < db;
+    }
+    return a->seq < b->seq;
+}
+
 static void
-task_delfunc(ldns_rbnode_t* node)
+heap_set(struct schedule_heap* heap, size_t i, task_type* task)
 {
-    task_type* task;
+    heap->tasks[i] = task;
+    task->heap = heap;
+    task->heap_index = (long) i;
+}
 
-    if (node && node != LDNS_RBTREE_NULL) {
-        task = (task_type*) node->data;
-        task_delfunc(node->left);
-        task_delfunc(node->right);
-        task_destroy(task);
-        free((void*)node);
+static void
+heap_up(struct schedule_heap* heap, size_t i)
+{
+    task_type* task = heap->tasks[i];
+    while (i > 0 && heap->before(task, heap->tasks[(i-1)/2])) {
+        heap_set(heap, i, heap->tasks[(i-1)/2]);
+        i = (i-1)/2;
     }
+    heap_set(heap, i, task);
 }
+
 static void
-task_delfunc2(ldns_rbnode_t* node)
+heap_down(struct schedule_heap* heap, size_t i)
 {
-    if (node && node != LDNS_RBTREE_NULL) {
-        task_delfunc2(node->left);
-        task_delfunc2(node->right);
-        free((void*)node);
+    task_type* task = heap->tasks[i];
+    size_t child;
+    while ((child = 2*i + 1) < heap->count) {
+        if (child + 1 < heap->count &&
+            heap->before(heap->tasks[child+1], heap->tasks[child])) {
+            child++;
+        }
+        if (!heap->before(heap->tasks[child], task)) {
+            break;
+        }
+        heap_set(heap, i, heap->tasks[child]);
+        i = child;
     }
+    heap_set(heap, i, task);
 }
 
-/* Removes task from both trees and assign nodes to node1 and node2.
- * These belong to the caller now
- * 
- * 0 on success */
-static int
-fetch_node_pair(schedule_type *schedule, task_type *task,
-    ldns_rbnode_t **nodeFromTimeTree, ldns_rbnode_t **nodeFromNameTree, int remove)
+static void
+heap_push(struct schedule_heap* heap, task_type* task)
 {
-    task_type *originalTask;
+    if (heap->count == heap->size) {
+        heap->size = heap->size ? heap->size * 2 : 64;
+        CHECKALLOC(heap->tasks = (task_type**) realloc(heap->tasks,
+            heap->size * sizeof(task_type*)));
+    }
+    heap_set(heap, heap->count++, task);
+    heap_up(heap, heap->count - 1);
+}
 
-    ods_log_assert(schedule);
-    ods_log_assert(task);
-    *nodeFromTimeTree = NULL;
-    if (remove) {
-        *nodeFromNameTree = ldns_rbtree_delete(schedule->tasks_by_name, task);
+static void
+heap_remove(struct schedule_heap* heap, task_type* task)
+{
+    size_t i = (size_t) task->heap_index;
+    task_type* last = heap->tasks[--heap->count];
+    task->heap = NULL;
+    task->heap_index = -1;
+    if (i == heap->count) {
+        return;
+    }
+    heap_set(heap, i, last);
+    heap_down(heap, i);
+    heap_up(heap, (size_t) last->heap_index);
+}
+
+/**
+ * Move the tasks that are due from the ready heap to the due heap.
+ *
+ */
+static void
+due_run(schedule_type* schedule, time_t now)
+{
+    task_type* task;
+    while (schedule->ready.count &&
+        (task = schedule->ready.tasks[0])->due_date <= now) {
+        heap_remove(&schedule->ready, task);
+        heap_push(&schedule->due, task);
+    }
+}
+
+/**
+ * Slot of the wheel for a task due after the wheel time. A task goes in
+ * the lowest level at which its due date and the wheel time only differ
+ * in the bits of that level.
+ *
+ */
+static task_type**
+wheel_slot(schedule_type* schedule, time_t due)
+{
+    int level, shift;
+    for (level = 0; level < SCHEDULE_WHEEL_LEVELS; level++) {
+        shift = SCHEDULE_WHEEL_BITS * (level + 1);
+        if ((due >> shift) == (schedule->wheel_time >> shift)) {
+            return &schedule->wheel[level][(due >> (shift -
+                SCHEDULE_WHEEL_BITS)) & SCHEDULE_WHEEL_MASK];
+        }
+    }
+    return &schedule->overflow;
+}
+
+static void
+slot_insert(task_type** slot, task_type* task)
+{
+    task->slot = slot;
+    task->slot_prev = NULL;
+    task->slot_next = *slot;
+    if (*slot) {
+        (*slot)->slot_prev = task;
+    }
+    *slot = task;
+}
+
+static void
+slot_remove(task_type* task)
+{
+    if (task->slot_prev) {
+        task->slot_prev->slot_next = task->slot_next;
     } else {
-        *nodeFromNameTree = ldns_rbtree_search(schedule->tasks_by_name, task);
+        *task->slot = task->slot_next;
+    }
+    if (task->slot_next) {
+        task->slot_next->slot_prev = task->slot_prev;
     }
-    if (!*nodeFromNameTree) {
-        return 1; /* could not find task*/
+    task->slot = NULL;
+    task->slot_next = NULL;
+    task->slot_prev = NULL;
+}
+
+/**
+ * Put task in the ready heap or the wheel, depending on its due date.
+ *
+ */
+static void
+wheel_place(schedule_type* schedule, task_type* task)
+{
+    if (task->due_date <= schedule->wheel_time) {
+        heap_push(&schedule->ready, task);
     } else {
-        originalTask = (task_type*) (*nodeFromNameTree)->key; /* This is the original task, it has the correct time so we can find it in tasks */
-        ods_log_assert(originalTask);
-        if (remove) {
-            *nodeFromTimeTree = ldns_rbtree_delete(schedule->tasks, originalTask);
-        } else {
-            *nodeFromTimeTree = ldns_rbtree_search(schedule->tasks, originalTask);
-        }
-        ods_log_assert(*nodeFromTimeTree);
-        return 0;
+        slot_insert(wheel_slot(schedule, task->due_date), task);
     }
 }
 
+static void
+wheel_add(schedule_type* schedule, task_type* task)
+{
+    task->seq = schedule->seq++;
+    wheel_place(schedule, task);
+    schedule->count++;
+}
+
+static void
+wheel_del(schedule_type* schedule, task_type* task)
+{
+    if (task->heap) {
+        heap_remove(task->heap, task);
+    } else if (task->slot) {
+        slot_remove(task);
+    }
+    schedule->count--;
+}
+
+/**
+ * Replace tasks in slot relative to the current wheel time.
+ *
+ */
+static void
+wheel_cascade(schedule_type* schedule, task_type** slot)
+{
+    task_type* task = *slot;
+    task_type* next;
+    *slot = NULL;
+    for (; task; task = next) {
+        next = task->slot_next;
+        task->slot = NULL;
+        task->slot_next = NULL;
+        task->slot_prev = NULL;
+        wheel_place(schedule, task);
+    }
+}
+
+/**
+ * Advance the wheel to now, moving tasks that became due to the ready
+ * heap.
+ *
+ */
+static void
+wheel_run(schedule_type* schedule, time_t now)
+{
+    task_type* pending = NULL;
+    task_type* task;
+    int level, slot;
+
+    if (now <= schedule->wheel_time) {
+        return;
+    }
+    if (now - schedule->wheel_time > SCHEDULE_WHEEL_MAXSTEP) {
+        /* big jump, e.g. after a time leap: start over */
+        for (level = 0; level < SCHEDULE_WHEEL_LEVELS; level++) {
+            for (slot = 0; slot < SCHEDULE_WHEEL_SLOTS; slot++) {
+                while ((task = schedule->wheel[level][slot]) != NULL) {
+                    slot_remove(task);
+                    task->slot_next = pending;
+                    pending = task;
+                }
+            }
+        }
+        while ((task = schedule->overflow) != NULL) {
+            slot_remove(task);
+            task->slot_next = pending;
+            pending = task;
+        }
+        schedule->wheel_time = now;
+        while ((task = pending) != NULL) {
+            pending = task->slot_next;
+            task->slot_next = NULL;
+            wheel_place(schedule, task);
+        }
+        return;
+    }
+    while (schedule->wheel_time < now) {
+        schedule->wheel_time++;
+        if (!(schedule->wheel_time & (((time_t) 1 <<
+            (SCHEDULE_WHEEL_BITS * SCHEDULE_WHEEL_LEVELS)) - 1))) {
+            wheel_cascade(schedule, &schedule->overflow);
+        }
+        for (level = SCHEDULE_WHEEL_LEVELS - 1; level > 0; level--) {
+            if (schedule->wheel_time & (((time_t) 1 <<
+                (SCHEDULE_WHEEL_BITS * level)) - 1)) {
+                continue;
+            }
+            wheel_cascade(schedule, &schedule->wheel[level][
+                (schedule->wheel_time >> (SCHEDULE_WHEEL_BITS * level)) &
+                SCHEDULE_WHEEL_MASK]);
+        }
+        wheel_cascade(schedule, &schedule->wheel[0][schedule->wheel_time &
+            SCHEDULE_WHEEL_MASK]);
+    }
+}
+
+/**
+ * Get the first scheduled task. As long as return value is used
+ * caller should hold schedule->schedule_lock.
+ *
+ * Due tasks come first, the one with the earliest deadline. If nothing
+ * is due and nothing is in the ready heap, the wheel is moved forward to
+ * the first slot in use, so that the first task ends up in the ready
+ * heap. The wheel time may then be ahead of the current time, tasks in
+ * the ready heap are not necessarily due.
+ *
+ * \param[in] schedule schedule
+ * \return task_type* first scheduled task, NULL on no task or error.
+ */
+static task_type*
+schedule_get_first_task(schedule_type* schedule)
+{
+    task_type* task;
+    time_t first;
+    int level, slot, shift;
+
+    if (schedule->due.count) {
+        return schedule->due.tasks[0];
+    }
+    while (!schedule->ready.count && schedule->count > 0) {
+        /* at each level, only the slots after the wheel time are in use */
+        for (level = 0; level < SCHEDULE_WHEEL_LEVELS; level++) {
+            shift = SCHEDULE_WHEEL_BITS * level;
+            slot = (int) ((schedule->wheel_time >> shift) &
+                SCHEDULE_WHEEL_MASK);
+            for (slot++; slot < SCHEDULE_WHEEL_SLOTS; slot++) {
+                if (schedule->wheel[level][slot]) {
+                    break;
+                }
+            }
+            if (slot < SCHEDULE_WHEEL_SLOTS) {
+                break;
+            }
+        }
+        if (level < SCHEDULE_WHEEL_LEVELS) {
+            /* run the wheel to the start of that slot */
+            first = ((schedule->wheel_time >> (shift + SCHEDULE_WHEEL_BITS))
+                << (shift + SCHEDULE_WHEEL_BITS)) | ((time_t) slot << shift);
+            schedule->wheel_time = first - 1;
+            wheel_run(schedule, first);
+            continue;
+        }
+        /* only far away tasks left */
+        first = schedule->overflow->due_date;
+        for (task = schedule->overflow; task; task = task->slot_next) {
+            if (task->due_date < first) {
+                first = task->due_date;
+            }
+        }
+        schedule->wheel_time = first - 1;
+        wheel_run(schedule, first);
+        wheel_cascade(schedule, &schedule->overflow);
+    }
+    return schedule->ready.count ? schedule->ready.tasks[0] : NULL;
+}
+
+/**
+ * Wake up an idle worker that would otherwise sleep past due. Caller
+ * holds schedule->schedule_lock.
+ *
+ */
+static void
+schedule_wakeup(schedule_type* schedule, time_t due)
+{
+    struct schedule_waiter_struct** link = &schedule->waiters;
+    struct schedule_waiter_struct* waiter;
+    for (; (waiter = *link) != NULL; link = &waiter->next) {
+        if (waiter->deadline <= 0 || due < waiter->deadline) {
+            *link = waiter->next;
+            waiter->woken = 1;
+            pthread_cond_signal(&waiter->cond);
+            return;
+        }
+    }
+}
+
+static void
+schedule_wakeup_all(schedule_type* schedule)
+{
+    struct schedule_waiter_struct* waiter;
+    while ((waiter = schedule->waiters) != NULL) {
+        schedule->waiters = waiter->next;
+        waiter->woken = 1;
+        pthread_cond_signal(&waiter->cond);
+    }
+}
+
+/**
+ * Take the first task out of the schedule, if due_only is set only if
+ * it is due. Caller holds schedule->schedule_lock, it is released on
+ * return. The shard lock of the task has to be taken first, if that
+ * would block the schedule lock is let go and the first task looked
+ * up again.
+ *
+ */
+static task_type*
+schedule_take(schedule_type* schedule, int due_only)
+{
+    struct schedule_shard* shard;
+    task_type* task;
+    time_t now;
+
+    while (1) {
+        now = time_now();
+        wheel_run(schedule, now);
+        due_run(schedule, now);
+        task = schedule_get_first_task(schedule);
+        if (!task || (due_only && task->due_date > now)) {
+            pthread_mutex_unlock(&schedule->schedule_lock);
+            return NULL;
+        }
+        shard = schedule_shard(schedule, task->hash);
+        if (pthread_mutex_trylock(&shard->shard_lock)) {
+            pthread_mutex_unlock(&schedule->schedule_lock);
+            pthread_mutex_lock(&shard->shard_lock);
+            pthread_mutex_lock(&schedule->schedule_lock);
+            task = schedule_get_first_task(schedule);
+            if (!task || (due_only && task->due_date > now) ||
+                schedule_shard(schedule, task->hash) != shard) {
+                /* changed meanwhile, try again */
+                pthread_mutex_unlock(&shard->shard_lock);
+                continue;
+            }
+        }
+        wheel_del(schedule, task);
+        shard_remove(shard, task);
+        pthread_mutex_unlock(&shard->shard_lock);
+        /* more work to do, pass it on */
+        if (schedule->due.count) {
+            schedule_wakeup(schedule, schedule->due.tasks[0]->due_date);
+        }
+        pthread_mutex_unlock(&schedule->schedule_lock);
+        if (task->due_date && task->due_date <= now) {
+            metrics_observe(schedule->lag,
+                (uint64_t) (now - task->due_date) * 1000000);
+        }
+        return task;
+    }
+}
+
+/**
+ * Free all tasks. Caller holds all locks or is the only user left.
+ *
+ */
+static void
+schedule_free_tasks(schedule_type* schedule)
+{
+    struct schedule_shard* shard;
+    task_type* task;
+    size_t i;
+    int s;
+
+    for (s = 0; s < SCHEDULE_SHARDS; s++) {
+        shard = &schedule->shards[s];
+        for (i = 0; i < shard->nbuckets; i++) {
+            while ((task = shard->tasks[i]) != NULL) {
+                shard->tasks[i] = task->hash_next;
+                task_destroy(task);
+            }
+        }
+        shard->ntasks = 0;
+    }
+    memset(schedule->wheel, 0, sizeof(schedule->wheel));
+    schedule->overflow = NULL;
+    schedule->ready.count = 0;
+    schedule->due.count = 0;
+    schedule->count = 0;
+}
+
 /**
  * Create new schedule. Allocate and initialise scheduler. To clean
  * up schedule_cleanup() should be called.
@@ -188,19 +700,40 @@ schedule_type*
 schedule_create()
 {
     schedule_type* schedule;
+    struct schedule_shard* shard;
+    int s;
     CHECKALLOC(schedule = (schedule_type*) malloc(sizeof(schedule_type)));
 
-    schedule->tasks = ldns_rbtree_create(task_compare_time_then_ttuple);
-    schedule->tasks_by_name = ldns_rbtree_create(task_compare_ttuple);
-    schedule->locks_by_name = ldns_rbtree_create(task_compare_ttuple_lock);
+    memset(schedule->wheel, 0, sizeof(schedule->wheel));
+    schedule->overflow = NULL;
+    schedule->wheel_time = time_now();
+    memset(&schedule->ready, 0, sizeof(schedule->ready));
+    schedule->ready.before = task_before;
+    memset(&schedule->due, 0, sizeof(schedule->due));
+    schedule->due.before = task_urgent;
+    schedule->seq = 0;
+    schedule->count = 0;
+    for (s = 0; s < SCHEDULE_SHARDS; s++) {
+        shard = &schedule->shards[s];
+        pthread_mutex_init(&shard->shard_lock, NULL);
+        shard->nbuckets = SCHEDULE_SHARD_BUCKETS;
+        CHECKALLOC(shard->tasks = (task_type**) calloc(shard->nbuckets,
+            sizeof(task_type*)));
+        CHECKALLOC(shard->locks = (struct schedule_lock_struct**) calloc(
+            shard->nbuckets, sizeof(struct schedule_lock_struct*)));
+        shard->ntasks = 0;
+        shard->nlocks = 0;
+    }
 
     pthread_mutex_init(&schedule->schedule_lock, NULL);
-    pthread_cond_init(&schedule->schedule_cond, NULL);
+    schedule->waiters = NULL;
     schedule->num_waiting = 0;
     schedule->handlers = NULL;
     schedule->nhandlers = 0;
     
     CHECKALLOC(schedule->signq = fifoq_create());
+    schedule->lag = metrics_histogram("ods_scheduler_lag_seconds",
+        "Time from due date until a worker takes the task.", NULL, NULL);
 
     return schedule;
 }
@@ -212,20 +745,21 @@ schedule_create()
 void
 schedule_cleanup(schedule_type* schedule)
 {
+    int s;
     if (!schedule) return;
     ods_log_debug("[%s] cleanup schedule", schedule_str);
 
-    if (schedule->tasks) {
-        task_delfunc(schedule->tasks->root);
-        task_delfunc2(schedule->tasks_by_name->root);
-        ldns_rbtree_free(schedule->tasks);
-        ldns_rbtree_free(schedule->tasks_by_name);
-        ldns_rbtree_free(schedule->locks_by_name);
-        schedule->tasks = NULL;
+    schedule_free_tasks(schedule);
+    for (s = 0; s < SCHEDULE_SHARDS; s++) {
+        shard_free_locks(&schedule->shards[s]);
+        free(schedule->shards[s].tasks);
+        free(schedule->shards[s].locks);
+        pthread_mutex_destroy(&schedule->shards[s].shard_lock);
     }
+    free(schedule->ready.tasks);
+    free(schedule->due.tasks);
     fifoq_cleanup(schedule->signq);
     pthread_mutex_destroy(&schedule->schedule_lock);
-    pthread_cond_destroy(&schedule->schedule_cond);
     free(schedule->handlers);
     free(schedule);
 }
@@ -233,102 +767,70 @@ schedule_cleanup(schedule_type* schedule)
 void
 schedule_purge(schedule_type* schedule)
 {
-    ldns_rbnode_t* node;
-    
-    if (!schedule || !schedule->tasks) return;
+    int s;
+
+    if (!schedule) return;
 
+    for (s = 0; s < SCHEDULE_SHARDS; s++) {
+        pthread_mutex_lock(&schedule->shards[s].shard_lock);
+    }
     pthread_mutex_lock(&schedule->schedule_lock);
-        /* don't attempt to free payload, still referenced by other tree*/
-        while ((node = ldns_rbtree_first(schedule->tasks)) !=
-            LDNS_RBTREE_NULL)
-        {
-            node = ldns_rbtree_delete(schedule->tasks, node->data);
-            if (node == 0) break;
-            free(node);
-        }
-        /* also clean up name tree */
-        while ((node = ldns_rbtree_first(schedule->tasks_by_name)) !=
-            LDNS_RBTREE_NULL)
-        {
-            node = ldns_rbtree_delete(schedule->tasks_by_name, node->data);
-            if (node == 0) break;
-            task_destroy((task_type*) node->data);
-            free(node);
-        }
-        /* also clean up locks tree */
-        while ((node = ldns_rbtree_first(schedule->locks_by_name)) !=
-            LDNS_RBTREE_NULL)
-        {
-            node = ldns_rbtree_delete(schedule->locks_by_name, node->data);
-            if (node == 0) break;
-            pthread_mutex_destroy(((task_type*) node->data)->lock);
-            free(((task_type*) node->data)->lock);
-            task_destroy((task_type*) node->data);
-            free(node);
+        schedule_free_tasks(schedule);
+        for (s = 0; s < SCHEDULE_SHARDS; s++) {
+            shard_free_locks(&schedule->shards[s]);
         }
     pthread_mutex_unlock(&schedule->schedule_lock);
+    for (s = SCHEDULE_SHARDS - 1; s >= 0; s--) {
+        pthread_mutex_unlock(&schedule->shards[s].shard_lock);
+    }
+}
+
+/**
+ * Remove all tasks that match the ttuple of match, which may have type
+ * schedule_WHATEVER, and destroy them.
+ *
+ */
+static void
+schedule_remove_matching(schedule_type* schedule, task_type* match)
+{
+    unsigned int hash = schedule_hash(match->owner, match->class);
+    struct schedule_shard* shard = schedule_shard(schedule, hash);
+    task_type* task;
+
+    pthread_mutex_lock(&shard->shard_lock);
+    while ((task = shard_find(shard, match, hash)) != NULL) {
+        shard_remove(shard, task);
+        pthread_mutex_lock(&schedule->schedule_lock);
+        wheel_del(schedule, task);
+        pthread_mutex_unlock(&schedule->schedule_lock);
+        ods_log_debug("[%s] unschedule task %s for zone %s",
+            schedule_str, task->type, task->owner);
+        task_destroy(task);
+    }
+    pthread_mutex_unlock(&shard->shard_lock);
 }
 
 void
 schedule_purge_owner(schedule_type* schedule, char const *class,
     char const *owner)
 {
-    /* This method is somewhat inefficient but not too bad. Approx:
-     * O(N + M log N). Where N total tasks, M tasks to remove. Probably
-     * a bit worse since the trees are balanced. */
-    task_type **tasks, *task;
-    int i, num_slots = 10, num_tasks = 0;
-    ldns_rbnode_t *n1, *n2, *node;
-
-    /* We expect around 3 tasks per owner so we probably never have to
-     * realloc if we start with num_slots = 10 */
-    tasks = (task_type **)malloc(num_slots * sizeof(task_type *));
-    if (!tasks) return;
-
-    pthread_mutex_lock(&schedule->schedule_lock);
-
-        /* First collect all tasks that match. Don't fiddle with the
-         * tree. That is not save and might mess up our iteration. */
-        node = ldns_rbtree_first(schedule->tasks_by_name);
-        while (node != LDNS_RBTREE_NULL) {
-            task = (task_type *) node->key;
-            node = ldns_rbtree_next(node);
-            if (!strcmp(task->owner, owner) && !strcmp(task->class, class)) {
-                tasks[num_tasks++] = task;
-                if (num_tasks == num_slots) {
-                    num_slots *= 2;
-                    tasks = realloc(tasks, num_slots * sizeof(task_type *));
-                    if (!tasks) {
-                        pthread_mutex_unlock(&schedule->schedule_lock);
-                        return;
-                    }
-                }
-            }
-        }
-
-        /* Be free my little tasks, be free! */
-        for (i = 0; i<num_tasks; i++) {
-            if (!fetch_node_pair(schedule, tasks[i], &n1, &n2, 1)) {
-                task_destroy(tasks[i]);
-                free(n1);
-                free(n2);
-            }
-        }
-        free(tasks);
-
-    pthread_mutex_unlock(&schedule->schedule_lock);
+    task_type match;
+    memset(&match, 0, sizeof(match));
+    match.owner = owner;
+    match.class = class;
+    match.type = schedule_WHATEVER;
+    schedule_remove_matching(schedule, &match);
 }
 
 ods_status
 schedule_task(schedule_type* schedule, task_type* task, int replace, int log)
 {
     ods_status status = ODS_STATUS_OK;
-    ldns_rbnode_t* node1;
-    ldns_rbnode_t* node2;
-    task_type *existing_task, *t;
+    struct schedule_shard* shard;
+    task_type *existing_task;
 
     ods_log_assert(task);
-    if (!schedule || !schedule->tasks) {
+    if (!schedule) {
         ods_log_error("[%s] unable to schedule task: no schedule",
                 schedule_str);
         return ODS_STATUS_ERR;
@@ -336,179 +838,169 @@ schedule_task(schedule_type* schedule, task_type* task, int replace, int log)
     ods_log_debug("[%s] schedule task %s for %s", schedule_str,
             task->type, task->owner);
 
-    pthread_mutex_lock(&schedule->schedule_lock);
-    if (fetch_node_pair(schedule, task, &node1, &node2, replace)) {
+    task->hash = schedule_hash(task->owner, task->class);
+    shard = schedule_shard(schedule, task->hash);
+    pthread_mutex_lock(&shard->shard_lock);
+    existing_task = shard_find(shard, task, task->hash);
+    if (!existing_task) {
         /* Though no such task is scheduled at the moment, there could
          * be a lock for it. If task already has a lock, keep using that.
          */
         if (!task->lock) {
-            node1 = ldns_rbtree_search(schedule->locks_by_name, task);
-            if (!node1) {
-                /* New lock, insert in tree */
-                t = task_duplicate_shallow(task);
-                t->lock = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
-                if (pthread_mutex_init(t->lock, NULL)) {
-                    task_destroy(t);
-                    pthread_mutex_unlock(&schedule->schedule_lock);
-                    return ODS_STATUS_ERR;
-                }
-                node1 = task2node(t);
-                ods_log_assert(ldns_rbtree_insert(schedule->locks_by_name, node1));
+            task->lock = shard_lock(shard, task);
+            if (!task->lock) {
+                pthread_mutex_unlock(&shard->shard_lock);
+                return ODS_STATUS_ERR;
             }
-            task->lock = ((task_type*)node1->key)->lock;
-        }
-        /* not is schedule yet */
-        node1 = task2node(task);
-        node2 = task2node(task);
-        if (!node1 || !node2) {
-            pthread_mutex_unlock(&schedule->schedule_lock);
-            free(node1);
-            free(node2);
-            return ODS_STATUS_ERR;
         }
-        ods_log_assert(ldns_rbtree_insert(schedule->tasks, node1));
-        ods_log_assert(ldns_rbtree_insert(schedule->tasks_by_name, node2));
+        shard_insert(shard, task);
+        pthread_mutex_lock(&schedule->schedule_lock);
+        wheel_add(schedule, task);
+    } else if (!replace) {
+        ods_log_error("[%s] unable to schedule task %s for zone %s: already present", schedule_str, task->type, task->owner);
+        pthread_mutex_unlock(&shard->shard_lock);
+        return ODS_STATUS_ERR;
     } else {
-        if (!replace) {
-            ods_log_error("[%s] unable to schedule task %s for zone %s: already present", schedule_str, task->type, task->owner);
-            status = ODS_STATUS_ERR;
-        } else {
-            ods_log_assert(node1->key == node2->key);
-            existing_task = (task_type*) node1->key;
-            if (task->due_date < existing_task->due_date)
+        pthread_mutex_lock(&schedule->schedule_lock);
+        if (task->due_date < existing_task->due_date || (task->deadline &&
+            (!existing_task->deadline ||
+            task->deadline < existing_task->deadline))) {
+            wheel_del(schedule, existing_task);
+            if (task->due_date < existing_task->due_date) {
                 existing_task->due_date = task->due_date;
-            if (existing_task->freedata)
-                existing_task->freedata(existing_task->userdata);
-            existing_task->userdata = task->userdata;
-            existing_task->freedata = task->freedata;
-            task->userdata = NULL; /* context is now assigned to existing_task, prevent it from freeing */
-            task_destroy(task);
-            ods_log_assert(ldns_rbtree_insert(schedule->tasks, node1));
-            ods_log_assert(ldns_rbtree_insert(schedule->tasks_by_name, node2));
-            task = existing_task;
+            }
+            if (task->deadline && (!existing_task->deadline ||
+                task->deadline < existing_task->deadline)) {
+                existing_task->deadline = task->deadline;
+            }
+            wheel_add(schedule, existing_task);
         }
+        if (existing_task->freedata)
+            existing_task->freedata(existing_task->userdata);
+        existing_task->userdata = task->userdata;
+        existing_task->freedata = task->freedata;
+        task->userdata = NULL; /* context is now assigned to existing_task, prevent it from freeing */
+        task_destroy(task);
+        task = existing_task;
     }
-    if (status == ODS_STATUS_OK) {
-        if (log) {
-            task_log(task);
-        }
+    if (log) {
+        task_log(task);
     }
-    pthread_cond_signal(&schedule->schedule_cond);
+    schedule_wakeup(schedule, task->due_date);
     pthread_mutex_unlock(&schedule->schedule_lock);
+    pthread_mutex_unlock(&shard->shard_lock);
     return status;
 }
 
-
-/**
- * Unschedule task.
- *
- * \param[in] schedule schedule
- * \return task_type* first scheduled task, NULL on no task or error.
- */
-static task_type*
-unschedule_task(schedule_type* schedule, task_type* task)
-{
-    ldns_rbnode_t* del_node = LDNS_RBTREE_NULL;
-    ldns_rbnode_t* node2 = LDNS_RBTREE_NULL;
-    task_type* del_task = NULL;
-    if (!task || !schedule || !schedule->tasks) {
-        return NULL;
-    }
-    ods_log_debug("[%s] unschedule task %s for zone %s",
-        schedule_str, task->type, task->owner);
-
-    del_node = ldns_rbtree_delete(schedule->tasks, (const void*) task);
-    if (del_node) {
-        del_task = (task_type*) del_node->data;
-        node2 = ldns_rbtree_delete(schedule->tasks_by_name, del_task);
-        if (node2 != NULL && node2 != LDNS_RBTREE_NULL) {
-            free(node2);
-        }
-        free((void*)del_node);
-        return del_task;
-    } else {
-        return NULL;
-    }
-}
-
 task_type*
 schedule_unschedule(schedule_type* schedule, task_type* task)
 {
+    unsigned int hash = schedule_hash(task->owner, task->class);
+    struct schedule_shard* shard = schedule_shard(schedule, hash);
     task_type* originalTask;
-    pthread_mutex_lock(&schedule->schedule_lock);
-    originalTask = unschedule_task(schedule, task);
-    pthread_mutex_unlock(&schedule->schedule_lock);
+
+    pthread_mutex_lock(&shard->shard_lock);
+    originalTask = shard_find(shard, task, hash);
+    if (originalTask) {
+        shard_remove(shard, originalTask);
+        pthread_mutex_lock(&schedule->schedule_lock);
+        wheel_del(schedule, originalTask);
+        pthread_mutex_unlock(&schedule->schedule_lock);
+    }
+    pthread_mutex_unlock(&shard->shard_lock);
     return originalTask;
 }
 
 task_type*
 schedule_pop_task(schedule_type* schedule)
 {
+    struct schedule_waiter_struct waiter;
     time_t timeout, now = time_now();
     task_type* task;
 
     pthread_mutex_lock(&schedule->schedule_lock);
+    wheel_run(schedule, now);
+    due_run(schedule, now);
     task = schedule_get_first_task(schedule);
     if (task && (task->due_date <= now)) {
-        ods_log_debug("[%s] pop task for zone %s", schedule_str, task->owner);
-        task = unschedule_task(schedule, task);
-    } else {
-        /* nothing to do now, sleep and wait for signal */
-        schedule->num_waiting += 1;
-        timeout = clamp((task ? (task->due_date - now) : 0),
-                        ((task && !strcmp(task->class, TASK_CLASS_ENFORCER)) ? 0 : 60),
-                        ODS_SE_MAX_BACKOFF);
-        if (time_leaped()) timeout = -1;
-        ods_thread_wait(&schedule->schedule_cond, &schedule->schedule_lock, timeout);
-        schedule->num_waiting -= 1;
-        task = NULL;
+        task = schedule_take(schedule, 1);
+        if (task) {
+            ods_log_debug("[%s] pop task for zone %s", schedule_str, task->owner);
+        }
+        return task;
+    }
+    /* nothing to do now, sleep and wait for signal */
+    timeout = clamp((task ? (task->due_date - now) : 0),
+                    ((task && !strcmp(task->class, TASK_CLASS_ENFORCER)) ? 0 : 60),
+                    ODS_SE_MAX_BACKOFF);
+    if (time_leaped()) timeout = -1;
+    pthread_cond_init(&waiter.cond, NULL);
+    waiter.deadline = (timeout > 0 ? now + timeout : 0);
+    waiter.woken = 0;
+    waiter.next = schedule->waiters;
+    schedule->waiters = &waiter;
+    schedule->num_waiting += 1;
+    ods_thread_wait(&waiter.cond, &schedule->schedule_lock, timeout);
+    schedule->num_waiting -= 1;
+    if (!waiter.woken) {
+        struct schedule_waiter_struct** link = &schedule->waiters;
+        while (*link && *link != &waiter) {
+            link = &(*link)->next;
+        }
+        if (*link) {
+            *link = waiter.next;
+        }
     }
     pthread_mutex_unlock(&schedule->schedule_lock);
-    return task;
+    pthread_cond_destroy(&waiter.cond);
+    return NULL;
 }
 
 task_type*
 schedule_pop_first_task(schedule_type* schedule)
 {
-    task_type *task;
-
     pthread_mutex_lock(&schedule->schedule_lock);
-    task = pop_first_task(schedule);
-    pthread_mutex_unlock(&schedule->schedule_lock);
-    return task;
+    return schedule_take(schedule, 0);
 }
 
 void
 schedule_flush(schedule_type* schedule)
 {
-    ldns_rbnode_t *node;
     task_type* task;
+    time_t now;
+    int level, slot;
 
     ods_log_debug("[%s] flush all tasks", schedule_str);
-    if (!schedule || !schedule->tasks) return;
+    if (!schedule) return;
 
     pthread_mutex_lock(&schedule->schedule_lock);
-    do {
-        node = ldns_rbtree_last(schedule->tasks);
-        if (node && node != LDNS_RBTREE_NULL) {
-            task = (task_type*) node->data;
-            if (task->due_date > time_now()) {
-                /* we only need to delete the node from the tasks tree as we
-                 * are immediately inserting it again.
-                 */
-                ldns_rbtree_delete(schedule->tasks, task);
-                task->due_date = time_now();
-                ldns_rbtree_insert(schedule->tasks, node);
-            } else {
-                /* the last in the ordered tree is already executing
-                 * immediately so this means that all of them are, we can abort
-                 * the loop as if we just hit the last one in the tree.
-                 */
-                node = NULL;
+    now = time_now();
+    wheel_run(schedule, now);
+    /* the ready heap can hold tasks ahead of now as well */
+    while (schedule->ready.count) {
+        task = schedule->ready.tasks[schedule->ready.count - 1];
+        heap_remove(&schedule->ready, task);
+        if (task->due_date > now) {
+            task->due_date = now;
+        }
+        heap_push(&schedule->due, task);
+    }
+    /* everything still in the wheel is in the future, make it due now */
+    for (level = 0; level < SCHEDULE_WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < SCHEDULE_WHEEL_SLOTS; slot++) {
+            while ((task = schedule->wheel[level][slot]) != NULL) {
+                slot_remove(task);
+                task->due_date = now;
+                heap_push(&schedule->due, task);
             }
         }
-    } while (node && node != LDNS_RBTREE_NULL);
-    pthread_cond_signal(&schedule->schedule_cond);
+    }
+    while ((task = schedule->overflow) != NULL) {
+        slot_remove(task);
+        task->due_date = now;
+        heap_push(&schedule->due, task);
+    }
+    schedule_wakeup_all(schedule);
     pthread_mutex_unlock(&schedule->schedule_lock);
 }
 
@@ -525,12 +1017,12 @@ schedule_info(schedule_type* schedule, time_t* firstFireTime, int* idleWorkers,
     if (taskCount) {
         *taskCount = 0;
     }
-    if (!schedule || !schedule->tasks) {
+    if (!schedule) {
         return -1;
     }
     pthread_mutex_lock(&schedule->schedule_lock);
     if (taskCount)
-        *taskCount = schedule->tasks->count;
+        *taskCount = schedule->count;
     if (idleWorkers) {
         *idleWorkers = schedule->num_waiting;
     }
@@ -542,11 +1034,59 @@ schedule_info(schedule_type* schedule, time_t* firstFireTime, int* idleWorkers,
     return 0;
 }
 
+static int
+schedule_walk_compare(const void* a, const void* b)
+{
+    return task_compare_time_then_ttuple(*(task_type* const*) a,
+        *(task_type* const*) b);
+}
+
+int
+schedule_walk(schedule_type* schedule,
+    void (*walk)(task_type* task, void* arg), void* arg)
+{
+    task_type** tasks;
+    task_type* task;
+    int level, slot, i, n = 0;
+
+    if (!schedule) return 0;
+    pthread_mutex_lock(&schedule->schedule_lock);
+    tasks = (task_type**) malloc((schedule->count + 1) * sizeof(task_type*));
+    if (!tasks) {
+        pthread_mutex_unlock(&schedule->schedule_lock);
+        return 0;
+    }
+    for (i = 0; i < (int) schedule->ready.count; i++) {
+        tasks[n++] = schedule->ready.tasks[i];
+    }
+    for (i = 0; i < (int) schedule->due.count; i++) {
+        tasks[n++] = schedule->due.tasks[i];
+    }
+    for (level = 0; level < SCHEDULE_WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < SCHEDULE_WHEEL_SLOTS; slot++) {
+            for (task = schedule->wheel[level][slot]; task;
+                task = task->slot_next) {
+                tasks[n++] = task;
+            }
+        }
+    }
+    for (task = schedule->overflow; task; task = task->slot_next) {
+        tasks[n++] = task;
+    }
+    qsort(tasks, n, sizeof(task_type*), schedule_walk_compare);
+    for (i = 0; i < n; i++) {
+        walk(tasks[i], arg);
+    }
+    pthread_mutex_unlock(&schedule->schedule_lock);
+    free(tasks);
+    return n;
+}
+
 void
 schedule_release_all(schedule_type* schedule)
 {
     pthread_mutex_lock(&schedule->schedule_lock);
-    pthread_cond_broadcast(&schedule->schedule_cond);
+    schedule_wakeup_all(schedule);
     pthread_mutex_unlock(&schedule->schedule_lock);
     fifoq_notifyall(schedule->signq);
 }
@@ -554,10 +1094,10 @@ schedule_release_all(schedule_type* schedule)
 void
 schedule_task_destroy(schedule_type* sched, task_type* task)
 {
-    pthread_mutex_lock(&sched->schedule_lock);
-    task = unschedule_task(sched, (task_type*) task);
-    pthread_mutex_unlock(&sched->schedule_lock);
-    task_destroy(task);
+    task = schedule_unschedule(sched, task);
+    if (task) {
+        task_destroy(task);
+    }
 }
 
 char*
@@ -611,6 +1151,13 @@ schedule_registertask(schedule_type* schedule, task_id taskclass, task_id taskty
 
 void
 schedule_scheduletask(schedule_type* schedule, task_id type, const char* owner, void* userdata, pthread_mutex_t* resource, time_t when)
+{
+    schedule_scheduletask_deadline(schedule, type, owner, userdata, resource,
+        when, 0);
+}
+
+void
+schedule_scheduletask_deadline(schedule_type* schedule, task_id type, const char* owner, void* userdata, pthread_mutex_t* resource, time_t when, time_t deadline)
 {
     int i;
     task_type* task;
@@ -623,6 +1170,7 @@ schedule_scheduletask(schedule_type* schedule, task_id type, const char* owner,
     if (handler) {
         task = task_create(strdup(owner), handler->class, type, handler->callback, userdata, NULL, when);
         task->lock = resource;
+        task->deadline = deadline;
         schedule_task(schedule, task, 0, 0);
     }
 }
@@ -630,17 +1178,10 @@ schedule_scheduletask(schedule_type* schedule, task_id type, const char* owner,
 void
 schedule_unscheduletask(schedule_type* schedule, task_id type, const char* owner)
 {
-    ldns_rbnode_t* node1;
-    ldns_rbnode_t* node2;
-    task_type* match;
-    task_type* found;
-    match = task_create(owner, TASK_CLASS_SIGNER, type, NULL, NULL, NULL, schedule_WHENEVER);
-    pthread_mutex_lock(&schedule->schedule_lock);
-    while (fetch_node_pair(schedule, match, &node1, &node2, 0) == 0) {
-        ods_log_assert(node1->key == node2->key);
-        found = (task_type*) node1->key;
-        unschedule_task(schedule, found);
-    }
-    pthread_mutex_unlock(&schedule->schedule_lock);
-    free(match); /* do not perform a destroy, this is a temporary, internal, flat task only */
+    task_type match;
+    memset(&match, 0, sizeof(match));
+    match.owner = owner;
+    match.class = TASK_CLASS_SIGNER;
+    match.type = type;
+    schedule_remove_matching(schedule, &match);
 }
@@ -35,7 +35,6 @@
 #include "config.h"
 #include <stdio.h>
 #include <time.h>
-#include <ldns/ldns.h>
 #include <pthread.h>
 #ifdef HAVE_SYS_TYPES_H
 # include <sys/types.h>
@@ -49,6 +48,7 @@ typedef struct schedule_struct schedule_type;
 #include "fifoq.h"
 #include "scheduler/task.h"
 #include "locks.h"
+#include "metrics.h"
 #include "status.h"
 #include "task.h"
 
@@ -61,17 +61,58 @@ struct schedule_handler {
     time_t (*callback)(task_type* task, char const *owner, void *userdata, void *context);
 };
 
+/* Timer wheel: SCHEDULE_WHEEL_LEVELS levels of SCHEDULE_WHEEL_SLOTS slots,
+ * level 0 has one slot per second. */
+#define SCHEDULE_WHEEL_BITS   6
+#define SCHEDULE_WHEEL_SLOTS  (1 << SCHEDULE_WHEEL_BITS)
+#define SCHEDULE_WHEEL_LEVELS 4
+/* Number of independently locked parts of the task lookup table. */
+#define SCHEDULE_SHARDS       64
+
+struct schedule_lock_struct;
+struct schedule_waiter_struct;
+
+/* Binary heap of tasks, before tells the order. */
+struct schedule_heap {
+    task_type** tasks;
+    size_t count;
+    size_t size;
+    int (*before)(task_type* a, task_type* b);
+};
+
+/* Tasks and locks, looked up by owner and class. */
+struct schedule_shard {
+    pthread_mutex_t shard_lock;
+    task_type** tasks;
+    struct schedule_lock_struct** locks;
+    size_t nbuckets;
+    size_t ntasks;
+    size_t nlocks;
+};
+
 struct schedule_struct {
-    /* Contains all tasks sorted by due_date so we can quickly find
-     * the first task. */
-    ldns_rbtree_t* tasks;
-    /* Contains all tasks in tasks tree but here sorted by ttuple. */
-    ldns_rbtree_t* tasks_by_name;
-    /* For every ttuple contains a task structure with an unique lock */
-    ldns_rbtree_t* locks_by_name;
-    fifoq_type* signq;
-    pthread_cond_t schedule_cond;
+    /* Tasks that are not due yet, by due date. */
+    task_type* wheel[SCHEDULE_WHEEL_LEVELS][SCHEDULE_WHEEL_SLOTS];
+    /* Tasks too far in the future for the wheel. */
+    task_type* overflow;
+    /* Time up to which the wheel has been run. */
+    time_t wheel_time;
+    /* Tasks the wheel has passed, a heap ordered by due date. */
+    struct schedule_heap ready;
+    /* Tasks that are due, a heap ordered by deadline. */
+    struct schedule_heap due;
+    unsigned long seq;
+    /* All tasks in wheel, overflow and ready heap. */
+    int count;
+    /* Protects wheel, overflow, ready heap and waiters. When both are
+     * needed, a shard lock is taken before this one. */
     pthread_mutex_t schedule_lock;
+    struct schedule_shard shards[SCHEDULE_SHARDS];
+    /* Idle workers, each waiting on its own condition. */
+    struct schedule_waiter_struct* waiters;
+    fifoq_type* signq;
+    /* Time due tasks waited before they were taken. */
+    metrics_type* lag;
     /* For testing. So we can verify al workers are waiting and nothing
      * is to be done. Used by enforcer_idle. */
     int num_waiting;
@@ -124,6 +165,11 @@ void schedule_purge_owner(schedule_type* schedule, char const *class,
  */
 ods_status schedule_task(schedule_type* schedule, task_type* task, int replace, int log);
 void schedule_scheduletask(schedule_type* schedule, task_id task, const char* owner, void* userdata, pthread_mutex_t* resource, time_t when);
+/**
+ * Schedule task with a deadline. Once due it runs before due tasks with
+ * a later deadline. A deadline of 0 is the same as schedule_scheduletask.
+ */
+void schedule_scheduletask_deadline(schedule_type* schedule, task_id task, const char* owner, void* userdata, pthread_mutex_t* resource, time_t when, time_t deadline);
 
 /**
  * Unschedule task.
@@ -155,6 +201,18 @@ task_type* schedule_pop_first_task(schedule_type* schedule);
 
 void schedule_flush(schedule_type* schedule);
 
+/**
+ * Call walk for every scheduled task, in order of due date. The
+ * schedule is locked meanwhile, walk must not call back into it.
+ *
+ * \param[in] schedule schedule
+ * \param[in] walk function called for every task
+ * \param[in] arg passed to walk
+ * \return int number of tasks walked
+ */
+int schedule_walk(schedule_type* schedule,
+    void (*walk)(task_type* task, void* arg), void* arg);
+
 int schedule_info(schedule_type* schedule, time_t* firstFireTime, int* idleWorkers, int* taskCount);
 
 /**
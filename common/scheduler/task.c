@@ -82,10 +82,20 @@ task_create(const char *owner, char const *class, char const *type,
     task->userdata = userdata;
     task->freedata = freedata;
     task->due_date = due_date;
+    task->deadline = 0;
     task->lock = NULL;
 
     task->backoff = 0;
 
+    task->hash = 0;
+    task->hash_next = NULL;
+    task->slot = NULL;
+    task->slot_next = NULL;
+    task->slot_prev = NULL;
+    task->heap = NULL;
+    task->heap_index = -1;
+    task->seq = 0;
+
     return task;
 }
 
@@ -128,6 +138,14 @@ task_perform(schedule_type* scheduler, task_type* task, void* context)
         task->backoff = clamp(task->backoff * 2, 60, ODS_SE_MAX_BACKOFF);
         ods_log_info("back-off task %s for zone %s with %lu seconds", task->type, task->owner, (long) task->backoff);
         rescheduleTime = time_now() + task->backoff;
+        /* do not back off past the deadline, but retry no more than
+         * once a minute */
+        if (task->deadline && rescheduleTime > task->deadline) {
+            rescheduleTime = task->deadline;
+            if (rescheduleTime < time_now() + 60) {
+                rescheduleTime = time_now() + 60;
+            }
+        }
     }
     if (rescheduleTime >= 0) {
         task->due_date = rescheduleTime;
@@ -154,6 +172,7 @@ task_duplicate_shallow(task_type *task)
     dup->type = task->type;
     dup->class = task->class;
     dup->lock = NULL;
+    dup->heap_index = -1;
     return dup;
 }
 
@@ -55,6 +55,7 @@
 
 struct task_struct;
 typedef struct task_struct task_type;
+struct schedule_heap;
 typedef const char* task_id;
 
 struct task_struct {
@@ -68,6 +69,10 @@ struct task_struct {
      * the past interpret it as *now* */
     time_t due_date;
 
+    /* Once due, tasks run in order of deadline, earliest first. Tasks
+     * without a deadline (0) have their due date as deadline. */
+    time_t deadline;
+
     /* if returned time >= 0 the task is rescheduled for that time.
      * keeping context. otherwise scheduler will free context, owner,
      * and task. */
@@ -87,6 +92,16 @@ struct task_struct {
     pthread_mutex_t *lock;
 
     time_t backoff;
+
+    /* Bookkeeping of the scheduler, only to be used by schedule.c */
+    unsigned int hash;
+    task_type* hash_next;
+    task_type** slot;
+    task_type* slot_next;
+    task_type* slot_prev;
+    struct schedule_heap* heap;
+    long heap_index;
+    unsigned long seq;
 };
 
 extern const char* TASK_CLASS_ENFORCER;
@@ -46,6 +46,8 @@ worker_create(char* name, schedule_type* taskq)
     worker->taskq = taskq;
     worker->tasksOutstanding = 0;
     worker->tasksFailed = 0;
+    worker->tasksWakeup = 0;
+    pthread_mutex_init(&worker->tasksLock, NULL);
     pthread_cond_init(&worker->tasksBlocker, NULL);
     return worker;
 }
@@ -82,6 +84,8 @@ worker_start(worker_type* worker)
 void
 worker_cleanup(worker_type* worker)
 {
+    pthread_cond_destroy(&worker->tasksBlocker);
+    pthread_mutex_destroy(&worker->tasksLock);
     free(worker->name);
     free(worker);
 }
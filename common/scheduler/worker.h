@@ -48,6 +48,8 @@ struct worker_struct {
     void* context;
     int tasksOutstanding;
     int tasksFailed;
+    int tasksWakeup; /* level of tasksOutstanding a throttled worker waits for */
+    pthread_mutex_t tasksLock;
     pthread_cond_t tasksBlocker;
 };
 
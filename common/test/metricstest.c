@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Unit tests of the metrics export: the output must be valid
+ * Prometheus text format and hold the values counted.
+ *
+ */
+
+#include "config.h"
+#include "clientpipe.h"
+#include "log.h"
+#include "metrics.h"
+
+#include "CUnit/Basic.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define METRICSTEST_THREADS 4
+#define METRICSTEST_COUNT 1000
+#define METRICSTEST_FAMILIES 16
+
+static char* exported = NULL;
+
+static void*
+metricstest_count(void* arg)
+{
+    metrics_type* metric = (metrics_type*) arg;
+    int i;
+    for (i = 0; i < METRICSTEST_COUNT; i++) {
+        metrics_count(metric, 1);
+    }
+    return NULL;
+}
+
+/**
+ * Count and observe from several threads, so that several shards are
+ * summed, then export to a file and collect what the client would have
+ * printed on stdout.
+ *
+ */
+static int
+metricstest_init(void)
+{
+    pthread_t threads[METRICSTEST_THREADS];
+    metrics_type* metric;
+    metrics_type* histogram;
+    FILE* file;
+    long size;
+    unsigned char* buf;
+    size_t pos, len, n = 0;
+    int i;
+
+    metric = metrics_counter("test_requests_total", "Requests handled.",
+        "zone", "a");
+    /* registered in between, must not split the series of the other */
+    metrics_count(metrics_counter("test_plain_total", "Plain counter.",
+        NULL, NULL), 7);
+    metrics_count(metrics_counter("test_requests_total", "Requests handled.",
+        "zone", "b\"\\\nq"), 1);
+    for (i = 0; i < METRICSTEST_THREADS; i++) {
+        if (pthread_create(&threads[i], NULL, metricstest_count, metric)) {
+            return 1;
+        }
+    }
+    for (i = 0; i < METRICSTEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    histogram = metrics_histogram("test_latency_seconds", "Latency.", NULL,
+        NULL);
+    metrics_observe(histogram, 10);
+    metrics_observe(histogram, 200);
+    metrics_observe(histogram, 20000000);
+    metrics_observe(metrics_histogram("test_stage_seconds", "Stage latency.",
+        "stage", "sign"), 40);
+
+    if (!(file = tmpfile())) {
+        return 1;
+    }
+    metrics_export(fileno(file));
+    size = lseek(fileno(file), 0, SEEK_END);
+    if (size <= 0 || lseek(fileno(file), 0, SEEK_SET) != 0) {
+        fclose(file);
+        return 1;
+    }
+    buf = (unsigned char*) malloc(size);
+    exported = (char*) malloc(size + 1);
+    if (!buf || !exported || read(fileno(file), buf, size) != size) {
+        free(buf);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+    /* strip the message headers of the client pipe */
+    for (pos = 0; pos + 3 <= (size_t) size; pos += 3 + len) {
+        len = ((size_t) buf[pos+1] << 8) | buf[pos+2];
+        if (pos + 3 + len > (size_t) size) {
+            break;
+        }
+        if (buf[pos] == CLIENT_OPC_STDOUT) {
+            memcpy(exported + n, buf + pos + 3, len);
+            n += len;
+        }
+    }
+    exported[n] = '\0';
+    free(buf);
+    return 0;
+}
+
+static int
+metricstest_clean(void)
+{
+    free(exported);
+    exported = NULL;
+    return 0;
+}
+
+static int
+metricstest_name(const char** s)
+{
+    const char* p = *s;
+    if (!isalpha((unsigned char) *p) && *p != '_' && *p != ':') {
+        return 0;
+    }
+    while (isalnum((unsigned char) *p) || *p == '_' || *p == ':') {
+        p++;
+    }
+    *s = p;
+    return 1;
+}
+
+/**
+ * Skip the labels of a sample, checking their syntax and escapes.
+ *
+ */
+static int
+metricstest_labels(const char** s)
+{
+    const char* p = *s;
+    if (*p != '{') {
+        return 1;
+    }
+    p++;
+    while (*p != '}') {
+        if (!metricstest_name(&p) || *p++ != '=' || *p++ != '"') {
+            return 0;
+        }
+        while (*p != '"') {
+            if (*p == '\0' || *p == '\n') {
+                return 0;
+            }
+            if (*p == '\\' && !strchr("\\\"n", *++p)) {
+                return 0;
+            }
+            p++;
+        }
+        p++;
+        if (*p == ',') {
+            p++;
+        } else if (*p != '}') {
+            return 0;
+        }
+    }
+    *s = p + 1;
+    return 1;
+}
+
+/**
+ * Whether name is family, or one of the series of a histogram family.
+ *
+ */
+static int
+metricstest_member(const char* name, size_t len, const char* family,
+    const char* type)
+{
+    static const char* suffixes[] = { "_bucket", "_sum", "_count", NULL };
+    size_t flen = strlen(family);
+    int i;
+    if (len == flen && !strncmp(name, family, len)) {
+        return strcmp(type, "histogram") != 0;
+    }
+    if (strcmp(type, "histogram") || len <= flen ||
+        strncmp(name, family, flen)) {
+        return 0;
+    }
+    for (i = 0; suffixes[i]; i++) {
+        if (len - flen == strlen(suffixes[i]) &&
+            !strncmp(name + flen, suffixes[i], len - flen)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Every line is a HELP, TYPE or sample line. Each family is described
+ * once, before its samples, and its samples are not split up.
+ *
+ */
+static void
+test_metrics_format(void)
+{
+    char families[METRICSTEST_FAMILIES][64];
+    char family[64] = "";
+    char type[16] = "";
+    int nfamilies = 0, help = 0, samples = 0;
+    const char* line;
+    const char* end;
+    const char* p;
+    char* stop;
+    int i;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(exported);
+    CU_ASSERT_FATAL(exported[0] != '\0');
+    CU_ASSERT(exported[strlen(exported) - 1] == '\n');
+    for (line = exported; *line; line = end + 1) {
+        end = strchr(line, '\n');
+        CU_ASSERT_PTR_NOT_NULL_FATAL(end);
+        if (!strncmp(line, "# HELP ", 7)) {
+            p = line + 7;
+            CU_ASSERT(metricstest_name(&p) && *p == ' ');
+            CU_ASSERT_FATAL(p - line - 7 < (long) sizeof(family));
+            CU_ASSERT_FATAL(nfamilies < METRICSTEST_FAMILIES);
+            snprintf(family, sizeof(family), "%.*s", (int) (p - line - 7),
+                line + 7);
+            for (i = 0; i < nfamilies; i++) {
+                CU_ASSERT(strcmp(families[i], family) != 0);
+            }
+            strcpy(families[nfamilies++], family);
+            type[0] = '\0';
+            help = 1;
+        } else if (!strncmp(line, "# TYPE ", 7)) {
+            CU_ASSERT(help);
+            CU_ASSERT(!strncmp(line + 7, family, strlen(family)) &&
+                line[7 + strlen(family)] == ' ');
+            p = line + 8 + strlen(family);
+            snprintf(type, sizeof(type), "%.*s", (int) (end - p), p);
+            CU_ASSERT(!strcmp(type, "counter") || !strcmp(type, "gauge") ||
+                !strcmp(type, "histogram"));
+            help = 0;
+        } else {
+            p = line;
+            CU_ASSERT_FATAL(metricstest_name(&p));
+            CU_ASSERT(type[0] != '\0');
+            CU_ASSERT(metricstest_member(line, p - line, family, type));
+            CU_ASSERT_FATAL(metricstest_labels(&p));
+            CU_ASSERT_FATAL(*p++ == ' ');
+            (void) strtod(p, &stop);
+            CU_ASSERT(stop != p && stop == end);
+            samples++;
+        }
+    }
+    CU_ASSERT(samples > 0);
+}
+
+/**
+ * The values counted, summed over the threads, with the label value
+ * escaped.
+ *
+ */
+static void
+test_metrics_counter(void)
+{
+    CU_ASSERT_PTR_NOT_NULL_FATAL(exported);
+    CU_ASSERT_PTR_NOT_NULL(strstr(exported,
+        "# HELP test_requests_total Requests handled.\n"
+        "# TYPE test_requests_total counter\n"
+        "test_requests_total{zone=\"a\"} 4000\n"
+        "test_requests_total{zone=\"b\\\"\\\\\\nq\"} 1\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(exported,
+        "# TYPE test_plain_total counter\n"
+        "test_plain_total 7\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(exported,
+        "# TYPE ods_log_dropped_total counter\n"));
+}
+
+/**
+ * Buckets are cumulative and end in +Inf, which equals the count.
+ *
+ */
+static void
+test_metrics_histogram(void)
+{
+    CU_ASSERT_PTR_NOT_NULL_FATAL(exported);
+    CU_ASSERT_PTR_NOT_NULL(strstr(exported,
+        "# TYPE test_latency_seconds histogram\n"
+        "test_latency_seconds_bucket{le=\"5e-05\"} 1\n"
+        "test_latency_seconds_bucket{le=\"0.0001\"} 1\n"
+        "test_latency_seconds_bucket{le=\"0.00025\"} 2\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(exported,
+        "test_latency_seconds_bucket{le=\"10\"} 2\n"
+        "test_latency_seconds_bucket{le=\"+Inf\"} 3\n"
+        "test_latency_seconds_sum 20.000210\n"
+        "test_latency_seconds_count 3\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(exported,
+        "test_stage_seconds_bucket{stage=\"sign\",le=\"5e-05\"} 1\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(exported,
+        "test_stage_seconds_sum{stage=\"sign\"} 0.000040\n"
+        "test_stage_seconds_count{stage=\"sign\"} 1\n"));
+}
+
+int
+main(void)
+{
+    CU_pSuite pSuite = NULL;
+
+    ods_log_init("metricstest", 0, NULL, 0);
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite = CU_add_suite("Metrics export", metricstest_init,
+        metricstest_clean);
+    if (!pSuite) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if (!CU_add_test(pSuite, "test of the text format", test_metrics_format)
+        || !CU_add_test(pSuite, "test of counters", test_metrics_counter)
+        || !CU_add_test(pSuite, "test of histograms", test_metrics_histogram))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    if (CU_get_number_of_failures()) {
+        CU_cleanup_registry();
+        return 1;
+    }
+    CU_cleanup_registry();
+    return CU_get_error();
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/**
+ * Scheduler benchmark.
+ *
+ * Pushes a large number of tasks from several threads, reschedules part
+ * of them, then flushes the schedule and pops everything again, and
+ * reports the operations per second of each phase.
+ *
+ */
+
+#include "config.h"
+#include "duration.h"
+#include "log.h"
+#include "scheduler/schedule.h"
+#include "scheduler/task.h"
+#include "test/bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define SCHEDBENCH_TASKS 1000000
+#define SCHEDBENCH_THREADS 4
+#define SCHEDBENCH_SPREAD (30*24*3600)
+
+struct schedbench_arg {
+    schedule_type* schedule;
+    int first;
+    int last;
+    int replace;
+    int count;
+    pthread_t thread;
+};
+
+static const char* schedbench_types[4];
+static time_t schedbench_now;
+
+static task_type*
+schedbench_task(int i, time_t due)
+{
+    char owner[64];
+    snprintf(owner, sizeof(owner), "zone%d.example.", i/4);
+    return task_create(strdup(owner), TASK_CLASS_ENFORCER,
+        schedbench_types[i%4], NULL, NULL, NULL, due);
+}
+
+static void*
+schedbench_push(void* data)
+{
+    struct schedbench_arg* arg = (struct schedbench_arg*) data;
+    unsigned int seed = (unsigned int) arg->first;
+    task_type* task;
+    time_t due;
+    int i;
+    for (i = arg->first; i < arg->last; i++) {
+        due = schedbench_now + 1 + (rand_r(&seed) % SCHEDBENCH_SPREAD);
+        if (arg->replace) {
+            /* move forward, like a zone that needs attention sooner */
+            due -= SCHEDBENCH_SPREAD;
+        }
+        task = schedbench_task(i, due);
+        if (schedule_task(arg->schedule, task, arg->replace, 0)
+            != ODS_STATUS_OK) {
+            task_destroy(task);
+            continue;
+        }
+        arg->count++;
+    }
+    return NULL;
+}
+
+static void*
+schedbench_pop(void* data)
+{
+    struct schedbench_arg* arg = (struct schedbench_arg*) data;
+    task_type* task;
+    time_t last = 0;
+    while ((task = schedule_pop_first_task(arg->schedule)) != NULL) {
+        if (task->due_date < last) {
+            fprintf(stderr, "task popped out of order\n");
+            exit(1);
+        }
+        last = task->due_date;
+        task_destroy(task);
+        arg->count++;
+    }
+    return NULL;
+}
+
+static int
+schedbench_run(schedule_type* schedule, int tasks, int threads, int replace,
+    void* (*run)(void*), const char* what)
+{
+    struct schedbench_arg* args;
+    struct timeval start;
+    double secs;
+    int i, count = 0;
+
+    args = (struct schedbench_arg*) calloc(threads, sizeof(*args));
+    gettimeofday(&start, NULL);
+    for (i = 0; i < threads; i++) {
+        args[i].schedule = schedule;
+        args[i].first = (int) ((long) tasks * i / threads);
+        args[i].last = (int) ((long) tasks * (i + 1) / threads);
+        args[i].replace = replace;
+        pthread_create(&args[i].thread, NULL, run, &args[i]);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(args[i].thread, NULL);
+        count += args[i].count;
+    }
+    secs = bench_elapsed(&start);
+    printf("%-10s %8d tasks %6.2f s %10.0f tasks/s\n", what, count, secs,
+        count / secs);
+    free(args);
+    return count;
+}
+
+int
+main(int argc, char* argv[])
+{
+    schedule_type* schedule;
+    struct timeval start;
+    time_t first;
+    int tasks = SCHEDBENCH_TASKS;
+    int threads = SCHEDBENCH_THREADS;
+    int i, count, pushed, popped;
+    double secs;
+
+    if (argc > 1) {
+        tasks = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        threads = atoi(argv[2]);
+    }
+    if (tasks <= 0 || threads <= 0) {
+        fprintf(stderr, "usage: %s [tasks [threads]]\n", argv[0]);
+        return 1;
+    }
+    ods_log_init("schedbench", 0, NULL, 0);
+    schedbench_types[0] = TASK_TYPE_ENFORCE;
+    schedbench_types[1] = TASK_TYPE_RESALT;
+    schedbench_types[2] = TASK_TYPE_DSSUBMIT;
+    schedbench_types[3] = TASK_TYPE_SIGNCONF;
+    schedbench_now = time_now();
+    schedule = schedule_create();
+
+    pushed = schedbench_run(schedule, tasks, threads, 0, schedbench_push,
+        "schedule");
+    (void) schedbench_run(schedule, tasks/10, threads, 1, schedbench_push,
+        "reschedule");
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < 1000; i++) {
+        schedule_info(schedule, &first, NULL, &count);
+    }
+    secs = bench_elapsed(&start);
+    printf("%-10s %8d calls %6.2f s %10.0f calls/s\n", "info", 1000, secs,
+        1000 / secs);
+    if (count != pushed) {
+        fprintf(stderr, "%d tasks scheduled, expected %d\n", count, pushed);
+        return 1;
+    }
+
+    popped = schedbench_run(schedule, 0, 1, 0, schedbench_pop, "pop");
+    if (popped != pushed) {
+        fprintf(stderr, "%d tasks popped, expected %d\n", popped, pushed);
+        return 1;
+    }
+    (void) schedbench_run(schedule, tasks, threads, 0, schedbench_push,
+        "schedule");
+    schedule_flush(schedule);
+    popped = schedbench_run(schedule, 0, threads, 0, schedbench_pop,
+        "flush+pop");
+    if (popped != pushed) {
+        fprintf(stderr, "%d tasks popped, expected %d\n", popped, pushed);
+        return 1;
+    }
+    schedule_cleanup(schedule);
+    return 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Unit tests of the scheduler: the order of the ready and due heaps,
+ * removing tasks from the middle of a heap, and the handoff between a
+ * throttled worker and the drudgers reporting its subtasks.
+ *
+ */
+
+#include "config.h"
+#include "duration.h"
+#include "log.h"
+#include "scheduler/fifoq.h"
+#include "scheduler/schedule.h"
+#include "scheduler/task.h"
+#include "scheduler/worker.h"
+
+#include "CUnit/Basic.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SCHEDTEST_NOW 1500000000
+#define SCHEDTEST_TASKS 100
+#define SCHEDTEST_SUBTASKS 10
+#define SCHEDTEST_SHARE 8
+
+static schedule_type* schedule = NULL;
+
+static int
+schedtest_init(void)
+{
+    set_time_now(SCHEDTEST_NOW);
+    schedule = schedule_create();
+    return schedule == NULL;
+}
+
+static int
+schedtest_clean(void)
+{
+    schedule_cleanup(schedule);
+    schedule = NULL;
+    set_time_now(0);
+    return 0;
+}
+
+static void
+schedtest_add(const char* owner, time_t due, time_t deadline)
+{
+    task_type* task;
+    task = task_create(strdup(owner), TASK_CLASS_SIGNER, TASK_SIGN, NULL,
+        NULL, NULL, due);
+    task->deadline = deadline;
+    CU_ASSERT_FATAL(schedule_task(schedule, task, 0, 0) == ODS_STATUS_OK);
+}
+
+/**
+ * Check the owner of the task and destroy it.
+ *
+ */
+static void
+schedtest_expect(task_type* task, const char* owner)
+{
+    CU_ASSERT_PTR_NOT_NULL_FATAL(task);
+    CU_ASSERT_STRING_EQUAL(task->owner, owner);
+    task_destroy(task);
+}
+
+/**
+ * Due tasks are taken by deadline, tasks that are not due yet by due
+ * date, whatever their deadline.
+ *
+ */
+static void
+test_schedule_deadline(void)
+{
+    time_t now = SCHEDTEST_NOW;
+    int count;
+
+    schedtest_add("late", now - 30, now + 100);
+    schedtest_add("urgent", now - 10, now + 10);
+    schedtest_add("plain", now - 20, 0);
+    schedtest_add("soon", now + 20, now + 500);
+    schedtest_add("later", now + 40, now + 1);
+
+    schedtest_expect(schedule_pop_task(schedule), "plain");
+    schedtest_expect(schedule_pop_task(schedule), "urgent");
+    schedtest_expect(schedule_pop_task(schedule), "late");
+    CU_ASSERT(!schedule_info(schedule, NULL, NULL, &count));
+    CU_ASSERT_EQUAL(count, 2);
+
+    /* Not due, an early deadline does not get ahead of an earlier due
+     * date. */
+    schedtest_expect(schedule_pop_first_task(schedule), "soon");
+    schedtest_expect(schedule_pop_first_task(schedule), "later");
+    CU_ASSERT_PTR_NULL(schedule_pop_first_task(schedule));
+}
+
+/**
+ * Remove tasks from the middle of the ready heap and of the due heap.
+ * The other tasks still come out by deadline.
+ *
+ */
+static void
+test_schedule_remove(void)
+{
+    time_t now = SCHEDTEST_NOW;
+    char owner[32];
+    int removed[SCHEDTEST_TASKS];
+    time_t deadline, last = 0;
+    task_type* task;
+    int i, n, count;
+
+    memset(removed, 0, sizeof(removed));
+    for (i = 0; i < SCHEDTEST_TASKS; i++) {
+        snprintf(owner, sizeof(owner), "zone%d", i);
+        /* spread the deadlines, unrelated to the due dates */
+        schedtest_add(owner, now - 1 - i, now + (i * 37) % SCHEDTEST_TASKS);
+    }
+    /* all tasks are due, the wheel passed them so they sit in the ready
+     * heap */
+    for (i = 1; i < SCHEDTEST_TASKS; i += 3) {
+        snprintf(owner, sizeof(owner), "zone%d", i);
+        schedule_unscheduletask(schedule, TASK_SIGN, owner);
+        removed[i] = 1;
+    }
+    /* the first pop moves the remaining tasks to the due heap */
+    task = schedule_pop_task(schedule);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(task);
+    last = task->deadline;
+    n = atoi(task->owner + 4);
+    CU_ASSERT(!removed[n]);
+    removed[n] = 1;
+    task_destroy(task);
+    for (i = 2; i < SCHEDTEST_TASKS; i += 3) {
+        if (removed[i]) continue;
+        snprintf(owner, sizeof(owner), "zone%d", i);
+        schedule_unscheduletask(schedule, TASK_SIGN, owner);
+        removed[i] = 1;
+    }
+    CU_ASSERT(!schedule_info(schedule, NULL, NULL, &count));
+    for (i = 0; i < SCHEDTEST_TASKS; i++) {
+        count -= !removed[i];
+    }
+    CU_ASSERT_EQUAL(count, 0);
+
+    while (!schedule_info(schedule, NULL, NULL, &count) && count > 0) {
+        task = schedule_pop_task(schedule);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(task);
+        deadline = task->deadline;
+        CU_ASSERT(deadline >= last);
+        last = deadline;
+        n = atoi(task->owner + 4);
+        CU_ASSERT(!removed[n]);
+        removed[n] = 1;
+        task_destroy(task);
+    }
+    for (i = 0; i < SCHEDTEST_TASKS; i++) {
+        CU_ASSERT(removed[i]);
+    }
+}
+
+struct schedtest_drudger {
+    fifoq_type* q;
+    worker_type* worker;
+    int reports;
+    int failures;
+    int reported;
+};
+
+/**
+ * Report subtasks one by one, slowly enough for the worker to go to
+ * sleep in between.
+ *
+ */
+static void*
+schedtest_report(void* arg)
+{
+    struct schedtest_drudger* drudger = (struct schedtest_drudger*) arg;
+    int i;
+    for (i = 0; i < drudger->reports; i++) {
+        usleep(10000);
+        __atomic_add_fetch(&drudger->reported, 1, __ATOMIC_SEQ_CST);
+        fifoq_report(drudger->q, drudger->worker, i < drudger->failures ?
+            ODS_STATUS_ERR : ODS_STATUS_OK);
+    }
+    return NULL;
+}
+
+/**
+ * A worker that queued more than its share waits until the drudgers
+ * brought it down to half its share, and is woken by the report that
+ * does so. The rest is collected by fifoq_waitfor().
+ *
+ */
+static void
+test_fifoq_waitfor_share(void)
+{
+    struct schedtest_drudger drudger;
+    worker_type worker;
+    pthread_t thread;
+    long failed = -1;
+    int reported;
+
+    memset(&worker, 0, sizeof(worker));
+    pthread_mutex_init(&worker.tasksLock, NULL);
+    pthread_cond_init(&worker.tasksBlocker, NULL);
+    memset(&drudger, 0, sizeof(drudger));
+    drudger.q = schedule->signq;
+    drudger.worker = &worker;
+
+    /* within its share, no waiting */
+    fifoq_waitfor_share(drudger.q, &worker, SCHEDTEST_SHARE, SCHEDTEST_SHARE);
+    CU_ASSERT_EQUAL(worker.tasksWakeup, 0);
+
+    /* over its share, it waits for the report that brings the
+     * outstanding subtasks down to half the share */
+    drudger.reports = SCHEDTEST_SUBTASKS - SCHEDTEST_SHARE / 2;
+    CU_ASSERT_FATAL(!pthread_create(&thread, NULL, schedtest_report,
+        &drudger));
+    fifoq_waitfor_share(drudger.q, &worker, SCHEDTEST_SUBTASKS,
+        SCHEDTEST_SHARE);
+    reported = __atomic_load_n(&drudger.reported, __ATOMIC_SEQ_CST);
+    CU_ASSERT_EQUAL(reported, drudger.reports);
+    CU_ASSERT_EQUAL(worker.tasksWakeup, 0);
+    CU_ASSERT_FATAL(!pthread_join(thread, NULL));
+
+    /* the rest, one of which fails */
+    drudger.reports = SCHEDTEST_SHARE / 2;
+    drudger.failures = 1;
+    drudger.reported = 0;
+    CU_ASSERT_FATAL(!pthread_create(&thread, NULL, schedtest_report,
+        &drudger));
+    fifoq_waitfor(drudger.q, &worker, SCHEDTEST_SUBTASKS, &failed);
+    CU_ASSERT_EQUAL(drudger.reported, drudger.reports);
+    CU_ASSERT_EQUAL(failed, 1);
+    CU_ASSERT_EQUAL(worker.tasksOutstanding, 0);
+    CU_ASSERT_FATAL(!pthread_join(thread, NULL));
+
+    pthread_cond_destroy(&worker.tasksBlocker);
+    pthread_mutex_destroy(&worker.tasksLock);
+}
+
+int
+main(void)
+{
+    CU_pSuite pSuite = NULL;
+
+    ods_log_init("schedtest", 0, NULL, 0);
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite = CU_add_suite("Scheduler", schedtest_init, schedtest_clean);
+    if (!pSuite) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if (!CU_add_test(pSuite, "test of deadline and due date order", test_schedule_deadline)
+        || !CU_add_test(pSuite, "test of removal from the heaps", test_schedule_remove)
+        || !CU_add_test(pSuite, "test of fifoq_waitfor_share", test_fifoq_waitfor_share))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    if (CU_get_number_of_failures()) {
+        CU_cleanup_registry();
+        return 1;
+    }
+    CU_cleanup_registry();
+    return CU_get_error();
+}
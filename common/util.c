@@ -118,6 +118,46 @@ util_dnssec_rrs_compare(ldns_rr* rr1, ldns_rr* rr2, int* cmp)
 }
 
 
+/**
+ * Hash RR only on RDATA.
+ *
+ */
+ldns_status
+util_dnssec_rdata_hash(ldns_rr* rr, uint32_t* hash)
+{
+    ldns_status status = LDNS_STATUS_OK;
+    ldns_buffer* rr_buf;
+    size_t offset = 0;
+    size_t len;
+    uint32_t h = 2166136261U;
+
+    if (!rr) {
+        return LDNS_STATUS_ERR;
+    }
+    rr_buf = ldns_buffer_new(ldns_rr_uncompressed_size(rr));
+    status = ldns_rr2buffer_wire_canonical(rr_buf, rr, LDNS_SECTION_ANY);
+    if (status != LDNS_STATUS_OK) {
+        ldns_buffer_free(rr_buf);
+        return status;
+    }
+    /* skip the owner name, type, class, ttl and rdata length, like
+     * ldns_rr_compare_wire() */
+    len = ldns_buffer_position(rr_buf);
+    while (offset < len && *ldns_buffer_at(rr_buf, offset) != 0) {
+        offset += *ldns_buffer_at(rr_buf, offset) + 1;
+    }
+    offset += 11;
+    /* FNV-1a */
+    for (; offset < len; offset++) {
+        h ^= *ldns_buffer_at(rr_buf, offset);
+        h *= 16777619U;
+    }
+    ldns_buffer_free(rr_buf);
+    *hash = h;
+    return LDNS_STATUS_OK;
+}
+
+
 /**
  * Read process id from file.
  *
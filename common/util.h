@@ -78,6 +78,16 @@ int util_serial_gt(uint32_t serial_new, uint32_t serial_old);
  */
 ldns_status util_dnssec_rrs_compare(ldns_rr* rr1, ldns_rr* rr2, int* cmp);
 
+/**
+ * Hash RR only on RDATA, RRs that util_dnssec_rrs_compare() finds equal
+ * have the same hash.
+ * \param[in] rr RR
+ * \param[out] hash hash value
+ * \return status hash status
+ *
+ */
+ldns_status util_dnssec_rdata_hash(ldns_rr* rr, uint32_t* hash);
+
 /**
  * Check process id file.
  * \param[in] pidfile pid filename
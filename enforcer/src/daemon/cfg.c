@@ -99,6 +99,7 @@ engine_config(const char* cfgfile,
             ecfg->db_username = strdup_or_null(oldcfg->db_username);
             ecfg->db_password = strdup_or_null(oldcfg->db_password);
             ecfg->db_port = oldcfg->db_port;
+            ecfg->db_performance = oldcfg->db_performance;
             ecfg->db_type = oldcfg->db_type;
         } else {
             ecfg->cfg_filename = strdup(cfgfile);
@@ -113,6 +114,7 @@ engine_config(const char* cfgfile,
             ecfg->db_username = parse_conf_db_username(cfgfile);
             ecfg->db_password = parse_conf_db_password(cfgfile);
             ecfg->db_port = parse_conf_db_port(cfgfile);
+            ecfg->db_performance = parse_conf_db_performance(cfgfile);
             ecfg->db_type = parse_conf_db_type(cfgfile);
         }
         /* get values */
@@ -125,6 +127,7 @@ engine_config(const char* cfgfile,
         ecfg->delegation_signer_retract_command = 
             parse_conf_delegation_signer_retract_command(cfgfile);
         ecfg->use_syslog = parse_conf_use_syslog(cfgfile);
+        ecfg->log_async = parse_conf_log_async(cfgfile);
         ecfg->num_worker_threads = parse_conf_worker_threads(cfgfile);
         ecfg->manual_keygen = parse_conf_manual_keygen(cfgfile);
         ecfg->repositories = parse_conf_repositories(cfgfile);
@@ -70,10 +70,12 @@ struct engineconfig_struct {
     const char* db_username; /* Datastore/MySQL/Username */
     const char* db_password; /* Datastore/MySQL/Password */
     int use_syslog;
+    int log_async;
     int num_worker_threads;
     int manual_keygen;
     int verbosity;
     int db_port; /* Datastore/MySQL/Host/@Port */
+    int db_performance; /* Datastore/SQLite/@Profile */
     time_t automatic_keygen_duration;
     time_t rollover_notification;
     hsm_repository_t* repositories;
@@ -297,6 +297,20 @@ setup_database(engine_type* engine)
             return 1;
         }
         dbcfg = NULL;
+        if (engine->config->db_performance) {
+            if (!(dbcfg = db_configuration_new())
+                || db_configuration_set_name(dbcfg, "profile")
+                || db_configuration_set_value(dbcfg, "performance")
+                || db_configuration_list_add(engine->dbcfg_list, dbcfg))
+            {
+                db_configuration_free(dbcfg);
+                db_configuration_list_free(engine->dbcfg_list);
+                engine->dbcfg_list = NULL;
+                fprintf(stderr, "setup configuration profile failed\n");
+                return 1;
+            }
+            dbcfg = NULL;
+        }
     }
     else if (engine->config->db_type == ENFORCER_DATABASE_TYPE_MYSQL) {
         if (!(dbcfg = db_configuration_new())
@@ -535,6 +549,8 @@ engine_setup()
     engine->init_setup_done = 1;
     
     engine->pid = getpid();
+    /* the log writer thread would not survive the fork */
+    ods_log_async(engine->config->log_async);
     ods_log_info("[%s] running as pid %lu", engine_str,
         (unsigned long) engine->pid);
 
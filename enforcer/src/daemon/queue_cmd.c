@@ -35,6 +35,7 @@
 #include "log.h"
 #include "str.h"
 #include "duration.h"
+#include "metrics.h"
 #include "scheduler/schedule.h"
 #include "cmdhandler.h"
 #include "daemon/enforcercommands.h"
@@ -65,18 +66,25 @@ help(int sockfd)
 	);
 }
 
+static void
+printtask(task_type* task, void* arg)
+{
+	int sockfd = *(int*) arg;
+	char* taskdescription;
+	taskdescription = schedule_describetask(task);
+	client_printf(sockfd, "%s", taskdescription);
+	free(taskdescription);
+}
+
 static int
 run(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 {
 	struct tm strtime_struct;
 	char strtime[64]; /* at least 26 according to docs plus a long integer */
-    char* taskdescription;
 	size_t i = 0;
         int count;
 	time_t now;
 	time_t nextFireTime;
-	ldns_rbnode_t* node = LDNS_RBTREE_NULL;
-	task_type* task = NULL;
 	int num_waiting;
         engine_type* engine = getglobalcontext(context);
 	(void)cmd;
@@ -84,7 +92,7 @@ run(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 	ods_log_debug("[%s] list tasks command", module_str);
 
 	ods_log_assert(engine);
-	if (!engine->taskq || !engine->taskq->tasks) {
+	if (!engine->taskq) {
 		client_printf(sockfd, "There are no tasks scheduled.\n");
 		return 0;
 	}
@@ -108,16 +116,7 @@ run(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 	} /* else: no tasks scheduled at all. */
 	
 	/* list tasks */
-	pthread_mutex_lock(&engine->taskq->schedule_lock);
-		node = ldns_rbtree_first(engine->taskq->tasks);
-		while (node && node != LDNS_RBTREE_NULL) {
-			task = (task_type*) node->data;
-			taskdescription = schedule_describetask(task);
-			client_printf(sockfd, "%s", taskdescription);
-                        free(taskdescription);
-			node = ldns_rbtree_next(node);
-		}
-	pthread_mutex_unlock(&engine->taskq->schedule_lock);
+	schedule_walk(engine->taskq, printtask, &sockfd);
 	return 0;
 }
 
@@ -159,3 +158,48 @@ run_flush(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 struct cmd_func_block flush_funcblock = {
 	"flush", &usage_flush, &help_flush, NULL, &run_flush
 };
+
+static void
+usage_metrics(int sockfd)
+{
+	client_printf(sockfd,
+		"metrics\n"
+	);
+}
+
+static void
+help_metrics(int sockfd)
+{
+	client_printf(sockfd,
+		"Show counters and latencies in the Prometheus text format.\n\n");
+}
+
+static int
+run_metrics(int sockfd, cmdhandler_ctx_type* context, char *cmd)
+{
+	engine_type* engine = getglobalcontext(context);
+	time_t first, now;
+	int idle, count;
+	(void)cmd;
+	ods_log_debug("[%s] metrics command", module_str);
+	ods_log_assert(engine);
+
+	metrics_export(sockfd);
+	if (!engine->taskq) {
+		return 0;
+	}
+	now = time_now();
+	schedule_info(engine->taskq, &first, &idle, &count);
+	metrics_export_value(sockfd, "ods_scheduler_tasks",
+		"Tasks in the schedule.", "gauge", count);
+	metrics_export_value(sockfd, "ods_scheduler_idle_workers",
+		"Workers waiting for a task.", "gauge", idle);
+	metrics_export_value(sockfd, "ods_scheduler_overdue_seconds",
+		"How long the first task in the schedule has been due.", "gauge",
+		(first > 0 && first < now) ? (double)(now - first) : 0.0);
+	return 0;
+}
+
+struct cmd_func_block metrics_funcblock = {
+	"metrics", &usage_metrics, &help_metrics, NULL, &run_metrics
+};
@@ -31,5 +31,6 @@
 
 struct cmd_func_block queue_funcblock;
 struct cmd_func_block flush_funcblock;
+struct cmd_func_block metrics_funcblock;
 
 #endif /* _QUEUE_CMD_H_ */
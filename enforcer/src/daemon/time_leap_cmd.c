@@ -136,7 +136,7 @@ run(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 	}
 
 	ods_log_assert(engine);
-	if (!engine->taskq || !engine->taskq->tasks) {
+	if (!engine->taskq) {
 		client_printf(sockfd, "There are no tasks scheduled.\n");
 		return 1;
 	}
@@ -186,6 +186,39 @@ int db_backend_handle_count(const db_backend_handle_t* backend_handle, const db_
     return backend_handle->count_function((void*)backend_handle->data, object, join_list, clause_list, count);
 }
 
+int db_backend_handle_transaction_begin(const db_backend_handle_t* backend_handle) {
+    if (!backend_handle) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!backend_handle->transaction_begin_function) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return backend_handle->transaction_begin_function((void*)backend_handle->data);
+}
+
+int db_backend_handle_transaction_commit(const db_backend_handle_t* backend_handle) {
+    if (!backend_handle) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!backend_handle->transaction_commit_function) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return backend_handle->transaction_commit_function((void*)backend_handle->data);
+}
+
+int db_backend_handle_transaction_rollback(const db_backend_handle_t* backend_handle) {
+    if (!backend_handle) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!backend_handle->transaction_rollback_function) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return backend_handle->transaction_rollback_function((void*)backend_handle->data);
+}
+
 int db_backend_handle_set_initialize(db_backend_handle_t* backend_handle, db_backend_handle_initialize_t initialize_function) {
     if (!backend_handle) {
         return DB_ERROR_UNKNOWN;
@@ -498,6 +531,39 @@ int db_backend_count(const db_backend_t* backend, const db_object_t* object, con
     return db_backend_handle_count(backend->handle, object, join_list, clause_list, count);
 }
 
+int db_backend_transaction_begin(const db_backend_t* backend) {
+    if (!backend) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!backend->handle) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return db_backend_handle_transaction_begin(backend->handle);
+}
+
+int db_backend_transaction_commit(const db_backend_t* backend) {
+    if (!backend) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!backend->handle) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return db_backend_handle_transaction_commit(backend->handle);
+}
+
+int db_backend_transaction_rollback(const db_backend_t* backend) {
+    if (!backend) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!backend->handle) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return db_backend_handle_transaction_rollback(backend->handle);
+}
+
 /* DB BACKEND FACTORY */
 
 db_backend_t* db_backend_factory_get_backend(const char* name) {
@@ -69,8 +69,37 @@ typedef struct db_backend_sqlite {
     int timeout;
     int time;
     long usleep;
+    int performance;
+    int checkpointer;
 } db_backend_sqlite_t;
 
+/**
+ * The background checkpointer for databases opened with the performance
+ * profile.
+ *
+ * In WAL mode SQLite normally checkpoints at the end of the commit that
+ * grows the WAL past its limit, in the thread of the writer. Instead the
+ * writers wake up this thread, which runs a passive checkpoint on its own
+ * connection. A passive checkpoint never waits for readers or writers.
+ * There is one checkpointer per process, for the database file of the
+ * first connection that uses it; `control` serializes starting and
+ * stopping it.
+ */
+static struct {
+    pthread_mutex_t control;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int users;
+    int wakeup;
+    int stop;
+    char* file;
+} __sqlite_checkpointer = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER
+};
+
 
 
 /**
@@ -136,6 +165,128 @@ static int __db_backend_sqlite_busy_handler(void *data, int retry) {
     return 1;
 }
 
+/**
+ * The checkpointer thread.
+ */
+static void* __db_backend_sqlite_checkpointer(void* arg) {
+    sqlite3* db = NULL;
+    struct timespec ts;
+    int log = 0, checkpointed = 0;
+    int ret;
+    (void)arg;
+
+    if (sqlite3_open_v2(__sqlite_checkpointer.file, &db,
+        SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX, NULL) != SQLITE_OK)
+    {
+        ods_log_error("db_backend_sqlite: checkpointer unable to open %s",
+            __sqlite_checkpointer.file);
+        sqlite3_close(db);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&__sqlite_checkpointer.lock);
+    while (!__sqlite_checkpointer.stop) {
+        if (!__sqlite_checkpointer.wakeup) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += DB_BACKEND_SQLITE_CHECKPOINT_INTERVAL;
+            (void)pthread_cond_timedwait(&__sqlite_checkpointer.cond,
+                &__sqlite_checkpointer.lock, &ts);
+            if (__sqlite_checkpointer.stop) {
+                break;
+            }
+        }
+        __sqlite_checkpointer.wakeup = 0;
+        pthread_mutex_unlock(&__sqlite_checkpointer.lock);
+
+        ret = sqlite3_wal_checkpoint_v2(db, NULL, SQLITE_CHECKPOINT_PASSIVE,
+            &log, &checkpointed);
+        if (ret != SQLITE_OK && ret != SQLITE_BUSY) {
+            ods_log_error("db_backend_sqlite: checkpoint error %d", ret);
+        } else {
+            ods_log_deeebug("db_backend_sqlite: checkpointed %d of %d WAL "
+                "pages", checkpointed, log);
+        }
+
+        pthread_mutex_lock(&__sqlite_checkpointer.lock);
+    }
+    pthread_mutex_unlock(&__sqlite_checkpointer.lock);
+    sqlite3_close(db);
+    return NULL;
+}
+
+/**
+ * Register a connection to `file` with the checkpointer, starting it for
+ * the first one. `registered` is set to 0 if the checkpointer already runs
+ * for another file, in which case SQLite checkpoints this one itself.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+static int __db_backend_sqlite_checkpointer_start(const char* file, int* registered) {
+    int ret = DB_OK;
+
+    *registered = 0;
+
+    pthread_mutex_lock(&__sqlite_checkpointer.control);
+    if (!__sqlite_checkpointer.users) {
+        if (!(__sqlite_checkpointer.file = strdup(file))) {
+            ret = DB_ERROR_UNKNOWN;
+        } else {
+            __sqlite_checkpointer.stop = 0;
+            __sqlite_checkpointer.wakeup = 0;
+            if (pthread_create(&__sqlite_checkpointer.thread, NULL,
+                __db_backend_sqlite_checkpointer, NULL))
+            {
+                ods_log_error("db_backend_sqlite: unable to start the "
+                    "checkpointer");
+                free(__sqlite_checkpointer.file);
+                __sqlite_checkpointer.file = NULL;
+                ret = DB_ERROR_UNKNOWN;
+            }
+        }
+    }
+    if (ret == DB_OK && !strcmp(__sqlite_checkpointer.file, file)) {
+        __sqlite_checkpointer.users++;
+        *registered = 1;
+    }
+    pthread_mutex_unlock(&__sqlite_checkpointer.control);
+    return ret;
+}
+
+/**
+ * Unregister a connection from the checkpointer, stopping it after the
+ * last one.
+ */
+static void __db_backend_sqlite_checkpointer_stop(void) {
+    pthread_mutex_lock(&__sqlite_checkpointer.control);
+    if (__sqlite_checkpointer.users && !--__sqlite_checkpointer.users) {
+        pthread_mutex_lock(&__sqlite_checkpointer.lock);
+        __sqlite_checkpointer.stop = 1;
+        pthread_cond_signal(&__sqlite_checkpointer.cond);
+        pthread_mutex_unlock(&__sqlite_checkpointer.lock);
+        pthread_join(__sqlite_checkpointer.thread, NULL);
+        free(__sqlite_checkpointer.file);
+        __sqlite_checkpointer.file = NULL;
+    }
+    pthread_mutex_unlock(&__sqlite_checkpointer.control);
+}
+
+/**
+ * The WAL hook, called after each commit with the size of the WAL. Replaces
+ * the automatic checkpoint of SQLite.
+ */
+static int __db_backend_sqlite_wal_hook(void* data, sqlite3* db, const char* name, int pages) {
+    (void)data;
+    (void)db;
+    (void)name;
+
+    if (pages >= DB_BACKEND_SQLITE_CHECKPOINT_PAGES) {
+        pthread_mutex_lock(&__sqlite_checkpointer.lock);
+        __sqlite_checkpointer.wakeup = 1;
+        pthread_cond_signal(&__sqlite_checkpointer.cond);
+        pthread_mutex_unlock(&__sqlite_checkpointer.lock);
+    }
+    return SQLITE_OK;
+}
+
 /**
  * SQLite prepare function.
  */
@@ -284,11 +435,51 @@ static int db_backend_sqlite_shutdown(void* data) {
     return DB_OK;
 }
 
+/**
+ * Apply the performance profile to a new connection: switch the database
+ * to WAL journal mode, in which readers and the writer no longer block each
+ * other, and enlarge the page cache and memory map. With WAL only the
+ * checkpoint syncs, so synchronous NORMAL keeps the database consistent.
+ */
+static int __db_backend_sqlite_performance(db_backend_sqlite_t* backend_sqlite) {
+    static const char* wal = "PRAGMA journal_mode=WAL";
+    sqlite3_stmt* statement = NULL;
+    const char* mode;
+    char sql[256];
+    char* errmsg = NULL;
+
+    if (__db_backend_sqlite_prepare(backend_sqlite, &statement, wal, strlen(wal))) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_ROW
+        || !(mode = (const char*)sqlite3_column_text(statement, 0))
+        || strcasecmp(mode, "wal"))
+    {
+        ods_log_error("db_backend_sqlite: unable to enable WAL journal mode");
+        __db_backend_sqlite_finalize(statement);
+        return DB_ERROR_UNKNOWN;
+    }
+    __db_backend_sqlite_finalize(statement);
+
+    (void)snprintf(sql, sizeof(sql), "PRAGMA synchronous=NORMAL; "
+        "PRAGMA cache_size=%d; PRAGMA mmap_size=%d",
+        DB_BACKEND_SQLITE_PERFORMANCE_CACHE_SIZE,
+        DB_BACKEND_SQLITE_PERFORMANCE_MMAP_SIZE);
+    if (sqlite3_exec(backend_sqlite->db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
+        ods_log_error("db_backend_sqlite: %s: %s", sql, errmsg ? errmsg : "error");
+        sqlite3_free(errmsg);
+        return DB_ERROR_UNKNOWN;
+    }
+    return DB_OK;
+}
+
 static int db_backend_sqlite_connect(void* data, const db_configuration_list_t* configuration_list) {
     db_backend_sqlite_t* backend_sqlite = (db_backend_sqlite_t*)data;
     const db_configuration_t* file;
     const db_configuration_t* timeout;
     const db_configuration_t* usleep;
+    const db_configuration_t* profile;
+    int registered;
     int ret;
 
     if (!__sqlite3_initialized) {
@@ -324,6 +515,11 @@ static int db_backend_sqlite_connect(void* data, const db_configuration_list_t*
         }
     }
 
+    backend_sqlite->performance = 0;
+    if ((profile = db_configuration_list_find(configuration_list, "profile"))) {
+        backend_sqlite->performance = !strcmp(db_configuration_value(profile), "performance");
+    }
+
     ret = sqlite3_open_v2(
         db_configuration_value(file),
         &(backend_sqlite->db),
@@ -340,6 +536,19 @@ static int db_backend_sqlite_connect(void* data, const db_configuration_list_t*
         backend_sqlite->db = NULL;
         return DB_ERROR_UNKNOWN;
     }
+    if (backend_sqlite->performance) {
+        if (__db_backend_sqlite_performance(backend_sqlite)
+            || __db_backend_sqlite_checkpointer_start(db_configuration_value(file), &registered))
+        {
+            sqlite3_close(backend_sqlite->db);
+            backend_sqlite->db = NULL;
+            return DB_ERROR_UNKNOWN;
+        }
+        if (registered) {
+            (void)sqlite3_wal_hook(backend_sqlite->db, __db_backend_sqlite_wal_hook, NULL);
+            backend_sqlite->checkpointer = 1;
+        }
+    }
     /*
      * Enable This line to log complete queries to stdout.
      * sqlite3_trace(backend_sqlite->db, printf, "SQL: %s\n");
@@ -370,6 +579,10 @@ static int db_backend_sqlite_disconnect(void* data) {
         return DB_ERROR_UNKNOWN;
     }
     backend_sqlite->db = NULL;
+    if (backend_sqlite->checkpointer) {
+        __db_backend_sqlite_checkpointer_stop();
+        backend_sqlite->checkpointer = 0;
+    }
     return DB_OK;
 }
 
@@ -35,6 +35,16 @@
 #define DB_BACKEND_SQLITE_DEFAULT_TIMEOUT 30
 #define DB_BACKEND_SQLITE_DEFAULT_USLEEP 200000
 
+/*
+ * The performance profile: WAL journal mode, page cache size (negative is
+ * in KiB), memory mapped I/O size, and when and how often the background
+ * checkpointer copies the WAL back into the database.
+ */
+#define DB_BACKEND_SQLITE_PERFORMANCE_CACHE_SIZE -16384
+#define DB_BACKEND_SQLITE_PERFORMANCE_MMAP_SIZE 268435456
+#define DB_BACKEND_SQLITE_CHECKPOINT_PAGES 1000
+#define DB_BACKEND_SQLITE_CHECKPOINT_INTERVAL 10
+
 /**
  * Create a new database backend handle for SQLite.
  * \return a db_backend_handle_t pointer or NULL on error.
@@ -32,6 +32,7 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 
 
 
@@ -194,3 +195,52 @@ int db_connection_count(const db_connection_t* connection, const db_object_t* ob
 
     return db_backend_count(connection->backend, object, join_list, clause_list, count);
 }
+
+int db_connection_transaction_begin(const db_connection_t* connection) {
+    if (!connection) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!connection->backend) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return db_backend_transaction_begin(connection->backend);
+}
+
+int db_connection_transaction_commit(const db_connection_t* connection) {
+    if (!connection) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!connection->backend) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return db_backend_transaction_commit(connection->backend);
+}
+
+int db_connection_transaction_rollback(const db_connection_t* connection) {
+    if (!connection) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!connection->backend) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    return db_backend_transaction_rollback(connection->backend);
+}
+
+int db_connection_snapshot_reads(const db_connection_t* connection) {
+    const db_configuration_t* profile;
+
+    if (!connection) {
+        return 0;
+    }
+    if (!connection->configuration_list) {
+        return 0;
+    }
+    if (!(profile = db_configuration_list_find(connection->configuration_list, "profile"))) {
+        return 0;
+    }
+
+    return !strcmp(db_configuration_value(profile), "performance");
+}
@@ -139,4 +139,34 @@ int db_connection_delete(const db_connection_t* connection, const db_object_t* o
  */
 int db_connection_count(const db_connection_t* connection, const db_object_t* object, const db_join_list_t* join_list, const db_clause_list_t* clause_list, size_t* count);
 
+/**
+ * Begin a transaction in the database.
+ * \param[in] connection a db_connection_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_connection_transaction_begin(const db_connection_t* connection);
+
+/**
+ * Commit the current transaction in the database.
+ * \param[in] connection a db_connection_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_connection_transaction_commit(const db_connection_t* connection);
+
+/**
+ * Roll back the current transaction in the database.
+ * \param[in] connection a db_connection_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_connection_transaction_rollback(const db_connection_t* connection);
+
+/**
+ * Check if reads on this connection run against a snapshot of the database
+ * and never wait for a writer on another connection, which is the case for
+ * an SQLite database with the performance profile (WAL journal mode).
+ * \param[in] connection a db_connection_t pointer.
+ * \return 1 if reads do not wait for writers, otherwise 0.
+ */
+int db_connection_snapshot_reads(const db_connection_t* connection);
+
 #endif
@@ -61,7 +61,7 @@ const char* db_schema_mysql_create[] = {
     0,
     "CREATE TABLE policy ( id BIGINT UNSIGNED PRIMARY KEY AUTO_INCREMENT NOT NULL,  rev INT UNSIGNED NOT NULL DEFAULT 1,  name TEXT NOT NULL,  description TEXT NOT NULL,  signaturesResign INT UNSIGNED NOT NULL,  signaturesRefresh INT UNSIGNED NOT NULL,  signaturesJitter INT UNSIGNED NOT NULL,  signaturesInceptionOffset INT UNSIGNED NOT NULL,  signaturesValidityDefault INT UNSIGNED NOT NULL,  signaturesValidityDenial INT UNSIGNED NOT NULL,  signaturesValidityKeyset INT UNSIGNED,  signaturesMaxZoneTtl INT UNSIGNED NOT NULL,  denialType INT N",
     "OT NULL,  denialOptout INT UNSIGNED NOT NULL,  denialTtl INT UNSIGNED NOT NULL,  denialResalt INT UNSIGNED NOT NULL,  denialAlgorithm INT UNSIGNED NOT NULL,  denialIterations INT UNSIGNED NOT NULL,  denialSaltLength INT UNSIGNED NOT NULL,  denialSalt TEXT NOT NULL,  denialSaltLastChange INT UNSIGNED NOT NULL,  keysTtl INT UNSIGNED NOT NULL,  keysRetireSafety INT UNSIGNED NOT NULL,  keysPublishSafety INT UNSIGNED NOT NULL,  keysShared INT UNSIGNED NOT NULL,  keysPurgeAfter INT UNSIGNED NOT NULL, ",
-    " zonePropagationDelay INT UNSIGNED NOT NULL,  zoneSoaTtl INT UNSIGNED NOT NULL,  zoneSoaMinimum INT UNSIGNED NOT NULL,  zoneSoaSerial INT NOT NULL,  parentRegistrationDelay INT UNSIGNED NOT NULL,  parentPropagationDelay INT UNSIGNED NOT NULL,  parentDsTtl INT UNSIGNED NOT NULL,  parentSoaTtl INT UNSIGNED NOT NULL,  parentSoaMinimum INT UNSIGNED NOT NULL,  passthrough INT UNSIGNED NOT NULL)",
+    " zonePropagationDelay INT UNSIGNED NOT NULL,  zoneSoaTtl INT UNSIGNED NOT NULL,  zoneSoaMinimum INT UNSIGNED NOT NULL,  zoneSoaSerial INT NOT NULL,  parentRegistrationDelay INT UNSIGNED NOT NULL,  parentPropagationDelay INT UNSIGNED NOT NULL,  parentDsTtl INT UNSIGNED NOT NULL,  parentSoaTtl INT UNSIGNED NOT NULL,  parentSoaMinimum INT UNSIGNED NOT NULL,  passthrough INT UNSIGNED NOT NULL,  slabStore INT UNSIGNED NOT NULL DEFAULT 0)",
     0,
     "CREATE UNIQUE INDEX policyName ON policy ( name(255) )",
     0,
@@ -61,7 +61,7 @@ const char* db_schema_sqlite_create[] = {
     0,
     "CREATE TABLE policy ( id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,  rev INTEGER NOT NULL DEFAULT 1,  name TEXT NOT NULL,  description TEXT NOT NULL,  signaturesResign UNSIGNED INT NOT NULL,  signaturesRefresh UNSIGNED INT NOT NULL,  signaturesJitter UNSIGNED INT NOT NULL,  signaturesInceptionOffset UNSIGNED INT NOT NULL,  signaturesValidityDefault UNSIGNED INT NOT NULL,  signaturesValidityDenial UNSIGNED INT NOT NULL,  signaturesValidityKeyset UNSIGNED INT,  signaturesMaxZoneTtl UNSIGNED INT NOT NULL,  denialType INT NOT NULL,  deni",
     "alOptout UNSIGNED INT NOT NULL,  denialTtl UNSIGNED INT NOT NULL,  denialResalt UNSIGNED INT NOT NULL,  denialAlgorithm UNSIGNED INT NOT NULL,  denialIterations UNSIGNED INT NOT NULL,  denialSaltLength UNSIGNED INT NOT NULL,  denialSalt TEXT NOT NULL,  denialSaltLastChange UNSIGNED INT NOT NULL,  keysTtl UNSIGNED INT NOT NULL,  keysRetireSafety UNSIGNED INT NOT NULL,  keysPublishSafety UNSIGNED INT NOT NULL,  keysShared UNSIGNED INT NOT NULL,  keysPurgeAfter UNSIGNED INT NOT NULL,  zonePropagati",
-    "onDelay UNSIGNED INT NOT NULL,  zoneSoaTtl UNSIGNED INT NOT NULL,  zoneSoaMinimum UNSIGNED INT NOT NULL,  zoneSoaSerial INT NOT NULL,  parentRegistrationDelay UNSIGNED INT NOT NULL,  parentPropagationDelay UNSIGNED INT NOT NULL,  parentDsTtl UNSIGNED INT NOT NULL,  parentSoaTtl UNSIGNED INT NOT NULL,  parentSoaMinimum UNSIGNED INT NOT NULL,  passthrough UNSIGNED INT NOT NULL)",
+    "onDelay UNSIGNED INT NOT NULL,  zoneSoaTtl UNSIGNED INT NOT NULL,  zoneSoaMinimum UNSIGNED INT NOT NULL,  zoneSoaSerial INT NOT NULL,  parentRegistrationDelay UNSIGNED INT NOT NULL,  parentPropagationDelay UNSIGNED INT NOT NULL,  parentDsTtl UNSIGNED INT NOT NULL,  parentSoaTtl UNSIGNED INT NOT NULL,  parentSoaMinimum UNSIGNED INT NOT NULL,  passthrough UNSIGNED INT NOT NULL,  slabStore UNSIGNED INT NOT NULL DEFAULT 0)",
     0,
     "CREATE UNIQUE INDEX policyName ON policy ( name )",
     0,
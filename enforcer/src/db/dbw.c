@@ -1,9 +1,11 @@
+#include <stdint.h>
 #include <string.h>
 #include <pthread.h>
 
 #include "config.h"
 
 #include "log.h"
+#include "metrics.h"
 #include "db/zone_db.h"
 #include "db/policy.h"
 #include "db/db_connection.h"
@@ -11,6 +13,21 @@
 #include "db/dbw.h"
 
 static pthread_rwlock_t db_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_once_t dbw_metrics_once = PTHREAD_ONCE_INIT;
+static metrics_type* dbw_fetch_latency = NULL;
+static metrics_type* dbw_commit_latency = NULL;
+static metrics_type* dbw_commit_failures = NULL;
+
+static void
+dbw_metrics_init(void)
+{
+    dbw_fetch_latency = metrics_histogram("ods_db_fetch_seconds",
+        "Time to read the database into memory.", NULL, NULL);
+    dbw_commit_latency = metrics_histogram("ods_db_commit_seconds",
+        "Time to write changes back to the database.", NULL, NULL);
+    dbw_commit_failures = metrics_counter("ods_db_commit_failures_total",
+        "Commits that failed, including those on stale records.", NULL, NULL);
+}
 
 const char *
 dbw_enum2txt(const char *c[], int n)
@@ -28,19 +45,112 @@ dbw_txt2enum(const char *c[], const char *txt)
     return -1;
 }
 
+/**
+ * Strings of fetched rows are kept in an arena owned by the dbw_db, so that
+ * they are allocated in a few blocks and released at once by dbw_free().
+ * Blocks double in size, which keeps the number of blocks to walk for
+ * dbw_arena_owns() small.
+ *
+ */
+#define DBW_ARENA_BLOCK 4096
+
+struct dbw_arena_block {
+    struct dbw_arena_block *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct dbw_arena {
+    struct dbw_arena_block *blocks;
+};
+
+static struct dbw_arena *
+dbw_arena_new(void)
+{
+    return calloc(1, sizeof (struct dbw_arena));
+}
+
+static void
+dbw_arena_free(struct dbw_arena *arena)
+{
+    struct dbw_arena_block *block, *next;
+    if (!arena) return;
+    for (block = arena->blocks; block; block = next) {
+        next = block->next;
+        free(block);
+    }
+    free(arena);
+}
+
+static char *
+dbw_arena_strdup(struct dbw_arena *arena, const char *str)
+{
+    struct dbw_arena_block *block = arena->blocks;
+    size_t len = strlen(str) + 1;
+    size_t size;
+    char *copy;
+
+    if (!block || block->size - block->used < len) {
+        size = block ? block->size * 2 : DBW_ARENA_BLOCK;
+        while (size < len) size *= 2;
+        if (!(block = malloc(sizeof (struct dbw_arena_block) + size))) {
+            return NULL;
+        }
+        block->next = arena->blocks;
+        block->size = size;
+        block->used = 0;
+        arena->blocks = block;
+    }
+    copy = block->data + block->used;
+    memcpy(copy, str, len);
+    block->used += len;
+    return copy;
+}
+
+static int
+dbw_arena_owns(const struct dbw_arena *arena, const char *str)
+{
+    const struct dbw_arena_block *block;
+    uintptr_t p = (uintptr_t)str;
+    if (!arena || !str) return 0;
+    for (block = arena->blocks; block; block = block->next) {
+        if (p >= (uintptr_t)block->data &&
+            p < (uintptr_t)block->data + block->size)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** Free a string of a row unless it lives in the arena. */
+static void
+dbw_string_free(const struct dbw_arena *arena, char *str)
+{
+    if (!dbw_arena_owns(arena, str)) free(str);
+}
+
+void
+dbw_replace_string(struct dbw_db *db, char **field, char *str)
+{
+    dbw_string_free(db->arena, *field);
+    *field = str;
+}
+
 static void
 dbw_list_free(struct dbw_list *dbw_list)
 {
     if (!dbw_list) return;
     for (size_t i = 0; i < dbw_list->n; i++) {
-        dbw_list->free(dbw_list->set[i]);
+        dbw_list->free(dbw_list->set[i], dbw_list->arena);
     }
     free(dbw_list->set);
     free(dbw_list);
 }
 
 static void
-dbw_policy_free(struct dbrow *row)
+dbw_policy_free(struct dbrow *row, struct dbw_arena *arena)
 {
     struct dbw_policy *policy = (struct dbw_policy *)row;
     if (!policy) return;
@@ -49,42 +159,49 @@ dbw_policy_free(struct dbrow *row)
     free(policy->hsmkey);
     free(policy->zone);
 
-    free(policy->name);
-    free(policy->description);
-    free(policy->denial_salt);
+    dbw_string_free(arena, policy->name);
+    dbw_string_free(arena, policy->description);
+    dbw_string_free(arena, policy->denial_salt);
     free(policy);
 }
 
 static void
-dbw_policykey_free(struct dbrow *row)
+dbw_policykey_free(struct dbrow *row, struct dbw_arena *arena)
 {
     struct dbw_policykey *policykey = (struct dbw_policykey *)row;
     if (!policykey) return;
-    free(policykey->repository);
+    dbw_string_free(arena, policykey->repository);
     free(policykey);
 }
 
-void
-dbw_zone_free(struct dbrow *row)
+static void
+dbw_zone_release(struct dbrow *row, struct dbw_arena *arena)
 {
     struct dbw_zone *zone = (struct dbw_zone *)row;
     if (!zone) return;
     free(zone->key);
     free(zone->keydependency);
 
-    free(zone->name);
-    free(zone->signconf_path);
-    free(zone->input_adapter_uri);
-    free(zone->input_adapter_type);
-    free(zone->output_adapter_uri);
-    free(zone->output_adapter_type);
+    dbw_string_free(arena, zone->name);
+    dbw_string_free(arena, zone->signconf_path);
+    dbw_string_free(arena, zone->input_adapter_uri);
+    dbw_string_free(arena, zone->input_adapter_type);
+    dbw_string_free(arena, zone->output_adapter_uri);
+    dbw_string_free(arena, zone->output_adapter_type);
     free(zone);
 }
 
+void
+dbw_zone_free(struct dbrow *row)
+{
+    dbw_zone_release(row, NULL);
+}
+
 static void
-dbw_key_free(struct dbrow *row)
+dbw_key_free(struct dbrow *row, struct dbw_arena *arena)
 {
     struct dbw_key *key = (struct dbw_key *)row;
+    (void)arena;
     if (!key) return;
     free(key->keystate);
     free(key->from_keydependency);
@@ -94,32 +211,34 @@ dbw_key_free(struct dbrow *row)
 }
 
 static void
-dbw_keystate_free(struct dbrow *row)
+dbw_keystate_free(struct dbrow *row, struct dbw_arena *arena)
 {
     struct dbw_keystate *keystate = (struct dbw_keystate *)row;
+    (void)arena;
     if (!keystate) return;
 
     free(keystate);
 }
 
 static void
-dbw_keydependency_free(struct dbrow *row)
+dbw_keydependency_free(struct dbrow *row, struct dbw_arena *arena)
 {
     struct dbw_keydependency *keydependency = (struct dbw_keydependency *)row;
+    (void)arena;
     if (!keydependency) return;
 
     free(keydependency);
 }
 
 static void
-dbw_hsmkey_free(struct dbrow *row)
+dbw_hsmkey_free(struct dbrow *row, struct dbw_arena *arena)
 {
     struct dbw_hsmkey *hsmkey = (struct dbw_hsmkey *)row;
     if (!hsmkey) return;
     free(hsmkey->key);
 
-    free(hsmkey->locator);
-    free(hsmkey->repository);
+    dbw_string_free(arena, hsmkey->locator);
+    dbw_string_free(arena, hsmkey->repository);
     free(hsmkey);
 }
 
@@ -243,6 +362,7 @@ dbw_policy_update(const db_connection_t *dbconn, struct dbrow *row)
         return 1;
     }
     dbx_obj->passthrough                    = policy->passthrough;
+    dbx_obj->slab_store                     = policy->slab_store;
     dbx_obj->signatures_resign              = policy->signatures_resign;
     dbx_obj->signatures_refresh             = policy->signatures_refresh;
     dbx_obj->signatures_jitter              = policy->signatures_jitter;
@@ -608,43 +728,34 @@ dbw_hsmkey_update(const db_connection_t *dbconn, struct dbrow *row)
     return r;
 }
 
-#define GT(x)   ((x)>0)
-#define LTE(x)   ((x)<=0)
 /**
- * cmp -,0,+: lt, eq, gt
+ * Comparators for qsort() on an array of rows. The lists come out of the
+ * database mostly sorted already, which a naive quicksort handles in
+ * quadratic time.
  */
-static void
-quicksort(struct dbrow **row, int first, int last,
-    int (*cmp)(struct dbrow*, struct dbrow*))
-{
-    /** not very efficient for already sorted lists! */
-    int pivot, j, i;
-    struct dbrow *temp;
-    if(first >= last) return;
-    pivot = i = first;
-    j = last;
-    while (i < j) {
-        while (i < last && LTE(cmp(row[i], row[pivot]))) i++;
-        while (GT(cmp(row[j], row[pivot]))) j--;
-        if (i < j) {
-            temp = row[i];
-            row[i] = row[j];
-            row[j] = temp;
-        }
-    }
-    temp = row[pivot];
-    row[pivot] = row[j];
-    row[j] = temp;
-    quicksort(row, first, j-1, cmp);
-    quicksort(row, j+1, last, cmp);
+static int
+cmp_id(const void *l, const void *r)
+{
+    return (*(struct dbrow * const *)l)->id - (*(struct dbrow * const *)r)->id;
 }
-static int cmp_id(struct dbrow *l, struct dbrow *r) { return l->id - r->id; }
-static int cmp_int0(struct dbrow *l, struct dbrow *r) { return l->int0 - r->int0; }
-static int cmp_int1(struct dbrow *l, struct dbrow *r) { return l->int1 - r->int1; }
-static int cmp_int2(struct dbrow *l, struct dbrow *r) { return l->int2 - r->int2; }
-static void sort_list(struct dbw_list *list, int (*cmp)(struct dbrow*, struct dbrow*))
+static int
+cmp_int0(const void *l, const void *r)
+{
+    return (*(struct dbrow * const *)l)->int0 - (*(struct dbrow * const *)r)->int0;
+}
+static int
+cmp_int1(const void *l, const void *r)
 {
-    quicksort(list->set, 0, list->n-1, cmp);
+    return (*(struct dbrow * const *)l)->int1 - (*(struct dbrow * const *)r)->int1;
+}
+static int
+cmp_int2(const void *l, const void *r)
+{
+    return (*(struct dbrow * const *)l)->int2 - (*(struct dbrow * const *)r)->int2;
+}
+static void sort_list(struct dbw_list *list, int (*cmp)(const void *, const void *))
+{
+    if (list->n > 1) qsort(list->set, list->n, sizeof (struct dbrow *), cmp);
 }
 static void sort_list_by_parent_id(struct dbw_list *list, int pidx)
 {
@@ -659,7 +770,7 @@ static void sort_list_by_parent_id(struct dbw_list *list, int pidx)
 static void
 sort_by_id(struct dbw_list *list)
 {
-    quicksort(list->set, 0, list->n-1, cmp_id);
+    sort_list(list, cmp_id);
 }
 
 
@@ -743,233 +854,243 @@ static void merge_kf_dp(struct dbw_list *l, struct dbw_list *r) { merge(l, 3, r,
 static void merge_kt_dp(struct dbw_list *l, struct dbw_list *r) { merge(l, 4, r, 2); }
 
 /**
- *  DBX to DBW conversions
+ *  Row decoding
+ *
+ *  Rows are decoded straight from the values the backend returns for each
+ *  row, in the column order of the dbx object. Strings are copied into the
+ *  arena of the fetch.
  *
  */
 
-static struct dbw_zone *
-zone_dbx_to_dbw(const zone_db_t *dbx_item)
+static int
+dbw_column_int(const db_value_set_t *values, size_t at)
+{
+    const struct db_value *val = db_value_set_at(values, at);
+    if (!val) return 0;
+    switch (val->type) {
+        case DB_TYPE_INT32:  return (int)val->int32;
+        case DB_TYPE_UINT32: return (int)val->uint32;
+        case DB_TYPE_INT64:  return (int)val->int64;
+        case DB_TYPE_UINT64: return (int)val->uint64;
+        case DB_TYPE_ENUM:   return val->enum_value;
+        default: return 0;
+    }
+}
+
+static unsigned int
+dbw_column_uint(const db_value_set_t *values, size_t at)
+{
+    return (unsigned int)dbw_column_int(values, at);
+}
+
+static char *
+dbw_column_text(const db_value_set_t *values, size_t at,
+    struct dbw_arena *arena)
+{
+    const char *text = db_value_text(db_value_set_at(values, at));
+    if (!text) return NULL;
+    return dbw_arena_strdup(arena, text);
+}
+
+static struct dbrow *
+zone_decode(const db_value_set_t *values, struct dbw_arena *arena)
 {
     struct dbw_zone *row = calloc(1, sizeof (struct dbw_zone));
     if (!row) return NULL;
 
-    row->id                  = dbxvalue2int(&dbx_item->id);
-    row->revision            = dbxvalue2int(&dbx_item->rev);
-    row->policy_id           = dbxvalue2int(&dbx_item->policy_id);
-    row->policy              = NULL;
-
-    row->name                = strdup(dbx_item->name);
-    row->next_change         = (time_t)dbx_item->next_change;
-    row->signconf_needs_writing = dbx_item->signconf_needs_writing;
-    row->signconf_path       = strdup(dbx_item->signconf_path);
-    row->input_adapter_uri   = strdup(dbx_item->input_adapter_uri);
-    row->input_adapter_type  = strdup(dbx_item->input_adapter_type);
-    row->output_adapter_uri  = strdup(dbx_item->output_adapter_uri);
-    row->output_adapter_type = strdup(dbx_item->output_adapter_type);
-    row->next_ksk_roll       = dbx_item->next_ksk_roll;
-    row->next_zsk_roll       = dbx_item->next_zsk_roll;
-    row->next_csk_roll       = dbx_item->next_csk_roll;
-    row->ttl_end_ds          = dbx_item->ttl_end_ds;
-    row->ttl_end_dk          = dbx_item->ttl_end_dk;
-    row->ttl_end_rs          = dbx_item->ttl_end_rs;
-    row->roll_ksk_now        = dbx_item->roll_ksk_now;
-    row->roll_zsk_now        = dbx_item->roll_zsk_now;
-    row->roll_csk_now        = dbx_item->roll_csk_now;
+    row->id                  = dbw_column_int(values, 0);
+    row->revision            = dbw_column_int(values, 1);
+    row->policy_id           = dbw_column_int(values, 2);
+    row->name                = dbw_column_text(values, 3, arena);
+    row->signconf_needs_writing = dbw_column_uint(values, 4);
+    row->signconf_path       = dbw_column_text(values, 5, arena);
+    row->next_change         = (time_t)dbw_column_int(values, 6);
+    row->ttl_end_ds          = dbw_column_uint(values, 7);
+    row->ttl_end_dk          = dbw_column_uint(values, 8);
+    row->ttl_end_rs          = dbw_column_uint(values, 9);
+    row->roll_ksk_now        = dbw_column_uint(values, 10);
+    row->roll_zsk_now        = dbw_column_uint(values, 11);
+    row->roll_csk_now        = dbw_column_uint(values, 12);
+    row->input_adapter_type  = dbw_column_text(values, 13, arena);
+    row->input_adapter_uri   = dbw_column_text(values, 14, arena);
+    row->output_adapter_type = dbw_column_text(values, 15, arena);
+    row->output_adapter_uri  = dbw_column_text(values, 16, arena);
+    row->next_ksk_roll       = dbw_column_uint(values, 17);
+    row->next_zsk_roll       = dbw_column_uint(values, 18);
+    row->next_csk_roll       = dbw_column_uint(values, 19);
 
     if (!row->name || !row->signconf_path ||
         !row->input_adapter_uri || !row->input_adapter_type ||
         !row->output_adapter_uri || !row->output_adapter_type)
     {
-        free(row->name);
-        free(row->signconf_path);
-        free(row->input_adapter_uri);
-        free(row->input_adapter_type);
-        free(row->output_adapter_uri);
-        free(row->output_adapter_type);
         free(row);
         return NULL;
     }
-    return row;
+    return (struct dbrow *)row;
 }
 
-static struct dbw_policykey *
-policykey_dbx_to_dbw(const policy_key_t *dbx_item)
+static struct dbrow *
+policykey_decode(const db_value_set_t *values, struct dbw_arena *arena)
 {
     struct dbw_policykey *row = calloc(1, sizeof (struct dbw_policykey));
     if (!row) return NULL;
 
-    row->id                             = dbxvalue2int(&dbx_item->id);
-    row->revision                       = dbxvalue2int(&dbx_item->rev);
-    row->policy_id                      = dbxvalue2int(&dbx_item->policy_id);
-    row->policy                         = NULL;
-
-    row->repository                     = strdup(dbx_item->repository);
+    row->id                  = dbw_column_int(values, 0);
+    row->revision            = dbw_column_int(values, 1);
+    row->policy_id           = dbw_column_int(values, 2);
+    row->role                = dbw_column_uint(values, 3);
+    row->algorithm           = dbw_column_uint(values, 4);
+    row->bits                = dbw_column_uint(values, 5);
+    row->lifetime            = dbw_column_uint(values, 6);
+    row->repository          = dbw_column_text(values, 7, arena);
+    row->standby             = dbw_column_uint(values, 8);
+    row->manual_rollover     = dbw_column_uint(values, 9);
+    row->rfc5011             = dbw_column_uint(values, 10);
+    row->minimize            = dbw_column_uint(values, 11);
 
     if (!row->repository) {
         free(row);
         return NULL;
     }
-    row->role                           = dbx_item->role;
-    row->algorithm                      = dbx_item->algorithm;
-    row->bits                           = dbx_item->bits;
-    row->lifetime                       = dbx_item->lifetime;
-    row->standby                        = dbx_item->standby;
-    row->manual_rollover                = dbx_item->manual_rollover;
-    row->rfc5011                        = dbx_item->rfc5011;
-    row->minimize                       = dbx_item->minimize;
-
-    return row;
+    return (struct dbrow *)row;
 }
 
-static struct dbw_policy *
-policy_dbx_to_dbw(const policy_t *dbx_item)
+static struct dbrow *
+policy_decode(const db_value_set_t *values, struct dbw_arena *arena)
 {
     struct dbw_policy *row = calloc(1, sizeof (struct dbw_policy));
     if (!row) return NULL;
 
-    row->id                  = dbxvalue2int(&dbx_item->id);
-    row->revision            = dbxvalue2int(&dbx_item->rev);
-
-    row->name                = strdup(dbx_item->name);
-    row->description          = strdup(dbx_item->description);
-    row->denial_salt          = strdup(dbx_item->denial_salt);
+    row->id                             = dbw_column_int(values, 0);
+    row->revision                       = dbw_column_int(values, 1);
+    row->name                           = dbw_column_text(values, 2, arena);
+    row->description                    = dbw_column_text(values, 3, arena);
+    row->signatures_resign              = dbw_column_uint(values, 4);
+    row->signatures_refresh             = dbw_column_uint(values, 5);
+    row->signatures_jitter              = dbw_column_uint(values, 6);
+    row->signatures_inception_offset    = dbw_column_uint(values, 7);
+    row->signatures_validity_default    = dbw_column_uint(values, 8);
+    row->signatures_validity_denial     = dbw_column_uint(values, 9);
+    row->signatures_validity_keyset     = dbw_column_uint(values, 10);
+    row->signatures_max_zone_ttl        = dbw_column_uint(values, 11);
+    row->denial_type                    = dbw_column_uint(values, 12);
+    row->denial_optout                  = dbw_column_uint(values, 13);
+    row->denial_ttl                     = dbw_column_uint(values, 14);
+    row->denial_resalt                  = dbw_column_uint(values, 15);
+    row->denial_algorithm               = dbw_column_uint(values, 16);
+    row->denial_iterations              = dbw_column_uint(values, 17);
+    row->denial_salt_length             = dbw_column_uint(values, 18);
+    row->denial_salt                    = dbw_column_text(values, 19, arena);
+    row->denial_salt_last_change        = dbw_column_uint(values, 20);
+    row->keys_ttl                       = dbw_column_uint(values, 21);
+    row->keys_retire_safety             = dbw_column_uint(values, 22);
+    row->keys_publish_safety            = dbw_column_uint(values, 23);
+    row->keys_shared                    = dbw_column_uint(values, 24);
+    row->keys_purge_after               = dbw_column_uint(values, 25);
+    row->zone_propagation_delay         = dbw_column_uint(values, 26);
+    row->zone_soa_ttl                   = dbw_column_uint(values, 27);
+    row->zone_soa_minimum               = dbw_column_uint(values, 28);
+    row->zone_soa_serial                = dbw_column_uint(values, 29);
+    row->parent_registration_delay      = dbw_column_uint(values, 30);
+    row->parent_propagation_delay       = dbw_column_uint(values, 31);
+    row->parent_ds_ttl                  = dbw_column_uint(values, 32);
+    row->parent_soa_ttl                 = dbw_column_uint(values, 33);
+    row->parent_soa_minimum             = dbw_column_uint(values, 34);
+    row->passthrough                    = dbw_column_uint(values, 35);
+    row->slab_store                     = dbw_column_uint(values, 36);
 
     if (!row->name || !row->description || !row->denial_salt) {
-        free(row->name);
-        free(row->description);
-        free(row->denial_salt);
         free(row);
         return NULL;
     }
-    row->passthrough                    = dbx_item->passthrough;
-    row->signatures_resign              = dbx_item->signatures_resign;
-    row->signatures_refresh             = dbx_item->signatures_refresh;
-    row->signatures_jitter              = dbx_item->signatures_jitter;
-    row->signatures_inception_offset    = dbx_item->signatures_inception_offset;
-    row->signatures_validity_default    = dbx_item->signatures_validity_default;
-    row->signatures_validity_denial     = dbx_item->signatures_validity_denial;
-    row->signatures_validity_keyset     = dbx_item->signatures_validity_keyset;
-    row->signatures_max_zone_ttl        = dbx_item->signatures_max_zone_ttl;
-    row->denial_type                    = dbx_item->denial_type;
-    row->denial_optout                  = dbx_item->denial_optout;
-    row->denial_ttl                     = dbx_item->denial_ttl;
-    row->denial_resalt                  = dbx_item->denial_resalt;
-    row->denial_algorithm               = dbx_item->denial_algorithm;
-    row->denial_iterations              = dbx_item->denial_iterations;
-    row->denial_salt_length             = dbx_item->denial_salt_length;
-    row->denial_salt_last_change        = dbx_item->denial_salt_last_change;
-    row->keys_ttl                       = dbx_item->keys_ttl;
-    row->keys_retire_safety             = dbx_item->keys_retire_safety;
-    row->keys_publish_safety            = dbx_item->keys_publish_safety;
-    row->keys_shared                    = dbx_item->keys_shared;
-    row->keys_purge_after               = dbx_item->keys_purge_after;
-    row->zone_propagation_delay         = dbx_item->zone_propagation_delay;
-    row->zone_soa_ttl                   = dbx_item->zone_soa_ttl;
-    row->zone_soa_minimum               = dbx_item->zone_soa_minimum;
-    row->zone_soa_serial                = dbx_item->zone_soa_serial;
-    row->parent_registration_delay      = dbx_item->parent_registration_delay;
-    row->parent_propagation_delay       = dbx_item->parent_propagation_delay;
-    row->parent_ds_ttl                  = dbx_item->parent_ds_ttl;
-    row->parent_soa_ttl                 = dbx_item->parent_soa_ttl;
-    row->parent_soa_minimum             = dbx_item->parent_soa_minimum;
-    return row;
-}
-
-static struct dbw_key *
-key_dbx_to_dbw(const key_data_t *dbx_item)
+    return (struct dbrow *)row;
+}
+
+static struct dbrow *
+key_decode(const db_value_set_t *values, struct dbw_arena *arena)
 {
     struct dbw_key *row = calloc(1, sizeof (struct dbw_key));
+    (void)arena;
     if (!row) return NULL;
 
-    row->id                  = dbxvalue2int(&dbx_item->id);
-    row->revision            = dbxvalue2int(&dbx_item->rev);
-    row->zone_id             = dbxvalue2int(&dbx_item->zone_id);
-    row->zone                = NULL;
-    row->hsmkey_id           = dbxvalue2int(&dbx_item->hsm_key_id);
-    row->hsmkey              = NULL;
-
-    row->role                = dbx_item->role;
-    row->ds_at_parent        = dbx_item->ds_at_parent;
-    row->algorithm           = dbx_item->algorithm;
-    row->inception           = dbx_item->inception;
-    row->introducing         = dbx_item->introducing;
-    row->should_revoke       = dbx_item->should_revoke;
-    row->standby             = dbx_item->standby;
-    row->active_zsk          = dbx_item->active_zsk;
-    row->active_ksk          = dbx_item->active_ksk;
-    row->publish             = dbx_item->publish;
-    row->keytag              = dbx_item->keytag;
-    row->minimize            = dbx_item->minimize;
-    return row;
-}
-
-static struct dbw_keystate *
-keystate_dbx_to_dbw(const key_state_t *dbx_item)
+    row->id                  = dbw_column_int(values, 0);
+    row->revision            = dbw_column_int(values, 1);
+    row->zone_id             = dbw_column_int(values, 2);
+    row->hsmkey_id           = dbw_column_int(values, 3);
+    row->algorithm           = dbw_column_uint(values, 4);
+    row->inception           = dbw_column_uint(values, 5);
+    row->role                = dbw_column_uint(values, 6);
+    row->introducing         = dbw_column_uint(values, 7);
+    row->should_revoke       = dbw_column_uint(values, 8);
+    row->standby             = dbw_column_uint(values, 9);
+    row->active_zsk          = dbw_column_uint(values, 10);
+    row->publish             = dbw_column_uint(values, 11);
+    row->active_ksk          = dbw_column_uint(values, 12);
+    row->ds_at_parent        = dbw_column_uint(values, 13);
+    row->keytag              = dbw_column_uint(values, 14);
+    row->minimize            = dbw_column_uint(values, 15);
+    return (struct dbrow *)row;
+}
+
+static struct dbrow *
+keystate_decode(const db_value_set_t *values, struct dbw_arena *arena)
 {
     struct dbw_keystate *row = calloc(1, sizeof (struct dbw_keystate));
+    (void)arena;
     if (!row) return NULL;
 
-    row->id                  = dbxvalue2int(&dbx_item->id);
-    row->revision            = dbxvalue2int(&dbx_item->rev);
-    row->key_id              = dbxvalue2int(&dbx_item->key_data_id);
-    row->key                 = NULL;
-
-    row->type                = dbx_item->type;
-    row->state               = dbx_item->state;
-    row->last_change         = dbx_item->last_change;
-    row->minimize            = dbx_item->minimize;
-    row->ttl                 = dbx_item->ttl;
-    return row;
+    row->id                  = dbw_column_int(values, 0);
+    row->revision            = dbw_column_int(values, 1);
+    row->key_id              = dbw_column_int(values, 2);
+    row->type                = dbw_column_uint(values, 3);
+    row->state               = dbw_column_uint(values, 4);
+    row->last_change         = dbw_column_uint(values, 5);
+    row->minimize            = dbw_column_uint(values, 6);
+    row->ttl                 = dbw_column_uint(values, 7);
+    return (struct dbrow *)row;
 }
 
-static struct dbw_keydependency *
-keydependency_dbx_to_dbw(const key_dependency_t *dbx_item)
+static struct dbrow *
+keydependency_decode(const db_value_set_t *values, struct dbw_arena *arena)
 {
     struct dbw_keydependency *row = calloc(1, sizeof (struct dbw_keydependency));
+    (void)arena;
     if (!row) return NULL;
 
-    row->id                  = dbxvalue2int(&dbx_item->id);
-    row->revision            = dbxvalue2int(&dbx_item->rev);
-    row->zone_id             = dbxvalue2int(&dbx_item->zone_id);
-    row->zone                = NULL;
-    row->fromkey_id          = dbxvalue2int(&dbx_item->from_key_data_id);
-    row->fromkey             = NULL;
-    row->tokey_id            = dbxvalue2int(&dbx_item->to_key_data_id);
-    row->tokey               = NULL;
-
-    row->type                = dbx_item->type;
-    return row;
+    row->id                  = dbw_column_int(values, 0);
+    row->revision            = dbw_column_int(values, 1);
+    row->zone_id             = dbw_column_int(values, 2);
+    row->fromkey_id          = dbw_column_int(values, 3);
+    row->tokey_id            = dbw_column_int(values, 4);
+    row->type                = dbw_column_uint(values, 5);
+    return (struct dbrow *)row;
 }
 
-static struct dbw_hsmkey *
-hsmkey_dbx_to_dbw(const hsm_key_t *dbx_item)
+static struct dbrow *
+hsmkey_decode(const db_value_set_t *values, struct dbw_arena *arena)
 {
     struct dbw_hsmkey *row = calloc(1, sizeof (struct dbw_hsmkey));
     if (!row) return NULL;
 
-    row->id                  = dbxvalue2int(&dbx_item->id);
-    row->revision            = dbxvalue2int(&dbx_item->rev);
-    row->policy_id           = dbxvalue2int(&dbx_item->policy_id);
-    row->policy              = NULL;
-    
-    row->locator             = strdup(dbx_item->locator);
-    row->repository          = strdup(dbx_item->repository);
+    row->id                  = dbw_column_int(values, 0);
+    row->revision            = dbw_column_int(values, 1);
+    row->policy_id           = dbw_column_int(values, 2);
+    row->locator             = dbw_column_text(values, 3, arena);
+    row->state               = dbw_column_uint(values, 4);
+    row->bits                = dbw_column_uint(values, 5);
+    row->algorithm           = dbw_column_uint(values, 6);
+    row->role                = dbw_column_uint(values, 7);
+    row->inception           = dbw_column_uint(values, 8);
+    row->is_revoked          = dbw_column_uint(values, 9);
+    row->key_type            = dbw_column_uint(values, 10);
+    row->repository          = dbw_column_text(values, 11, arena);
+    row->backup              = dbw_column_uint(values, 12);
 
     if (!row->locator || !row->repository) {
-        free(row->locator);
-        free(row->repository);
         free(row);
         return NULL;
     }
-    row->state               = dbx_item->state;
-    row->bits                = dbx_item->bits;
-    row->algorithm           = dbx_item->algorithm;
-    row->role                = dbx_item->role;
-    row->inception           = dbx_item->inception;
-    row->is_revoked          = dbx_item->is_revoked;
-    row->key_type            = dbx_item->key_type;
-    row->backup              = dbx_item->backup;
-    return row;
+    return (struct dbrow *)row;
 }
 
 /**
@@ -978,283 +1099,177 @@ hsmkey_dbx_to_dbw(const hsm_key_t *dbx_item)
  */
 
 static struct dbw_list *
-dbw_zones(db_connection_t *dbconn, int fetch)
-{
-    zone_list_db_t* dbx_list = NULL;
-    size_t n = 0;
-    if (fetch) {
-        dbx_list = zone_list_db_new_get(dbconn);
-        if (!dbx_list) return NULL;
-        n = zone_list_db_size(dbx_list);
-    }
+dbw_list_new(struct dbw_arena *arena,
+    void (*free_row)(struct dbrow *, struct dbw_arena *),
+    int (*update)(const db_connection_t *, struct dbrow *),
+    int (*revision)(const db_connection_t *, struct db_value *))
+{
     struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
-    if (!list) {
-        zone_list_db_free(dbx_list);
-        return NULL;
-    }
-    list->free = dbw_zone_free;
-    list->update = dbw_zone_update;
-    list->revision = dbw_zone_revision;
-    if (fetch) {
-        list->set = calloc(n, sizeof (struct dbw_zone *));
-        if (!list->set) {
-            dbw_list_free(list);
-            zone_list_db_free(dbx_list);
-            return NULL;
+    if (!list) return NULL;
+    list->arena = arena;
+    list->free = free_row;
+    list->update = update;
+    list->revision = revision;
+    return list;
+}
+
+/**
+ * Read every row of a table into list. The rows are decoded as the backend
+ * steps through the result, so no dbx objects are built on the way.
+ *
+ * return 0 on success, 1 otherwise
+ */
+static int
+dbw_list_read(struct dbw_list *list, const db_object_t *dbo, size_t columns,
+    struct dbrow *(*decode)(const db_value_set_t *, struct dbw_arena *))
+{
+    db_result_list_t *result_list;
+    const db_result_t *result;
+    const db_value_set_t *values;
+    struct dbrow *row, **set;
+    size_t size = 0;
+
+    if (!(result_list = db_object_read(dbo, NULL, NULL))) return 1;
+    while ((result = db_result_list_next(result_list))) {
+        if (!(values = db_result_value_set(result))
+            || db_value_set_size(values) != columns
+            || !(row = decode(values, list->arena)))
+        {
+            db_result_list_free(result_list);
+            return 1;
         }
-        const zone_db_t* dbx_item;
-        while ((dbx_item = zone_list_db_next(dbx_list)) != NULL && list->n < n) {
-            struct dbrow *row = (struct dbrow *)zone_dbx_to_dbw(dbx_item);
-            if (!row) {
-                dbw_list_free(list);
-                zone_list_db_free(dbx_list);
-                return NULL;
+        if (list->n == size) {
+            size = size ? size * 2 : 64;
+            if (!(set = realloc(list->set, size * sizeof (struct dbrow *)))) {
+                list->free(row, list->arena);
+                db_result_list_free(result_list);
+                return 1;
             }
-            list->set[list->n++] = row;
+            list->set = set;
         }
-        zone_list_db_free(dbx_list);
+        list->set[list->n++] = row;
     }
-    return list;
+    db_result_list_free(result_list);
+    return 0;
 }
 
 static struct dbw_list *
-dbw_keys(db_connection_t *dbconn, int fetch)
-{
-    key_data_list_t* dbx_list = NULL;
-    size_t n = 0;
-    if (fetch) {
-        dbx_list = key_data_list_new_get(dbconn);
-        if (!dbx_list) return NULL;
-        n = key_data_list_size(dbx_list);
-    }
-    struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
-    if (!list) {
-        key_data_list_free(dbx_list);
-        return NULL;
-    }
-    list->free = dbw_key_free;
-    list->update = dbw_key_update;
-    list->revision = dbw_key_revision;
-    if (fetch) {
-        list->set = calloc(n, sizeof (struct dbw_key *));
-        if (!list->set) {
-            dbw_list_free(list);
-            key_data_list_free(dbx_list);
-            return NULL;
-        }
-        const key_data_t* dbx_item;
-        while ((dbx_item = key_data_list_next(dbx_list)) != NULL && list->n < n) {
-            struct dbrow *row = (struct dbrow *)key_dbx_to_dbw(dbx_item);
-            if (!row) {
-                dbw_list_free(list);
-                key_data_list_free(dbx_list);
-                return NULL;
-            }
-            list->set[list->n++] = row;
-        }
-        key_data_list_free(dbx_list);
+dbw_zones(db_connection_t *dbconn, int fetch, struct dbw_arena *arena)
+{
+    zone_db_t *dbx_obj = NULL;
+    struct dbw_list *list = dbw_list_new(arena, dbw_zone_release,
+        dbw_zone_update, dbw_zone_revision);
+    if (!list || !fetch) return list;
+    if (!(dbx_obj = zone_db_new(dbconn))
+        || dbw_list_read(list, dbx_obj->dbo, 20, zone_decode))
+    {
+        dbw_list_free(list);
+        list = NULL;
     }
+    zone_db_free(dbx_obj);
     return list;
 }
 
 static struct dbw_list *
-dbw_keystates(db_connection_t *dbconn, int fetch)
-{
-    key_state_list_t* dbx_list = NULL;
-    size_t n = 0;
-    if (fetch) {
-        dbx_list = key_state_list_new_get(dbconn);
-        if (!dbx_list) return NULL;
-        n = key_state_list_size(dbx_list);
-    }
-    struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
-    if (!list) {
-        key_state_list_free(dbx_list);
-        return NULL;
-    }
-    list->free = dbw_keystate_free;
-    list->update = dbw_keystate_update;
-    list->revision = dbw_keystate_revision;
-    if (fetch) {
-        list->set = calloc(n, sizeof (struct dbw_keystate *));
-        if (!list->set) {
-            dbw_list_free(list);
-            key_state_list_free(dbx_list);
-            return NULL;
-        }
-        const key_state_t* dbx_item;
-        while ((dbx_item = key_state_list_next(dbx_list)) != NULL && list->n < n) {
-            struct dbrow *row = (struct dbrow *)keystate_dbx_to_dbw(dbx_item);
-            if (!row) {
-                dbw_list_free(list);
-                key_state_list_free(dbx_list);
-                return NULL;
-            }
-            list->set[list->n++] = row;
-        }
-        key_state_list_free(dbx_list);
+dbw_keys(db_connection_t *dbconn, int fetch, struct dbw_arena *arena)
+{
+    key_data_t *dbx_obj = NULL;
+    struct dbw_list *list = dbw_list_new(arena, dbw_key_free,
+        dbw_key_update, dbw_key_revision);
+    if (!list || !fetch) return list;
+    if (!(dbx_obj = key_data_new(dbconn))
+        || dbw_list_read(list, dbx_obj->dbo, 16, key_decode))
+    {
+        dbw_list_free(list);
+        list = NULL;
     }
+    key_data_free(dbx_obj);
     return list;
 }
 
 static struct dbw_list *
-dbw_keydependencies(db_connection_t *dbconn, int fetch)
-{
-    key_dependency_list_t* dbx_list = NULL;
-    size_t n = 0;
-    if (fetch) {
-        dbx_list = key_dependency_list_new_get(dbconn);
-        if (!dbx_list) return NULL;
-        n = key_dependency_list_size(dbx_list);
-    }
-    struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
-    if (!list) {
-        key_dependency_list_free(dbx_list);
-        return NULL;
-    }
-    list->free = dbw_keydependency_free;
-    list->update = dbw_keydependency_update;
-    list->revision = dbw_keydependency_revision;
-    if (fetch) {
-    list->set = calloc(n, sizeof (struct dbw_keydependency *));
-        if (!list->set) {
-            dbw_list_free(list);
-            key_dependency_list_free(dbx_list);
-            return NULL;
-        }
-        const key_dependency_t* dbx_item;
-        while ((dbx_item = key_dependency_list_next(dbx_list)) != NULL && list->n < n) {
-            struct dbrow *row = (struct dbrow *)keydependency_dbx_to_dbw(dbx_item);
-            if (!row) {
-                dbw_list_free(list);
-                key_dependency_list_free(dbx_list);
-                return NULL;
-            }
-            list->set[list->n++] = row;
-        }
-        key_dependency_list_free(dbx_list);
+dbw_keystates(db_connection_t *dbconn, int fetch, struct dbw_arena *arena)
+{
+    key_state_t *dbx_obj = NULL;
+    struct dbw_list *list = dbw_list_new(arena, dbw_keystate_free,
+        dbw_keystate_update, dbw_keystate_revision);
+    if (!list || !fetch) return list;
+    if (!(dbx_obj = key_state_new(dbconn))
+        || dbw_list_read(list, dbx_obj->dbo, 8, keystate_decode))
+    {
+        dbw_list_free(list);
+        list = NULL;
     }
+    key_state_free(dbx_obj);
     return list;
 }
 
 static struct dbw_list *
-dbw_hsmkeys(db_connection_t *dbconn, int fetch)
-{
-    hsm_key_list_t* dbx_list = NULL;
-    size_t n = 0;
-    if (fetch) {
-        dbx_list = hsm_key_list_new_get(dbconn);
-        if (!dbx_list) return NULL;
-        n = hsm_key_list_size(dbx_list);
-    }
-    struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
-    if (!list) {
-        hsm_key_list_free(dbx_list);
-        return NULL;
-    }
-    list->free = dbw_hsmkey_free;
-    list->update = dbw_hsmkey_update;
-    list->revision = dbw_hsmkey_revision;
-    if (fetch) {
-        list->set = calloc(n, sizeof (struct dbw_hsmkey *));
-        if (!list->set) {
-            dbw_list_free(list);
-            hsm_key_list_free(dbx_list);
-            return NULL;
-        }
-        const hsm_key_t* dbx_item;
-        while ((dbx_item = hsm_key_list_next(dbx_list)) != NULL && list->n < n) {
-            struct dbrow *row = (struct dbrow *)hsmkey_dbx_to_dbw(dbx_item);
-            if (!row) {
-                dbw_list_free(list);
-                hsm_key_list_free(dbx_list);
-                return NULL;
-            }
-            list->set[list->n++] = row;
-        }
-        hsm_key_list_free(dbx_list);
+dbw_keydependencies(db_connection_t *dbconn, int fetch,
+    struct dbw_arena *arena)
+{
+    key_dependency_t *dbx_obj = NULL;
+    struct dbw_list *list = dbw_list_new(arena, dbw_keydependency_free,
+        dbw_keydependency_update, dbw_keydependency_revision);
+    if (!list || !fetch) return list;
+    if (!(dbx_obj = key_dependency_new(dbconn))
+        || dbw_list_read(list, dbx_obj->dbo, 6, keydependency_decode))
+    {
+        dbw_list_free(list);
+        list = NULL;
     }
+    key_dependency_free(dbx_obj);
     return list;
 }
 
-
 static struct dbw_list *
-dbw_policies(db_connection_t *dbconn, int fetch)
-{
-    policy_list_t* dbx_list = NULL;
-    size_t n = 0;
-    if (fetch) {
-        dbx_list = policy_list_new_get(dbconn);
-        if (!dbx_list) return NULL;
-        n = policy_list_size(dbx_list);
-    }
-    struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
-    if (!list) {
-        policy_list_free(dbx_list);
-        return NULL;
-    }
-    list->free = dbw_policy_free;
-    list->update = dbw_policy_update;
-    list->revision = dbw_policy_revision;
-    if (fetch) {
-        list->set = calloc(n, sizeof (struct dbw_policy *));
-        if (!list->set) {
-            dbw_list_free(list);
-            policy_list_free(dbx_list);
-            return NULL;
-        }
-        const policy_t* dbx_item;
-        while ((dbx_item = policy_list_next(dbx_list)) != NULL && list->n < n) {
-            struct dbrow *row = (struct dbrow *)policy_dbx_to_dbw(dbx_item);
-            if (!row) {
-                dbw_list_free(list);
-                policy_list_free(dbx_list);
-                return NULL;
-            }
-            list->set[list->n++] = row;
-        }
-        policy_list_free(dbx_list);
+dbw_hsmkeys(db_connection_t *dbconn, int fetch, struct dbw_arena *arena)
+{
+    hsm_key_t *dbx_obj = NULL;
+    struct dbw_list *list = dbw_list_new(arena, dbw_hsmkey_free,
+        dbw_hsmkey_update, dbw_hsmkey_revision);
+    if (!list || !fetch) return list;
+    if (!(dbx_obj = hsm_key_new(dbconn))
+        || dbw_list_read(list, dbx_obj->dbo, 13, hsmkey_decode))
+    {
+        dbw_list_free(list);
+        list = NULL;
     }
+    hsm_key_free(dbx_obj);
     return list;
 }
 
 static struct dbw_list *
-dbw_policykeys(db_connection_t *dbconn, int fetch)
-{
-    policy_key_list_t* dbx_list = NULL;
-    size_t n = 0;
-    if (fetch) {
-        dbx_list = policy_key_list_new_get(dbconn);
-        if (!dbx_list) return NULL;
-        n = policy_key_list_size(dbx_list);
-    }
-    struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
-    if (!list) {
-        policy_key_list_free(dbx_list);
-        return NULL;
+dbw_policies(db_connection_t *dbconn, int fetch, struct dbw_arena *arena)
+{
+    policy_t *dbx_obj = NULL;
+    struct dbw_list *list = dbw_list_new(arena, dbw_policy_free,
+        dbw_policy_update, dbw_policy_revision);
+    if (!list || !fetch) return list;
+    if (!(dbx_obj = policy_new(dbconn))
+        || dbw_list_read(list, dbx_obj->dbo, 37, policy_decode))
+    {
+        dbw_list_free(list);
+        list = NULL;
     }
-    list->free = dbw_policykey_free;
-    list->update = dbw_policykey_update;
-    list->revision = dbw_policykey_revision;
-    if (fetch) {
-        list->set = calloc(n, sizeof (struct dbw_policykey *));
-        if (!list->set) {
-            dbw_list_free(list);
-            policy_key_list_free(dbx_list);
-            return NULL;
-        }
-        const policy_key_t* dbx_item;
-        while ((dbx_item = policy_key_list_next(dbx_list)) != NULL && list->n < n) {
-            struct dbrow *row = (struct dbrow *)policykey_dbx_to_dbw(dbx_item);
-            if (!row) {
-                dbw_list_free(list);
-                policy_key_list_free(dbx_list);
-                return NULL;
-            }
-            list->set[list->n++] = row;
-        }
-        policy_key_list_free(dbx_list);
+    policy_free(dbx_obj);
+    return list;
+}
+
+static struct dbw_list *
+dbw_policykeys(db_connection_t *dbconn, int fetch, struct dbw_arena *arena)
+{
+    policy_key_t *dbx_obj = NULL;
+    struct dbw_list *list = dbw_list_new(arena, dbw_policykey_free,
+        dbw_policykey_update, dbw_policykey_revision);
+    if (!list || !fetch) return list;
+    if (!(dbx_obj = policy_key_new(dbconn))
+        || dbw_list_read(list, dbx_obj->dbo, 12, policykey_decode))
+    {
+        dbw_list_free(list);
+        list = NULL;
     }
+    policy_key_free(dbx_obj);
     return list;
 }
 
@@ -1268,34 +1283,56 @@ dbw_free(struct dbw_db *db)
     dbw_list_free(db->hsmkeys);
     dbw_list_free(db->policykeys);
     dbw_list_free(db->keydependencies);
+    dbw_arena_free(db->arena);
     free(db);
 }
 
-struct dbw_db *
-dbw_fetch_filtered(db_connection_t *conn, int mask)
+static struct dbw_db *
+dbw_fetch_tables(db_connection_t *conn, int mask)
 {
+    int snapshot;
     struct dbw_db *db = calloc(1, sizeof(struct dbw_db));
     if (!db) {
         ods_log_error("[dbw_fetch] Memory allocation failure.");
         return NULL;
     }
 
-    if (pthread_rwlock_rdlock(&db_lock)) {
+    /* When reads see a snapshot (SQLite in WAL mode) a single read
+     * transaction keeps the tables consistent without waiting for
+     * dbw_commit(). Otherwise the lock does. */
+    snapshot = db_connection_snapshot_reads(conn);
+    if (snapshot) {
+        if (db_connection_transaction_begin(conn)) {
+            ods_log_error("[dbw_fetch] Unable to start read transaction.");
+            free(db);
+            return NULL;
+        }
+    } else if (pthread_rwlock_rdlock(&db_lock)) {
         ods_log_error("[dbw_fetch] Unable to obtain database read lock.");
         free(db);
         return NULL;
     }
     db->conn            = conn;
-    db->policies        = dbw_policies(conn, mask&DBW_F_POLICY);
-    db->zones           = dbw_zones(conn, mask&DBW_F_ZONE);
-    db->keys            = dbw_keys(conn, mask&DBW_F_KEY);
-    db->keystates       = dbw_keystates(conn, mask&DBW_F_KEYSTATE);
-    db->hsmkeys         = dbw_hsmkeys(conn, mask&DBW_F_HSMKEY);
-    db->policykeys      = dbw_policykeys(conn, mask&DBW_F_POLICYKEY);
-    db->keydependencies = dbw_keydependencies(conn, mask&DBW_F_KEYDEPENDENCY);
-    (void)pthread_rwlock_unlock(&db_lock);
+    db->arena           = dbw_arena_new();
+    if (db->arena) {
+        db->policies        = dbw_policies(conn, mask&DBW_F_POLICY, db->arena);
+        db->zones           = dbw_zones(conn, mask&DBW_F_ZONE, db->arena);
+        db->keys            = dbw_keys(conn, mask&DBW_F_KEY, db->arena);
+        db->keystates       = dbw_keystates(conn, mask&DBW_F_KEYSTATE, db->arena);
+        db->hsmkeys         = dbw_hsmkeys(conn, mask&DBW_F_HSMKEY, db->arena);
+        db->policykeys      = dbw_policykeys(conn, mask&DBW_F_POLICYKEY, db->arena);
+        db->keydependencies = dbw_keydependencies(conn,
+            mask&DBW_F_KEYDEPENDENCY, db->arena);
+    }
+    if (snapshot) {
+        if (db_connection_transaction_commit(conn)) {
+            (void)db_connection_transaction_rollback(conn);
+        }
+    } else {
+        (void)pthread_rwlock_unlock(&db_lock);
+    }
 
-    if (!db->policies || !db->zones || !db->keys || !db->keystates ||
+    if (!db->arena || !db->policies || !db->zones || !db->keys || !db->keystates ||
             !db->hsmkeys || !db->policykeys || !db->keydependencies)
     {
         dbw_free(db);
@@ -1314,6 +1351,17 @@ dbw_fetch_filtered(db_connection_t *conn, int mask)
     return db;
 }
 
+struct dbw_db *
+dbw_fetch_filtered(db_connection_t *conn, int mask)
+{
+    struct dbw_db *db;
+    uint64_t start = metrics_clock();
+    (void)pthread_once(&dbw_metrics_once, dbw_metrics_init);
+    db = dbw_fetch_tables(conn, mask);
+    if (db) metrics_since(dbw_fetch_latency, start);
+    return db;
+}
+
 struct dbw_db *
 dbw_fetch(db_connection_t *conn)
 {
@@ -1376,15 +1424,24 @@ dbw_verify_revisions(struct dbw_db *db)
     return r;
 }
 
-int
-dbw_commit(struct dbw_db *db)
+static int
+dbw_commit_tables(struct dbw_db *db)
 {
+    /* Readers that do not take the lock must never see half a commit, so
+     * then all changes go in one transaction. */
+    int snapshot = db_connection_snapshot_reads(db->conn);
     if (pthread_rwlock_wrlock(&db_lock)) {
         ods_log_error("[dbw_commit] Unable to obtain database write lock.");
         return 1;
     }
+    if (snapshot && db_connection_transaction_begin(db->conn)) {
+        ods_log_error("[dbw_commit] Unable to start transaction.");
+        (void)pthread_rwlock_unlock(&db_lock);
+        return 1;
+    }
     if (dbw_verify_revisions(db)) {
         ods_log_error("[dbw_commit] Some records are stale, can't commit to database.");
+        if (snapshot) (void)db_connection_transaction_rollback(db->conn);
         (void)pthread_rwlock_unlock(&db_lock);
         return 1;
     }
@@ -1396,10 +1453,31 @@ dbw_commit(struct dbw_db *db)
     r |= dbw_commit_list(db->conn, db->keys);
     r |= dbw_commit_list(db->conn, db->keystates);
     r |= dbw_commit_list(db->conn, db->keydependencies);
+    if (snapshot) {
+        if (r) {
+            (void)db_connection_transaction_rollback(db->conn);
+        } else if (db_connection_transaction_commit(db->conn)) {
+            ods_log_error("[dbw_commit] Unable to commit transaction.");
+            (void)db_connection_transaction_rollback(db->conn);
+            r = 1;
+        }
+    }
     (void)pthread_rwlock_unlock(&db_lock);
     return r;
 }
 
+int
+dbw_commit(struct dbw_db *db)
+{
+    int r;
+    uint64_t start = metrics_clock();
+    (void)pthread_once(&dbw_metrics_once, dbw_metrics_init);
+    r = dbw_commit_tables(db);
+    metrics_since(dbw_commit_latency, start);
+    if (r) metrics_count(dbw_commit_failures, 1);
+    return r;
+}
+
 struct dbw_zone *
 dbw_get_zone(struct dbw_db *db, char const *zonename)
 {
@@ -185,6 +185,7 @@ struct dbw_policy {
     char *description;
     char* denial_salt;
     unsigned int passthrough;
+    unsigned int slab_store;
     unsigned int signatures_resign;
     unsigned int signatures_refresh;
     unsigned int signatures_jitter;
@@ -341,10 +342,13 @@ struct dbw_zone {
     unsigned int roll_csk_now;
 };
 
+struct dbw_arena;
+
 struct dbw_list {
     struct dbrow **set;
     size_t n;
-    void (*free)(struct dbrow *);
+    struct dbw_arena *arena; /* holds the strings of fetched rows */
+    void (*free)(struct dbrow *, struct dbw_arena *);
     int (*update)(const db_connection_t *, struct dbrow *);
     int (*revision)(const db_connection_t *, struct db_value *);
 };
@@ -358,6 +362,7 @@ struct dbw_db {
     struct dbw_list *hsmkeys;
     struct dbw_list *keystates;
     struct dbw_list *keydependencies;
+    struct dbw_arena *arena;
 };
 
 /* DB operations */
@@ -402,6 +407,14 @@ int dbw_commit(struct dbw_db *db);
  */
 void dbw_free(struct dbw_db *db);
 
+/**
+ * Replace a string field of a row with str, which must be allocated with
+ * malloc and is owned by the row afterwards. Strings of rows read from the
+ * database live in the arena of db and are released by dbw_free(), so the
+ * fields must not be freed directly.
+ */
+void dbw_replace_string(struct dbw_db *db, char **field, char *str);
+
 /**
  * Mark database object as dirty. Clean objects will never be written to the
  * database
@@ -465,6 +465,17 @@ static db_object_t* __policy_new_object(const db_connection_t* connection) {
         return NULL;
     }
 
+    if (!(object_field = db_object_field_new())
+        || db_object_field_set_name(object_field, "slabStore")
+        || db_object_field_set_type(object_field, DB_TYPE_UINT32)
+        || db_object_field_list_add(object_field_list, object_field))
+    {
+        db_object_field_free(object_field);
+        db_object_field_list_free(object_field_list);
+        db_object_free(object);
+        return NULL;
+    }
+
     if (db_object_set_object_field_list(object, object_field_list)) {
         db_object_field_list_free(object_field_list);
         db_object_free(object);
@@ -701,6 +712,7 @@ int policy_copy(policy_t* policy, const policy_t* policy_copy) {
     policy->parent_soa_ttl = policy_copy->parent_soa_ttl;
     policy->parent_soa_minimum = policy_copy->parent_soa_minimum;
     policy->passthrough = policy_copy->passthrough;
+    policy->slab_store = policy_copy->slab_store;
     return DB_OK;
 }
 
@@ -732,7 +744,7 @@ int policy_from_result(policy_t* policy, const db_result_t* result) {
     policy->denial_salt = NULL;
     policy->signatures_validity_keyset = 0;
     if (!(value_set = db_result_value_set(result))
-        || db_value_set_size(value_set) != 36
+        || db_value_set_size(value_set) != 37
         || db_value_copy(&(policy->id), db_value_set_at(value_set, 0))
         || db_value_copy(&(policy->rev), db_value_set_at(value_set, 1))
         || db_value_to_text(db_value_set_at(value_set, 2), &(policy->name))
@@ -768,7 +780,8 @@ int policy_from_result(policy_t* policy, const db_result_t* result) {
         || db_value_to_uint32(db_value_set_at(value_set, 32), &(policy->parent_ds_ttl))
         || db_value_to_uint32(db_value_set_at(value_set, 33), &(policy->parent_soa_ttl))
         || db_value_to_uint32(db_value_set_at(value_set, 34), &(policy->parent_soa_minimum))
-        || db_value_to_uint32(db_value_set_at(value_set, 35), &(policy->passthrough)))
+        || db_value_to_uint32(db_value_set_at(value_set, 35), &(policy->passthrough))
+        || db_value_to_uint32(db_value_set_at(value_set, 36), &(policy->slab_store)))
     {
         return DB_ERROR_UNKNOWN;
     }
@@ -1102,6 +1115,14 @@ unsigned int policy_passthrough(const policy_t* policy) {
     return policy->passthrough;
 }
 
+unsigned int policy_slab_store(const policy_t* policy) {
+    if (!policy) {
+        return 0;
+    }
+
+    return policy->slab_store;
+}
+
 zone_list_db_t* policy_zone_list(policy_t* policy) {
 
     if (!policy) {
@@ -1549,6 +1570,16 @@ int policy_set_passthrough(policy_t* policy, unsigned int passthrough) {
     return DB_OK;
 }
 
+int policy_set_slab_store(policy_t* policy, unsigned int slab_store) {
+    if (!policy) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    policy->slab_store = slab_store;
+
+    return DB_OK;
+}
+
 db_clause_t* policy_denial_type_clause(db_clause_list_t* clause_list, policy_denial_type_t denial_type) {
     db_clause_t* clause;
 
@@ -1945,7 +1976,17 @@ int policy_create(policy_t* policy) {
         return DB_ERROR_UNKNOWN;
     }
 
-    if (!(value_set = db_value_set_new(34))) {
+    if (!(object_field = db_object_field_new())
+        || db_object_field_set_name(object_field, "slabStore")
+        || db_object_field_set_type(object_field, DB_TYPE_UINT32)
+        || db_object_field_list_add(object_field_list, object_field))
+    {
+        db_object_field_free(object_field);
+        db_object_field_list_free(object_field_list);
+        return DB_ERROR_UNKNOWN;
+    }
+
+    if (!(value_set = db_value_set_new(35))) {
         db_object_field_list_free(object_field_list);
         return DB_ERROR_UNKNOWN;
     }
@@ -1983,7 +2024,8 @@ int policy_create(policy_t* policy) {
         || db_value_from_uint32(db_value_set_get(value_set, 30), policy->parent_ds_ttl)
         || db_value_from_uint32(db_value_set_get(value_set, 31), policy->parent_soa_ttl)
         || db_value_from_uint32(db_value_set_get(value_set, 32), policy->parent_soa_minimum)
-        || db_value_from_uint32(db_value_set_get(value_set, 33), policy->passthrough))
+        || db_value_from_uint32(db_value_set_get(value_set, 33), policy->passthrough)
+        || db_value_from_uint32(db_value_set_get(value_set, 34), policy->slab_store))
     {
         db_value_set_free(value_set);
         db_object_field_list_free(object_field_list);
@@ -2496,7 +2538,17 @@ int policy_update(policy_t* policy) {
         return DB_ERROR_UNKNOWN;
     }
 
-    if (!(value_set = db_value_set_new(34))) {
+    if (!(object_field = db_object_field_new())
+        || db_object_field_set_name(object_field, "slabStore")
+        || db_object_field_set_type(object_field, DB_TYPE_UINT32)
+        || db_object_field_list_add(object_field_list, object_field))
+    {
+        db_object_field_free(object_field);
+        db_object_field_list_free(object_field_list);
+        return DB_ERROR_UNKNOWN;
+    }
+
+    if (!(value_set = db_value_set_new(35))) {
         db_object_field_list_free(object_field_list);
         return DB_ERROR_UNKNOWN;
     }
@@ -2534,7 +2586,8 @@ int policy_update(policy_t* policy) {
         || db_value_from_uint32(db_value_set_get(value_set, 30), policy->parent_ds_ttl)
         || db_value_from_uint32(db_value_set_get(value_set, 31), policy->parent_soa_ttl)
         || db_value_from_uint32(db_value_set_get(value_set, 32), policy->parent_soa_minimum)
-        || db_value_from_uint32(db_value_set_get(value_set, 33), policy->passthrough))
+        || db_value_from_uint32(db_value_set_get(value_set, 33), policy->passthrough)
+        || db_value_from_uint32(db_value_set_get(value_set, 34), policy->slab_store))
     {
         db_value_set_free(value_set);
         db_object_field_list_free(object_field_list);
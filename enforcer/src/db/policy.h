@@ -65,6 +65,8 @@ struct policy {
     /* if passthrough set, no modifications to the zonefile should
      * be made. I.e. No signatures added or removed */
     unsigned int passthrough;
+    /* if set, the signer keeps the signatures in a slab file */
+    unsigned int slab_store;
     char* description;
     unsigned int signatures_resign;
     unsigned int signatures_refresh;
@@ -159,6 +161,13 @@ const char* policy_name(const policy_t* policy);
  */
 unsigned int policy_passthrough(const policy_t* policy);
 
+/**
+ * Get the slab_store of a policy object. Undefined behavior if `policy` is NULL.
+ * \param[in] policy a policy_t pointer.
+ * \return an unsigned integer.
+ */
+unsigned int policy_slab_store(const policy_t* policy);
+
 /**
  * Get the description of a policy object.
  * \param[in] policy a policy_t pointer.
@@ -416,6 +425,14 @@ int policy_set_name(policy_t* policy, const char* name_text);
  */
 int policy_set_passthrough(policy_t* policy, unsigned int passthrough);
 
+/**
+ * Set the slab_store of a policy object.
+ * \param[in] policy a policy_t pointer.
+ * \param[in] slab_store an unsigned integer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int policy_set_slab_store(policy_t* policy, unsigned int slab_store);
+
 /**
  * Set the description of a policy object.
  * \param[in] policy a policy_t pointer.
@@ -50,6 +50,7 @@ static int __xmlNode2policy(policy_t* policy, xmlNodePtr policy_node, int* updat
     int keys_purge = 0;
     int denial_ttl = 0;
     unsigned int passthrough = 0;
+    unsigned int slab_store = 0;
 
     if (!policy) {
         return DB_ERROR_UNKNOWN;
@@ -132,6 +133,14 @@ static int __xmlNode2policy(policy_t* policy, xmlNodePtr policy_node, int* updat
         else if (!strcmp((char*)node->name, "Passthrough")) {
             passthrough = 1;
         }
+        else if (!strcmp((char*)node->name, "SignatureStore")) {
+            if (!(xml_text = xmlNodeGetContent(node))) {
+                return DB_ERROR_UNKNOWN;
+            }
+            slab_store = !strcmp((char*)xml_text, "slab");
+            xmlFree(xml_text);
+            xml_text = NULL;
+        }
         else if (!strcmp((char*)node->name, "Signatures")) {
             for (node2 = node->children; node2; node2 = node2->next) {
                 if (node2->type != XML_ELEMENT_NODE) {
@@ -1209,6 +1218,15 @@ static int __xmlNode2policy(policy_t* policy, xmlNodePtr policy_node, int* updat
             return DB_ERROR_UNKNOWN;
         }
     }
+    if (slab_store != policy_slab_store(policy)) {
+        ods_log_deeebug("[policy_*_from_xml] - slab store set to %d",
+            slab_store);
+        if (check_if_updated)
+            *updated = 1;
+        if (policy_set_slab_store(policy, slab_store)) {
+            return DB_ERROR_UNKNOWN;
+        }
+    }
 
     return DB_OK;
 }
@@ -56,6 +56,6 @@ autostart(engine_type* engine)
 	if (status != ODS_STATUS_OK)
 		ods_log_crit("[%s] failed to create resalt tasks", module_str);
 
-	enforce_task_flush_all(engine, dbconn);
+	enforce_task_restore_all(engine, dbconn);
 	db_connection_free(dbconn);
 }
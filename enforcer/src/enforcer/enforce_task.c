@@ -48,6 +48,10 @@
 
 static const char *module_str = "enforce_task";
 
+/* Zones with a future deadline are enforced up to this many seconds early
+ * at startup, so zones sharing a deadline do not all fire at once. */
+#define ENFORCE_TASK_STARTUP_JITTER 3600
+
 static void
 schedule_ds_tasks(engine_type *engine, struct dbw_zone *zone)
 {
@@ -140,11 +144,17 @@ enforce_task_perform(task_type* task, char const *owner, void *userdata, void *c
     return perform_enforce(-1, (engine_type *)userdata, owner, dbconn);
 }
 
+static task_type *
+enforce_task_at(engine_type *engine, char const *owner, time_t due_date)
+{
+    return task_create(strdup(owner), TASK_CLASS_ENFORCER, TASK_TYPE_ENFORCE,
+        enforce_task_perform, engine, NULL, due_date);
+}
+
 task_type *
 enforce_task(engine_type *engine, char const *owner)
 {
-    return task_create(strdup(owner), TASK_CLASS_ENFORCER, TASK_TYPE_ENFORCE,
-        enforce_task_perform, engine, NULL, time_now());
+    return enforce_task_at(engine, owner, time_now());
 }
 
 void
@@ -173,3 +183,39 @@ enforce_task_flush_all(engine_type *engine, db_connection_t *dbconn)
     }
     dbw_free(db);
 }
+
+void
+enforce_task_restore_all(engine_type *engine, db_connection_t *dbconn)
+{
+    size_t overdue = 0, scheduled = 0, idle = 0;
+    time_t now, due, window;
+    struct dbw_db *db = dbw_fetch(dbconn);
+    if (!db) ods_fatal_exit("[%s] failed to list zones from DB", module_str);
+    now = time_now();
+    for (size_t z = 0; z < db->zones->n; z++) {
+        struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
+        due = zone->next_change;
+        if (zone->signconf_needs_writing || (due >= 0 && due <= now)) {
+            /* Overdue, or interrupted before its signconf was written. */
+            due = now;
+            overdue++;
+        } else if (due < 0) {
+            /* No changes scheduled, e.g. a suspended zone. */
+            idle++;
+            continue;
+        } else {
+            /* Never later than the deadline, spread by zone id. */
+            window = due - now;
+            if (window > ENFORCE_TASK_STARTUP_JITTER)
+                window = ENFORCE_TASK_STARTUP_JITTER;
+            due -= ((unsigned int)zone->id * 2654435761U) % (window + 1);
+            scheduled++;
+        }
+        (void)schedule_task(engine->taskq,
+            enforce_task_at(engine, zone->name, due), 1, 0);
+    }
+    ods_log_info("[%s] restored schedule: %lu zones overdue, %lu scheduled, "
+        "%lu without changes", module_str, (unsigned long)overdue,
+        (unsigned long)scheduled, (unsigned long)idle);
+    dbw_free(db);
+}
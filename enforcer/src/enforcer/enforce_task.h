@@ -49,4 +49,8 @@ void enforce_task_flush_policy(engine_type *engine, struct dbw_policy *policy);
 /* Schedule enforce tasks for *now* for ALL zones. */
 void enforce_task_flush_all(engine_type *engine, db_connection_t *dbconn);
 
+/* Schedule enforce tasks for ALL zones at their stored next change, *now*
+ * only for zones that are overdue. Used at startup. */
+void enforce_task_restore_all(engine_type *engine, db_connection_t *dbconn);
+
 #endif
@@ -76,6 +76,22 @@ struct future_key {
     int pretend_update;
 };
 
+/**
+ * Policy derived parts of the evaluation, worked out once per zone
+ * update rather than for every record considered.
+ */
+struct policy_timing {
+    /** Delay added to the TTL before a record may leave a certain state,
+     * per keystate type. Index 1 when heading for OMNIPRESENT. */
+    unsigned int transition[4][2];
+    /** TTL of the records per keystate type. */
+    unsigned int ttl[4];
+    /** DNSKEY TTL while no DNSKEY is published, negative caching included. */
+    unsigned int ttl_dnskey_unpublished;
+    /** Extra wait of an RRSIG for a smooth ZSK rollover. */
+    int smooth_rollover;
+};
+
 static int64_t max(int64_t a, int64_t b) { return a>b?a:b; }
 static int64_t min(int64_t a, int64_t b) { return a<b?a:b; }
 
@@ -98,7 +114,9 @@ minTime(const time_t t, time_t* min)
 /**
  * Adds seconds to a time. 
  *
- * Adds seconds to a time. Adding seconds directly is not portable.
+ * POSIX time_t counts seconds, so this is plain addition. Going through
+ * localtime_r() and mktime() gave the same result, as the DST flag was
+ * kept, but made glibc reread the time zone on every call.
  *
  * \param[in] t, base time
  * \param[in] seconds, seconds to add to base
@@ -107,11 +125,7 @@ minTime(const time_t t, time_t* min)
 static time_t
 addtime(const time_t t, const int seconds)
 {
-    struct tm timebuf;
-    struct tm *tp = localtime_r(&t, &timebuf);
-    if (!tp) return -1; /* bad, but mktime also returns -1 on error */
-    tp->tm_sec += seconds;
-    return mktime(tp);
+    return t + seconds;
 }
 
 /**
@@ -518,35 +532,59 @@ dnssecApproval(struct future_key *future_key, int allow_unsigned)
  * return a time_t with the absolute time
  */
 static time_t
-minTransitionTime(const struct dbw_policy *policy, enum dbw_keystate_type type,
+minTransitionTime(const struct policy_timing *timing, enum dbw_keystate_type type,
     enum dbw_keystate_state next_state, const time_t lastchange, const int ttl)
 {
     /* We may freely move a record to a uncertain state.  */
     if (next_state == RUMOURED || next_state == UNRETENTIVE) return lastchange;
 
-    switch (type) {
-        case DBW_DS:
-            return addtime(lastchange, ttl
-                + policy->parent_registration_delay
-                + policy->parent_propagation_delay);
-
-        /* TODO: 5011 will create special case here */
-        case DBW_DNSKEY: /* intentional fall-through */
-        case DBW_RRSIGDNSKEY:
-            return addtime(lastchange, ttl
-                + policy->zone_propagation_delay
-                + ( next_state == OMNIPRESENT
-                    ? policy->keys_publish_safety
-                    : policy->keys_retire_safety ));
-
-        case DBW_RRSIG:
-            return addtime(lastchange, ttl
-                + policy->zone_propagation_delay);
+    if (type < DBW_DS || type > DBW_RRSIGDNSKEY) {
+        ods_log_assert(0);
+        return 0; /* squelch compiler */
+    }
+    return addtime(lastchange, ttl
+        + timing->transition[type][next_state == OMNIPRESENT]);
+}
 
-        default:
-            ods_log_assert(0);
-            return 0; /* squelch compiler */
+/**
+ * Work out the policy derived parts of the evaluation.
+ */
+static void
+policy_timing_compute(const struct dbw_policy *policy, struct policy_timing *timing)
+{
+    unsigned int ttl;
+
+    timing->transition[DBW_DS][0] = policy->parent_registration_delay
+        + policy->parent_propagation_delay;
+    timing->transition[DBW_DS][1] = timing->transition[DBW_DS][0];
+    /* TODO: 5011 will create special case here */
+    timing->transition[DBW_DNSKEY][0] = policy->zone_propagation_delay
+        + policy->keys_retire_safety;
+    timing->transition[DBW_DNSKEY][1] = policy->zone_propagation_delay
+        + policy->keys_publish_safety;
+    timing->transition[DBW_RRSIGDNSKEY][0] = timing->transition[DBW_DNSKEY][0];
+    timing->transition[DBW_RRSIGDNSKEY][1] = timing->transition[DBW_DNSKEY][1];
+    timing->transition[DBW_RRSIG][0] = policy->zone_propagation_delay;
+    timing->transition[DBW_RRSIG][1] = policy->zone_propagation_delay;
+
+    timing->ttl[DBW_DS] = policy->parent_ds_ttl;
+    timing->ttl[DBW_DNSKEY] = policy->keys_ttl;
+    timing->ttl[DBW_RRSIGDNSKEY] = policy->keys_ttl;
+    if (policy->denial_type == POLICY_DENIAL_TYPE_NSEC3) {
+        ttl = max(policy->signatures_max_zone_ttl, policy->denial_ttl);
+    } else {
+        ttl = policy->signatures_max_zone_ttl;
     }
+    timing->ttl[DBW_RRSIG] = max(ttl,
+        min(policy->zone_soa_ttl, policy->zone_soa_minimum));
+    timing->ttl_dnskey_unpublished = max(policy->keys_ttl,
+        min(policy->zone_soa_ttl, policy->zone_soa_minimum));
+
+    timing->smooth_rollover = policy->signatures_jitter
+        + max(policy->signatures_validity_default,
+            policy->signatures_validity_denial)
+        + policy->signatures_resign
+        - policy->signatures_refresh;
 }
 
 /**
@@ -657,34 +695,28 @@ policyApproval(struct future_key *future_key)
  * \return The TTL that should be used for the record or -1 on error.
  */
 static unsigned int
-getZoneTTL(struct dbw_zone *zone, int type, const time_t now)
+getZoneTTL(struct dbw_zone *zone, const struct policy_timing *timing, int type,
+    const time_t now)
 {
     time_t end_date = 0;
     int ttl = 0;
-    struct dbw_policy *policy = zone->policy;
 
     switch (type) {
         case DBW_DS:
             end_date = zone->ttl_end_ds;
-            ttl = policy->parent_ds_ttl;
             break;
         case DBW_DNSKEY: /* Intentional fall-through */
         case DBW_RRSIGDNSKEY:
             end_date = zone->ttl_end_dk;
-            ttl = policy->keys_ttl;
             break;
         case DBW_RRSIG:
             end_date = zone->ttl_end_rs;
-            ttl = max(min(policy->zone_soa_ttl, policy->zone_soa_minimum),
-                ( policy->denial_type == POLICY_DENIAL_TYPE_NSEC3
-                    ? ( policy->denial_ttl > policy->signatures_max_zone_ttl
-                        ? policy->denial_ttl
-                        : policy->signatures_max_zone_ttl )
-                    : policy->signatures_max_zone_ttl ));
             break;
         default:
             ods_log_assert(0);
+            return 0; /* squelch compiler */
     }
+    ttl = timing->ttl[type];
 
     return max((int)difftime(end_date, now), ttl);
 }
@@ -778,9 +810,9 @@ has_omnipresent_dnskey(struct dbw_zone *zone)
 }
 
 static void
-track_ttls(struct dbw_zone *zone, const time_t now)
+track_ttls(struct dbw_zone *zone, const struct policy_timing *timing,
+    const time_t now)
 {
-    struct dbw_policy *policy = zone->policy;
     /*
      * This code keeps track of TTL changes. If in the past a large TTL is used,
      * our keys *may* need to transition extra careful to make sure each
@@ -788,30 +820,22 @@ track_ttls(struct dbw_zone *zone, const time_t now)
      * policies TTL.
      */
     if (zone->ttl_end_ds <= now) { /*DS*/
-        zone->ttl_end_ds = addtime(now, policy->parent_ds_ttl);
+        zone->ttl_end_ds = addtime(now, timing->ttl[DBW_DS]);
         dbw_mark_dirty((struct dbrow *)zone);
     }
     if (zone->ttl_end_dk <= now) { /*DNSKEY*/
         unsigned int ttl;
         if (has_omnipresent_dnskey(zone)) {
-            ttl = policy->keys_ttl;
+            ttl = timing->ttl[DBW_DNSKEY];
         } else {
             /* No dnskeys published yet. So consider negative caching as well. */
-            ttl = max(policy->keys_ttl, min(policy->zone_soa_ttl,
-                policy->zone_soa_minimum));
+            ttl = timing->ttl_dnskey_unpublished;
         }
         zone->ttl_end_dk = addtime(now, ttl);
         dbw_mark_dirty((struct dbrow *)zone);
     }
     if (zone->ttl_end_rs <= now) { /*RRSIG*/
-        unsigned int ttl;
-        if (policy->denial_type == POLICY_DENIAL_TYPE_NSEC3) {
-            ttl = max(policy->signatures_max_zone_ttl, policy->denial_ttl);
-        } else {
-            ttl = policy->signatures_max_zone_ttl;
-        }
-        zone->ttl_end_rs = addtime(now, max(ttl,
-            min(policy->zone_soa_ttl, policy->zone_soa_minimum)));
+        zone->ttl_end_rs = addtime(now, timing->ttl[DBW_RRSIG]);
         dbw_mark_dirty((struct dbrow *)zone);
     }
 }
@@ -845,7 +869,8 @@ initial_state(unsigned int type, unsigned int role)
 }
 
 static void
-generate_missing_keystates(struct dbw_db *db, struct dbw_zone *zone, time_t now)
+generate_missing_keystates(struct dbw_db *db, struct dbw_zone *zone,
+    const struct policy_timing *timing, time_t now)
     //TODO call from policy update instead of zoneupdate
 {
     static const char *scmd = "generate_missing_keystates";
@@ -864,7 +889,7 @@ generate_missing_keystates(struct dbw_db *db, struct dbw_zone *zone, time_t now)
             /* We might consider not generating non relevant key states. */
             keystate->state = initial_state(i, zone->key[k]->role);
             keystate->last_change = now;
-            keystate->ttl = getZoneTTL(zone, i, now);
+            keystate->ttl = getZoneTTL(zone, timing, i, now);
             if (dbw_add_keystate(db, zone->key[k], keystate)) {
                 ods_log_error("[%s] %s memory allocation error", module_str, scmd);
                 continue;
@@ -949,14 +974,16 @@ updateZone(struct dbw_db *db, struct dbw_zone *zone, const time_t now,
 {
     static const char *scmd = "updateZone";
     struct future_key future_key;
+    struct policy_timing timing;
     time_t returntime_zone = -1;
 
     struct dbw_policy *policy = zone->policy;
 
      ods_log_verbose("[%s] %s: processing %s with policyName %s",
          module_str, scmd, zone->name, policy->name);
-    track_ttls(zone, now);
-    generate_missing_keystates(db, zone, now);
+    policy_timing_compute(policy, &timing);
+    track_ttls(zone, &timing, now);
+    generate_missing_keystates(db, zone, &timing, now);
 
     int stable = 0;
     while (!stable) {
@@ -996,8 +1023,8 @@ updateZone(struct dbw_db *db, struct dbw_zone *zone, const time_t now,
                 if (!dnssecApproval(&future_key, allow_unsigned)) continue;
                 ods_log_verbose("[%s] %s DNSSEC says we can (2/3)", module_str, scmd);
 
-                returntime_keystate = minTransitionTime(policy, keystate->type, next_state,
-                    keystate->last_change, getZoneTTL(zone, keystate->type, now));
+                returntime_keystate = minTransitionTime(&timing, keystate->type, next_state,
+                    keystate->last_change, getZoneTTL(zone, &timing, keystate->type, now));
 
                 /* If this is an RRSIG and the DNSKEY is omnipresent and next
                  * state is a certain state, wait an additional signature
@@ -1006,20 +1033,13 @@ updateZone(struct dbw_db *db, struct dbw_zone *zone, const time_t now,
                     {NA, UNRETENTIVE, OMNIPRESENT, NA},
                     {NA, RUMOURED,    OMNIPRESENT, NA}
                 };
-                int zsk_out = exists(&future_key, 1, mask[0]);
-                int zsk_in  = exists(&future_key, 1, mask[1]);
-
                 if (keystate->type == DBW_RRSIG
                     && getstate(key, DBW_DNSKEY)->state == OMNIPRESENT
-                    && ((next_state == OMNIPRESENT && zsk_out)
-                        || (next_state == HIDDEN && zsk_in)))
+                    && ((next_state == OMNIPRESENT && exists(&future_key, 1, mask[0]))
+                        || (next_state == HIDDEN && exists(&future_key, 1, mask[1]))))
                 {
                     returntime_keystate = addtime(returntime_keystate,
-                        policy->signatures_jitter
-                        + max(policy->signatures_validity_default,
-                            policy->signatures_validity_denial)
-                        + policy->signatures_resign
-                        - policy->signatures_refresh);
+                        timing.smooth_rollover);
                 }
 
                 /* It is to soon to make this change. Schedule it. */
@@ -1057,7 +1077,7 @@ updateZone(struct dbw_db *db, struct dbw_zone *zone, const time_t now,
 
                 keystate->state = next_state;
                 keystate->last_change = now;
-                keystate->ttl = getZoneTTL(zone, keystate->type, now);
+                keystate->ttl = getZoneTTL(zone, &timing, keystate->type, now);
                 /* we don't want DELETED or INSERTED to be marked UPDATE */
                 dbw_mark_dirty((struct dbrow *)keystate);
                 stable = 0; /* There have been changes. Keep processing */
@@ -1460,7 +1480,10 @@ removeDeadKeys(struct dbw_zone *zone, const time_t now, int mockup)
             minTime(key_time, &first_purge);
             continue;
         }
-        ods_log_info("[%s] %s deleting key: %s", module_str, scmd, key->hsmkey->locator);
+        if (mockup)
+            ods_log_verbose("[%s] %s deleting key: %s", module_str, scmd, key->hsmkey->locator);
+        else
+            ods_log_info("[%s] %s deleting key: %s", module_str, scmd, key->hsmkey->locator);
         for (size_t s = 0; s < key->keystate_count; s++) {
             key->keystate[s]->dirty = DBW_DELETE;
         }
@@ -1522,7 +1545,10 @@ static time_t
 _update(engine_type *engine, struct dbw_db *db, struct dbw_zone *zone, time_t now,
     int *zone_updated, int mockup)
 {
-    ods_log_info("[%s] update zone: %s", module_str, zone->name);
+    if (mockup)
+        ods_log_verbose("[%s] update zone: %s", module_str, zone->name);
+    else
+        ods_log_info("[%s] update zone: %s", module_str, zone->name);
 
     /* Update policy.*/
     int allow_unsigned = 0;
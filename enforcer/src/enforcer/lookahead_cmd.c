@@ -190,7 +190,7 @@ purge(struct dbw_list *list)
     int left = 0;
     while (left < list->n) {
         if (list->set[left]->dirty == DBW_DELETE) {
-            list->free(list->set[left]);
+            list->free(list->set[left], list->arena);
             list->set[left] = list->set[--list->n];
         } else {
             if (list->set[left]->dirty == DBW_INSERT) {
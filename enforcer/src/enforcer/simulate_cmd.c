@@ -0,0 +1,483 @@
+/*
+ * Copyright (c) 2017 Stichting NLnet Labs
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <getopt.h>
+#include "config.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "cmdhandler.h"
+#include "daemon/enforcercommands.h"
+#include "daemon/engine.h"
+#include "file.h"
+#include "log.h"
+#include "str.h"
+#include "clientpipe.h"
+#include "duration.h"
+#include "janitor.h"
+#include "locks.h"
+#include "enforcer/enforcer.h"
+#include "policy/policy_import.h"
+
+#include "enforcer/simulate_cmd.h"
+
+static const char *module_str = "simulate_cmd";
+
+#define MAX_ARGS 16
+#define MAX_THREADS 64
+
+/* A zone that takes more enforces than this is stuck. */
+#define MAX_EVENTS 100000
+/* Nor should a zone keep asking to be enforced at the same moment. */
+#define MAX_REPEAT 16
+
+/**
+ * What happened in one interval of virtual time.
+ *
+ */
+struct simulate_bucket {
+    unsigned long enforces;
+    unsigned long keys;
+    unsigned long generated;
+    unsigned long ds_submit;
+    unsigned long ds_retract;
+    unsigned long signconf;
+};
+
+/**
+ * A worker owns a private snapshot of the database and the zones of its
+ * partition. Zones on a policy with shared keys stay together.
+ *
+ */
+struct simulate_worker {
+    janitor_thread_t thread;
+    engine_type *engine;
+    int sockfd;
+    int index;
+    int count;
+    const char *kasp;
+    const char *policy;
+    time_t start;
+    time_t interval;
+    size_t nbuckets;
+    struct simulate_bucket *bucket;
+    int key_id;
+    int keystate_id;
+    int hsmkey_id;
+    int keydependency_id;
+    unsigned long zones;
+    unsigned long stalled;
+    int error;
+};
+
+static void
+usage(int sockfd)
+{
+    client_printf(sockfd,
+        "simulate\n"
+        "	[--days <n>]		aka -d\n"
+        "	[--interval <days>]	aka -i\n"
+        "	[--policy <policy>]	aka -p\n"
+        "	[--kasp <file>]		aka -k\n"
+        "	[--threads <n>]		aka -t\n");
+}
+
+static void
+help(int sockfd)
+{
+    client_printf(sockfd,
+        "Simulate the enforcer for all zones in memory and show what it would do\n"
+        "over time. Nothing is written to the database or the HSM.\n"
+        "\nOptions:\n"
+        "days		Number of days to simulate, default 365.\n"
+        "interval	Number of days per line of output, default 1.\n"
+        "policy		Only simulate the zones on this policy.\n"
+        "kasp		Apply the policies in this KASP file first, to see what\n"
+        "		a change to the policies would do.\n"
+        "threads		Number of threads, default the number of worker threads.\n"
+        "\n"
+        "DS changes are assumed to be seen at the parent right away and keys\n"
+        "awaiting a backup are assumed to be backed up.\n"
+        "\n"
+    );
+}
+
+static int
+max_id(struct dbw_list *list)
+{
+    int id = 0;
+    for (size_t n = 0; n < list->n; n++) {
+        if (list->set[n]->id > id) id = list->set[n]->id;
+    }
+    return id;
+}
+
+/**
+ * Remove the rows marked DELETE from an array, keeping the order.
+ *
+ */
+static void
+drop_deleted(struct dbrow **set, int *count)
+{
+    int n = 0;
+    for (int i = 0; i < *count; i++) {
+        if (set[i]->dirty != DBW_DELETE) set[n++] = set[i];
+    }
+    *count = n;
+}
+
+/**
+ * Since nothing is committed, make the zone look like it was just read
+ * back from the database: unlink deleted rows and give new rows an ID.
+ * Unlinked rows stay in the lists of the snapshot until it is freed.
+ *
+ */
+static void
+scrub_zone(struct simulate_worker *w, struct dbw_zone *zone)
+{
+    for (int d = 0; d < zone->keydependency_count; d++) {
+        struct dbw_keydependency *dep = zone->keydependency[d];
+        if (dep->dirty != DBW_DELETE) continue;
+        drop_deleted((struct dbrow **)dep->fromkey->from_keydependency,
+            &dep->fromkey->from_keydependency_count);
+        drop_deleted((struct dbrow **)dep->tokey->to_keydependency,
+            &dep->tokey->to_keydependency_count);
+    }
+    drop_deleted((struct dbrow **)zone->keydependency,
+        &zone->keydependency_count);
+    for (int k = 0; k < zone->key_count; k++) {
+        struct dbw_key *key = zone->key[k];
+        if (key->dirty != DBW_DELETE) continue;
+        struct dbw_hsmkey *hsmkey = key->hsmkey;
+        drop_deleted((struct dbrow **)hsmkey->key, &hsmkey->key_count);
+        if (hsmkey->dirty == DBW_DELETE) {
+            drop_deleted((struct dbrow **)hsmkey->policy->hsmkey,
+                &hsmkey->policy->hsmkey_count);
+        }
+    }
+    drop_deleted((struct dbrow **)zone->key, &zone->key_count);
+
+    for (int k = 0; k < zone->key_count; k++) {
+        struct dbw_key *key = zone->key[k];
+        struct dbw_hsmkey *hsmkey = key->hsmkey;
+        if (hsmkey->dirty == DBW_INSERT) hsmkey->id = ++w->hsmkey_id;
+        hsmkey->dirty = DBW_CLEAN;
+        if (key->dirty == DBW_INSERT) key->id = ++w->key_id;
+        key->hsmkey_id = hsmkey->id;
+        key->dirty = DBW_CLEAN;
+        for (int s = 0; s < key->keystate_count; s++) {
+            struct dbw_keystate *keystate = key->keystate[s];
+            if (keystate->dirty == DBW_INSERT)
+                keystate->id = ++w->keystate_id;
+            keystate->key_id = key->id;
+            keystate->dirty = DBW_CLEAN;
+        }
+    }
+    for (int d = 0; d < zone->keydependency_count; d++) {
+        struct dbw_keydependency *dep = zone->keydependency[d];
+        if (dep->dirty == DBW_INSERT) {
+            dep->id = ++w->keydependency_id;
+            dep->fromkey_id = dep->fromkey->id;
+            dep->tokey_id = dep->tokey->id;
+        }
+        dep->dirty = DBW_CLEAN;
+    }
+    zone->dirty = DBW_CLEAN;
+}
+
+/**
+ * Run the enforce events of one zone until the end of the simulation.
+ *
+ */
+static void
+simulate_zone(struct simulate_worker *w, struct dbw_db *db,
+    struct dbw_zone *zone)
+{
+    time_t end = w->start + (time_t)w->nbuckets * w->interval;
+    time_t t = zone->next_change;
+    time_t last = -1;
+    unsigned long events = 0;
+    int repeat = 0;
+
+    if (zone->policy->scratch & POLICY_UPDATED || (t >= 0 && t < w->start))
+        t = w->start;
+    w->zones++;
+    while (t >= 0 && t < end) {
+        repeat = (t == last) ? repeat + 1 : 0;
+        if (repeat > MAX_REPEAT || ++events > MAX_EVENTS) {
+            ods_log_warning("[%s] zone %s makes no progress at %ld",
+                module_str, zone->name, (long)t);
+            w->stalled++;
+            return;
+        }
+        last = t;
+
+        struct simulate_bucket *b = &w->bucket[(t - w->start) / w->interval];
+        int zone_updated = 0;
+        time_t t_next = update_mockup(w->engine, db, zone, t, &zone_updated);
+        b->enforces++;
+        for (int k = 0; k < zone->key_count; k++) {
+            struct dbw_key *key = zone->key[k];
+            if (key->dirty == DBW_DELETE) continue;
+            if (key->dirty == DBW_INSERT) {
+                b->keys++;
+                if (key->hsmkey->dirty == DBW_INSERT) b->generated++;
+            }
+            if (key->ds_at_parent == DBW_DS_AT_PARENT_SUBMIT) {
+                key->ds_at_parent = DBW_DS_AT_PARENT_SEEN;
+                b->ds_submit++;
+                t_next = t;
+            } else if (key->ds_at_parent == DBW_DS_AT_PARENT_RETRACT) {
+                key->ds_at_parent = DBW_DS_AT_PARENT_UNSUBMITTED;
+                b->ds_retract++;
+                t_next = t;
+            }
+        }
+        if (zone->signconf_needs_writing) {
+            zone->signconf_needs_writing = 0;
+            b->signconf++;
+        }
+        scrub_zone(w, zone);
+        if (t_next >= 0 && t_next < t) t_next = t;
+        t = t_next;
+    }
+}
+
+static void
+simulate_worker_run(struct simulate_worker *w)
+{
+    db_connection_t *dbconn;
+    struct dbw_db *db;
+
+    if (!(dbconn = get_database_connection(w->engine))) {
+        w->error = 1;
+        return;
+    }
+    if (!(db = dbw_fetch(dbconn))) {
+        db_connection_free(dbconn);
+        w->error = 1;
+        return;
+    }
+    /* Only the first worker reports on the KASP file. */
+    if (w->kasp && policy_import_db(w->index ? -1 : w->sockfd, w->engine,
+            db, w->kasp, 0))
+    {
+        dbw_free(db);
+        db_connection_free(dbconn);
+        w->error = 1;
+        return;
+    }
+    w->key_id = max_id(db->keys);
+    w->keystate_id = max_id(db->keystates);
+    w->hsmkey_id = max_id(db->hsmkeys);
+    w->keydependency_id = max_id(db->keydependencies);
+    for (size_t h = 0; h < db->hsmkeys->n; h++) {
+        struct dbw_hsmkey *hsmkey = (struct dbw_hsmkey *)db->hsmkeys->set[h];
+        if (hsmkey->backup == DBW_BACKUP_REQUIRED
+                || hsmkey->backup == DBW_BACKUP_REQUESTED)
+            hsmkey->backup = DBW_BACKUP_DONE;
+    }
+    for (size_t z = 0; z < db->zones->n; z++) {
+        struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
+        struct dbw_policy *policy = zone->policy;
+        int part = policy->keys_shared ? policy->id : zone->id;
+        if (part % w->count != w->index) continue;
+        if (w->policy && strcmp(w->policy, policy->name)) continue;
+        if (policy->passthrough) continue;
+        simulate_zone(w, db, zone);
+    }
+    dbw_free(db);
+    db_connection_free(dbconn);
+}
+
+/**
+ * Handle the 'simulate' command.
+ *
+ */
+static int
+run(int sockfd, cmdhandler_ctx_type* context, char *cmd)
+{
+    int argc = 0;
+    char const *argv[MAX_ARGS];
+    int long_index = 0, opt = 0;
+    const char *policy = NULL;
+    const char *kasp = NULL;
+    int days = 365;
+    int interval = 1;
+    engine_type* engine = getglobalcontext(context);
+    int threads = engine->config->num_worker_threads;
+    struct simulate_worker *worker;
+    struct simulate_bucket total;
+    unsigned long zones = 0, stalled = 0;
+    time_t start, t0;
+    int error = 0;
+
+    static struct option long_options[] = {
+        {"days", required_argument, 0, 'd'},
+        {"interval", required_argument, 0, 'i'},
+        {"policy", required_argument, 0, 'p'},
+        {"kasp", required_argument, 0, 'k'},
+        {"threads", required_argument, 0, 't'},
+        {0, 0, 0, 0}
+    };
+
+    ods_log_debug("[%s] %s command", module_str, simulate_funcblock.cmdname);
+    if (!cmd) return -1;
+    argc = ods_str_explode(cmd, MAX_ARGS, argv);
+    if (argc == -1) {
+        client_printf_err(sockfd, "too many arguments\n");
+        return -1;
+    }
+
+    optind = 0;
+    while ((opt = getopt_long(argc, (char* const*)argv, "d:i:p:k:t:", long_options, &long_index)) != -1) {
+        switch (opt) {
+            case 'd':
+                days = atoi(optarg);
+                break;
+            case 'i':
+                interval = atoi(optarg);
+                break;
+            case 'p':
+                policy = optarg;
+                break;
+            case 'k':
+                kasp = optarg;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            default:
+                client_printf_err(sockfd, "unknown arguments\n");
+                ods_log_error("[%s] unknown arguments for %s command",
+                    module_str, simulate_funcblock.cmdname);
+                return -1;
+        }
+    }
+    if (days <= 0 || interval <= 0) {
+        client_printf_err(sockfd, "--days and --interval must be positive\n");
+        return -1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    if (!(worker = calloc(threads, sizeof (struct simulate_worker)))) {
+        client_printf_err(sockfd, "out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < threads; i++) {
+        worker[i].nbuckets = (days + interval - 1) / interval;
+        worker[i].bucket = calloc(worker[i].nbuckets,
+            sizeof (struct simulate_bucket));
+        if (!worker[i].bucket) error = 1;
+    }
+    if (error) {
+        for (int i = 0; i < threads; i++) free(worker[i].bucket);
+        free(worker);
+        client_printf_err(sockfd, "out of memory\n");
+        return 1;
+    }
+    start = time_now();
+    t0 = time(NULL);
+    for (int i = 0; i < threads; i++) {
+        worker[i].engine = engine;
+        worker[i].sockfd = sockfd;
+        worker[i].index = i;
+        worker[i].count = threads;
+        worker[i].kasp = kasp;
+        worker[i].policy = policy;
+        worker[i].start = start;
+        worker[i].interval = (time_t)interval * 86400;
+    }
+    for (int i = 1; i < threads; i++) {
+        janitor_thread_create(&worker[i].thread, workerthreadclass,
+            (janitor_runfn_t)simulate_worker_run, &worker[i]);
+    }
+    simulate_worker_run(&worker[0]);
+    for (int i = 1; i < threads; i++) {
+        janitor_thread_join(worker[i].thread);
+    }
+
+    client_printf(sockfd, "%-10s %9s %9s %10s %10s %11s %9s\n", "Date:",
+        "Enforces:", "Keys:", "Generated:", "DS-submit:", "DS-retract:",
+        "Signconf:");
+    memset(&total, 0, sizeof (total));
+    for (size_t n = 0; n < worker[0].nbuckets; n++) {
+        struct simulate_bucket b;
+        memset(&b, 0, sizeof (b));
+        for (int i = 0; i < threads; i++) {
+            b.enforces += worker[i].bucket[n].enforces;
+            b.keys += worker[i].bucket[n].keys;
+            b.generated += worker[i].bucket[n].generated;
+            b.ds_submit += worker[i].bucket[n].ds_submit;
+            b.ds_retract += worker[i].bucket[n].ds_retract;
+            b.signconf += worker[i].bucket[n].signconf;
+        }
+        total.enforces += b.enforces;
+        total.keys += b.keys;
+        total.generated += b.generated;
+        total.ds_submit += b.ds_submit;
+        total.ds_retract += b.ds_retract;
+        total.signconf += b.signconf;
+        if (!b.enforces) continue;
+        time_t t = start + (time_t)n * worker[0].interval;
+        struct tm tm;
+        char date[11];
+        if (!localtime_r(&t, &tm) || !strftime(date, sizeof (date), "%Y-%m-%d", &tm))
+            date[0] = '\0';
+        client_printf(sockfd, "%-10s %9lu %9lu %10lu %10lu %11lu %9lu\n",
+            date, b.enforces, b.keys, b.generated, b.ds_submit, b.ds_retract,
+            b.signconf);
+    }
+    client_printf(sockfd, "%-10s %9lu %9lu %10lu %10lu %11lu %9lu\n",
+        "Total", total.enforces, total.keys, total.generated,
+        total.ds_submit, total.ds_retract, total.signconf);
+    for (int i = 0; i < threads; i++) {
+        zones += worker[i].zones;
+        stalled += worker[i].stalled;
+        error |= worker[i].error;
+        free(worker[i].bucket);
+    }
+    free(worker);
+    client_printf(sockfd, "Simulated %lu zones over %d days in %ld seconds"
+        " using %d threads.\n", zones, days, (long)(time(NULL) - t0), threads);
+    if (stalled) {
+        client_printf_err(sockfd, "%lu zones made no progress, see the log"
+            " for details.\n", stalled);
+    }
+    if (error) {
+        client_printf_err(sockfd, "Not all zones could be simulated.\n");
+        return 1;
+    }
+    return 0;
+}
+
+struct cmd_func_block simulate_funcblock = {
+    "simulate", &usage, &help, NULL, &run
+};
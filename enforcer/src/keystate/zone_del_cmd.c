@@ -208,7 +208,11 @@ run(int sockfd, cmdhandler_ctx_type* context, char *cmd)
         ods_log_info("[%s] internal zonelist updated successfully", module_str);
     }
 
-    if (snprintf(cmd2, sizeof(cmd2), "%s %s", SIGNER_CLI_UPDATE, "--all") >= (int)sizeof(cmd2)
+    /* A single zone is removed from the signer without it rereading the
+     * complete zone list. */
+    if ((zonename
+            ? snprintf(cmd2, sizeof(cmd2), "%s %s --remove", SIGNER_CLI_UPDATE, zonename)
+            : snprintf(cmd2, sizeof(cmd2), "%s %s", SIGNER_CLI_UPDATE, "--all")) >= (int)sizeof(cmd2)
         || system(cmd2))
     {
         ods_log_error("[%s] unable to notify signer of zone deletion!", module_str);
@@ -225,18 +225,13 @@ process_xml(int sockfd, xmlNodePtr root, struct dbw_db *db)
                 }
                 zone->scratch = 3;
                 zone->dirty = DBW_UPDATE;
-                free(zone->signconf_path);
-                free(zone->input_adapter_uri);
-                free(zone->input_adapter_type);
-                free(zone->output_adapter_uri);
-                free(zone->output_adapter_type);
                 free(xz.name);
                 zone->policy              = p;
-                zone->signconf_path       = xz.signconf;
-                zone->input_adapter_uri   = xz.inadapter_uri;
-                zone->input_adapter_type  = xz.inadapter_type;
-                zone->output_adapter_uri  = xz.outadapter_uri;
-                zone->output_adapter_type = xz.outadapter_type;
+                dbw_replace_string(db, &zone->signconf_path, xz.signconf);
+                dbw_replace_string(db, &zone->input_adapter_uri, xz.inadapter_uri);
+                dbw_replace_string(db, &zone->input_adapter_type, xz.inadapter_type);
+                dbw_replace_string(db, &zone->output_adapter_uri, xz.outadapter_uri);
+                dbw_replace_string(db, &zone->output_adapter_type, xz.outadapter_type);
             }
         }
     }
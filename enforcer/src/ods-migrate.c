@@ -27,6 +27,7 @@
 #include "config.h"
 
 #include <getopt.h>
+#include <strings.h>
 #include <dlfcn.h>
 #include <libxml/parser.h>
 
@@ -66,6 +67,8 @@ functioncast(void*generic) {
 /****************************************************************************/
 
 struct dblayer_struct {
+    int (*hascolumn)(const char* table, const char* column);
+    void (*execute)(const char* statementStr);
     void (*foreach)(const char* listQueryStr, const char* updateQueryStr, int (*compute)(char**,int*,uint16_t*));
     void (*close)(void);
 } dblayer;
@@ -128,6 +131,41 @@ dblayer_sqlite3_close(void)
     dblayer_sqlite3.sqlite3_close(dblayer_sqlite3.handle);
 }
 
+struct hascolumnoperation {
+    const char* column;
+    int found;
+};
+
+static int
+hascolumn_callback(void *cargo, int argc, char **argv, char **names)
+{
+    struct hascolumnoperation* operation = (struct hascolumnoperation*) cargo;
+    /* table_info yields cid, name, type, notnull, dflt_value, pk */
+    if (argc > 1 && argv[1] && !strcasecmp(argv[1], operation->column))
+        operation->found = 1;
+    return SQLITE_OK;
+}
+
+static int
+dblayer_sqlite3_hascolumn(const char* table, const char* column)
+{
+    struct hascolumnoperation operation;
+    char queryStr[256];
+    operation.column = column;
+    operation.found = 0;
+    snprintf(queryStr, sizeof(queryStr), "PRAGMA table_info(%s)", table);
+    CHECKSQLITE(dblayer_sqlite3.sqlite3_exec(dblayer_sqlite3.handle, queryStr, hascolumn_callback, &operation, &dblayer_sqlite3.message));
+    return operation.found;
+}
+
+static void
+dblayer_sqlite3_execute(const char* statementStr)
+{
+    CHECKSQLITE(dblayer_sqlite3.sqlite3_exec(dblayer_sqlite3.handle, statementStr, NULL, NULL, &dblayer_sqlite3.message));
+    if (dblayer_sqlite3.status != SQLITE_OK)
+        exit(1);
+}
+
 struct callbackoperation {
     int (*compute)(char **argv, int* id, uint16_t *keytag);
     sqlite3_stmt* updateStmt;
@@ -181,6 +219,8 @@ static void
 dblayer_sqlite3_open(const char *datastore) {
     CHECKSQLITE(dblayer_sqlite3.sqlite3_open(datastore, &dblayer_sqlite3.handle));
     dblayer.close = &dblayer_sqlite3_close;
+    dblayer.hascolumn = &dblayer_sqlite3_hascolumn;
+    dblayer.execute = &dblayer_sqlite3_execute;
     dblayer.foreach = &dblayer_sqlite3_foreach;
 }
 
@@ -214,6 +254,32 @@ dblayer_mysql_close(void)
     }
 }
 
+static int
+dblayer_mysql_hascolumn(const char* table, const char* column)
+{
+    char queryStr[256];
+    MYSQL_RES* res;
+    int found;
+    snprintf(queryStr, sizeof(queryStr), "SHOW COLUMNS FROM %s LIKE '%s'", table, column);
+    if (mysql_query(dblayer_mysql.handle, queryStr) ||
+        !(res = mysql_store_result(dblayer_mysql.handle))) {
+        fprintf(stderr, "%s: sql error: %s\n", argv0, mysql_error(dblayer_mysql.handle));
+        exit(1);
+    }
+    found = (mysql_num_rows(res) > 0);
+    mysql_free_result(res);
+    return found;
+}
+
+static void
+dblayer_mysql_execute(const char* statementStr)
+{
+    if (mysql_query(dblayer_mysql.handle, statementStr)) {
+        fprintf(stderr, "%s: sql error: %s\n", argv0, mysql_error(dblayer_mysql.handle));
+        exit(1);
+    }
+}
+
 static void
 dblayer_mysql_foreach(const char* listQueryStr, const char* updateQueryStr, int (*compute)(char**,int*,uint16_t*))
 {
@@ -261,6 +327,8 @@ dblayer_mysql_open(const char* host, const char* user, const char* pass,
 	exit(1);
     }
     dblayer.close = &dblayer_mysql_close;
+    dblayer.hascolumn = &dblayer_mysql_hascolumn;
+    dblayer.execute = &dblayer_mysql_execute;
     dblayer.foreach = &dblayer_mysql_foreach;
 
 }
@@ -292,6 +360,18 @@ dblayer_finalize(void) {
 #endif
 }
 
+static int
+dblayer_hascolumn(const char* table, const char* column)
+{
+    return dblayer.hascolumn(table, column);
+}
+
+static void
+dblayer_execute(const char* statementStr)
+{
+    dblayer.execute(statementStr);
+}
+
 static void
 dblayer_foreach(const char* listQueryStr, const char* updateQueryStr, int (*compute)(char**,int*,uint16_t*))
 {
@@ -303,6 +383,23 @@ dblayer_foreach(const char* listQueryStr, const char* updateQueryStr, int (*comp
 const char* listQueryStr = "select keyData.id,keyData.algorithm,keyData.role,keyData.keytag,hsmKey.locator from keyData join hsmKey on keyData.hsmKeyId = hsmKey.id";
 const char* updateQueryStr = "update keyData set keytag = ? where id = ?";
 
+/* same as enforcer/utils/add_signature_store.sql, valid for both databases */
+const char* addSignatureStoreStr = "alter table policy add column slabStore int not null default 0";
+
+/**
+ * Add the columns that a database created by an older release lacks,
+ * before anything reads the tables.
+ *
+ */
+static void
+upgrade(void)
+{
+    if (!dblayer_hascolumn("policy", "slabStore")) {
+        ods_log_info("[ods-migrate] adding column slabStore to table policy");
+        dblayer_execute(addSignatureStoreStr);
+    }
+}
+
 static int
 compute(char **argv, int* id, uint16_t* keytag)
 {
@@ -417,6 +514,7 @@ main(int argc, char* argv[])
             fprintf(stderr, "No database defined\n");
     }
 
+    upgrade();
     dblayer_foreach(listQueryStr, updateQueryStr, &compute);
     
     hsm_close();
@@ -215,6 +215,7 @@ parse_conf_repositories(const char* cfgfile)
     char* module;
     char* tokenlabel;
     char* pin;
+    char* group;
     uint8_t use_pubkey;
     uint8_t allowextract;
     int require_backup;
@@ -254,6 +255,7 @@ parse_conf_repositories(const char* cfgfile)
             module = NULL;
             tokenlabel = NULL;
             pin = NULL;
+            group = NULL;
             use_pubkey = 1;
             allowextract = 0;
             require_backup = 0;
@@ -270,6 +272,8 @@ parse_conf_repositories(const char* cfgfile)
                     tokenlabel = (char *) xmlNodeGetContent(curNode);
                 if (xmlStrEqual(curNode->name, (const xmlChar *)"PIN"))
                     pin = (char *) xmlNodeGetContent(curNode);
+                if (xmlStrEqual(curNode->name, (const xmlChar *)"ReplicaGroup"))
+                    group = (char *) xmlNodeGetContent(curNode);
                 if (xmlStrEqual(curNode->name, (const xmlChar *)"SkipPublicKey"))
                     use_pubkey = 0;
                 if (xmlStrEqual(curNode->name, (const xmlChar *)"AllowExtraction"))
@@ -279,7 +283,7 @@ parse_conf_repositories(const char* cfgfile)
             }
             if (name && module && tokenlabel) {
                 repo = hsm_repository_new(name, module, tokenlabel, pin,
-                    use_pubkey, allowextract, require_backup);
+                    use_pubkey, allowextract, require_backup, group);
             }
             if (!repo) {
                ods_log_error("[%s] unable to add %s repository: "
@@ -293,6 +297,7 @@ parse_conf_repositories(const char* cfgfile)
             free((void*)name);
             free((void*)module);
             free((void*)tokenlabel);
+            free((void*)group);
         }
     }
 
@@ -613,6 +618,19 @@ parse_conf_use_syslog(const char* cfgfile)
     return 0;
 }
 
+int
+parse_conf_log_async(const char* cfgfile)
+{
+    const char* str = parse_conf_string(cfgfile,
+        "//Configuration/Common/Logging/Async",
+        0);
+    if (str) {
+        free((void*)str);
+        return 1;
+    }
+    return 0;
+}
+
 int
 parse_conf_verbosity(const char* cfgfile)
 {
@@ -675,6 +693,20 @@ parse_conf_db_port(const char* cfgfile)
     return port;
 }
 
+int
+parse_conf_db_performance(const char* cfgfile)
+{
+    int performance = 0;
+    const char* str = parse_conf_string(cfgfile,
+		"//Configuration/Enforcer/Datastore/SQLite/@Profile",
+		0);
+    if (str) {
+        performance = !strcmp(str, "performance");
+        free((void*)str);
+    }
+    return performance;
+}
+
 engineconfig_database_type_t parse_conf_db_type(const char *cfgfile) {
     const char* str = NULL;
 
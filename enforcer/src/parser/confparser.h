@@ -95,12 +95,14 @@ engineconfig_database_type_t parse_conf_db_type(const char *cfgfile);
 
 /** Common */
 int parse_conf_use_syslog(const char* cfgfile);
+int parse_conf_log_async(const char* cfgfile);
 int parse_conf_verbosity(const char* cfgfile);
 
 /** Enforcer specific */
 int parse_conf_worker_threads(const char* cfgfile);
 int parse_conf_manual_keygen(const char* cfgfile);
 int parse_conf_db_port(const char *cfgfile);
+int parse_conf_db_performance(const char *cfgfile);
 time_t parse_conf_automatic_keygen_period(const char* cfgfile);
 time_t parse_conf_rollover_notification(const char* cfgfile);
 hsm_repository_t* parse_conf_repositories(const char* cfgfile);
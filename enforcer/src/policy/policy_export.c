@@ -76,6 +76,7 @@ static int __policy_export(int sockfd, const struct dbw_policy *policy, xmlNodeP
         || !(error = 2)
         || !xmlNewProp(node, (xmlChar*)"name", (xmlChar*)policy->name)
         || !(error = 3)
+        || (policy->slab_store && !xmlNewChild(node, NULL, (xmlChar*)"SignatureStore", (xmlChar*)"slab"))
         || !xmlNewChild(node, NULL, (xmlChar*)"Description", (xmlChar*)policy->description)
 
         || !(error = 4)
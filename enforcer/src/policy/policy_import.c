@@ -60,6 +60,7 @@ struct xml_policy {
     char *description;
     char* denial_salt;
     unsigned int passthrough;
+    unsigned int slab_store;
     unsigned int signatures_resign;
     unsigned int signatures_refresh;
     unsigned int signatures_jitter;
@@ -217,6 +218,10 @@ xml_read_policy(xmlNodePtr node, struct xml_policy *policy)
 
     xml_try_read_bool(node,     "./Passthrough", &policy->passthrough);
     xml_try_read_content(node,  "./Description", &policy->description);
+    char *store = NULL;
+    xml_try_read_content(node,  "./SignatureStore", &store);
+    policy->slab_store = store && !strcmp(store, "slab");
+    free(store);
 
     xml_try_read_duration(node, "./Signatures/Resign", &policy->signatures_resign);
     xml_try_read_duration(node, "./Signatures/Refresh", &policy->signatures_refresh);
@@ -316,6 +321,7 @@ policy_xml_cmp(int sockfd, struct dbw_policy *p, struct xml_policy *xp)
         || (strcasecmp(p->description, xp->description))
         || (xp->denial_salt && strcmp(p->denial_salt, xp->denial_salt))
         || (p->passthrough != xp->passthrough)
+        || (p->slab_store != xp->slab_store)
         || (p->signatures_resign != xp->signatures_resign)
         || (p->signatures_refresh != xp->signatures_refresh)
         || (p->signatures_jitter != xp->signatures_jitter)
@@ -401,17 +407,16 @@ process_xml(int sockfd, xmlNodePtr root, struct xml_policy** policies_out, int *
 }
 
 static void
-xml2db(struct dbw_policy *p, struct xml_policy *xp)
+xml2db(struct dbw_db *db, struct dbw_policy *p, struct xml_policy *xp)
 {
-    free(p->name);
-    free(p->description);
-    p->name                         = strdup(xp->name?xp->name:"");
-    p->description                  = strdup(xp->description?xp->description:"");
+    dbw_replace_string(db, &p->name, strdup(xp->name?xp->name:""));
+    dbw_replace_string(db, &p->description,
+        strdup(xp->description?xp->description:""));
     if (xp->denial_salt) {
-        free(p->denial_salt);
-        p->denial_salt              = strdup(xp->denial_salt);
+        dbw_replace_string(db, &p->denial_salt, strdup(xp->denial_salt));
     }
     p->passthrough                  = xp->passthrough;
+    p->slab_store                   = xp->slab_store;
     p->signatures_resign            = xp->signatures_resign;
     p->signatures_refresh           = xp->signatures_refresh;
     p->signatures_jitter            = xp->signatures_jitter;
@@ -443,40 +448,35 @@ xml2db(struct dbw_policy *p, struct xml_policy *xp)
     p->parent_soa_minimum           = xp->parent_soa_minimum;
 }
 
-int policy_import(int sockfd, engine_type* engine, db_connection_t *dbconn,
-    int do_delete)
+int policy_import_db(int sockfd, engine_type* engine, struct dbw_db *db,
+    const char *filename, int do_delete)
 {
-    ods_log_assert(dbconn);
     ods_log_assert(engine);
     ods_log_assert(engine->config);
-    ods_log_assert(engine->config->policy_filename);
+    ods_log_assert(db);
+    ods_log_assert(filename);
 
     xmlDocPtr doc;
     xmlNodePtr root;
-    struct dbw_db *db = dbw_fetch(dbconn);
-    if (!db) return POLICY_IMPORT_ERR_DATABASE;
 
     char **hsm_names;
     int hsm_count;
     repository_names(engine->config->repositories, &hsm_names, &hsm_count);
 
     /* Validate, parse and walk the XML. */
-    if (check_kasp(engine->config->policy_filename, hsm_names, hsm_count, 0, NULL, NULL)) {
+    if (check_kasp(filename, hsm_names, hsm_count, 0, NULL, NULL)) {
         client_printf_err(sockfd, "Unable to validate the KASP XML, please run ods-kaspcheck for more details!\n");
         free(hsm_names);
-        dbw_free(db);
         return POLICY_IMPORT_ERR_XML;
     }
     free(hsm_names);
-    if (!(doc = xmlParseFile(engine->config->policy_filename))) {
+    if (!(doc = xmlParseFile(filename))) {
         client_printf_err(sockfd, "Unable to read/parse KASP XML file %s!\n",
-            engine->config->policy_filename);
-        dbw_free(db);
+            filename);
         return POLICY_IMPORT_ERR_XML;
     } else if (!(root = xmlDocGetRootElement(doc))) {
         client_printf_err(sockfd, "Unable to get the root element in the KASP XML!\n");
         xmlFreeDoc(doc);
-        dbw_free(db);
         return POLICY_IMPORT_ERR_XML;
     }
 
@@ -485,7 +485,6 @@ int policy_import(int sockfd, engine_type* engine, db_connection_t *dbconn,
     int r = process_xml(sockfd, root, &xpolicies, &count);
     xmlFreeDoc(doc);
     if (r) {
-        dbw_free(db);
         return POLICY_IMPORT_ERR_XML;
     }
     for (int i = 0; i < count; i++) {
@@ -508,7 +507,7 @@ int policy_import(int sockfd, engine_type* engine, db_connection_t *dbconn,
            p->scratch |= POLICY_SEEN|POLICY_CREATED;
         }
 
-        xml2db(p, xpolicies+i);
+        xml2db(db, p, xpolicies+i);
         dbw_mark_dirty((struct dbrow *)p);
         /* policykeys */
         for (int pk = 0; pk < p->policykey_count; pk++) {
@@ -551,6 +550,26 @@ int policy_import(int sockfd, engine_type* engine, db_connection_t *dbconn,
             }
         }
     }
+    return POLICY_IMPORT_OK;
+}
+
+int policy_import(int sockfd, engine_type* engine, db_connection_t *dbconn,
+    int do_delete)
+{
+    ods_log_assert(dbconn);
+    ods_log_assert(engine);
+    ods_log_assert(engine->config);
+    ods_log_assert(engine->config->policy_filename);
+
+    struct dbw_db *db = dbw_fetch(dbconn);
+    if (!db) return POLICY_IMPORT_ERR_DATABASE;
+
+    int r = policy_import_db(sockfd, engine, db,
+        engine->config->policy_filename, do_delete);
+    if (r) {
+        dbw_free(db);
+        return r;
+    }
     if (dbw_commit(db)) {
         r = POLICY_IMPORT_ERR_DATABASE;
     } else {
@@ -71,4 +71,19 @@
 int policy_import(int sockfd, engine_type* engine, db_connection_t *dbconn,
     int do_delete);
 
+/*
+ * Apply the policies of a KASP XML file to the in-memory database without
+ * committing. Policies that differ from the file are marked in their
+ * scratch field with POLICY_CREATED, POLICY_UPDATED or POLICY_RESALT.
+ * \param[in] sockfd a client socket which progress is written to if non-zero.
+ * \param[in] engine a engine_type pointer.
+ * \param[in] db the database to change.
+ * \param[in] filename KASP XML file.
+ * \param[in] do_delete a interger which will trigger deletion of policies not
+ * in the KASP if non-zero.
+ * \return POLICY_IMPORT_ERR_* on error otherwise POLICY_IMPORT_OK.
+ */
+int policy_import_db(int sockfd, engine_type* engine, struct dbw_db *db,
+    const char *filename, int do_delete);
+
 #endif /* _POLICY_POLICY_IMPORT_H_ */
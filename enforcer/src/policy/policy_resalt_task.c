@@ -130,7 +130,7 @@ perform_policy_resalt(task_type* task, char const *policyname, void *userdata,
 
     generate_salt(salt, policy->denial_salt_length);
     to_hex(salt, policy->denial_salt_length, salthex);
-    policy->denial_salt = strdup(salthex);
+    dbw_replace_string(db, &policy->denial_salt, strdup(salthex));
     policy->denial_salt_last_change = now;
     dbw_mark_dirty((struct dbrow *)policy);
 
@@ -27,6 +27,8 @@
  *
  */
 
+#include <ctype.h>
+
 #include "signconf/signconf_xml.h"
 #include "duration.h"
 #include "log.h"
@@ -38,6 +40,48 @@
 
 static const char *module_str = "signconf_cmd";
 
+/**
+ * Whether a zone setting can be handed to the signer on its command line.
+ * The command passes through the shell and is split on white space.
+ *
+ */
+static int
+signer_safe(const char *s)
+{
+    if (!s || !*s) return 0;
+    for (; *s; s++) {
+        if (!isalnum((unsigned char)*s) && !strchr("/._-+:@,=", *s))
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Build the command notifying the signer of the new signconf. The zone
+ * settings are passed along so the signer can reconcile just this zone
+ * instead of rereading the complete zone list.
+ *
+ */
+static int
+signer_update_cmd(char *cmd, size_t len, struct dbw_zone *zone)
+{
+    if (!zone->policy || !signer_safe(zone->policy->name)
+        || !signer_safe(zone->signconf_path)
+        || !signer_safe(zone->input_adapter_type)
+        || !signer_safe(zone->input_adapter_uri)
+        || !signer_safe(zone->output_adapter_type)
+        || !signer_safe(zone->output_adapter_uri))
+    {
+        return snprintf(cmd, len, "%s %s", SIGNER_CLI_UPDATE, zone->name);
+    }
+    return snprintf(cmd, len, "%s %s --policy %s --signconf %s"
+        " --in-type %s --input %s --out-type %s --output %s",
+        SIGNER_CLI_UPDATE, zone->name, zone->policy->name,
+        zone->signconf_path, zone->input_adapter_type,
+        zone->input_adapter_uri, zone->output_adapter_type,
+        zone->output_adapter_uri);
+}
+
 static time_t
 perform(task_type* task, char const *zonename, void *userdata, void *context)
 {
@@ -49,22 +93,40 @@ perform(task_type* task, char const *zonename, void *userdata, void *context)
     ods_log_info("[%s] performing signconf for zone %s", module_str,
         zonename);
 
-    /* exports all that have "needswriting set */
-    ret = signconf_export_zone(zonename, dbconn);
+    struct dbw_db *db = dbw_fetch(dbconn);
+    if (!db) {
+        ods_log_error("[%s] signconf failed", module_str);
+        return schedule_DEFER;
+    }
+    struct dbw_zone *zone = dbw_get_zone(db, zonename);
+    if (!zone) {
+        ods_log_error("[%s] Unable to fetch zone %s from database",
+            module_str, zonename);
+        dbw_free(db);
+        return schedule_DEFER;
+    }
+    /* We always force. Since now it is scheduled per zone */
+    ret = signconf_xml_export(-1, zone, 1);
+    if (ret == SIGNCONF_EXPORT_OK) {
+        ret = dbw_commit(db);
+    }
     if (ret == SIGNCONF_EXPORT_NO_CHANGE) {
         ods_log_info("[%s] signconf done, no change", module_str);
+        dbw_free(db);
         return schedule_SUCCESS;
     } else if (ret) {
         ods_log_error("[%s] signconf failed", module_str);
+        dbw_free(db);
         return schedule_DEFER;
     }
 
     ods_log_info("[%s] signconf done for zone %s, notifying signer",
         module_str, zonename);
-        
+
     /* TODO: do this better, connect directly or use execve() */
-    if (snprintf(cmd, sizeof(cmd), "%s %s", SIGNER_CLI_UPDATE, zonename) >= (int)sizeof(cmd)
-        || system(cmd))
+    ret = signer_update_cmd(cmd, sizeof(cmd), zone);
+    dbw_free(db);
+    if (ret >= (int)sizeof(cmd) || system(cmd))
     {
         ods_log_error("[%s] unable to notify signer of signconf changes for zone %s!",
             module_str, zonename);
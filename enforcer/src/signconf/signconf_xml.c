@@ -49,17 +49,7 @@ static int __free(char **p) {
     return 0;
 }
 
-/**
- * Export the signconf XML for the given zone that uses the given policy.
- * \param[in] sockfd a socket fd.
- * \param[in] policy a policy_t pointer.
- * \param[in] zone a zone_db_t pointer.
- * \param[in] force if non-zero it will force the export for all zones even if
- * there are no updates for the zones.
- * \return SIGNCONF_EXPORT_ERR_* on error, otherwise SIGNCONF_EXPORT_OK or
- * SIGNCONF_EXPORT_NO_CHANGE.
- */
-static int
+int
 signconf_xml_export(int sockfd, struct dbw_zone *zone, int force)
 {
     char path[PATH_MAX];
@@ -117,6 +107,8 @@ signconf_xml_export(int sockfd, struct dbw_zone *zone, int force)
     if (!xmlNewProp(node, (xmlChar*)"name", (xmlChar*)zone->name)
         || !(error = 26)
         || (policy->passthrough && !(node2 = xmlNewChild(node, NULL, (xmlChar*)"Passthrough", NULL)))
+        || !(error = 27)
+        || (policy->slab_store && !(node2 = xmlNewChild(node, NULL, (xmlChar*)"SignatureStore", (xmlChar*)"slab")))
         || !(error = 2)
         || !(node2 = xmlNewChild(node, NULL, (xmlChar*)"Signatures", NULL))
         || !(error = 3)
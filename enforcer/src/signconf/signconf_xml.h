@@ -60,6 +60,19 @@
  */
 #define SIGNCONF_EXPORT_NO_CHANGE 6
 
+/**
+ * Export the signconf XML for the given zone of a fetched database. The
+ * caller commits the changes.
+ * \param[in] sockfd a socket fd.
+ * \param[in] zone the zone, joined with its policy.
+ * \param[in] force if non-zero it will force the export for all zones even if
+ * there are no updates for the zones.
+ * \return SIGNCONF_EXPORT_ERR_* on error, otherwise SIGNCONF_EXPORT_OK or
+ * SIGNCONF_EXPORT_NO_CHANGE.
+ */
+int
+signconf_xml_export(int sockfd, struct dbw_zone *zone, int force);
+
 /**
  * Export the signconf XML for zone.
  * \param[in] zonename Name of zone to write signconf for.
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Synthetic KASP databases for the enforcer benchmarks.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "test/benchdb.h"
+
+#if defined(ENFORCER_DATABASE_SQLITE3)
+#include <sqlite3.h>
+#include "db/db_schema_sqlite.h"
+#include "db/db_data_sqlite.h"
+
+#define BENCHDB_DAY 86400
+
+/**
+ * Run the statements of a schema, each one spanning several strings and
+ * terminated by a NULL, like ods-enforcer-db-setup does.
+ *
+ */
+static int
+benchdb_exec_strs(sqlite3 *db, const char **strs)
+{
+    char sql[4096];
+    int len, i;
+    for (i = 0; strs[i]; i++) {
+        len = 0;
+        for (; strs[i]; i++) {
+            len += snprintf(sql + len, sizeof(sql) - len, "%s", strs[i]);
+            if (len >= (int)sizeof(sql)) return -1;
+        }
+        if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) return -1;
+    }
+    return 0;
+}
+
+static int
+benchdb_policies(sqlite3 *db, int policies)
+{
+    char sql[1024];
+    int p;
+    for (p = 1; p <= policies; p++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO policy (id, name, "
+            "description, signaturesResign, signaturesRefresh, "
+            "signaturesJitter, signaturesInceptionOffset, "
+            "signaturesValidityDefault, signaturesValidityDenial, "
+            "signaturesMaxZoneTtl, denialType, denialOptout, denialTtl, "
+            "denialResalt, denialAlgorithm, denialIterations, "
+            "denialSaltLength, denialSalt, denialSaltLastChange, keysTtl, "
+            "keysRetireSafety, keysPublishSafety, keysShared, "
+            "keysPurgeAfter, zonePropagationDelay, zoneSoaTtl, "
+            "zoneSoaMinimum, zoneSoaSerial, parentRegistrationDelay, "
+            "parentPropagationDelay, parentDsTtl, parentSoaTtl, "
+            "parentSoaMinimum, passthrough) VALUES (%d, 'bench%d', "
+            "'benchmark policy', 7200, 259200, 43200, 3600, 1209600, "
+            "1209600, 86400, 0, 0, 3600, 8640000, 1, 5, 8, 'aabbccdd', 0, "
+            "3600, 3600, 3600, 0, 1209600, 3600, 3600, 3600, 0, 86400, "
+            "3600, 3600, 3600, 3600, 0)", p, p);
+        if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Give every policy a KSK and a ZSK, like the default kasp.xml.
+ *
+ */
+static int
+benchdb_policykeys(sqlite3 *db, int policies)
+{
+    char sql[512];
+    int p;
+    for (p = 1; p <= policies; p++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO policyKey (policyId, role, "
+            "algorithm, bits, lifetime, repository, standby, manualRollover, "
+            "rfc5011, minimize) VALUES (%d, 1, 8, 2048, 31536000, 'SoftHSM', "
+            "0, 0, 0, 0), (%d, 2, 8, 1024, 7776000, 'SoftHSM', 0, 0, 0, 0)",
+            p, p);
+        if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) return -1;
+    }
+    return 0;
+}
+
+static int
+benchdb_zones(sqlite3 *db, int zones, int policies, time_t now)
+{
+    sqlite3_stmt *stmt = NULL;
+    char name[64];
+    time_t next;
+    int z, ret = 0;
+    if (sqlite3_prepare_v2(db, "INSERT INTO zone (policyId, name, "
+        "signconfNeedsWriting, signconfPath, nextChange, ttlEndDs, "
+        "ttlEndDk, ttlEndRs, rollKskNow, rollZskNow, rollCskNow, "
+        "inputAdapterType, inputAdapterUri, outputAdapterType, "
+        "outputAdapterUri, nextKskRoll, nextZskRoll, nextCskRoll) VALUES "
+        "(?, ?, 0, '/dev/null', ?, 0, 0, 0, 0, 0, 0, 'File', '/dev/null', "
+        "'File', '/dev/null', 0, 0, 0)", -1, &stmt, NULL) != SQLITE_OK)
+    {
+        return -1;
+    }
+    for (z = 0; z < zones && !ret; z++) {
+        if (z % 20 == 0) {
+            next = now - z % 3600;
+        } else if (z % 20 == 1) {
+            next = -1;
+        } else if (z % 4 >= 2) {
+            next = now + BENCHDB_DAY;
+        } else {
+            next = now + 1 + (time_t)z * 7919 % (30 * BENCHDB_DAY);
+        }
+        snprintf(name, sizeof(name), "zone%d.example", z);
+        if (sqlite3_bind_int(stmt, 1, 1 + z % policies) != SQLITE_OK
+            || sqlite3_bind_text(stmt, 2, name, -1, SQLITE_TRANSIENT) != SQLITE_OK
+            || sqlite3_bind_int64(stmt, 3, next) != SQLITE_OK
+            || sqlite3_step(stmt) != SQLITE_DONE)
+        {
+            ret = -1;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return ret;
+}
+
+int
+benchdb_create(const char *file, int zones, int policies, time_t now)
+{
+    sqlite3 *db = NULL;
+    int ret;
+    if (zones < 0 || policies < 0 || (zones && !policies)) return -1;
+    (void)unlink(file);
+    if (sqlite3_open_v2(file, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+        NULL) != SQLITE_OK)
+    {
+        fprintf(stderr, "unable to create %s\n", file);
+        sqlite3_close(db);
+        return -1;
+    }
+    ret = benchdb_exec_strs(db, db_schema_sqlite_create)
+        || benchdb_exec_strs(db, db_data_sqlite)
+        || sqlite3_exec(db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK
+        || benchdb_policies(db, policies)
+        || benchdb_policykeys(db, policies)
+        || benchdb_zones(db, zones, policies, now)
+        || sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK;
+    if (ret) {
+        fprintf(stderr, "unable to fill %s: %s\n", file, sqlite3_errmsg(db));
+    }
+    sqlite3_close(db);
+    return ret ? -1 : 0;
+}
+
+db_configuration_list_t *
+benchdb_configuration(const char *file, const char *profile)
+{
+    db_configuration_list_t *list;
+    db_configuration_t *cfg = NULL;
+    if (!(list = db_configuration_list_new())) return NULL;
+    if (!(cfg = db_configuration_new())
+        || db_configuration_set_name(cfg, "backend")
+        || db_configuration_set_value(cfg, "sqlite")
+        || db_configuration_list_add(list, cfg)
+        || !(cfg = db_configuration_new())
+        || db_configuration_set_name(cfg, "file")
+        || db_configuration_set_value(cfg, file)
+        || db_configuration_list_add(list, cfg))
+    {
+        db_configuration_free(cfg);
+        db_configuration_list_free(list);
+        return NULL;
+    }
+    if (profile && (!(cfg = db_configuration_new())
+        || db_configuration_set_name(cfg, "profile")
+        || db_configuration_set_value(cfg, profile)
+        || db_configuration_list_add(list, cfg)))
+    {
+        db_configuration_free(cfg);
+        db_configuration_list_free(list);
+        return NULL;
+    }
+    return list;
+}
+
+#else
+
+int
+benchdb_create(const char *file, int zones, int policies, time_t now)
+{
+    (void)file; (void)zones; (void)policies; (void)now;
+    fprintf(stderr, "the enforcer benchmarks need the SQLite backend\n");
+    return -1;
+}
+
+db_configuration_list_t *
+benchdb_configuration(const char *file, const char *profile)
+{
+    (void)file; (void)profile;
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _TEST_BENCHDB_H_
+#define _TEST_BENCHDB_H_
+
+#include <time.h>
+
+#include "db/db_configuration.h"
+
+/**
+ * Create a synthetic KASP database for the enforcer benchmarks.
+ *
+ * Every policy has a KSK and a ZSK, the zones have no keys yet.
+ * The zones are spread over the policies. Of the zones 5% are overdue,
+ * 5% have no changes scheduled, half share one deadline a day from now
+ * as if imported together, and the rest have deadlines spread over the
+ * next 30 days. Without zones and policies only the schema is created.
+ * \param[in] file SQLite database file, overwritten
+ * \param[in] zones number of zones
+ * \param[in] policies number of policies
+ * \param[in] now time the next changes of the zones are relative to
+ * \return 0 on success
+ */
+int benchdb_create(const char *file, int zones, int policies, time_t now);
+
+/**
+ * Database configuration for a file created by benchdb_create().
+ * \param[in] file SQLite database file
+ * \param[in] profile SQLite profile, NULL for the default
+ * \return configuration list, NULL on failure
+ */
+db_configuration_list_t *benchdb_configuration(const char *file,
+    const char *profile);
+
+#endif /* _TEST_BENCHDB_H_ */
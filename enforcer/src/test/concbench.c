@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Enforcer database concurrency benchmark.
+ *
+ * Runs a number of reader threads, each with its own connection like the
+ * enforcer workers, that read the database with dbw_fetch, next to a writer
+ * that keeps changing zones and committing them with dbw_commit. This is
+ * done with the default SQLite profile and with the performance profile
+ * on the same synthetic database. Reports the number of reads and commits
+ * and how long they took, including the slowest.
+ *
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "db/db_connection.h"
+#include "db/dbw.h"
+#include "duration.h"
+#include "log.h"
+#include "test/bench.h"
+#include "test/benchdb.h"
+
+#define CONCBENCH_ZONES 5000
+#define CONCBENCH_READERS 4
+#define CONCBENCH_SECONDS 5
+#define CONCBENCH_CHANGES 500
+#define CONCBENCH_FILE "concbench.db"
+
+struct concbench_stats {
+    long count;
+    long failed;
+    double total;
+    double max;
+};
+
+struct concbench_thread {
+    pthread_t thread;
+    const db_configuration_list_t *cfg;
+    struct concbench_stats stats;
+    int changes;
+};
+
+static volatile int concbench_stop = 0;
+
+static void
+concbench_record(struct concbench_stats *stats, double start, int failed)
+{
+    double secs = bench_now() - start;
+    if (failed) {
+        stats->failed++;
+        return;
+    }
+    stats->count++;
+    stats->total += secs;
+    if (secs > stats->max) stats->max = secs;
+}
+
+static db_connection_t *
+concbench_connect(const db_configuration_list_t *cfg)
+{
+    db_connection_t *dbconn;
+    if (!(dbconn = db_connection_new())
+        || db_connection_set_configuration_list(dbconn, cfg)
+        || db_connection_setup(dbconn)
+        || db_connection_connect(dbconn))
+    {
+        db_connection_free(dbconn);
+        return NULL;
+    }
+    return dbconn;
+}
+
+static void *
+concbench_reader(void *arg)
+{
+    struct concbench_thread *t = (struct concbench_thread *)arg;
+    db_connection_t *dbconn = concbench_connect(t->cfg);
+    struct dbw_db *db;
+    double start;
+
+    if (!dbconn) return NULL;
+    while (!concbench_stop) {
+        start = bench_now();
+        db = dbw_fetch(dbconn);
+        concbench_record(&t->stats, start, !db);
+        dbw_free(db);
+    }
+    db_connection_free(dbconn);
+    return NULL;
+}
+
+static void *
+concbench_writer(void *arg)
+{
+    struct concbench_thread *t = (struct concbench_thread *)arg;
+    db_connection_t *dbconn = concbench_connect(t->cfg);
+    struct dbw_db *db;
+    struct dbw_zone *zone;
+    double start;
+    size_t next = 0;
+    int i;
+
+    if (!dbconn) return NULL;
+    while (!concbench_stop) {
+        if (!(db = dbw_fetch(dbconn))) {
+            t->stats.failed++;
+            continue;
+        }
+        for (i = 0; i < t->changes && db->zones->n; i++) {
+            zone = (struct dbw_zone *)db->zones->set[next++ % db->zones->n];
+            zone->next_change++;
+            dbw_mark_dirty((struct dbrow *)zone);
+        }
+        start = bench_now();
+        concbench_record(&t->stats, start, dbw_commit(db));
+        dbw_free(db);
+    }
+    db_connection_free(dbconn);
+    return NULL;
+}
+
+static void
+concbench_print(const char *profile, const char *what,
+    struct concbench_stats *stats, int seconds)
+{
+    printf("%-12s %-7s %7ld ok %5ld failed %9.1f/s %9.2f ms avg "
+        "%9.2f ms max\n", profile, what, stats->count, stats->failed,
+        (double)stats->count / seconds,
+        stats->count ? stats->total / stats->count * 1000.0 : 0.0,
+        stats->max * 1000.0);
+}
+
+static int
+concbench_run(const char *profile, int readers, int seconds, int changes)
+{
+    db_configuration_list_t *cfg;
+    struct concbench_thread *threads;
+    struct concbench_stats reads;
+    int i;
+
+    if (!(cfg = benchdb_configuration(CONCBENCH_FILE, profile))
+        || !(threads = calloc(readers + 1, sizeof(struct concbench_thread))))
+    {
+        db_configuration_list_free(cfg);
+        return 1;
+    }
+    concbench_stop = 0;
+    for (i = 0; i <= readers; i++) {
+        threads[i].cfg = cfg;
+        threads[i].changes = changes;
+        if (pthread_create(&threads[i].thread, NULL,
+            i ? concbench_reader : concbench_writer, &threads[i]))
+        {
+            fprintf(stderr, "unable to start thread\n");
+            exit(1);
+        }
+    }
+    sleep(seconds);
+    concbench_stop = 1;
+    memset(&reads, 0, sizeof(reads));
+    for (i = 0; i <= readers; i++) {
+        pthread_join(threads[i].thread, NULL);
+        if (!i) continue;
+        reads.count += threads[i].stats.count;
+        reads.failed += threads[i].stats.failed;
+        reads.total += threads[i].stats.total;
+        if (threads[i].stats.max > reads.max) reads.max = threads[i].stats.max;
+    }
+    concbench_print(profile ? profile : "default", "fetch", &reads, seconds);
+    concbench_print(profile ? profile : "default", "commit",
+        &threads[0].stats, seconds);
+    free(threads);
+    db_configuration_list_free(cfg);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int zones = CONCBENCH_ZONES;
+    int readers = CONCBENCH_READERS;
+    int seconds = CONCBENCH_SECONDS;
+    int changes = CONCBENCH_CHANGES;
+
+    if (argc > 1) zones = atoi(argv[1]);
+    if (argc > 2) readers = atoi(argv[2]);
+    if (argc > 3) seconds = atoi(argv[3]);
+    if (argc > 4) changes = atoi(argv[4]);
+    if (zones <= 0 || readers <= 0 || seconds <= 0 || changes <= 0) {
+        fprintf(stderr, "usage: %s [zones [readers [seconds [changes]]]]\n",
+            argv[0]);
+        return 1;
+    }
+    ods_log_init("concbench", 0, NULL, 0);
+    if (benchdb_create(CONCBENCH_FILE, zones, 4, time_now())) {
+        fprintf(stderr, "unable to set up the benchmark\n");
+        return 1;
+    }
+    printf("%d zones, %d readers, 1 writer changing %d zones per commit, "
+        "%d s per profile\n", zones, readers, changes, seconds);
+    /* WAL mode sticks to the file, so the default profile goes first */
+    if (concbench_run(NULL, readers, seconds, changes)
+        || concbench_run("performance", readers, seconds, changes))
+    {
+        fprintf(stderr, "unable to run the benchmark\n");
+        return 1;
+    }
+    (void)unlink(CONCBENCH_FILE);
+    (void)unlink(CONCBENCH_FILE "-wal");
+    (void)unlink(CONCBENCH_FILE "-shm");
+    return 0;
+}
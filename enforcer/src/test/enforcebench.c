@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/**
+ * Enforcer evaluation benchmark.
+ *
+ * Creates a synthetic database with many zones on one policy, gives every
+ * zone its keys and then enforces all zones a number of times, each zone
+ * at the time it asked to be enforced again, with a ZSK rollover halfway.
+ * The DS is taken to be seen at the parent right away, like the lookahead
+ * command does. The checksum of the resulting key states is printed so
+ * that runs of different builds can be compared. The database uses the
+ * performance profile to store the keys quickly.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "daemon/cfg.h"
+#include "daemon/engine.h"
+#include "db/dbw.h"
+#include "enforcer/enforcer.h"
+#include "log.h"
+#include "test/bench.h"
+#include "test/benchdb.h"
+
+#define ENFORCEBENCH_ZONES 10000
+#define ENFORCEBENCH_STEPS 12
+#define ENFORCEBENCH_FILE "enforcebench.db"
+/** Fixed start time, so the checksum can be compared between builds. */
+#define ENFORCEBENCH_START 1500000000
+
+/**
+ * Move the DS of the keys of zone along as if the user did.
+ *
+ * \return 1 if a DS changed
+ */
+static int
+enforcebench_parent(struct dbw_zone *zone)
+{
+    int changed = 0;
+    for (size_t k = 0; k < zone->key_count; k++) {
+        struct dbw_key *key = zone->key[k];
+        switch (key->ds_at_parent) {
+            case DBW_DS_AT_PARENT_SUBMIT:
+                key->ds_at_parent = DBW_DS_AT_PARENT_SUBMITTED;
+                break;
+            case DBW_DS_AT_PARENT_SUBMITTED:
+                key->ds_at_parent = DBW_DS_AT_PARENT_SEEN;
+                break;
+            case DBW_DS_AT_PARENT_RETRACT:
+                key->ds_at_parent = DBW_DS_AT_PARENT_RETRACTED;
+                break;
+            case DBW_DS_AT_PARENT_RETRACTED:
+                key->ds_at_parent = DBW_DS_AT_PARENT_UNSUBMITTED;
+                break;
+            default:
+                continue;
+        }
+        changed = 1;
+    }
+    return changed;
+}
+
+/**
+ * Sum up the key states of all zones, to compare runs.
+ *
+ */
+static unsigned long
+enforcebench_checksum(struct dbw_db *db)
+{
+    unsigned long sum = 0;
+    for (size_t z = 0; z < db->zones->n; z++) {
+        struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
+        sum = sum * 31 + (unsigned long)zone->next_change;
+        for (size_t k = 0; k < zone->key_count; k++) {
+            struct dbw_key *key = zone->key[k];
+            sum = sum * 31 + key->role;
+            for (size_t s = 0; s < key->keystate_count; s++) {
+                sum = sum * 31 + key->keystate[s]->type;
+                sum = sum * 31 + key->keystate[s]->state;
+                sum = sum * 31 + (unsigned long)key->keystate[s]->last_change;
+            }
+        }
+    }
+    return sum;
+}
+
+/**
+ * Enforce every zone steps times.
+ *
+ * \param[out] checksum of the resulting key states
+ * \return seconds spent enforcing, negative on error
+ */
+static double
+enforcebench_run(engine_type *engine, db_connection_t *dbconn, time_t now,
+    int steps, size_t *evaluations, unsigned long *checksum)
+{
+    struct dbw_db *db;
+    struct timeval start;
+    double secs = 0.0;
+    int zone_updated;
+
+    if (!(db = dbw_fetch(dbconn))) return -1.0;
+    *evaluations = 0;
+    for (size_t z = 0; z < db->zones->n; z++) {
+        struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
+        zone->next_change = now;
+    }
+    for (int step = 0; step < steps; step++) {
+        gettimeofday(&start, NULL);
+        for (size_t z = 0; z < db->zones->n; z++) {
+            struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
+            time_t t = zone->next_change;
+            if (t < 0) continue;
+            if (step == steps / 2) zone->roll_zsk_now = 1;
+            zone_updated = 0;
+            t = update_mockup(engine, db, zone, t, &zone_updated);
+            if (enforcebench_parent(zone)) t = zone->next_change;
+            zone->next_change = t;
+            (*evaluations)++;
+        }
+        secs += bench_elapsed(&start);
+    }
+    *checksum = enforcebench_checksum(db);
+    dbw_free(db);
+    return secs;
+}
+
+int
+main(int argc, char *argv[])
+{
+    engine_type engine;
+    engineconfig_type config;
+    db_connection_t *dbconn;
+    struct dbw_db *db;
+    int zones = ENFORCEBENCH_ZONES;
+    int steps = ENFORCEBENCH_STEPS;
+    int zone_updated;
+    time_t now = ENFORCEBENCH_START;
+    size_t evaluations;
+    unsigned long checksum;
+    double secs;
+
+    if (argc > 1) {
+        zones = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        steps = atoi(argv[2]);
+    }
+    if (zones <= 0 || steps <= 0) {
+        fprintf(stderr, "usage: %s [zones [steps]]\n", argv[0]);
+        return 1;
+    }
+    ods_log_init("enforcebench", 0, NULL, 0);
+    memset(&engine, 0, sizeof(engine));
+    memset(&config, 0, sizeof(config));
+    engine.config = &config;
+    if (benchdb_create(ENFORCEBENCH_FILE, zones, 1, now)
+        || !(engine.dbcfg_list = benchdb_configuration(ENFORCEBENCH_FILE,
+            "performance"))
+        || !(dbconn = get_database_connection(&engine)))
+    {
+        fprintf(stderr, "unable to set up the benchmark\n");
+        return 1;
+    }
+
+    /* Store a KSK and a ZSK for every zone so the keys have an id. */
+    if (!(db = dbw_fetch(dbconn))) {
+        fprintf(stderr, "unable to read the database\n");
+        return 1;
+    }
+    for (size_t z = 0; z < db->zones->n; z++) {
+        struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
+        zone_updated = 0;
+        (void)update_mockup(&engine, db, zone, now, &zone_updated);
+    }
+    for (size_t h = 0; h < db->hsmkeys->n; h++) {
+        struct dbw_hsmkey *hsmkey = (struct dbw_hsmkey *)db->hsmkeys->set[h];
+        char locator[32];
+        char *str;
+        /* the mockup keys all have the same locator */
+        snprintf(locator, sizeof(locator), "enforcebench-%lu", (unsigned long)h);
+        if (!(str = strdup(locator))) return 1;
+        dbw_replace_string(db, &hsmkey->locator, str);
+    }
+    if (dbw_commit(db)) {
+        fprintf(stderr, "unable to store the keys\n");
+        return 1;
+    }
+    dbw_free(db);
+
+    secs = enforcebench_run(&engine, dbconn, now, steps, &evaluations,
+        &checksum);
+    if (secs < 0.0) {
+        fprintf(stderr, "unable to read the database\n");
+        return 1;
+    }
+
+    printf("zones=%d\n", zones);
+    printf("steps=%d\n", steps);
+    printf("evaluations=%lu\n", (unsigned long)evaluations);
+    printf("enforce_s=%.3f\n", secs);
+    printf("enforce_us=%.1f\n",
+        evaluations ? secs * 1e6 / evaluations : 0.0);
+    printf("checksum=%lx\n", checksum);
+
+    db_connection_free(dbconn);
+    db_configuration_list_free(engine.dbcfg_list);
+    (void)unlink(ENFORCEBENCH_FILE);
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Enforcer database fetch benchmark.
+ *
+ * Creates a synthetic database with many zones and reads it into memory
+ * with dbw_fetch a number of times, the way every enforce and most
+ * commands do. Reports the time and the number of allocations per fetch.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "daemon/engine.h"
+#include "db/dbw.h"
+#include "duration.h"
+#include "log.h"
+#include "test/bench.h"
+#include "test/benchdb.h"
+
+#define FETCHBENCH_ZONES 50000
+#define FETCHBENCH_ROUNDS 5
+#define FETCHBENCH_FILE "fetchbench.db"
+
+static unsigned long fetchbench_allocs = 0;
+
+#ifdef __GLIBC__
+/**
+ * Count allocations, passing them on to the C library.
+ *
+ */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+void*
+malloc(size_t size)
+{
+    __atomic_fetch_add(&fetchbench_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void*
+calloc(size_t nmemb, size_t size)
+{
+    __atomic_fetch_add(&fetchbench_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void*
+realloc(void* ptr, size_t size)
+{
+    __atomic_fetch_add(&fetchbench_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void
+free(void* ptr)
+{
+    __libc_free(ptr);
+}
+#endif
+
+static unsigned long
+fetchbench_allocations(void)
+{
+    return __atomic_load_n(&fetchbench_allocs, __ATOMIC_RELAXED);
+}
+
+int
+main(int argc, char *argv[])
+{
+    engine_type engine;
+    db_connection_t *dbconn;
+    struct dbw_db *db;
+    struct timeval start;
+    int zones = FETCHBENCH_ZONES;
+    int rounds = FETCHBENCH_ROUNDS;
+    unsigned long allocs;
+    double secs, best = 0.0, total = 0.0;
+    size_t rows = 0;
+    int i;
+
+    if (argc > 1) {
+        zones = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        rounds = atoi(argv[2]);
+    }
+    if (zones <= 0 || rounds <= 0) {
+        fprintf(stderr, "usage: %s [zones [rounds]]\n", argv[0]);
+        return 1;
+    }
+    ods_log_init("fetchbench", 0, NULL, 0);
+    memset(&engine, 0, sizeof(engine));
+    if (benchdb_create(FETCHBENCH_FILE, zones, 4, time_now())
+        || !(engine.dbcfg_list = benchdb_configuration(FETCHBENCH_FILE, NULL))
+        || !(dbconn = get_database_connection(&engine)))
+    {
+        fprintf(stderr, "unable to set up the benchmark\n");
+        return 1;
+    }
+
+    allocs = fetchbench_allocations();
+    for (i = 0; i < rounds; i++) {
+        gettimeofday(&start, NULL);
+        if (!(db = dbw_fetch(dbconn))) {
+            fprintf(stderr, "unable to read the database\n");
+            return 1;
+        }
+        secs = bench_elapsed(&start);
+        rows = db->policies->n + db->policykeys->n + db->zones->n +
+            db->keys->n + db->hsmkeys->n + db->keystates->n +
+            db->keydependencies->n;
+        dbw_free(db);
+        if (!i || secs < best) best = secs;
+        total += secs;
+    }
+    allocs = fetchbench_allocations() - allocs;
+
+    printf("zones=%d\n", zones);
+    printf("rows=%lu\n", (unsigned long)rows);
+    printf("rounds=%d\n", rounds);
+    printf("fetch_best_s=%.3f\n", best);
+    printf("fetch_avg_s=%.3f\n", total / rounds);
+    printf("fetch_allocs=%lu\n", allocs / rounds);
+    printf("allocs_per_row=%.1f\n", rows ? (double)allocs / rounds / rows : 0.0);
+
+    db_connection_free(dbconn);
+    db_configuration_list_free(engine.dbcfg_list);
+    (void)unlink(FETCHBENCH_FILE);
+    return 0;
+}
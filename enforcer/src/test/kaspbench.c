@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/**
+ * Enforcer throughput benchmark.
+ *
+ * Writes a KASP file with a number of policies and a zonelist with a
+ * number of zones and loads them into an empty database through
+ * policy_import() and zonelist_import(), like 'ods-enforcer update all'.
+ * Then it time leaps through the scheduled tasks for a number of days,
+ * so the zones build up a history of rollovers, and lists the keys.
+ *
+ * The enforce and key generation tasks are the daemon's own, with the
+ * keys in the software keystore of libhsm. Once a day the DS changes are
+ * confirmed, as 'ods-enforcer key ds-seen' and 'key ds-gone' would. The
+ * signconf tasks write the signer configuration but do not notify a
+ * signer. Output is one name=value pair per line.
+ *
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "cmdhandler.h"
+#include "daemon/cfg.h"
+#include "daemon/engine.h"
+#include "db/dbw.h"
+#include "duration.h"
+#include "hsmkey/hsm_key_factory.h"
+#include "keystate/keystate_ds.h"
+#include "keystate/keystate_list_cmd.h"
+#include "keystate/zonelist_import.h"
+#include "libhsm.h"
+#include "log.h"
+#include "policy/policy_import.h"
+#include "scheduler/schedule.h"
+#include "scheduler/task.h"
+#include "signconf/signconf_xml.h"
+#include "test/bench.h"
+#include "test/benchdb.h"
+
+#define KASPBENCH_ZONES 200
+#define KASPBENCH_POLICIES 4
+#define KASPBENCH_DAYS 365
+#define KASPBENCH_FILE "kaspbench.db"
+#define KASPBENCH_KASP "kaspbench-kasp.xml"
+#define KASPBENCH_ZONELIST "kaspbench-zonelist.xml"
+#define KASPBENCH_KEYSTORE "kaspbench.keystore"
+#define KASPBENCH_SIGNCONF "kaspbench-signconf"
+/** Fixed start time, so runs can be compared between builds. */
+#define KASPBENCH_START 1500000000
+
+/**
+ * Where the tasks spent their time.
+ *
+ */
+struct kaspbench_stats {
+    unsigned long enforces;
+    unsigned long keygens;
+    unsigned long signconfs;
+    double enforce;
+    double keygen;
+    double signconf;
+    double ds;
+    int queue_max;
+};
+
+static struct kaspbench_stats kaspbench_stats;
+
+/**
+ * Write a KASP file with policies that differ in their ZSK lifetime and
+ * denial of existence. The keys are ECDSA, which the keystore generates
+ * quickly.
+ *
+ */
+static int
+kaspbench_write_kasp(const char *file, int policies)
+{
+    static const int zsk_days[] = {90, 60, 30};
+    FILE *fp;
+    int p;
+
+    if (!(fp = fopen(file, "w"))) return -1;
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<KASP>\n");
+    for (p = 0; p < policies; p++) {
+        fprintf(fp,
+            "<Policy name=\"policy%d\">\n"
+            "<Description>kaspbench policy %d</Description>\n"
+            "<Signatures><Resign>PT2H</Resign><Refresh>P3D</Refresh>"
+            "<Validity><Default>P14D</Default><Denial>P14D</Denial></Validity>"
+            "<Jitter>PT12H</Jitter><InceptionOffset>PT3600S</InceptionOffset>"
+            "<MaxZoneTTL>P1D</MaxZoneTTL></Signatures>\n"
+            "<Denial>%s</Denial>\n"
+            "<Keys><TTL>PT3600S</TTL><RetireSafety>PT3600S</RetireSafety>"
+            "<PublishSafety>PT3600S</PublishSafety><Purge>P14D</Purge>"
+            "<KSK><Algorithm length=\"256\">13</Algorithm><Lifetime>P1Y</Lifetime>"
+            "<Repository>kaspbench</Repository></KSK>"
+            "<ZSK><Algorithm length=\"256\">13</Algorithm><Lifetime>P%dD</Lifetime>"
+            "<Repository>kaspbench</Repository></ZSK></Keys>\n"
+            "<Zone><PropagationDelay>PT43200S</PropagationDelay><SOA>"
+            "<TTL>PT3600S</TTL><Minimum>PT3600S</Minimum><Serial>unixtime</Serial>"
+            "</SOA></Zone>\n"
+            "<Parent><PropagationDelay>PT9999S</PropagationDelay><DS>"
+            "<TTL>PT3600S</TTL></DS><SOA><TTL>PT172800S</TTL>"
+            "<Minimum>PT10800S</Minimum></SOA></Parent>\n"
+            "</Policy>\n", p, p,
+            p % 2 ? "<NSEC/>" : "<NSEC3><Resalt>P100D</Resalt><Hash>"
+                "<Algorithm>1</Algorithm><Iterations>5</Iterations>"
+                "<Salt length=\"8\"/></Hash></NSEC3>",
+            zsk_days[p % 3]);
+    }
+    fprintf(fp, "</KASP>\n");
+    return fclose(fp) ? -1 : 0;
+}
+
+static int
+kaspbench_write_zonelist(const char *file, int zones, int policies)
+{
+    FILE *fp;
+    int z;
+
+    if (!(fp = fopen(file, "w"))) return -1;
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<ZoneList>\n");
+    for (z = 0; z < zones; z++) {
+        fprintf(fp,
+            "<Zone name=\"zone%d.example\"><Policy>policy%d</Policy>"
+            "<SignerConfiguration>" KASPBENCH_SIGNCONF "/zone%d.xml"
+            "</SignerConfiguration><Adapters>"
+            "<Input><Adapter type=\"File\">/dev/null</Adapter></Input>"
+            "<Output><Adapter type=\"File\">/dev/null</Adapter></Output>"
+            "</Adapters></Zone>\n", z, z % policies, z);
+    }
+    fprintf(fp, "</ZoneList>\n");
+    return fclose(fp) ? -1 : 0;
+}
+
+/**
+ * The signconf task without notifying the signer.
+ *
+ */
+static time_t
+kaspbench_signconf(task_type *task, char const *owner, void *userdata,
+    void *context)
+{
+    db_connection_t *dbconn = (db_connection_t *)context;
+    struct dbw_db *db;
+    struct dbw_zone *zone;
+    int ret;
+    (void)task;
+    (void)userdata;
+
+    if (!(db = dbw_fetch(dbconn))) return schedule_DEFER;
+    if (!(zone = dbw_get_zone(db, owner))) {
+        dbw_free(db);
+        return schedule_SUCCESS;
+    }
+    ret = signconf_xml_export(-1, zone, 1);
+    if (ret == SIGNCONF_EXPORT_OK) {
+        ret = dbw_commit(db);
+    }
+    dbw_free(db);
+    if (ret && ret != SIGNCONF_EXPORT_NO_CHANGE) return schedule_DEFER;
+    return schedule_SUCCESS;
+}
+
+/**
+ * Run the scheduled tasks in order of their due date, leaping in time
+ * like 'ods-enforcer time leap --attach', until the next one is due
+ * after until.
+ *
+ */
+static void
+kaspbench_leap(engine_type *engine, db_connection_t *dbconn, time_t until)
+{
+    struct timeval start;
+    task_type *task;
+    double *spent;
+    unsigned long *count;
+    time_t t;
+    int queued;
+
+    for (;;) {
+        (void)schedule_info(engine->taskq, &t, NULL, &queued);
+        if (queued > kaspbench_stats.queue_max)
+            kaspbench_stats.queue_max = queued;
+        if (t == -1 || t > until) break;
+        if (t > time_now()) set_time_now(t);
+        if (!(task = schedule_pop_first_task(engine->taskq))) break;
+        spent = NULL;
+        count = NULL;
+        if (schedule_task_istype(task, TASK_TYPE_ENFORCE)) {
+            spent = &kaspbench_stats.enforce;
+            count = &kaspbench_stats.enforces;
+        } else if (schedule_task_istype(task, TASK_TYPE_HSMKEYGEN)) {
+            spent = &kaspbench_stats.keygen;
+            count = &kaspbench_stats.keygens;
+        } else if (schedule_task_istype(task, TASK_TYPE_SIGNCONF)) {
+            task->callback = kaspbench_signconf;
+            spent = &kaspbench_stats.signconf;
+            count = &kaspbench_stats.signconfs;
+        } else {
+            /* no DS commands are configured, nothing else to run */
+            task->callback = NULL;
+        }
+        gettimeofday(&start, NULL);
+        task_perform(engine->taskq, task, dbconn);
+        if (spent) {
+            *spent += bench_elapsed(&start);
+            (*count)++;
+        }
+    }
+}
+
+/**
+ * Confirm the DS changes of all zones, as the user would with
+ * 'key ds-seen' and 'key ds-gone'. This schedules the zones again.
+ *
+ */
+static void
+kaspbench_ds(engine_type *engine, db_connection_t *dbconn, int fd)
+{
+    struct timeval start;
+
+    gettimeofday(&start, NULL);
+    (void)change_keys_from_to(dbconn, fd, NULL, NULL, -1,
+        DBW_DS_AT_PARENT_SUBMIT, DBW_DS_AT_PARENT_SEEN, engine, 1);
+    (void)change_keys_from_to(dbconn, fd, NULL, NULL, -1,
+        DBW_DS_AT_PARENT_RETRACT, DBW_DS_AT_PARENT_UNSUBMITTED, engine, 1);
+    kaspbench_stats.ds += bench_elapsed(&start);
+}
+
+/**
+ * Run the 'key list' command with its output going nowhere.
+ *
+ * \return seconds spent, negative on error
+ */
+static double
+kaspbench_key_list(engine_type *engine, db_connection_t *dbconn, int fd)
+{
+    cmdhandler_ctx_type context;
+    struct timeval start;
+    char cmd[] = "key list --verbose --all";
+    int r;
+
+    memset(&context, 0, sizeof(context));
+    context.sockfd = fd;
+    context.globalcontext = engine;
+    context.localcontext = dbconn;
+    gettimeofday(&start, NULL);
+    r = key_list_funcblock.run(fd, &context, cmd);
+    return r ? -1.0 : bench_elapsed(&start);
+}
+
+int
+main(int argc, char *argv[])
+{
+    engine_type engine;
+    engineconfig_type config;
+    db_connection_t *dbconn;
+    struct timeval start;
+    struct rusage usage;
+    int zones = KASPBENCH_ZONES;
+    int policies = KASPBENCH_POLICIES;
+    int days = KASPBENCH_DAYS;
+    double import, enforce_all, leap, key_list;
+    unsigned long enforce_all_zones;
+    int queue_import, day, devnull;
+
+    if (argc > 1) zones = atoi(argv[1]);
+    if (argc > 2) policies = atoi(argv[2]);
+    if (argc > 3) days = atoi(argv[3]);
+    if (zones <= 0 || policies <= 0 || days < 0) {
+        fprintf(stderr, "usage: %s [zones [policies [days]]]\n", argv[0]);
+        return 1;
+    }
+    ods_log_init("kaspbench", 0, NULL, 0);
+    set_time_now(KASPBENCH_START);
+    memset(&engine, 0, sizeof(engine));
+    memset(&config, 0, sizeof(config));
+    engine.config = &config;
+    config.policy_filename = KASPBENCH_KASP;
+    config.zonelist_filename = KASPBENCH_ZONELIST;
+    /* the daemon's default */
+    config.automatic_keygen_duration = 365 * 24 * 3600;
+    (void)unlink(KASPBENCH_KEYSTORE);
+    (void)mkdir(KASPBENCH_SIGNCONF, 0755);
+    if (kaspbench_write_kasp(KASPBENCH_KASP, policies)
+        || kaspbench_write_zonelist(KASPBENCH_ZONELIST, zones, policies)
+        || (devnull = open("/dev/null", O_WRONLY)) == -1
+        || !(config.repositories = hsm_repository_new("kaspbench",
+            "keystore:" KASPBENCH_KEYSTORE, "kaspbench", "1234",
+            0, 0, 0, NULL))
+        || hsm_open2(config.repositories, NULL) != HSM_OK
+        || benchdb_create(KASPBENCH_FILE, 0, 0, KASPBENCH_START)
+        || !(engine.dbcfg_list = benchdb_configuration(KASPBENCH_FILE, NULL))
+        || !(engine.taskq = schedule_create())
+        || !(dbconn = get_database_connection(&engine)))
+    {
+        fprintf(stderr, "unable to set up the benchmark\n");
+        return 1;
+    }
+
+    /* what 'ods-enforcer update all' does for a new installation */
+    gettimeofday(&start, NULL);
+    if (policy_import(-1, &engine, dbconn, 0) != POLICY_IMPORT_OK
+        || zonelist_import(-1, &engine, dbconn, 0, NULL) != ZONELIST_IMPORT_OK)
+    {
+        fprintf(stderr, "unable to import %s and %s, are the schemas "
+            "installed in %s?\n", KASPBENCH_KASP, KASPBENCH_ZONELIST,
+            OPENDNSSEC_SCHEMA_DIR);
+        return 1;
+    }
+    import = bench_elapsed(&start);
+    (void)schedule_info(engine.taskq, NULL, NULL, &queue_import);
+
+    /* the new zones are due now, enforce them all */
+    gettimeofday(&start, NULL);
+    kaspbench_leap(&engine, dbconn, time_now());
+    enforce_all = bench_elapsed(&start);
+    enforce_all_zones = kaspbench_stats.enforces;
+
+    gettimeofday(&start, NULL);
+    for (day = 1; day <= days; day++) {
+        kaspbench_ds(&engine, dbconn, devnull);
+        kaspbench_leap(&engine, dbconn, KASPBENCH_START + (time_t)day * 86400);
+    }
+    leap = bench_elapsed(&start);
+    key_list = kaspbench_key_list(&engine, dbconn, devnull);
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("zones=%d\n", zones);
+    printf("policies=%d\n", policies);
+    printf("days=%d\n", days);
+    printf("import_s=%.3f\n", import);
+    printf("enforce_all_s=%.3f\n", enforce_all);
+    printf("enforce_all_zones=%lu\n", enforce_all_zones);
+    printf("leap_s=%.3f\n", leap);
+    printf("enforces=%lu\n", kaspbench_stats.enforces);
+    printf("enforce_s=%.3f\n", kaspbench_stats.enforce);
+    printf("enforces_per_s=%.1f\n", kaspbench_stats.enforce > 0
+        ? kaspbench_stats.enforces / kaspbench_stats.enforce : 0.0);
+    printf("keygens=%lu\n", kaspbench_stats.keygens);
+    printf("keygen_s=%.3f\n", kaspbench_stats.keygen);
+    printf("signconfs=%lu\n", kaspbench_stats.signconfs);
+    printf("signconf_s=%.3f\n", kaspbench_stats.signconf);
+    printf("ds_s=%.3f\n", kaspbench_stats.ds);
+    printf("key_list_s=%.3f\n", key_list);
+    printf("queue_after_import=%d\n", queue_import);
+    printf("queue_max=%d\n", kaspbench_stats.queue_max);
+    printf("peak_rss_kb=%ld\n", usage.ru_maxrss);
+
+    close(devnull);
+    schedule_purge(engine.taskq);
+    schedule_cleanup(engine.taskq);
+    hsm_key_factory_deinit();
+    hsm_close();
+    db_connection_free(dbconn);
+    db_configuration_list_free(engine.dbcfg_list);
+    hsm_repository_free(config.repositories);
+    return key_list < 0 ? 1 : 0;
+}
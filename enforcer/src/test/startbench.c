@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Enforcer startup benchmark.
+ *
+ * Creates a synthetic database with many zones and seeds the schedule
+ * from it the way ods-enforcerd did at startup, with an enforce task for
+ * every zone right away, and the way it does now, from the stored next
+ * change of each zone. Reports for both how many zones are enforced at
+ * once and how long that takes when each enforce reads the database.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "daemon/engine.h"
+#include "db/dbw.h"
+#include "duration.h"
+#include "enforcer/enforce_task.h"
+#include "log.h"
+#include "scheduler/schedule.h"
+#include "scheduler/task.h"
+#include "test/bench.h"
+#include "test/benchdb.h"
+
+#define STARTBENCH_ZONES 50000
+#define STARTBENCH_FILE "startbench.db"
+
+struct startbench_due {
+    time_t now;
+    int due_now;
+    int due_hour;
+};
+
+static void
+startbench_walk(task_type *task, void *arg)
+{
+    struct startbench_due *due = (struct startbench_due *)arg;
+    if (!schedule_task_istype(task, TASK_TYPE_ENFORCE)) return;
+    if (task->due_date <= due->now)
+        due->due_now++;
+    else if (task->due_date <= due->now + 3600)
+        due->due_hour++;
+}
+
+static void
+startbench_report(const char *step, engine_type *engine, int zones,
+    struct timeval *start, double fetch)
+{
+    struct startbench_due due;
+    double secs = bench_elapsed(start);
+    due.now = time_now();
+    due.due_now = 0;
+    due.due_hour = 0;
+    (void)schedule_walk(engine->taskq, startbench_walk, &due);
+    printf("%-8s %8d zones %8.3f s %8d due now %8d in 1h %10.1f s to "
+        "enforce due\n", step, zones, secs, due.due_now, due.due_hour,
+        due.due_now * fetch);
+    schedule_purge(engine->taskq);
+}
+
+int
+main(int argc, char *argv[])
+{
+    engine_type engine;
+    db_connection_t *dbconn;
+    struct dbw_db *db;
+    struct timeval start;
+    int zones = STARTBENCH_ZONES;
+    double fetch;
+
+    if (argc > 1) {
+        zones = atoi(argv[1]);
+    }
+    if (zones <= 0) {
+        fprintf(stderr, "usage: %s [zones]\n", argv[0]);
+        return 1;
+    }
+    ods_log_init("startbench", 0, NULL, 0);
+    memset(&engine, 0, sizeof(engine));
+    if (benchdb_create(STARTBENCH_FILE, zones, 4, time_now())
+        || !(engine.dbcfg_list = benchdb_configuration(STARTBENCH_FILE, NULL))
+        || !(engine.taskq = schedule_create())
+        || !(dbconn = get_database_connection(&engine)))
+    {
+        fprintf(stderr, "unable to set up the benchmark\n");
+        return 1;
+    }
+
+    /* what every enforce task reads */
+    gettimeofday(&start, NULL);
+    if (!(db = dbw_fetch(dbconn))) {
+        fprintf(stderr, "unable to read the database\n");
+        return 1;
+    }
+    dbw_free(db);
+    fetch = bench_elapsed(&start);
+    printf("%-8s %8d zones %8.3f s\n", "fetch", zones, fetch);
+
+    /* enforce every zone now */
+    gettimeofday(&start, NULL);
+    enforce_task_flush_all(&engine, dbconn);
+    startbench_report("flush", &engine, zones, &start, fetch);
+
+    /* enforce from the stored next change */
+    gettimeofday(&start, NULL);
+    enforce_task_restore_all(&engine, dbconn);
+    startbench_report("restore", &engine, zones, &start, fetch);
+
+    db_connection_free(dbconn);
+    schedule_cleanup(engine.taskq);
+    db_configuration_list_free(engine.dbcfg_list);
+    (void)unlink(STARTBENCH_FILE);
+    return 0;
+}
@@ -0,0 +1,6 @@
+-- Adds the column for the <SignatureStore> policy setting to an existing
+-- enforcer database. ods-migrate does this when the column is missing;
+-- to do it by hand, with either SQLite or MySQL:
+--   sqlite3 kasp.db < add_signature_store.sql
+--   mysql -u <user> -p <database> < add_signature_store.sql
+ALTER TABLE policy ADD COLUMN slabStore INT NOT NULL DEFAULT 0;
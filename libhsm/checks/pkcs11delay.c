@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * PKCS#11 module that passes all calls on to another module, and makes
+ * the calls that go to the device slower and less reliable. This mimics
+ * an HSM at the other end of a network, where each operation waits for a
+ * round trip that does not use the CPU, and the device only handles a
+ * limited number of operations at the same time.
+ *
+ * PKCS11DELAY_MODULE         path of the module to pass the calls on to
+ * PKCS11DELAY_USEC           added latency of each signature, in
+ *                            microseconds (default 10000)
+ * PKCS11DELAY_FIND_USEC      added latency of C_FindObjects*
+ * PKCS11DELAY_ATTRIBUTE_USEC added latency of C_GetAttributeValue
+ * PKCS11DELAY_GENERATE_USEC  added latency of C_GenerateKeyPair
+ * PKCS11DELAY_RANDOM_USEC    added latency of C_GenerateRandom
+ * PKCS11DELAY_MAX_INFLIGHT   number of delayed calls the device handles at
+ *                            the same time, others wait (default unlimited)
+ * PKCS11DELAY_FAIL_EVERY     fail every Nth call (default never)
+ * PKCS11DELAY_FAIL_CALLS     calls that fail, a comma separated list of
+ *                            sign, find, attribute, generate and random
+ *                            (default sign)
+ * PKCS11DELAY_FAIL_RV        return value of a failed call, in hex
+ *                            (default CKR_DEVICE_ERROR)
+ *
+ * Failures are counted per kind of call, so a run with the same settings
+ * fails the same calls.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include <pkcs11.h>
+
+#define PKCS11DELAY_DEFAULT_USEC 10000
+
+enum delay_call {
+    DELAY_SIGN = 0,
+    DELAY_FIND,
+    DELAY_ATTRIBUTE,
+    DELAY_GENERATE,
+    DELAY_RANDOM,
+    DELAY_CALLS
+};
+
+static const char *delay_names[DELAY_CALLS] = {
+    "sign", "find", "attribute", "generate", "random"
+};
+
+static const char *delay_variables[DELAY_CALLS] = {
+    "PKCS11DELAY_USEC",
+    "PKCS11DELAY_FIND_USEC",
+    "PKCS11DELAY_ATTRIBUTE_USEC",
+    "PKCS11DELAY_GENERATE_USEC",
+    "PKCS11DELAY_RANDOM_USEC"
+};
+
+static CK_FUNCTION_LIST delay_functions;
+static CK_FUNCTION_LIST_PTR next_functions = NULL;
+static long delay_usec[DELAY_CALLS] = { PKCS11DELAY_DEFAULT_USEC };
+
+static pthread_mutex_t delay_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t delay_cond = PTHREAD_COND_INITIALIZER;
+static long delay_max_inflight = 0;
+static long delay_inflight = 0;
+
+static unsigned long fail_every = 0;
+static CK_RV fail_rv = CKR_DEVICE_ERROR;
+static int fail_calls[DELAY_CALLS] = { 1 };
+static unsigned long fail_count[DELAY_CALLS];
+
+static void
+delay_sleep(long usec)
+{
+    struct timespec ts;
+
+    ts.tv_sec = usec / 1000000;
+    ts.tv_nsec = (usec % 1000000) * 1000;
+    while (nanosleep(&ts, &ts) == -1) {
+        /* interrupted, sleep the remainder */
+    }
+}
+
+/* Wait for the device to accept the call, and for the round trip.
+ * Returns non-zero if the call is to fail. */
+static int
+delay_begin(enum delay_call call)
+{
+    int fail = 0;
+
+    pthread_mutex_lock(&delay_lock);
+    if (delay_max_inflight > 0) {
+        while (delay_inflight >= delay_max_inflight) {
+            pthread_cond_wait(&delay_cond, &delay_lock);
+        }
+    }
+    delay_inflight++;
+    if (fail_every && fail_calls[call]) {
+        fail = (++fail_count[call] % fail_every) == 0;
+    }
+    pthread_mutex_unlock(&delay_lock);
+    if (delay_usec[call] > 0) delay_sleep(delay_usec[call]);
+    return fail;
+}
+
+static void
+delay_end(void)
+{
+    pthread_mutex_lock(&delay_lock);
+    delay_inflight--;
+    pthread_cond_signal(&delay_cond);
+    pthread_mutex_unlock(&delay_lock);
+}
+
+/* Operations that start a session state fail before they reach the
+ * module, the others fail after it, so that the module never keeps an
+ * operation active that libhsm does not know of. */
+
+static CK_RV
+delay_C_FindObjectsInit(CK_SESSION_HANDLE session, CK_ATTRIBUTE_PTR templ,
+                        CK_ULONG count)
+{
+    CK_RV rv = fail_rv;
+
+    if (!delay_begin(DELAY_FIND)) {
+        rv = next_functions->C_FindObjectsInit(session, templ, count);
+    }
+    delay_end();
+    return rv;
+}
+
+static CK_RV
+delay_C_FindObjects(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE_PTR object,
+                    CK_ULONG max_object_count, CK_ULONG_PTR object_count)
+{
+    CK_RV rv;
+    int fail = delay_begin(DELAY_FIND);
+
+    rv = next_functions->C_FindObjects(session, object, max_object_count,
+                                       object_count);
+    delay_end();
+    return fail && rv == CKR_OK ? fail_rv : rv;
+}
+
+static CK_RV
+delay_C_FindObjectsFinal(CK_SESSION_HANDLE session)
+{
+    CK_RV rv;
+    int fail = delay_begin(DELAY_FIND);
+
+    rv = next_functions->C_FindObjectsFinal(session);
+    delay_end();
+    return fail && rv == CKR_OK ? fail_rv : rv;
+}
+
+static CK_RV
+delay_C_GetAttributeValue(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE object,
+                          CK_ATTRIBUTE_PTR templ, CK_ULONG count)
+{
+    CK_RV rv;
+    int fail = delay_begin(DELAY_ATTRIBUTE);
+
+    rv = next_functions->C_GetAttributeValue(session, object, templ, count);
+    delay_end();
+    return fail && rv == CKR_OK ? fail_rv : rv;
+}
+
+static CK_RV
+delay_C_SignInit(CK_SESSION_HANDLE session, CK_MECHANISM_PTR mechanism,
+                 CK_OBJECT_HANDLE key)
+{
+    /* Sign initialization is local to the session, only the signature
+     * itself goes to the device */
+    return next_functions->C_SignInit(session, mechanism, key);
+}
+
+static CK_RV
+delay_C_Sign(CK_SESSION_HANDLE session, CK_BYTE_PTR data, CK_ULONG data_len,
+             CK_BYTE_PTR signature, CK_ULONG_PTR signature_len)
+{
+    CK_RV rv;
+    int fail;
+
+    /* The length query does not go to the device */
+    if (!signature) {
+        return next_functions->C_Sign(session, data, data_len, signature,
+                                      signature_len);
+    }
+    fail = delay_begin(DELAY_SIGN);
+    rv = next_functions->C_Sign(session, data, data_len, signature,
+                                signature_len);
+    delay_end();
+    return fail && rv == CKR_OK ? fail_rv : rv;
+}
+
+static CK_RV
+delay_C_SignFinal(CK_SESSION_HANDLE session, CK_BYTE_PTR signature,
+                  CK_ULONG_PTR signature_len)
+{
+    CK_RV rv;
+    int fail;
+
+    if (!signature) {
+        return next_functions->C_SignFinal(session, signature,
+                                           signature_len);
+    }
+    fail = delay_begin(DELAY_SIGN);
+    rv = next_functions->C_SignFinal(session, signature, signature_len);
+    delay_end();
+    return fail && rv == CKR_OK ? fail_rv : rv;
+}
+
+static CK_RV
+delay_C_GenerateKeyPair(CK_SESSION_HANDLE session, CK_MECHANISM_PTR mechanism,
+                        CK_ATTRIBUTE_PTR public_templ, CK_ULONG public_count,
+                        CK_ATTRIBUTE_PTR private_templ,
+                        CK_ULONG private_count,
+                        CK_OBJECT_HANDLE_PTR public_key,
+                        CK_OBJECT_HANDLE_PTR private_key)
+{
+    /* A failed generation must not leave keys behind */
+    CK_RV rv = fail_rv;
+
+    if (!delay_begin(DELAY_GENERATE)) {
+        rv = next_functions->C_GenerateKeyPair(session, mechanism,
+                                               public_templ, public_count,
+                                               private_templ, private_count,
+                                               public_key, private_key);
+    }
+    delay_end();
+    return rv;
+}
+
+static CK_RV
+delay_C_GenerateRandom(CK_SESSION_HANDLE session, CK_BYTE_PTR data,
+                       CK_ULONG len)
+{
+    CK_RV rv;
+    int fail = delay_begin(DELAY_RANDOM);
+
+    rv = next_functions->C_GenerateRandom(session, data, len);
+    delay_end();
+    return fail && rv == CKR_OK ? fail_rv : rv;
+}
+
+static void
+delay_configure(void)
+{
+    const char *env;
+    const char *p;
+    size_t len;
+    int i;
+
+    for (i = 0; i < DELAY_CALLS; i++) {
+        env = getenv(delay_variables[i]);
+        if (env) delay_usec[i] = atol(env);
+    }
+    env = getenv("PKCS11DELAY_MAX_INFLIGHT");
+    if (env) delay_max_inflight = atol(env);
+    env = getenv("PKCS11DELAY_FAIL_EVERY");
+    if (env) fail_every = strtoul(env, NULL, 10);
+    env = getenv("PKCS11DELAY_FAIL_RV");
+    if (env) fail_rv = strtoul(env, NULL, 16);
+    env = getenv("PKCS11DELAY_FAIL_CALLS");
+    if (env) {
+        for (i = 0; i < DELAY_CALLS; i++) {
+            fail_calls[i] = 0;
+        }
+        for (p = env; *p; p += len + (p[len] == ',')) {
+            len = strcspn(p, ",");
+            for (i = 0; i < DELAY_CALLS; i++) {
+                if (strlen(delay_names[i]) == len
+                    && strncmp(p, delay_names[i], len) == 0) {
+                    fail_calls[i] = 1;
+                }
+            }
+        }
+    }
+}
+
+CK_RV
+C_GetFunctionList(CK_FUNCTION_LIST_PTR_PTR ppFunctionList)
+{
+    CK_C_GetFunctionList next_get_function_list;
+    const char *path;
+    void *handle;
+    CK_RV rv;
+
+    if (!ppFunctionList) return CKR_ARGUMENTS_BAD;
+    if (!next_functions) {
+        path = getenv("PKCS11DELAY_MODULE");
+        if (!path) path = PKCS11DELAY_MODULE;
+        delay_configure();
+        handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if (!handle) return CKR_GENERAL_ERROR;
+        next_get_function_list = (CK_C_GetFunctionList)
+            dlsym(handle, "C_GetFunctionList");
+        if (!next_get_function_list) return CKR_GENERAL_ERROR;
+        rv = next_get_function_list(&next_functions);
+        if (rv != CKR_OK) return rv;
+        delay_functions = *next_functions;
+        delay_functions.C_FindObjectsInit = delay_C_FindObjectsInit;
+        delay_functions.C_FindObjects = delay_C_FindObjects;
+        delay_functions.C_FindObjectsFinal = delay_C_FindObjectsFinal;
+        delay_functions.C_GetAttributeValue = delay_C_GetAttributeValue;
+        delay_functions.C_SignInit = delay_C_SignInit;
+        delay_functions.C_Sign = delay_C_Sign;
+        delay_functions.C_SignFinal = delay_C_SignFinal;
+        delay_functions.C_GenerateKeyPair = delay_C_GenerateKeyPair;
+        delay_functions.C_GenerateRandom = delay_C_GenerateRandom;
+    }
+    *ppFunctionList = &delay_functions;
+    return CKR_OK;
+}
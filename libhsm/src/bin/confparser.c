@@ -61,6 +61,7 @@ parse_conf_repositories(const char* cfgfile)
     char* module;
     char* tokenlabel;
     char* pin;
+    char* group;
     uint8_t use_pubkey;
     uint8_t allowextract;
     int require_backup;
@@ -100,6 +101,7 @@ parse_conf_repositories(const char* cfgfile)
             module = NULL;
             tokenlabel = NULL;
             pin = NULL;
+            group = NULL;
             use_pubkey = 1;
             allowextract = 0;
             require_backup = 0;
@@ -116,6 +118,8 @@ parse_conf_repositories(const char* cfgfile)
                     tokenlabel = (char *) xmlNodeGetContent(curNode);
                 if (xmlStrEqual(curNode->name, (const xmlChar *)"PIN"))
                     pin = (char *) xmlNodeGetContent(curNode);
+                if (xmlStrEqual(curNode->name, (const xmlChar *)"ReplicaGroup"))
+                    group = (char *) xmlNodeGetContent(curNode);
                 if (xmlStrEqual(curNode->name, (const xmlChar *)"SkipPublicKey"))
                     use_pubkey = 0;
                 if (xmlStrEqual(curNode->name, (const xmlChar *)"AllowExtraction"))
@@ -125,7 +129,7 @@ parse_conf_repositories(const char* cfgfile)
             }
             if (name && module && tokenlabel) {
                 repo = hsm_repository_new(name, module, tokenlabel, pin,
-                    use_pubkey, allowextract, require_backup);
+                    use_pubkey, allowextract, require_backup, group);
             }
             if (!repo) {
                ods_log_error("[%s] unable to add %s repository: "
@@ -139,6 +143,7 @@ parse_conf_repositories(const char* cfgfile)
             free((void*)name);
             free((void*)module);
             free((void*)tokenlabel);
+            free((void*)group);
         }
     }
 
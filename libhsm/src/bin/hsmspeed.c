@@ -49,8 +49,9 @@ char *progname = NULL;
 typedef struct {
     unsigned int id;
     hsm_ctx_t *ctx;
-    libhsm_key_t *key;
+    const libhsm_key_t *key;
     unsigned int iterations;
+    unsigned int depth;
 } sign_arg_t;
 
 static void
@@ -58,18 +59,23 @@ usage ()
 {
     fprintf(stderr,
         "usage: %s "
-        "[-c config] -r repository [-i iterations] [-s keysize] [-t threads]\n",
-        progname);
+        "[-c config] -r repository [-i iterations] [-s keysize] [-t threads]\n"
+        "       [-p sessions]\n"
+        "       %s "
+        "[-c config] -k locator [-i iterations] [-t threads] [-p sessions]\n",
+        progname, progname);
 }
 
 static void *
 sign (void *arg)
 {
     hsm_ctx_t *ctx = NULL;
-    libhsm_key_t *key = NULL;
+    const libhsm_key_t *key = NULL;
 
-    size_t i;
+    size_t i, submitted;
     unsigned int iterations = 0;
+    hsm_sign_queue_t *queue = NULL;
+    void *cookie;
 
     ldns_rr_list *rrset;
     ldns_rr *rr, *sig, *dnskey_rr;
@@ -96,6 +102,39 @@ sign (void *arg)
     dnskey_rr = hsm_get_dnskey(ctx, key, sign_params);
     sign_params->keytag = ldns_calc_keytag(dnskey_rr);
 
+    if (sign_arg->depth) {
+        /* Keep signatures in flight on the session pool */
+        queue = hsm_sign_queue_new(ctx);
+        for (i=0, submitted=0; i<iterations; i++) {
+            while (submitted < iterations &&
+                   hsm_sign_pending(queue) < sign_arg->depth) {
+                if (hsm_sign_submit(queue, rrset, key, sign_params, NULL)
+                    != HSM_OK) {
+                    break;
+                }
+                submitted++;
+            }
+            if (hsm_sign_complete(queue, &sig, &cookie)) {
+                /* nothing in flight, submit failed */
+                sig = NULL;
+            }
+            if (! sig) {
+                fprintf(stderr,
+                        "hsm_sign_complete() returned error: %s in %s\n",
+                        ctx->error_message,
+                        ctx->error_action
+                );
+                break;
+            }
+            ldns_rr_free(sig);
+        }
+        while (hsm_sign_complete(queue, &sig, &cookie) == 0) {
+            ldns_rr_free(sig);
+        }
+        hsm_sign_queue_free(queue);
+        iterations = 0;
+    }
+
     /* Do some signing */
     for (i=0; i<iterations; i++) {
         sig = hsm_sign_rrset(ctx, rrset, key, sign_params);
@@ -130,9 +169,13 @@ main (int argc, char *argv[])
 
     hsm_ctx_t *ctx = NULL;
     libhsm_key_t *key = NULL;
+    const libhsm_key_t *replica = NULL;
+    const char *locator = NULL;
     unsigned int keysize = 1024;
     unsigned int iterations = 1;
     unsigned int threads = 1;
+    unsigned int sessions = 0;
+    unsigned int depth = 0;
 
     static struct timeval start,end;
 
@@ -148,10 +191,12 @@ main (int argc, char *argv[])
     int ch;
     unsigned int n;
     double elapsed, speed;
+    hsm_session_t *session;
+    unsigned long *before;
 
     progname = argv[0];
 
-    while ((ch = getopt(argc, argv, "c:i:r:s:t:")) != -1) {
+    while ((ch = getopt(argc, argv, "c:i:k:p:r:s:t:")) != -1) {
         switch (ch) {
         case 'c':
             config = strdup(optarg);
@@ -159,6 +204,12 @@ main (int argc, char *argv[])
         case 'i':
             iterations = atoi(optarg);
             break;
+        case 'k':
+            locator = strdup(optarg);
+            break;
+        case 'p':
+            sessions = atoi(optarg);
+            break;
         case 'r':
             repository = strdup(optarg);
             break;
@@ -174,7 +225,7 @@ main (int argc, char *argv[])
         }
     }
 
-    if (!repository) {
+    if (!repository == !locator) {
         usage();
         exit(1);
     }
@@ -210,16 +261,52 @@ main (int argc, char *argv[])
         exit(-1);
     }
 
-    /* Generate a temporary key */
-    fprintf(stderr, "Generating temporary key...\n");
-    key = hsm_generate_rsa_key(ctx, repository, keysize);
-    if (key) {
-        char *id = hsm_get_key_id(ctx, key);
-        fprintf(stderr, "Temporary key created: %s\n", id);
-        free(id);
+    if (locator) {
+        /* Use an existing key, with its replicas */
+        replica = keycache_lookup(ctx, locator);
+        if (!replica) {
+            fprintf(stderr, "Could not find key \"%s\"\n", locator);
+            exit(-1);
+        }
+        for (key = (libhsm_key_t *) replica; key; key = key->replica) {
+            fprintf(stderr, "Key found in repository \"%s\"\n",
+                key->modulename);
+        }
     } else {
-        fprintf(stderr, "Could not generate a key pair in repository \"%s\"\n", repository);
-        exit(-1);
+        /* Generate a temporary key */
+        fprintf(stderr, "Generating temporary key...\n");
+        key = hsm_generate_rsa_key(ctx, repository, keysize);
+        if (key) {
+            char *id = hsm_get_key_id(ctx, key);
+            fprintf(stderr, "Temporary key created: %s\n", id);
+            free(id);
+        } else {
+            fprintf(stderr, "Could not generate a key pair in repository \"%s\"\n", repository);
+            exit(-1);
+        }
+        replica = key;
+    }
+
+    /* Remember the signature counts, to report the share of each
+     * repository */
+    before = calloc(ctx->session_count, sizeof(unsigned long));
+    for (n=0; n<ctx->session_count && before; n++) {
+        before[n] = ctx->session[n]->module->signatures;
+    }
+
+    /* Open the session pool, each thread keeping enough signatures in
+     * flight to keep the sessions busy */
+    if (sessions) {
+        if (hsm_sign_pool_start(sessions) != HSM_OK) {
+            char* error =  hsm_get_error(NULL);
+            if (error != NULL) {
+                fprintf(stderr,"%s\n", error);
+                free(error);
+            }
+            exit(-1);
+        }
+        depth = 2 * sessions / threads;
+        if (depth < 1) depth = 1;
     }
 
     /* Prepare threads */
@@ -233,12 +320,17 @@ main (int argc, char *argv[])
             fprintf(stderr, "hsm_create_context() returned error\n");
             exit(-1);
         }
-        sign_arg_array[n].key = key;
+        sign_arg_array[n].key = replica;
         sign_arg_array[n].iterations = iterations;
+        sign_arg_array[n].depth = depth;
     }
 
     fprintf(stderr, "Signing %d RRsets with %s using %d %s...\n",
         iterations, algoname, threads, (threads > 1 ? "threads" : "thread"));
+    if (sessions) {
+        fprintf(stderr, "Keeping %d signatures in flight per thread on "
+            "%d sessions...\n", depth, sessions);
+    }
     gettimeofday(&start, NULL);
 
     /* Create threads for signing */
@@ -268,16 +360,33 @@ main (int argc, char *argv[])
     end.tv_usec-= start.tv_usec;
     elapsed =(double)(end.tv_sec)+(double)(end.tv_usec)*.000001;
     speed = iterations / elapsed * threads;
-    printf("%d %s, %d signatures per thread, %.2f sig/s (RSA %d bits)\n",
-        threads, (threads > 1 ? "threads" : "thread"), iterations,
-        speed, keysize);
-
-    /* Delete temporary key */
-    fprintf(stderr, "Deleting temporary key...\n");
-    result = hsm_remove_key(ctx, key);
-    if (result) {
-        fprintf(stderr, "hsm_remove_key() returned %d\n", result);
-        exit(-1);
+    if (locator) {
+        printf("%d %s, %d signatures per thread, %.2f sig/s (aggregate)\n",
+            threads, (threads > 1 ? "threads" : "thread"), iterations,
+            speed);
+    } else {
+        printf("%d %s, %d signatures per thread, %.2f sig/s (RSA %d bits)\n",
+            threads, (threads > 1 ? "threads" : "thread"), iterations,
+            speed, keysize);
+    }
+    for (n=0; n<ctx->session_count && before; n++) {
+        session = ctx->session[n];
+        if (session->module->signatures == before[n]) continue;
+        printf("  %s: %lu signatures, %.2f sig/s\n", session->module->name,
+            session->module->signatures - before[n],
+            (session->module->signatures - before[n]) / elapsed);
+    }
+    free(before);
+
+    if (key) {
+        /* Delete temporary key */
+        fprintf(stderr, "Deleting temporary key...\n");
+        result = hsm_remove_key(ctx, key);
+        if (result) {
+            fprintf(stderr, "hsm_remove_key() returned %d\n", result);
+            exit(-1);
+        }
+        libhsm_key_free(key);
     }
 
     /* Clean up */
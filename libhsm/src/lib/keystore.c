@@ -0,0 +1,1557 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Software keystore, built into libhsm as a PKCS#11 module.
+ *
+ * Keys are kept in a file that is encrypted with AES-256-GCM, under a key
+ * derived from the token PIN with PBKDF2. After login all keys live in
+ * memory, and signatures are made with OpenSSL directly. A signing session
+ * holds a reference to the shared key object, so that any number of
+ * sessions sign with the same key in parallel without taking a lock.
+ *
+ * The enforcer, ods-hsmutil and the signer share the file. Changes are made
+ * under a lock on "<file>.lock", after merging what other processes wrote,
+ * and a lookup that finds nothing rereads the file if it was replaced.
+ *
+ * Only the parts of PKCS#11 that libhsm uses are implemented.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "keystore.h"
+
+#if defined(HAVE_SSL) && defined(HAVE_SSL_NEW_HMAC)
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#define KEYSTORE_MAGIC "ODSKEYS1"
+#define KEYSTORE_MAGIC_LEN 8
+#define KEYSTORE_SALT_LEN 16
+#define KEYSTORE_IV_LEN 12
+#define KEYSTORE_TAG_LEN 16
+#define KEYSTORE_SECRET_LEN 32
+#define KEYSTORE_ITERATIONS 100000
+/* The magic, salt and iteration count are authenticated with the keys */
+#define KEYSTORE_AAD_LEN (KEYSTORE_MAGIC_LEN + KEYSTORE_SALT_LEN + 4)
+#define KEYSTORE_HEADER_LEN (KEYSTORE_AAD_LEN + KEYSTORE_IV_LEN \
+    + KEYSTORE_TAG_LEN)
+#define KEYSTORE_LABEL_LEN 32
+#define KEYSTORE_MAX_SLOTS 16
+
+/* A key is two objects: the private key with handle 2i+1 and the public
+ * key with handle 2i+2, where i is its index in the slot */
+#define KEYSTORE_PRIVATE 1
+#define KEYSTORE_PUBLIC  2
+#define KEYSTORE_HANDLE(i, object) ((CK_OBJECT_HANDLE)(i) * 2 + (object))
+#define KEYSTORE_INDEX(handle) (((handle) - 1) / 2)
+#define KEYSTORE_OBJECT(handle) \
+    (((handle) & 1) ? KEYSTORE_PRIVATE : KEYSTORE_PUBLIC)
+
+typedef struct keystore_key_struct keystore_key_t;
+struct keystore_key_struct {
+    CK_BYTE *id;
+    CK_ULONG id_len;
+    EVP_PKEY *pkey;
+    int objects;        /* objects not yet destroyed */
+    int stored;         /* seen in the file by the last merge */
+};
+
+typedef struct keystore_slot_struct keystore_slot_t;
+struct keystore_slot_struct {
+    unsigned char label[KEYSTORE_LABEL_LEN];
+    char *path;
+    pthread_rwlock_t lock;  /* protects everything below */
+    int loggedin;
+    unsigned char salt[KEYSTORE_SALT_LEN];
+    unsigned char secret[KEYSTORE_SECRET_LEN];
+    uint32_t iterations;
+    keystore_key_t *keys;
+    size_t count;
+    size_t alloc;
+    /* the file as last read or written */
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    off_t size;
+};
+
+typedef struct keystore_session_struct keystore_session_t;
+struct keystore_session_struct {
+    int open;
+    CK_SLOT_ID slot;
+    /* find operation */
+    int finding;
+    CK_ATTRIBUTE_PTR filter;
+    CK_ULONG filter_count;
+    CK_OBJECT_HANDLE cursor;
+    int found;
+    int refreshed;
+    /* sign operation */
+    EVP_PKEY *signkey;
+};
+
+static pthread_mutex_t keystore_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CK_FUNCTION_LIST keystore_function_list;
+static int keystore_function_list_ready = 0;
+static int keystore_initialized = 0;
+static keystore_slot_t *keystore_slots[KEYSTORE_MAX_SLOTS];
+static CK_ULONG keystore_slot_count = 0;
+static keystore_session_t **keystore_sessions = NULL;
+static CK_ULONG keystore_session_count = 0;
+
+static CK_BYTE keystore_oid_p256[] =
+    { 0x06, 0x08, 0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x03, 0x01, 0x07 };
+static CK_BYTE keystore_oid_p384[] =
+    { 0x06, 0x05, 0x2B, 0x81, 0x04, 0x00, 0x22 };
+
+static void
+put_u16(unsigned char *buf, uint16_t v)
+{
+    buf[0] = v >> 8;
+    buf[1] = v;
+}
+
+static void
+put_u32(unsigned char *buf, uint32_t v)
+{
+    buf[0] = v >> 24;
+    buf[1] = v >> 16;
+    buf[2] = v >> 8;
+    buf[3] = v;
+}
+
+static uint16_t
+get_u16(const unsigned char *buf)
+{
+    return ((uint16_t)buf[0] << 8) | buf[1];
+}
+
+static uint32_t
+get_u32(const unsigned char *buf)
+{
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16)
+        | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+/* Look up an open session, and the slot it belongs to */
+static keystore_session_t *
+keystore_session(CK_SESSION_HANDLE handle, keystore_slot_t **slot)
+{
+    keystore_session_t *session = NULL;
+
+    pthread_mutex_lock(&keystore_mutex);
+    if (keystore_initialized && handle > 0
+        && handle <= keystore_session_count
+        && keystore_sessions[handle - 1]->open) {
+        session = keystore_sessions[handle - 1];
+        if (slot) *slot = keystore_slots[session->slot];
+    }
+    pthread_mutex_unlock(&keystore_mutex);
+    return session;
+}
+
+/* Find the key behind an object handle, the slot must be locked */
+static keystore_key_t *
+keystore_object(keystore_slot_t *slot, CK_OBJECT_HANDLE handle)
+{
+    keystore_key_t *key;
+
+    if (!slot->loggedin || handle == 0) return NULL;
+    if (KEYSTORE_INDEX(handle) >= slot->count) return NULL;
+    key = &slot->keys[KEYSTORE_INDEX(handle)];
+    if (!(key->objects & KEYSTORE_OBJECT(handle))) return NULL;
+    return key;
+}
+
+static void
+keystore_unload(keystore_slot_t *slot)
+{
+    size_t i;
+
+    for (i = 0; i < slot->count; i++) {
+        free(slot->keys[i].id);
+        EVP_PKEY_free(slot->keys[i].pkey);
+    }
+    free(slot->keys);
+    slot->keys = NULL;
+    slot->count = 0;
+    slot->alloc = 0;
+    OPENSSL_cleanse(slot->secret, sizeof(slot->secret));
+    slot->loggedin = 0;
+}
+
+static CK_RV
+keystore_add(keystore_slot_t *slot, const CK_BYTE *id, CK_ULONG id_len,
+             EVP_PKEY *pkey, size_t *index)
+{
+    keystore_key_t *keys;
+    size_t alloc;
+
+    if (slot->count == slot->alloc) {
+        alloc = slot->alloc ? slot->alloc * 2 : 16;
+        keys = realloc(slot->keys, alloc * sizeof(keystore_key_t));
+        if (!keys) return CKR_HOST_MEMORY;
+        slot->keys = keys;
+        slot->alloc = alloc;
+    }
+    keys = &slot->keys[slot->count];
+    keys->id = malloc(id_len ? id_len : 1);
+    if (!keys->id) return CKR_HOST_MEMORY;
+    memcpy(keys->id, id, id_len);
+    keys->id_len = id_len;
+    keys->pkey = pkey;
+    keys->objects = KEYSTORE_PRIVATE | KEYSTORE_PUBLIC;
+    if (index) *index = slot->count;
+    slot->count++;
+    return CKR_OK;
+}
+
+/* Remember which file the keys in memory correspond to */
+static void
+keystore_stamp(keystore_slot_t *slot, const struct stat *st)
+{
+    slot->dev = st->st_dev;
+    slot->ino = st->st_ino;
+    slot->mtime = st->st_mtime;
+    slot->size = st->st_size;
+}
+
+/* Serialize changes to the keystore file between processes. Returns the
+ * descriptor that holds the lock, or -1. */
+static int
+keystore_lock(keystore_slot_t *slot)
+{
+    size_t len = strlen(slot->path) + 6;
+    char *path = malloc(len);
+    int fd;
+
+    if (!path) return -1;
+    snprintf(path, len, "%s.lock", slot->path);
+    fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    free(path);
+    if (fd == -1) return -1;
+    while (flock(fd, LOCK_EX) == -1) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+static void
+keystore_unlock(int fd)
+{
+    (void) flock(fd, LOCK_UN);
+    close(fd);
+}
+
+/* Write all private keys to the keystore file, encrypted with the secret
+ * of the slot. The file is replaced atomically. The slot must be write
+ * locked, and the file locked and refreshed, or keys that another process
+ * stored in the meantime are lost. */
+static CK_RV
+keystore_save(keystore_slot_t *slot)
+{
+    unsigned char *plain = NULL, *file = NULL, *p, *der;
+    size_t plain_len = 0, file_len, i, tmp_len;
+    int len, fd = -1, ok = 0;
+    ssize_t written;
+    struct stat st;
+    char *tmp = NULL;
+    EVP_CIPHER_CTX *cipher = NULL;
+
+    for (i = 0; i < slot->count; i++) {
+        if (!(slot->keys[i].objects & KEYSTORE_PRIVATE)) continue;
+        len = i2d_PrivateKey(slot->keys[i].pkey, NULL);
+        if (len <= 0) return CKR_FUNCTION_FAILED;
+        plain_len += 2 + slot->keys[i].id_len + 4 + len;
+    }
+    file_len = KEYSTORE_HEADER_LEN + plain_len;
+    plain = malloc(plain_len ? plain_len : 1);
+    file = malloc(file_len);
+    tmp_len = strlen(slot->path) + 5;
+    tmp = malloc(tmp_len);
+    if (!plain || !file || !tmp) goto done;
+    snprintf(tmp, tmp_len, "%s.tmp", slot->path);
+
+    p = plain;
+    for (i = 0; i < slot->count; i++) {
+        if (!(slot->keys[i].objects & KEYSTORE_PRIVATE)) continue;
+        put_u16(p, slot->keys[i].id_len);
+        memcpy(p + 2, slot->keys[i].id, slot->keys[i].id_len);
+        p += 2 + slot->keys[i].id_len;
+        der = p + 4;
+        len = i2d_PrivateKey(slot->keys[i].pkey, &der);
+        put_u32(p, len);
+        p += 4 + len;
+    }
+
+    memcpy(file, KEYSTORE_MAGIC, KEYSTORE_MAGIC_LEN);
+    p = file + KEYSTORE_MAGIC_LEN;
+    memcpy(p, slot->salt, KEYSTORE_SALT_LEN);
+    p += KEYSTORE_SALT_LEN;
+    put_u32(p, slot->iterations);
+    p += 4;
+    if (RAND_bytes(p, KEYSTORE_IV_LEN) != 1) goto done;
+    if (!(cipher = EVP_CIPHER_CTX_new())
+        || EVP_EncryptInit_ex(cipher, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1
+        || EVP_CIPHER_CTX_ctrl(cipher, EVP_CTRL_GCM_SET_IVLEN,
+                               KEYSTORE_IV_LEN, NULL) != 1
+        || EVP_EncryptInit_ex(cipher, NULL, NULL, slot->secret, p) != 1
+        || EVP_EncryptUpdate(cipher, NULL, &len, file,
+                             KEYSTORE_AAD_LEN) != 1
+        || EVP_EncryptUpdate(cipher, file + KEYSTORE_HEADER_LEN, &len,
+                             plain, plain_len) != 1
+        || EVP_EncryptFinal_ex(cipher, file + KEYSTORE_HEADER_LEN + len,
+                               &len) != 1
+        || EVP_CIPHER_CTX_ctrl(cipher, EVP_CTRL_GCM_GET_TAG,
+                               KEYSTORE_TAG_LEN,
+                               p + KEYSTORE_IV_LEN) != 1) {
+        goto done;
+    }
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) goto done;
+    for (p = file; p < file + file_len; p += written) {
+        written = write(fd, p, file + file_len - p);
+        if (written == -1) {
+            if (errno == EINTR) {
+                written = 0;
+                continue;
+            }
+            goto done;
+        }
+    }
+    if (fsync(fd) == -1 || fstat(fd, &st) == -1) goto done;
+    if (close(fd) == -1) {
+        fd = -1;
+        goto done;
+    }
+    fd = -1;
+    ok = rename(tmp, slot->path) == 0;
+    if (ok) keystore_stamp(slot, &st);
+
+done:
+    if (fd != -1) close(fd);
+    if (!ok && tmp) (void) unlink(tmp);
+    EVP_CIPHER_CTX_free(cipher);
+    if (plain) {
+        OPENSSL_cleanse(plain, plain_len);
+        free(plain);
+    }
+    free(file);
+    free(tmp);
+    return ok ? CKR_OK : CKR_DEVICE_ERROR;
+}
+
+/* Read and decrypt the keystore file. With a PIN the secret of the slot is
+ * derived from it, otherwise the file must be encrypted under the secret
+ * that the slot already has. */
+static CK_RV
+keystore_read(keystore_slot_t *slot, int fd, const CK_BYTE *pin,
+              CK_ULONG pin_len, unsigned char **plain_out,
+              size_t *plain_len_out, struct stat *st)
+{
+    unsigned char *file = NULL, *plain = NULL, *p;
+    size_t file_len = 0, plain_len = 0;
+    ssize_t got;
+    int len;
+    EVP_CIPHER_CTX *cipher = NULL;
+    CK_RV rv = CKR_DEVICE_ERROR;
+
+    if (fstat(fd, st) == -1 || st->st_size < KEYSTORE_HEADER_LEN) {
+        return CKR_DEVICE_ERROR;
+    }
+    file = malloc(st->st_size);
+    if (!file) return CKR_HOST_MEMORY;
+    while (file_len < (size_t) st->st_size) {
+        got = read(fd, file + file_len, st->st_size - file_len);
+        if (got == -1 && errno == EINTR) continue;
+        if (got <= 0) break;
+        file_len += got;
+    }
+    if (file_len != (size_t) st->st_size
+        || memcmp(file, KEYSTORE_MAGIC, KEYSTORE_MAGIC_LEN) != 0) {
+        goto done;
+    }
+
+    p = file + KEYSTORE_MAGIC_LEN;
+    if (pin) {
+        memcpy(slot->salt, p, KEYSTORE_SALT_LEN);
+        slot->iterations = get_u32(p + KEYSTORE_SALT_LEN);
+        if (PKCS5_PBKDF2_HMAC((const char *) pin, pin_len, slot->salt,
+                KEYSTORE_SALT_LEN, slot->iterations, EVP_sha256(),
+                KEYSTORE_SECRET_LEN, slot->secret) != 1) {
+            rv = CKR_FUNCTION_FAILED;
+            goto done;
+        }
+    } else if (memcmp(slot->salt, p, KEYSTORE_SALT_LEN) != 0
+        || get_u32(p + KEYSTORE_SALT_LEN) != slot->iterations) {
+        /* Recreated under another PIN, we cannot read it */
+        goto done;
+    }
+    p += KEYSTORE_SALT_LEN + 4;
+    plain_len = file_len - KEYSTORE_HEADER_LEN;
+    plain = malloc(plain_len ? plain_len : 1);
+    if (!plain) {
+        rv = CKR_HOST_MEMORY;
+        goto done;
+    }
+    if (!(cipher = EVP_CIPHER_CTX_new())
+        || EVP_DecryptInit_ex(cipher, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1
+        || EVP_CIPHER_CTX_ctrl(cipher, EVP_CTRL_GCM_SET_IVLEN,
+                               KEYSTORE_IV_LEN, NULL) != 1
+        || EVP_DecryptInit_ex(cipher, NULL, NULL, slot->secret, p) != 1
+        || EVP_DecryptUpdate(cipher, NULL, &len, file,
+                             KEYSTORE_AAD_LEN) != 1
+        || EVP_DecryptUpdate(cipher, plain, &len, file + KEYSTORE_HEADER_LEN,
+                             plain_len) != 1
+        || EVP_CIPHER_CTX_ctrl(cipher, EVP_CTRL_GCM_SET_TAG,
+                               KEYSTORE_TAG_LEN,
+                               p + KEYSTORE_IV_LEN) != 1) {
+        goto done;
+    }
+    if (EVP_DecryptFinal_ex(cipher, plain + len, &len) != 1) {
+        if (pin) {
+            /* The tag does not match, so the PIN must be wrong */
+            OPENSSL_cleanse(slot->secret, sizeof(slot->secret));
+            rv = CKR_PIN_INCORRECT;
+        }
+        goto done;
+    }
+    *plain_out = plain;
+    *plain_len_out = plain_len;
+    plain = NULL;
+    rv = CKR_OK;
+
+done:
+    EVP_CIPHER_CTX_free(cipher);
+    if (plain) {
+        OPENSSL_cleanse(plain, plain_len);
+        free(plain);
+    }
+    free(file);
+    return rv;
+}
+
+/* Make the keys of the slot match the decrypted file. Keys that are new
+ * are appended, so that existing handles stay valid, and keys that are no
+ * longer stored are destroyed. The slot must be write locked. */
+static CK_RV
+keystore_merge(keystore_slot_t *slot, const unsigned char *plain,
+               size_t plain_len)
+{
+    const unsigned char *p, *end = plain + plain_len, *der;
+    size_t id_len, der_len, i, index;
+    EVP_PKEY *pkey;
+
+    /* Check the framing before anything is changed */
+    for (p = plain; end - p >= 2; p += 2 + id_len + 4 + der_len) {
+        id_len = get_u16(p);
+        if ((size_t)(end - p) < 2 + id_len + 4) break;
+        der_len = get_u32(p + 2 + id_len);
+        if ((size_t)(end - p) < 2 + id_len + 4 + der_len) break;
+    }
+    if (p != end) return CKR_DEVICE_ERROR;
+
+    for (i = 0; i < slot->count; i++) {
+        slot->keys[i].stored = 0;
+    }
+    for (p = plain; p < end; p += 2 + id_len + 4 + der_len) {
+        id_len = get_u16(p);
+        der_len = get_u32(p + 2 + id_len);
+        for (i = 0; i < slot->count; i++) {
+            if ((slot->keys[i].objects & KEYSTORE_PRIVATE)
+                && slot->keys[i].id_len == id_len
+                && !memcmp(slot->keys[i].id, p + 2, id_len)) {
+                break;
+            }
+        }
+        if (i < slot->count) {
+            slot->keys[i].stored = 1;
+            continue;
+        }
+        der = p + 2 + id_len + 4;
+        pkey = d2i_AutoPrivateKey(NULL, &der, der_len);
+        if (!pkey) return CKR_DEVICE_ERROR;
+        if (keystore_add(slot, p + 2, id_len, pkey, &index) != CKR_OK) {
+            EVP_PKEY_free(pkey);
+            return CKR_HOST_MEMORY;
+        }
+        slot->keys[index].stored = 1;
+    }
+    for (i = 0; i < slot->count; i++) {
+        if ((slot->keys[i].objects & KEYSTORE_PRIVATE)
+            && !slot->keys[i].stored) {
+            /* Deleted by another process, signing sessions keep their
+             * own reference */
+            slot->keys[i].objects = 0;
+            EVP_PKEY_free(slot->keys[i].pkey);
+            slot->keys[i].pkey = NULL;
+        }
+    }
+    return CKR_OK;
+}
+
+/* Pick up the keys that other processes stored or deleted, if the file
+ * was replaced since we last read or wrote it. The slot must be write
+ * locked. */
+static CK_RV
+keystore_refresh(keystore_slot_t *slot)
+{
+    unsigned char *plain = NULL;
+    size_t plain_len = 0;
+    struct stat st;
+    int fd;
+    CK_RV rv;
+
+    if (!slot->loggedin) return CKR_USER_NOT_LOGGED_IN;
+    fd = open(slot->path, O_RDONLY);
+    if (fd == -1) return CKR_DEVICE_ERROR;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return CKR_DEVICE_ERROR;
+    }
+    if (st.st_dev == slot->dev && st.st_ino == slot->ino
+        && st.st_mtime == slot->mtime && st.st_size == slot->size) {
+        close(fd);
+        return CKR_OK;
+    }
+    rv = keystore_read(slot, fd, NULL, 0, &plain, &plain_len, &st);
+    close(fd);
+    if (rv == CKR_OK) rv = keystore_merge(slot, plain, plain_len);
+    if (rv == CKR_OK) keystore_stamp(slot, &st);
+    if (plain) {
+        OPENSSL_cleanse(plain, plain_len);
+        free(plain);
+    }
+    return rv;
+}
+
+/* Read the keystore file, or create an empty one if it does not exist.
+ * The slot must be write locked. */
+static CK_RV
+keystore_load(keystore_slot_t *slot, const CK_BYTE *pin, CK_ULONG pin_len)
+{
+    unsigned char *plain = NULL;
+    size_t plain_len = 0;
+    struct stat st;
+    int fd, lock;
+    CK_RV rv;
+
+    lock = keystore_lock(slot);
+    if (lock == -1) return CKR_DEVICE_ERROR;
+    fd = open(slot->path, O_RDONLY);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            keystore_unlock(lock);
+            return CKR_DEVICE_ERROR;
+        }
+        /* New keystore, protected by this PIN */
+        slot->iterations = KEYSTORE_ITERATIONS;
+        if (RAND_bytes(slot->salt, KEYSTORE_SALT_LEN) != 1
+            || PKCS5_PBKDF2_HMAC((const char *) pin, pin_len, slot->salt,
+                   KEYSTORE_SALT_LEN, slot->iterations, EVP_sha256(),
+                   KEYSTORE_SECRET_LEN, slot->secret) != 1) {
+            rv = CKR_FUNCTION_FAILED;
+        } else {
+            rv = keystore_save(slot);
+        }
+        if (rv == CKR_OK) slot->loggedin = 1;
+        keystore_unlock(lock);
+        return rv;
+    }
+    rv = keystore_read(slot, fd, pin, pin_len, &plain, &plain_len, &st);
+    close(fd);
+    keystore_unlock(lock);
+    if (rv == CKR_OK) {
+        slot->loggedin = 1;
+        rv = keystore_merge(slot, plain, plain_len);
+        if (rv == CKR_OK) {
+            keystore_stamp(slot, &st);
+        } else {
+            keystore_unload(slot);
+        }
+    }
+    if (plain) {
+        OPENSSL_cleanse(plain, plain_len);
+        free(plain);
+    }
+    return rv;
+}
+
+static CK_BYTE *
+keystore_bn(const BIGNUM *bn, CK_ULONG *len)
+{
+    CK_BYTE *data;
+
+    *len = BN_num_bytes(bn);
+    data = malloc(*len ? *len : 1);
+    if (data) BN_bn2bin(bn, data);
+    return data;
+}
+
+/* Compute the value of an attribute of an object into allocated memory.
+ * Returns CKR_ATTRIBUTE_TYPE_INVALID if the object has no such attribute. */
+static CK_RV
+keystore_value(const keystore_key_t *key, int object, CK_ATTRIBUTE_TYPE type,
+               CK_BYTE **data, CK_ULONG *len)
+{
+    CK_OBJECT_CLASS cls;
+    CK_KEY_TYPE key_type;
+    CK_BBOOL flag;
+    CK_ULONG bits;
+    const void *src = NULL;
+    const BIGNUM *n, *e;
+    const EC_KEY *ec;
+    unsigned char *p;
+    size_t point_len;
+    CK_ULONG i;
+    int base = EVP_PKEY_base_id(key->pkey);
+
+    *data = NULL;
+    switch (type) {
+        case CKA_CLASS:
+            cls = object == KEYSTORE_PRIVATE ? CKO_PRIVATE_KEY : CKO_PUBLIC_KEY;
+            src = &cls;
+            *len = sizeof(cls);
+            break;
+        case CKA_KEY_TYPE:
+            key_type = base == EVP_PKEY_RSA ? CKK_RSA : CKK_EC;
+            src = &key_type;
+            *len = sizeof(key_type);
+            break;
+        case CKA_ID:
+            src = key->id;
+            *len = key->id_len;
+            break;
+        case CKA_LABEL:
+            /* libhsm labels keys with the hexadecimal id */
+            *len = key->id_len * 2;
+            if (!(*data = malloc(*len + 1))) return CKR_HOST_MEMORY;
+            for (i = 0; i < key->id_len; i++) {
+                snprintf((char *) *data + 2 * i, 3, "%02x", key->id[i]);
+            }
+            return CKR_OK;
+        case CKA_TOKEN:
+        case CKA_SENSITIVE:
+        case CKA_EXTRACTABLE:
+        case CKA_PRIVATE:
+        case CKA_SIGN:
+        case CKA_VERIFY:
+            if (type == CKA_TOKEN) {
+                flag = CK_TRUE;
+            } else if (type == CKA_EXTRACTABLE) {
+                flag = CK_FALSE;
+            } else if (type == CKA_VERIFY) {
+                flag = object == KEYSTORE_PUBLIC;
+            } else {
+                flag = object == KEYSTORE_PRIVATE;
+            }
+            src = &flag;
+            *len = sizeof(flag);
+            break;
+        case CKA_MODULUS:
+        case CKA_PUBLIC_EXPONENT:
+        case CKA_MODULUS_BITS:
+            if (base != EVP_PKEY_RSA) return CKR_ATTRIBUTE_TYPE_INVALID;
+            RSA_get0_key(EVP_PKEY_get0_RSA(key->pkey), &n, &e, NULL);
+            if (type == CKA_MODULUS_BITS) {
+                bits = BN_num_bits(n);
+                src = &bits;
+                *len = sizeof(bits);
+                break;
+            }
+            *data = keystore_bn(type == CKA_MODULUS ? n : e, len);
+            return *data ? CKR_OK : CKR_HOST_MEMORY;
+        case CKA_EC_PARAMS:
+            if (base != EVP_PKEY_EC) return CKR_ATTRIBUTE_TYPE_INVALID;
+            ec = EVP_PKEY_get0_EC_KEY(key->pkey);
+            switch (EC_GROUP_get_curve_name(EC_KEY_get0_group(ec))) {
+                case NID_X9_62_prime256v1:
+                    src = keystore_oid_p256;
+                    *len = sizeof(keystore_oid_p256);
+                    break;
+                case NID_secp384r1:
+                    src = keystore_oid_p384;
+                    *len = sizeof(keystore_oid_p384);
+                    break;
+                default:
+                    return CKR_ATTRIBUTE_TYPE_INVALID;
+            }
+            break;
+        case CKA_EC_POINT:
+            /* The uncompressed point, wrapped in a DER OCTET STRING */
+            if (base != EVP_PKEY_EC) return CKR_ATTRIBUTE_TYPE_INVALID;
+            ec = EVP_PKEY_get0_EC_KEY(key->pkey);
+            point_len = EC_POINT_point2oct(EC_KEY_get0_group(ec),
+                EC_KEY_get0_public_key(ec), POINT_CONVERSION_UNCOMPRESSED,
+                NULL, 0, NULL);
+            if (point_len == 0 || point_len > 255) {
+                return CKR_ATTRIBUTE_TYPE_INVALID;
+            }
+            *len = point_len + (point_len < 128 ? 2 : 3);
+            if (!(p = *data = malloc(*len))) return CKR_HOST_MEMORY;
+            *p++ = 0x04;
+            if (point_len >= 128) *p++ = 0x81;
+            *p++ = point_len;
+            EC_POINT_point2oct(EC_KEY_get0_group(ec),
+                EC_KEY_get0_public_key(ec), POINT_CONVERSION_UNCOMPRESSED,
+                p, point_len, NULL);
+            return CKR_OK;
+        default:
+            return CKR_ATTRIBUTE_TYPE_INVALID;
+    }
+    if (!(*data = malloc(*len ? *len : 1))) return CKR_HOST_MEMORY;
+    memcpy(*data, src, *len);
+    return CKR_OK;
+}
+
+static int
+keystore_match(const keystore_key_t *key, int object,
+               CK_ATTRIBUTE_PTR filter, CK_ULONG filter_count)
+{
+    CK_BYTE *data;
+    CK_ULONG i, len;
+    int match;
+
+    for (i = 0; i < filter_count; i++) {
+        if (keystore_value(key, object, filter[i].type, &data, &len)
+            != CKR_OK) {
+            return 0;
+        }
+        match = len == filter[i].ulValueLen
+            && memcmp(data, filter[i].pValue, len) == 0;
+        free(data);
+        if (!match) return 0;
+    }
+    return 1;
+}
+
+static void
+keystore_find_final(keystore_session_t *session)
+{
+    CK_ULONG i;
+
+    for (i = 0; i < session->filter_count; i++) {
+        free(session->filter[i].pValue);
+    }
+    free(session->filter);
+    session->filter = NULL;
+    session->filter_count = 0;
+    session->finding = 0;
+}
+
+static void
+keystore_sign_final(keystore_session_t *session)
+{
+    EVP_PKEY_free(session->signkey);
+    session->signkey = NULL;
+}
+
+static CK_RV
+keystore_C_Initialize(CK_VOID_PTR args)
+{
+    CK_RV rv = CKR_OK;
+
+    (void) args;
+    pthread_mutex_lock(&keystore_mutex);
+    if (keystore_initialized) {
+        rv = CKR_CRYPTOKI_ALREADY_INITIALIZED;
+    } else {
+        keystore_initialized = 1;
+    }
+    pthread_mutex_unlock(&keystore_mutex);
+    return rv;
+}
+
+static CK_RV
+keystore_C_Finalize(CK_VOID_PTR reserved_arg)
+{
+    CK_ULONG i;
+
+    (void) reserved_arg;
+    pthread_mutex_lock(&keystore_mutex);
+    if (!keystore_initialized) {
+        pthread_mutex_unlock(&keystore_mutex);
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+    for (i = 0; i < keystore_session_count; i++) {
+        keystore_find_final(keystore_sessions[i]);
+        keystore_sign_final(keystore_sessions[i]);
+        free(keystore_sessions[i]);
+    }
+    free(keystore_sessions);
+    keystore_sessions = NULL;
+    keystore_session_count = 0;
+    /* The slots stay registered, but are logged out */
+    for (i = 0; i < keystore_slot_count; i++) {
+        pthread_rwlock_wrlock(&keystore_slots[i]->lock);
+        keystore_unload(keystore_slots[i]);
+        pthread_rwlock_unlock(&keystore_slots[i]->lock);
+    }
+    keystore_initialized = 0;
+    pthread_mutex_unlock(&keystore_mutex);
+    return CKR_OK;
+}
+
+static CK_RV
+keystore_C_GetSlotList(CK_BBOOL present, CK_SLOT_ID_PTR list,
+                       CK_ULONG_PTR count)
+{
+    CK_ULONG i;
+    CK_RV rv = CKR_OK;
+
+    (void) present;
+    if (!count) return CKR_ARGUMENTS_BAD;
+    pthread_mutex_lock(&keystore_mutex);
+    if (!keystore_initialized) {
+        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
+    } else if (list && *count < keystore_slot_count) {
+        rv = CKR_BUFFER_TOO_SMALL;
+    } else if (list) {
+        for (i = 0; i < keystore_slot_count; i++) list[i] = i;
+    }
+    *count = keystore_slot_count;
+    pthread_mutex_unlock(&keystore_mutex);
+    return rv;
+}
+
+static CK_RV
+keystore_C_GetTokenInfo(CK_SLOT_ID slot_id_arg, CK_TOKEN_INFO_PTR info)
+{
+    CK_RV rv = CKR_OK;
+
+    if (!info) return CKR_ARGUMENTS_BAD;
+    pthread_mutex_lock(&keystore_mutex);
+    if (!keystore_initialized) {
+        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
+    } else if (slot_id_arg >= keystore_slot_count) {
+        rv = CKR_SLOT_ID_INVALID;
+    } else {
+        memset(info, 0, sizeof(CK_TOKEN_INFO));
+        memcpy(info->label, keystore_slots[slot_id_arg]->label,
+               KEYSTORE_LABEL_LEN);
+        memset(info->manufacturerID, ' ', sizeof(info->manufacturerID));
+        memcpy(info->manufacturerID, "OpenDNSSEC", 10);
+        memset(info->model, ' ', sizeof(info->model));
+        memcpy(info->model, "keystore", 8);
+        memset(info->serialNumber, ' ', sizeof(info->serialNumber));
+        memset(info->utcTime, ' ', sizeof(info->utcTime));
+        info->flags = CKF_RNG | CKF_LOGIN_REQUIRED | CKF_USER_PIN_INITIALIZED
+            | CKF_TOKEN_INITIALIZED;
+        info->ulMaxPinLen = 255;
+        info->ulMinPinLen = 1;
+    }
+    pthread_mutex_unlock(&keystore_mutex);
+    return rv;
+}
+
+static CK_RV
+keystore_C_OpenSession(CK_SLOT_ID slot_id_arg, CK_FLAGS flags,
+                       CK_VOID_PTR application, CK_NOTIFY notify,
+                       CK_SESSION_HANDLE_PTR handle)
+{
+    keystore_session_t **sessions;
+    keystore_session_t *session = NULL;
+    CK_ULONG i;
+    CK_RV rv = CKR_OK;
+
+    (void) application;
+    (void) notify;
+    if (!handle) return CKR_ARGUMENTS_BAD;
+    if (!(flags & CKF_SERIAL_SESSION)) {
+        return CKR_SESSION_PARALLEL_NOT_SUPPORTED;
+    }
+    pthread_mutex_lock(&keystore_mutex);
+    if (!keystore_initialized) {
+        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+    if (slot_id_arg >= keystore_slot_count) {
+        rv = CKR_SLOT_ID_INVALID;
+        goto done;
+    }
+    for (i = 0; i < keystore_session_count; i++) {
+        if (!keystore_sessions[i]->open) {
+            session = keystore_sessions[i];
+            break;
+        }
+    }
+    if (!session) {
+        sessions = realloc(keystore_sessions,
+            (keystore_session_count + 1) * sizeof(keystore_session_t *));
+        if (!sessions) {
+            rv = CKR_HOST_MEMORY;
+            goto done;
+        }
+        keystore_sessions = sessions;
+        session = calloc(1, sizeof(keystore_session_t));
+        if (!session) {
+            rv = CKR_HOST_MEMORY;
+            goto done;
+        }
+        i = keystore_session_count++;
+        keystore_sessions[i] = session;
+    }
+    session->open = 1;
+    session->slot = slot_id_arg;
+    *handle = i + 1;
+
+done:
+    pthread_mutex_unlock(&keystore_mutex);
+    return rv;
+}
+
+static CK_RV
+keystore_C_CloseSession(CK_SESSION_HANDLE handle)
+{
+    keystore_session_t *session = keystore_session(handle, NULL);
+
+    if (!session) return CKR_SESSION_HANDLE_INVALID;
+    keystore_find_final(session);
+    keystore_sign_final(session);
+    pthread_mutex_lock(&keystore_mutex);
+    session->open = 0;
+    pthread_mutex_unlock(&keystore_mutex);
+    return CKR_OK;
+}
+
+static CK_RV
+keystore_C_GetSessionInfo(CK_SESSION_HANDLE handle, CK_SESSION_INFO_PTR info)
+{
+    keystore_slot_t *slot;
+    keystore_session_t *session = keystore_session(handle, &slot);
+
+    if (!session) return CKR_SESSION_HANDLE_INVALID;
+    if (!info) return CKR_ARGUMENTS_BAD;
+    info->slotID = session->slot;
+    pthread_rwlock_rdlock(&slot->lock);
+    info->state = slot->loggedin ? CKS_RW_USER_FUNCTIONS
+                                 : CKS_RW_PUBLIC_SESSION;
+    pthread_rwlock_unlock(&slot->lock);
+    info->flags = CKF_SERIAL_SESSION | CKF_RW_SESSION;
+    info->ulDeviceError = 0;
+    return CKR_OK;
+}
+
+static CK_RV
+keystore_C_Login(CK_SESSION_HANDLE handle, CK_USER_TYPE user_type,
+                 CK_UTF8CHAR_PTR pin, CK_ULONG pin_len)
+{
+    keystore_slot_t *slot;
+    CK_RV rv;
+
+    if (!keystore_session(handle, &slot)) return CKR_SESSION_HANDLE_INVALID;
+    if (user_type != CKU_USER) return CKR_USER_TYPE_INVALID;
+    if (!pin) return CKR_ARGUMENTS_BAD;
+    pthread_rwlock_wrlock(&slot->lock);
+    if (slot->loggedin) {
+        rv = CKR_USER_ALREADY_LOGGED_IN;
+    } else {
+        rv = keystore_load(slot, pin, pin_len);
+    }
+    pthread_rwlock_unlock(&slot->lock);
+    return rv;
+}
+
+static CK_RV
+keystore_C_Logout(CK_SESSION_HANDLE handle)
+{
+    keystore_slot_t *slot;
+    CK_RV rv = CKR_OK;
+
+    if (!keystore_session(handle, &slot)) return CKR_SESSION_HANDLE_INVALID;
+    pthread_rwlock_wrlock(&slot->lock);
+    if (!slot->loggedin) {
+        rv = CKR_USER_NOT_LOGGED_IN;
+    } else {
+        keystore_unload(slot);
+    }
+    pthread_rwlock_unlock(&slot->lock);
+    return rv;
+}
+
+static CK_RV
+keystore_C_DestroyObject(CK_SESSION_HANDLE handle, CK_OBJECT_HANDLE object)
+{
+    keystore_slot_t *slot;
+    keystore_key_t *key;
+    int lock = -1;
+    CK_RV rv = CKR_OK;
+
+    if (!keystore_session(handle, &slot)) return CKR_SESSION_HANDLE_INVALID;
+    pthread_rwlock_wrlock(&slot->lock);
+    if (slot->loggedin && KEYSTORE_OBJECT(object) == KEYSTORE_PRIVATE) {
+        /* Only private keys are stored, so only they need the file */
+        if ((lock = keystore_lock(slot)) == -1) {
+            rv = CKR_DEVICE_ERROR;
+        } else {
+            rv = keystore_refresh(slot);
+        }
+    }
+    key = rv == CKR_OK ? keystore_object(slot, object) : NULL;
+    if (rv != CKR_OK) {
+        /* The file could not be locked or read */
+    } else if (!key) {
+        rv = CKR_OBJECT_HANDLE_INVALID;
+    } else {
+        key->objects &= ~KEYSTORE_OBJECT(object);
+        if (KEYSTORE_OBJECT(object) == KEYSTORE_PRIVATE) {
+            rv = keystore_save(slot);
+            if (rv != CKR_OK) key->objects |= KEYSTORE_PRIVATE;
+        }
+        if (!key->objects) {
+            /* The index stays in use, so handles remain unique */
+            EVP_PKEY_free(key->pkey);
+            key->pkey = NULL;
+        }
+    }
+    if (lock != -1) keystore_unlock(lock);
+    pthread_rwlock_unlock(&slot->lock);
+    return rv;
+}
+
+static CK_RV
+keystore_C_GetAttributeValue(CK_SESSION_HANDLE handle,
+                             CK_OBJECT_HANDLE object,
+                             CK_ATTRIBUTE_PTR templ, CK_ULONG count)
+{
+    keystore_slot_t *slot;
+    keystore_key_t *key;
+    CK_BYTE *data;
+    CK_ULONG i, len;
+    CK_RV rv = CKR_OK, attr_rv;
+
+    if (!keystore_session(handle, &slot)) return CKR_SESSION_HANDLE_INVALID;
+    if (!templ && count) return CKR_ARGUMENTS_BAD;
+    pthread_rwlock_rdlock(&slot->lock);
+    key = keystore_object(slot, object);
+    if (!key) {
+        pthread_rwlock_unlock(&slot->lock);
+        return CKR_OBJECT_HANDLE_INVALID;
+    }
+    for (i = 0; i < count; i++) {
+        attr_rv = keystore_value(key, KEYSTORE_OBJECT(object),
+                                 templ[i].type, &data, &len);
+        if (attr_rv == CKR_HOST_MEMORY) {
+            rv = attr_rv;
+            break;
+        } else if (attr_rv != CKR_OK) {
+            templ[i].ulValueLen = (CK_ULONG) -1;
+            rv = attr_rv;
+        } else if (!templ[i].pValue) {
+            templ[i].ulValueLen = len;
+        } else if (templ[i].ulValueLen < len) {
+            templ[i].ulValueLen = (CK_ULONG) -1;
+            rv = CKR_BUFFER_TOO_SMALL;
+        } else {
+            memcpy(templ[i].pValue, data, len);
+            templ[i].ulValueLen = len;
+        }
+        free(data);
+    }
+    pthread_rwlock_unlock(&slot->lock);
+    return rv;
+}
+
+/* Continue the search of a session, the slot must be locked */
+static void
+keystore_find(keystore_slot_t *slot, keystore_session_t *session,
+              CK_OBJECT_HANDLE_PTR objects, CK_ULONG max_count,
+              CK_ULONG_PTR count)
+{
+    keystore_key_t *key;
+    CK_OBJECT_HANDLE object;
+
+    for (object = session->cursor + 1;
+         *count < max_count && slot->loggedin
+         && KEYSTORE_INDEX(object) < slot->count;
+         object++) {
+        session->cursor = object;
+        key = keystore_object(slot, object);
+        if (key && keystore_match(key, KEYSTORE_OBJECT(object),
+                                  session->filter, session->filter_count)) {
+            objects[(*count)++] = object;
+        }
+    }
+}
+
+static CK_RV
+keystore_C_FindObjectsInit(CK_SESSION_HANDLE handle, CK_ATTRIBUTE_PTR templ,
+                           CK_ULONG count)
+{
+    keystore_session_t *session = keystore_session(handle, NULL);
+    CK_ULONG i;
+
+    if (!session) return CKR_SESSION_HANDLE_INVALID;
+    if (!templ && count) return CKR_ARGUMENTS_BAD;
+    if (session->finding) return CKR_OPERATION_ACTIVE;
+    session->filter = calloc(count ? count : 1, sizeof(CK_ATTRIBUTE));
+    if (!session->filter) return CKR_HOST_MEMORY;
+    session->finding = 1;
+    for (i = 0; i < count; i++) {
+        session->filter[i].type = templ[i].type;
+        session->filter[i].ulValueLen = templ[i].ulValueLen;
+        session->filter[i].pValue = malloc(templ[i].ulValueLen
+                                           ? templ[i].ulValueLen : 1);
+        session->filter_count = i + 1;
+        if (!session->filter[i].pValue) {
+            keystore_find_final(session);
+            return CKR_HOST_MEMORY;
+        }
+        memcpy(session->filter[i].pValue, templ[i].pValue,
+               templ[i].ulValueLen);
+    }
+    session->cursor = 0;
+    session->found = 0;
+    session->refreshed = 0;
+    return CKR_OK;
+}
+
+static CK_RV
+keystore_C_FindObjects(CK_SESSION_HANDLE handle, CK_OBJECT_HANDLE_PTR objects,
+                       CK_ULONG max_count, CK_ULONG_PTR count)
+{
+    keystore_slot_t *slot;
+    keystore_session_t *session = keystore_session(handle, &slot);
+
+    if (!session) return CKR_SESSION_HANDLE_INVALID;
+    if (!objects || !count) return CKR_ARGUMENTS_BAD;
+    if (!session->finding) return CKR_OPERATION_NOT_INITIALIZED;
+    *count = 0;
+    pthread_rwlock_rdlock(&slot->lock);
+    keystore_find(slot, session, objects, max_count, count);
+    pthread_rwlock_unlock(&slot->lock);
+    if (*count == 0 && !session->found && !session->refreshed) {
+        /* The key may have been generated by another process since the
+         * file was read. New keys are appended, so the search goes on
+         * where it stopped. */
+        session->refreshed = 1;
+        pthread_rwlock_wrlock(&slot->lock);
+        if (slot->loggedin && keystore_refresh(slot) == CKR_OK) {
+            keystore_find(slot, session, objects, max_count, count);
+        }
+        pthread_rwlock_unlock(&slot->lock);
+    }
+    if (*count > 0) session->found = 1;
+    return CKR_OK;
+}
+
+static CK_RV
+keystore_C_FindObjectsFinal(CK_SESSION_HANDLE handle)
+{
+    keystore_session_t *session = keystore_session(handle, NULL);
+
+    if (!session) return CKR_SESSION_HANDLE_INVALID;
+    if (!session->finding) return CKR_OPERATION_NOT_INITIALIZED;
+    keystore_find_final(session);
+    return CKR_OK;
+}
+
+static CK_RV
+keystore_C_DigestInit(CK_SESSION_HANDLE handle, CK_MECHANISM_PTR mechanism)
+{
+    (void) mechanism;
+    if (!keystore_session(handle, NULL)) return CKR_SESSION_HANDLE_INVALID;
+    return CKR_MECHANISM_INVALID;
+}
+
+static CK_RV
+keystore_C_Digest(CK_SESSION_HANDLE handle, CK_BYTE_PTR data,
+                  CK_ULONG data_len, CK_BYTE_PTR digest,
+                  CK_ULONG_PTR digest_len)
+{
+    (void) data;
+    (void) data_len;
+    (void) digest;
+    (void) digest_len;
+    if (!keystore_session(handle, NULL)) return CKR_SESSION_HANDLE_INVALID;
+    return CKR_OPERATION_NOT_INITIALIZED;
+}
+
+static CK_RV
+keystore_C_SignInit(CK_SESSION_HANDLE handle, CK_MECHANISM_PTR mechanism,
+                    CK_OBJECT_HANDLE object)
+{
+    keystore_slot_t *slot;
+    keystore_session_t *session = keystore_session(handle, &slot);
+    keystore_key_t *key;
+    int base;
+    CK_RV rv = CKR_OK;
+
+    if (!session) return CKR_SESSION_HANDLE_INVALID;
+    if (!mechanism) return CKR_ARGUMENTS_BAD;
+    if (session->signkey) return CKR_OPERATION_ACTIVE;
+    if (mechanism->mechanism == CKM_RSA_PKCS) {
+        base = EVP_PKEY_RSA;
+    } else if (mechanism->mechanism == CKM_ECDSA) {
+        base = EVP_PKEY_EC;
+    } else {
+        return CKR_MECHANISM_INVALID;
+    }
+    pthread_rwlock_rdlock(&slot->lock);
+    key = keystore_object(slot, object);
+    if (!key || KEYSTORE_OBJECT(object) != KEYSTORE_PRIVATE) {
+        rv = CKR_KEY_HANDLE_INVALID;
+    } else if (EVP_PKEY_base_id(key->pkey) != base) {
+        rv = CKR_KEY_TYPE_INCONSISTENT;
+    } else {
+        /* Sign with our own reference, outside of the lock */
+        EVP_PKEY_up_ref(key->pkey);
+        session->signkey = key->pkey;
+    }
+    pthread_rwlock_unlock(&slot->lock);
+    return rv;
+}
+
+static CK_RV
+keystore_C_Sign(CK_SESSION_HANDLE handle, CK_BYTE_PTR data, CK_ULONG data_len,
+                CK_BYTE_PTR signature, CK_ULONG_PTR signature_len)
+{
+    keystore_session_t *session = keystore_session(handle, NULL);
+    EVP_PKEY_CTX *pctx = NULL;
+    ECDSA_SIG *sig = NULL;
+    const BIGNUM *r, *s;
+    const unsigned char *der_p;
+    unsigned char *der = NULL;
+    size_t der_len, len;
+    CK_ULONG needed;
+    int rsa;
+    CK_RV rv = CKR_FUNCTION_FAILED;
+
+    if (!session) return CKR_SESSION_HANDLE_INVALID;
+    if (!session->signkey) return CKR_OPERATION_NOT_INITIALIZED;
+    if (!data || !signature_len) {
+        keystore_sign_final(session);
+        return CKR_ARGUMENTS_BAD;
+    }
+    rsa = EVP_PKEY_base_id(session->signkey) == EVP_PKEY_RSA;
+    if (rsa) {
+        needed = EVP_PKEY_size(session->signkey);
+    } else {
+        /* ECDSA signatures are r | s, each the size of the field */
+        needed = 2 * ((EVP_PKEY_bits(session->signkey) + 7) / 8);
+    }
+    /* Size queries leave the operation active */
+    if (!signature) {
+        *signature_len = needed;
+        return CKR_OK;
+    } else if (*signature_len < needed) {
+        *signature_len = needed;
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    pctx = EVP_PKEY_CTX_new(session->signkey, NULL);
+    if (!pctx || EVP_PKEY_sign_init(pctx) != 1) goto done;
+    if (rsa) {
+        /* The data already carries the DigestInfo prefix */
+        len = needed;
+        if (EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PADDING) != 1
+            || EVP_PKEY_sign(pctx, signature, &len, data, data_len) != 1) {
+            goto done;
+        }
+        *signature_len = len;
+    } else {
+        der_len = EVP_PKEY_size(session->signkey);
+        if (!(der = malloc(der_len))) {
+            rv = CKR_HOST_MEMORY;
+            goto done;
+        }
+        der_p = der;
+        if (EVP_PKEY_sign(pctx, der, &der_len, data, data_len) != 1
+            || !(sig = d2i_ECDSA_SIG(NULL, &der_p, der_len))) {
+            goto done;
+        }
+        ECDSA_SIG_get0(sig, &r, &s);
+        if (BN_bn2binpad(r, signature, needed / 2) < 0
+            || BN_bn2binpad(s, signature + needed / 2, needed / 2) < 0) {
+            goto done;
+        }
+        *signature_len = needed;
+    }
+    rv = CKR_OK;
+
+done:
+    ECDSA_SIG_free(sig);
+    free(der);
+    EVP_PKEY_CTX_free(pctx);
+    keystore_sign_final(session);
+    return rv;
+}
+
+static CK_ATTRIBUTE_PTR
+keystore_attribute(CK_ATTRIBUTE_PTR templ, CK_ULONG count,
+                   CK_ATTRIBUTE_TYPE type)
+{
+    CK_ULONG i;
+
+    for (i = 0; i < count; i++) {
+        if (templ[i].type == type) return &templ[i];
+    }
+    return NULL;
+}
+
+static CK_RV
+keystore_C_GenerateKeyPair(CK_SESSION_HANDLE handle,
+                           CK_MECHANISM_PTR mechanism,
+                           CK_ATTRIBUTE_PTR public_templ,
+                           CK_ULONG public_count,
+                           CK_ATTRIBUTE_PTR private_templ,
+                           CK_ULONG private_count,
+                           CK_OBJECT_HANDLE_PTR public_key,
+                           CK_OBJECT_HANDLE_PTR private_key)
+{
+    static const CK_BYTE f4[] = { 0x01, 0x00, 0x01 };
+    keystore_slot_t *slot;
+    CK_ATTRIBUTE_PTR id, bits, exponent, params;
+    EVP_PKEY_CTX *pctx = NULL;
+    EVP_PKEY *pkey = NULL;
+    size_t index;
+    int nid = NID_undef, lock = -1;
+    CK_RV rv;
+
+    if (!keystore_session(handle, &slot)) return CKR_SESSION_HANDLE_INVALID;
+    if (!mechanism || !public_key || !private_key) return CKR_ARGUMENTS_BAD;
+    id = keystore_attribute(private_templ, private_count, CKA_ID);
+    if (!id) id = keystore_attribute(public_templ, public_count, CKA_ID);
+    if (!id) return CKR_TEMPLATE_INCOMPLETE;
+
+    if (mechanism->mechanism == CKM_RSA_PKCS_KEY_PAIR_GEN) {
+        bits = keystore_attribute(public_templ, public_count,
+                                  CKA_MODULUS_BITS);
+        exponent = keystore_attribute(public_templ, public_count,
+                                      CKA_PUBLIC_EXPONENT);
+        if (!bits || bits->ulValueLen != sizeof(CK_ULONG)) {
+            return CKR_TEMPLATE_INCOMPLETE;
+        }
+        /* OpenSSL generates keys with exponent 65537 */
+        if (exponent && (exponent->ulValueLen != sizeof(f4)
+                         || memcmp(exponent->pValue, f4, sizeof(f4)) != 0)) {
+            return CKR_TEMPLATE_INCONSISTENT;
+        }
+        pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+        if (!pctx || EVP_PKEY_keygen_init(pctx) != 1
+            || EVP_PKEY_CTX_set_rsa_keygen_bits(pctx,
+                   *(CK_ULONG *) bits->pValue) != 1) {
+            EVP_PKEY_CTX_free(pctx);
+            return CKR_TEMPLATE_INCONSISTENT;
+        }
+    } else if (mechanism->mechanism == CKM_EC_KEY_PAIR_GEN) {
+        params = keystore_attribute(public_templ, public_count,
+                                    CKA_EC_PARAMS);
+        if (!params) return CKR_TEMPLATE_INCOMPLETE;
+        if (params->ulValueLen == sizeof(keystore_oid_p256)
+            && !memcmp(params->pValue, keystore_oid_p256,
+                       sizeof(keystore_oid_p256))) {
+            nid = NID_X9_62_prime256v1;
+        } else if (params->ulValueLen == sizeof(keystore_oid_p384)
+            && !memcmp(params->pValue, keystore_oid_p384,
+                       sizeof(keystore_oid_p384))) {
+            nid = NID_secp384r1;
+        } else {
+            return CKR_DOMAIN_PARAMS_INVALID;
+        }
+        pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+        if (!pctx || EVP_PKEY_keygen_init(pctx) != 1
+            || EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, nid) != 1) {
+            EVP_PKEY_CTX_free(pctx);
+            return CKR_FUNCTION_FAILED;
+        }
+    } else {
+        return CKR_MECHANISM_INVALID;
+    }
+
+    /* Generate outside of the lock, signing carries on meanwhile */
+    if (EVP_PKEY_keygen(pctx, &pkey) != 1) {
+        EVP_PKEY_CTX_free(pctx);
+        return CKR_FUNCTION_FAILED;
+    }
+    EVP_PKEY_CTX_free(pctx);
+
+    pthread_rwlock_wrlock(&slot->lock);
+    if (!slot->loggedin) {
+        rv = CKR_USER_NOT_LOGGED_IN;
+    } else if ((lock = keystore_lock(slot)) == -1) {
+        rv = CKR_DEVICE_ERROR;
+    } else if ((rv = keystore_refresh(slot)) == CKR_OK) {
+        rv = keystore_add(slot, id->pValue, id->ulValueLen, pkey, &index);
+    }
+    if (rv != CKR_OK) {
+        if (lock != -1) keystore_unlock(lock);
+        pthread_rwlock_unlock(&slot->lock);
+        EVP_PKEY_free(pkey);
+        return rv;
+    }
+    rv = keystore_save(slot);
+    if (rv != CKR_OK) {
+        slot->count--;
+        free(slot->keys[index].id);
+        EVP_PKEY_free(pkey);
+    } else {
+        *private_key = KEYSTORE_HANDLE(index, KEYSTORE_PRIVATE);
+        *public_key = KEYSTORE_HANDLE(index, KEYSTORE_PUBLIC);
+    }
+    keystore_unlock(lock);
+    pthread_rwlock_unlock(&slot->lock);
+    return rv;
+}
+
+static CK_RV
+keystore_C_GenerateKey(CK_SESSION_HANDLE handle, CK_MECHANISM_PTR mechanism,
+                       CK_ATTRIBUTE_PTR templ, CK_ULONG count,
+                       CK_OBJECT_HANDLE_PTR key)
+{
+    (void) mechanism;
+    (void) templ;
+    (void) count;
+    (void) key;
+    if (!keystore_session(handle, NULL)) return CKR_SESSION_HANDLE_INVALID;
+    return CKR_MECHANISM_INVALID;
+}
+
+static CK_RV
+keystore_C_GenerateRandom(CK_SESSION_HANDLE handle, CK_BYTE_PTR data,
+                          CK_ULONG len)
+{
+    if (!keystore_session(handle, NULL)) return CKR_SESSION_HANDLE_INVALID;
+    if (!data) return CKR_ARGUMENTS_BAD;
+    return RAND_bytes(data, len) == 1 ? CKR_OK : CKR_FUNCTION_FAILED;
+}
+
+CK_RV
+hsm_keystore_functions(const char *label, const char *path,
+                       CK_FUNCTION_LIST_PTR_PTR functions)
+{
+    unsigned char padded[KEYSTORE_LABEL_LEN];
+    keystore_slot_t *slot = NULL;
+    size_t len;
+    CK_ULONG i;
+    char *copy;
+
+    if (!label || !path || !functions) return CKR_ARGUMENTS_BAD;
+    len = strlen(label);
+    if (len > KEYSTORE_LABEL_LEN) len = KEYSTORE_LABEL_LEN;
+    memset(padded, ' ', KEYSTORE_LABEL_LEN);
+    memcpy(padded, label, len);
+
+    pthread_mutex_lock(&keystore_mutex);
+    for (i = 0; i < keystore_slot_count; i++) {
+        if (!memcmp(keystore_slots[i]->label, padded, KEYSTORE_LABEL_LEN)) {
+            slot = keystore_slots[i];
+            break;
+        }
+    }
+    if (slot) {
+        /* Known token, it may have moved while logged out */
+        pthread_rwlock_wrlock(&slot->lock);
+        if (!slot->loggedin && strcmp(slot->path, path) != 0
+            && (copy = strdup(path))) {
+            free(slot->path);
+            slot->path = copy;
+        }
+        pthread_rwlock_unlock(&slot->lock);
+    } else {
+        if (keystore_slot_count == KEYSTORE_MAX_SLOTS
+            || !(slot = calloc(1, sizeof(keystore_slot_t)))
+            || !(slot->path = strdup(path))) {
+            free(slot);
+            pthread_mutex_unlock(&keystore_mutex);
+            return CKR_FUNCTION_FAILED;
+        }
+        memcpy(slot->label, padded, KEYSTORE_LABEL_LEN);
+        pthread_rwlock_init(&slot->lock, NULL);
+        keystore_slots[keystore_slot_count++] = slot;
+    }
+
+    if (!keystore_function_list_ready) {
+        /* Functions that libhsm does not use are left out */
+        memset(&keystore_function_list, 0, sizeof(keystore_function_list));
+        keystore_function_list.version.major = 2;
+        keystore_function_list.version.minor = 20;
+        keystore_function_list.C_Initialize = keystore_C_Initialize;
+        keystore_function_list.C_Finalize = keystore_C_Finalize;
+        keystore_function_list.C_GetSlotList = keystore_C_GetSlotList;
+        keystore_function_list.C_GetTokenInfo = keystore_C_GetTokenInfo;
+        keystore_function_list.C_OpenSession = keystore_C_OpenSession;
+        keystore_function_list.C_CloseSession = keystore_C_CloseSession;
+        keystore_function_list.C_GetSessionInfo = keystore_C_GetSessionInfo;
+        keystore_function_list.C_Login = keystore_C_Login;
+        keystore_function_list.C_Logout = keystore_C_Logout;
+        keystore_function_list.C_DestroyObject = keystore_C_DestroyObject;
+        keystore_function_list.C_GetAttributeValue =
+            keystore_C_GetAttributeValue;
+        keystore_function_list.C_FindObjectsInit = keystore_C_FindObjectsInit;
+        keystore_function_list.C_FindObjects = keystore_C_FindObjects;
+        keystore_function_list.C_FindObjectsFinal =
+            keystore_C_FindObjectsFinal;
+        keystore_function_list.C_DigestInit = keystore_C_DigestInit;
+        keystore_function_list.C_Digest = keystore_C_Digest;
+        keystore_function_list.C_SignInit = keystore_C_SignInit;
+        keystore_function_list.C_Sign = keystore_C_Sign;
+        keystore_function_list.C_GenerateKey = keystore_C_GenerateKey;
+        keystore_function_list.C_GenerateKeyPair = keystore_C_GenerateKeyPair;
+        keystore_function_list.C_GenerateRandom = keystore_C_GenerateRandom;
+        keystore_function_list_ready = 1;
+    }
+    pthread_mutex_unlock(&keystore_mutex);
+    *functions = &keystore_function_list;
+    return CKR_OK;
+}
+
+#else /* HAVE_SSL && HAVE_SSL_NEW_HMAC */
+
+CK_RV
+hsm_keystore_functions(const char *label, const char *path,
+                       CK_FUNCTION_LIST_PTR_PTR functions)
+{
+    (void) label;
+    (void) path;
+    (void) functions;
+    /* The software keystore needs OpenSSL 1.1 or later */
+    return CKR_FUNCTION_FAILED;
+}
+
+#endif /* HAVE_SSL && HAVE_SSL_NEW_HMAC */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef HSM_KEYSTORE_H
+#define HSM_KEYSTORE_H 1
+
+#include <pkcs11.h>
+
+/*! Module path prefix selecting the built-in software keystore, the
+ * remainder of the path names the keystore file */
+#define HSM_KEYSTORE_PREFIX "keystore:"
+
+/*! Register a software keystore as a token with the given label, and
+ * return the function list of the built-in keystore module.
+ *
+ * The keystore file is encrypted with the PIN of the token. It is created,
+ * empty, on the first login with that PIN.
+ *
+ * \param[in] label the token label
+ * \param[in] path the path to the keystore file
+ * \param[out] functions the PKCS#11 function list
+ * \return CKR_OK, or CKR_FUNCTION_FAILED if the software keystore is not
+ *         available in this build
+ */
+CK_RV hsm_keystore_functions(const char *label, const char *path,
+                             CK_FUNCTION_LIST_PTR_PTR functions);
+
+#endif /* HSM_KEYSTORE_H */
@@ -43,8 +43,11 @@
 
 #include "libhsm.h"
 #include "libhsmdns.h"
+#include "keystore.h"
 #include "compat.h"
 #include "duration.h"
+#include "log.h"
+#include "metrics.h"
 #include "status.h"
 
 #include <pkcs11.h>
@@ -235,6 +238,25 @@ static int
 hsm_pkcs11_check_error(hsm_ctx_t *ctx, CK_RV rv, const char *action)
 {
     if (rv != CKR_OK) {
+        if (ctx) {
+            switch (rv) {
+            case CKR_GENERAL_ERROR:
+            case CKR_FUNCTION_FAILED:
+            case CKR_DEVICE_ERROR:
+            case CKR_DEVICE_MEMORY:
+            case CKR_DEVICE_REMOVED:
+            case CKR_TOKEN_NOT_PRESENT:
+            case CKR_TOKEN_NOT_RECOGNIZED:
+            case CKR_SESSION_CLOSED:
+            case CKR_SESSION_HANDLE_INVALID:
+            case CKR_USER_NOT_LOGGED_IN:
+            case CKR_CRYPTOKI_NOT_INITIALIZED:
+                ctx->device_error = 1;
+                break;
+            default:
+                break;
+            }
+        }
         if (ctx && ctx->error == 0) {
             ctx->error = (int) rv;
             ctx->error_action = action;
@@ -264,7 +286,13 @@ hsm_pkcs11_load_functions(hsm_module_t *module)
 {
     CK_C_GetFunctionList pGetFunctionList = NULL;
 
-    if (module && module->path) {
+    if (module && module->path && strncmp(module->path,
+        HSM_KEYSTORE_PREFIX, strlen(HSM_KEYSTORE_PREFIX)) == 0) {
+        /* Software keystore built into libhsm */
+        return hsm_keystore_functions(module->token_label,
+            module->path + strlen(HSM_KEYSTORE_PREFIX),
+            (CK_FUNCTION_LIST_PTR_PTR)(&module->sym));
+    } else if (module && module->path) {
         /* library provided by application or user */
 
 #if defined(HAVE_LOADLIBRARY)
@@ -370,7 +398,8 @@ hsm_pkcs11_check_token_name(hsm_ctx_t *ctx,
 
 hsm_repository_t *
 hsm_repository_new(char* name, char* module, char* tokenlabel, char* pin,
-    uint8_t use_pubkey, uint8_t allowextract, uint8_t require_backup)
+    uint8_t use_pubkey, uint8_t allowextract, uint8_t require_backup,
+    char* group)
 {
     hsm_repository_t* r;
 
@@ -380,6 +409,7 @@ hsm_repository_new(char* name, char* module, char* tokenlabel, char* pin,
 
     r->next = NULL;
     r->pin = NULL;
+    r->group = NULL;
     r->name = strdup(name);
     r->module = strdup(module);
     r->tokenlabel = strdup(tokenlabel);
@@ -394,6 +424,13 @@ hsm_repository_new(char* name, char* module, char* tokenlabel, char* pin,
             return NULL;
         }
     }
+    if (group) {
+        r->group = strdup(group);
+        if (!r->group) {
+            hsm_repository_free(r);
+            return NULL;
+        }
+    }
     r->use_pubkey = use_pubkey;
     r->allow_extract = allowextract; 
     r->require_backup = require_backup;
@@ -409,6 +446,7 @@ hsm_repository_free(hsm_repository_t *r)
         if (r->module) free(r->module);
         if (r->tokenlabel) free(r->tokenlabel);
         if (r->pin) free(r->pin);
+        if (r->group) free(r->group);
     }
     free(r);
 }
@@ -495,6 +533,14 @@ hsm_module_new(const char *repository,
     module->path = strdup(path);
     module->handle = NULL;
     module->sym = NULL;
+    module->group = NULL;
+    module->inflight = 0;
+    module->signatures = 0;
+    module->failed = 0;
+    module->sign_latency = metrics_histogram("ods_hsm_sign_seconds",
+        "Time to make a signature in the HSM.", "repository", repository);
+    module->sign_errors = metrics_counter("ods_hsm_sign_errors_total",
+        "Signatures the HSM failed to make.", "repository", repository);
     
     return module;
 }
@@ -507,6 +553,7 @@ hsm_module_free(hsm_module_t *module)
         if (module->token_label) free(module->token_label);
         if (module->path) free(module->path);
         if (module->config) free(module->config);
+        if (module->group) free(module->group);
 
         free(module);
     }
@@ -672,6 +719,8 @@ hsm_ctx_new()
     memset(ctx->session, 0, HSM_MAX_SESSIONS);
     ctx->session_count = 0;
     ctx->error = 0;
+    ctx->device_error = 0;
+    ctx->keycache = NULL;
     return ctx;
 }
 
@@ -762,6 +811,34 @@ hsm_ctx_add_session(hsm_ctx_t *ctx, hsm_session_t *session)
     return 0;
 }
 
+/* Log the error that made a member of a replica group unusable, and
+ * forget it: the other members of the group carry on. */
+static void
+hsm_replica_skip(hsm_ctx_t *ctx, const char *repository, const char *group)
+{
+    ods_log_warning("[hsm] repository %s of replica group %s is not "
+        "available: %s: %s", repository, group,
+        ctx->error_action ? ctx->error_action : "unknown()",
+        ctx->error_message[0] ? ctx->error_message : "unknown error");
+    ctx->error = 0;
+}
+
+/* Is any repository of the replica group attached to the context? */
+static int
+hsm_group_attached(hsm_ctx_t *ctx, const char *group, const int *usable)
+{
+    unsigned int i;
+
+    for (i = 0; i < ctx->session_count; i++) {
+        if (ctx->session[i] && ctx->session[i]->module->group
+            && strcmp(ctx->session[i]->module->group, group) == 0
+            && (!usable || usable[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static hsm_ctx_t *
 hsm_ctx_clone(hsm_ctx_t *ctx)
 {
@@ -774,6 +851,19 @@ hsm_ctx_clone(hsm_ctx_t *ctx)
         new_ctx = hsm_ctx_new();
         for (i = 0; i < ctx->session_count; i++) {
             new_session = hsm_session_clone(ctx, ctx->session[i]);
+            if (!new_session && ctx->session[i]->module->group) {
+                /* a replica may be left out, keys are found by the
+                 * name of their repository */
+                if (!__atomic_load_n(&ctx->session[i]->module->failed,
+                                     __ATOMIC_RELAXED)) {
+                    hsm_replica_skip(ctx, ctx->session[i]->module->name,
+                                     ctx->session[i]->module->group);
+                }
+                ctx->error = 0;
+                __atomic_store_n(&ctx->session[i]->module->failed,
+                                 time(NULL), __ATOMIC_RELAXED);
+                continue;
+            }
             if (!new_session) {
                 /* one of the sessions failed to clone. Clear the
                  * new ctx and return NULL */
@@ -782,8 +872,18 @@ hsm_ctx_clone(hsm_ctx_t *ctx)
             }
             hsm_ctx_add_session(new_ctx, new_session);
         }
+        for (i = 0; i < ctx->session_count; i++) {
+            if (ctx->session[i]->module->group
+                && !hsm_group_attached(new_ctx,
+                       ctx->session[i]->module->group, NULL)) {
+                hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_create_context()",
+                    "No repository of replica group %s is available",
+                    ctx->session[i]->module->group);
+                hsm_ctx_close(new_ctx, 0);
+                return NULL;
+            }
+        }
         new_ctx->keycache = ctx->keycache;
-        new_ctx->keycache_lock = ctx->keycache_lock;
     }
     return new_ctx;
 }
@@ -796,6 +896,7 @@ libhsm_key_new()
     key->modulename = NULL;
     key->private_key = 0;
     key->public_key = 0;
+    key->replica = NULL;
     return key;
 }
 
@@ -1465,6 +1566,35 @@ hsm_find_key_by_id_bin(hsm_ctx_t *ctx,
     return NULL;
 }
 
+/* Look up the key in the other repositories of its replica group, and
+ * chain the copies found to key->replica.
+ */
+static void
+hsm_find_key_replicas(hsm_ctx_t *ctx, libhsm_key_t *key,
+                      const unsigned char *id, size_t len)
+{
+    hsm_session_t *session;
+    libhsm_key_t **last;
+    libhsm_key_t *replica;
+    unsigned int i;
+
+    session = hsm_find_key_session(ctx, key);
+    if (!session || !session->module->group) return;
+    last = &key->replica;
+    for (i = 0; i < ctx->session_count; i++) {
+        if (!ctx->session[i] || ctx->session[i]->module == session->module ||
+            !ctx->session[i]->module->group ||
+            strcmp(ctx->session[i]->module->group, session->module->group)) {
+            continue;
+        }
+        replica = hsm_find_key_by_id_session(ctx, ctx->session[i], id, len);
+        if (replica) {
+            *last = replica;
+            last = &replica->replica;
+        }
+    }
+}
+
 
 /**
  * returns the first session found if repository is null, otherwise
@@ -1832,7 +1962,8 @@ hsm_digest_through_hsm(hsm_ctx_t *ctx,
 }
 
 static ldns_rdf *
-hsm_sign_buffer(hsm_ctx_t *ctx,
+hsm_sign_buffer_session(hsm_ctx_t *ctx,
+                hsm_session_t *session,
                 ldns_buffer *sign_buf,
                 const libhsm_key_t *key,
                 ldns_algorithm algorithm)
@@ -1849,11 +1980,6 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
     CK_BYTE *data = NULL;
     CK_ULONG data_len = 0;
 
-    hsm_session_t *session;
-
-    session = hsm_find_key_session(ctx, key);
-    if (!session) return NULL;
-
     /* some HSMs don't really handle CKM_SHA1_RSA_PKCS well, so
      * we'll do the hashing manually */
     /* When adding algorithms, remember there is another switch below */
@@ -1987,6 +2113,97 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
 
 }
 
+/* Pick the replica of the key to sign with: a healthy one with the
+ * fewest signatures in progress. Replicas that reported a device error
+ * are retried after HSM_REPLICA_RETRY seconds, or when no healthy
+ * replica is left.
+ */
+static const libhsm_key_t *
+hsm_pick_replica(hsm_ctx_t *ctx, const libhsm_key_t *key,
+                 hsm_session_t **session, time_t now)
+{
+    const libhsm_key_t *best = NULL;
+    const libhsm_key_t *replica;
+    hsm_session_t *candidate;
+    unsigned long load, best_load = 0;
+    time_t failed, best_failed = 0;
+    int healthy, best_healthy = 0;
+
+    *session = NULL;
+    for (replica = key; replica; replica = replica->replica) {
+        candidate = hsm_find_key_session(ctx, replica);
+        if (!candidate) continue;
+        if (!key->replica) {
+            *session = candidate;
+            return replica;
+        }
+        failed = __atomic_load_n(&candidate->module->failed, __ATOMIC_RELAXED);
+        healthy = (failed == 0 || now - failed >= HSM_REPLICA_RETRY);
+        load = __atomic_load_n(&candidate->module->inflight, __ATOMIC_RELAXED);
+        if (!best || (healthy && !best_healthy) ||
+            (healthy == best_healthy &&
+             (healthy ? load < best_load : failed < best_failed))) {
+            best = replica;
+            best_load = load;
+            best_failed = failed;
+            best_healthy = healthy;
+            *session = candidate;
+        }
+    }
+    return best;
+}
+
+/* Sign the buffer, with the least loaded replica of the key. If that
+ * fails because of the device, mark the replica as failed and try the
+ * next one.
+ */
+static ldns_rdf *
+hsm_sign_buffer(hsm_ctx_t *ctx,
+                ldns_buffer *sign_buf,
+                const libhsm_key_t *key,
+                ldns_algorithm algorithm)
+{
+    const libhsm_key_t *replica;
+    hsm_session_t *session;
+    ldns_rdf *sig_rdf = NULL;
+    size_t tries = 1;
+    time_t now;
+    uint64_t start;
+
+    for (replica = key->replica; replica; replica = replica->replica) {
+        tries++;
+    }
+    now = time(NULL);
+    while (tries--) {
+        replica = hsm_pick_replica(ctx, key, &session, now);
+        if (!replica) return NULL;
+        ctx->device_error = 0;
+        __atomic_add_fetch(&session->module->inflight, 1, __ATOMIC_RELAXED);
+        start = metrics_clock();
+        sig_rdf = hsm_sign_buffer_session(ctx, session, sign_buf, replica,
+                                          algorithm);
+        __atomic_sub_fetch(&session->module->inflight, 1, __ATOMIC_RELAXED);
+        if (sig_rdf) {
+            metrics_since(session->module->sign_latency, start);
+            __atomic_add_fetch(&session->module->signatures, 1,
+                               __ATOMIC_RELAXED);
+            if (__atomic_load_n(&session->module->failed, __ATOMIC_RELAXED)) {
+                __atomic_store_n(&session->module->failed, 0,
+                                 __ATOMIC_RELAXED);
+            }
+            return sig_rdf;
+        }
+        metrics_count(session->module->sign_errors, 1);
+        if (!ctx->device_error || !key->replica) break;
+        __atomic_store_n(&session->module->failed, now, __ATOMIC_RELAXED);
+        if (tries) {
+            /* forget the error, another replica may do the job */
+            ctx->error = 0;
+        }
+    }
+    return NULL;
+}
+
 static int
 hsm_dname_is_wildcard(const ldns_rdf* dname)
 {
@@ -1995,36 +2212,31 @@ hsm_dname_is_wildcard(const ldns_rdf* dname)
              ldns_rdf_data(dname)[1] == '*');
 }
 
+/* Create the signature for an RRset with the given owner, type, class
+ * and TTL, without the signature data */
 static ldns_rr *
-hsm_create_empty_rrsig(const ldns_rr_list *rrset,
-                       const hsm_sign_params_t *sign_params)
+hsm_create_empty_rrsig_for(const ldns_rdf *owner,
+                           ldns_rr_type type,
+                           ldns_rr_class orig_class,
+                           uint32_t orig_ttl,
+                           const hsm_sign_params_t *sign_params)
 {
     ldns_rr *rrsig;
-    uint32_t orig_ttl;
-    uint32_t orig_class;
     time_t now;
     uint8_t label_count;
 
-    label_count = ldns_dname_label_count(
-                       ldns_rr_owner(ldns_rr_list_rr(rrset, 0)));
+    label_count = ldns_dname_label_count(owner);
     /* RFC 4035 section 2.2: dnssec label length and wildcards */
-    if (hsm_dname_is_wildcard(ldns_rr_owner(ldns_rr_list_rr(rrset, 0)))) {
+    if (hsm_dname_is_wildcard(owner)) {
         label_count--;
     }
 
     rrsig = ldns_rr_new_frm_type(LDNS_RR_TYPE_RRSIG);
 
     /* set the type on the new signature */
-    orig_ttl = ldns_rr_ttl(ldns_rr_list_rr(rrset, 0));
-    orig_class = ldns_rr_get_class(ldns_rr_list_rr(rrset, 0));
-
     ldns_rr_set_class(rrsig, orig_class);
     ldns_rr_set_ttl(rrsig, orig_ttl);
-    ldns_rr_set_owner(rrsig,
-              ldns_rdf_clone(
-                   ldns_rr_owner(
-                    ldns_rr_list_rr(rrset,
-                            0))));
+    ldns_rr_set_owner(rrsig, ldns_rdf_clone(owner));
 
     /* fill in what we know of the signature */
 
@@ -2084,12 +2296,24 @@ hsm_create_empty_rrsig(const ldns_rr_list *rrset,
             rrsig,
             ldns_native2rdf_int16(
                 LDNS_RDF_TYPE_TYPE,
-                ldns_rr_get_type(ldns_rr_list_rr(rrset,
-                                                 0))));
+                type));
 
     return rrsig;
 }
 
+static ldns_rr *
+hsm_create_empty_rrsig(const ldns_rr_list *rrset,
+                       const hsm_sign_params_t *sign_params)
+{
+    const ldns_rr *first = ldns_rr_list_rr(rrset, 0);
+
+    return hsm_create_empty_rrsig_for(ldns_rr_owner(first),
+                                      ldns_rr_get_type(first),
+                                      ldns_rr_get_class(first),
+                                      ldns_rr_ttl(first),
+                                      sign_params);
+}
+
 
 /*
  *  API functions
@@ -2115,6 +2339,7 @@ hsm_open2(hsm_repository_t* rlist,
     int result = HSM_OK;
     int tries;
     int repositories = 0;
+    unsigned int i, id = 0;
 
     pthread_mutex_lock(&_hsm_ctx_mutex);
     /* create an internal context with an attached session for each
@@ -2137,14 +2362,13 @@ hsm_open2(hsm_repository_t* rlist,
                     result = HSM_PIN_INCORRECT;
                     tries = 0;
                     while (result == HSM_PIN_INCORRECT && tries < 3) {
-                        module_pin = pin_callback(_hsm_ctx->session_count,
+                        module_pin = pin_callback(id,
                             repo->name, tries?HSM_PIN_RETRY:HSM_PIN_FIRST);
                         if (module_pin == NULL) break;
                         result = hsm_attach(repo->name, repo->tokenlabel,
                             repo->module, module_pin, &module_config);
                         if (result == HSM_OK) {
-                            pin_callback(_hsm_ctx->session_count - 1,
-                                repo->name, HSM_PIN_SAVE);
+                            pin_callback(id, repo->name, HSM_PIN_SAVE);
                         }
                         memset(module_pin, 0, strlen(module_pin));
                         tries++;
@@ -2156,13 +2380,44 @@ hsm_open2(hsm_repository_t* rlist,
                     result = HSM_ERROR;
                 }
             }
-            if (result != HSM_OK) {
+            /* PINs are kept by the position of the repository */
+            id++;
+            if (result != HSM_OK && repo->group) {
+                /* Whether the group has a live member is known once
+                 * all repositories have been tried */
+                hsm_replica_skip(_hsm_ctx, repo->name, repo->group);
+                result = HSM_OK;
+            } else if (result != HSM_OK) {
                 break;
+            } else {
+                if (repo->group) {
+                    hsm_module_t *module =
+                        _hsm_ctx->session[_hsm_ctx->session_count - 1]->module;
+                    module->group = strdup(repo->group);
+                }
+                repositories++;
             }
-            repositories++;
         }
         repo = repo->next;
     }
+    for (repo = rlist; result == HSM_OK && repo; repo = repo->next) {
+        if (!repo->group || !repo->name || !repo->module
+            || !repo->tokenlabel) {
+            continue;
+        }
+        for (i = 0; i < _hsm_ctx->session_count; i++) {
+            if (!strcmp(_hsm_ctx->session[i]->module->name, repo->name)) {
+                break;
+            }
+        }
+        if (i == _hsm_ctx->session_count
+            && !hsm_group_attached(_hsm_ctx, repo->group, NULL)) {
+            hsm_ctx_set_error(_hsm_ctx, HSM_ERROR, "hsm_open2()",
+                "No repository of replica group %s is available",
+                repo->group);
+            result = HSM_ERROR;
+        }
+    }
     if (result == HSM_OK && repositories == 0) {
         hsm_ctx_set_error(_hsm_ctx, HSM_NO_REPOSITORIES, "hsm_open2()",
             "No repositories found");
@@ -2172,9 +2427,12 @@ hsm_open2(hsm_repository_t* rlist,
     return result;
 }
 
+static void hsm_sign_pool_stop(void);
+
 void
 hsm_close()
 {
+    hsm_sign_pool_stop();
     pthread_mutex_lock(&_hsm_ctx_mutex);
     keycache_destroy(_hsm_ctx);
     hsm_ctx_close(_hsm_ctx, 1);
@@ -2192,52 +2450,84 @@ hsm_create_context()
     return newctx;
 }
 
+/* Check that a session is still logged in, and that the token still
+ * opens sessions. Returns non-zero, with the error set, if not. */
+static int
+hsm_check_session(hsm_ctx_t *ctx, hsm_session_t *session)
+{
+    CK_SESSION_INFO info;
+    CK_RV rv;
+    CK_SESSION_HANDLE session_handle;
+
+    /* Get session info */
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_GetSessionInfo(
+                                    session->session,
+                                    &info);
+    if (hsm_pkcs11_check_error(ctx, rv, "get session info")) {
+        return 1;
+    }
+
+    /* Check session info */
+    if (info.state != CKS_RW_USER_FUNCTIONS) {
+        hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_check_context()",
+                          "Session not logged in");
+        return 1;
+    }
+
+    /* Try open and close a session with the token */
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_OpenSession(info.slotID,
+                                    CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                                    NULL,
+                                    NULL,
+                                    &session_handle);
+    if (hsm_pkcs11_check_error(ctx, rv, "test open session")) {
+        return 1;
+    }
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_CloseSession(session_handle);
+    if (hsm_pkcs11_check_error(ctx, rv, "test close session")) {
+        return 1;
+    }
+    return 0;
+}
+
+/* A repository in a replica group may fail, as long as another member
+ * of its group is usable. It is marked failed, so that signing leaves it
+ * alone until HSM_REPLICA_RETRY has passed. */
 int
 hsm_check_context()
 {
     unsigned int i;
     hsm_session_t *session;
-    CK_SESSION_INFO info;
-    CK_RV rv;
-    CK_SESSION_HANDLE session_handle;
     hsm_ctx_t *ctx;
+    int usable[HSM_MAX_SESSIONS];
+    time_t now = time(NULL);
 
     pthread_mutex_lock(&_hsm_ctx_mutex);
     ctx = _hsm_ctx;
 
     for (i = 0; i < ctx->session_count; i++) {
         session = ctx->session[i];
+        usable[i] = 1;
         if (session == NULL) continue;
-
-        /* Get session info */
-        rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_GetSessionInfo(
-                                        session->session,
-                                        &info);
-        if (hsm_pkcs11_check_error(ctx, rv, "get session info")) {
-            pthread_mutex_unlock(&_hsm_ctx_mutex);
-            return HSM_ERROR;
-        }
-
-        /* Check session info */
-        if (info.state != CKS_RW_USER_FUNCTIONS) {
-            hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_check_context()",
-                              "Session not logged in");
+        if (!hsm_check_session(ctx, session)) continue;
+        if (!session->module->group) {
             pthread_mutex_unlock(&_hsm_ctx_mutex);
             return HSM_ERROR;
         }
-
-        /* Try open and close a session with the token */
-        rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_OpenSession(info.slotID,
-                                        CKF_SERIAL_SESSION | CKF_RW_SESSION,
-                                        NULL,
-                                        NULL,
-                                        &session_handle);
-        if (hsm_pkcs11_check_error(ctx, rv, "test open session")) {
-            pthread_mutex_unlock(&_hsm_ctx_mutex);
-            return HSM_ERROR;
+        usable[i] = 0;
+        if (!__atomic_load_n(&session->module->failed, __ATOMIC_RELAXED)) {
+            hsm_replica_skip(ctx, session->module->name,
+                             session->module->group);
         }
-        rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_CloseSession(session_handle);
-        if (hsm_pkcs11_check_error(ctx, rv, "test close session")) {
+        ctx->error = 0;
+        __atomic_store_n(&session->module->failed, now, __ATOMIC_RELAXED);
+    }
+    for (i = 0; i < ctx->session_count; i++) {
+        if (!usable[i] && !hsm_group_attached(ctx,
+                ctx->session[i]->module->group, usable)) {
+            hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_check_context()",
+                "No repository of replica group %s is usable",
+                ctx->session[i]->module->group);
             pthread_mutex_unlock(&_hsm_ctx_mutex);
             return HSM_ERROR;
         }
@@ -2282,8 +2572,13 @@ hsm_sign_params_free(hsm_sign_params_t *params)
 void
 libhsm_key_free(libhsm_key_t *key)
 {
-    free(key->modulename);
-    free(key);
+    libhsm_key_t *replica;
+    while (key) {
+        replica = key->replica;
+        free(key->modulename);
+        free(key);
+        key = replica;
+    }
 }
 
 libhsm_key_t **
@@ -2863,33 +3158,31 @@ libhsm_key_info_free(libhsm_key_info_t *key_info)
     }
 }
 
-ldns_rr*
-hsm_sign_rrset(hsm_ctx_t *ctx,
-               const ldns_rr_list* rrset,
-               const libhsm_key_t *key,
-               const hsm_sign_params_t *sign_params)
+/* Create the signature RR without the signature, and the buffer with
+ * the data to be signed. Returns NULL on failure.
+ */
+static ldns_buffer *
+hsm_sign_prepare(const ldns_rr_list* rrset,
+                 const hsm_sign_params_t *sign_params,
+                 ldns_rr **signature)
 {
-    ldns_rr *signature;
     ldns_buffer *sign_buf;
-    ldns_rdf *b64_rdf;
     size_t i;
 
-    if (!key) return NULL;
-    if (!sign_params) return NULL;
-
-    signature = hsm_create_empty_rrsig((ldns_rr_list *)rrset,
-                                       sign_params);
+    *signature = hsm_create_empty_rrsig((ldns_rr_list *)rrset,
+                                        sign_params);
 
     /* right now, we have: a key, a semi-sig and an rrset. For
      * which we can create the sig and base64 encode that and
      * add that to the signature */
     sign_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
 
-    if (ldns_rrsig2buffer_wire(sign_buf, signature)
+    if (ldns_rrsig2buffer_wire(sign_buf, *signature)
         != LDNS_STATUS_OK) {
         ldns_buffer_free(sign_buf);
         /* ERROR */
-        ldns_rr_free(signature);
+        ldns_rr_free(*signature);
+        *signature = NULL;
         return NULL;
     }
 
@@ -2902,11 +3195,48 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
     if (ldns_rr_list2buffer_wire(sign_buf, rrset)
         != LDNS_STATUS_OK) {
         ldns_buffer_free(sign_buf);
-        ldns_rr_free(signature);
+        ldns_rr_free(*signature);
+        *signature = NULL;
         return NULL;
     }
+    return sign_buf;
+}
 
-    b64_rdf = hsm_sign_buffer(ctx, sign_buf, key, sign_params->algorithm);
+/* Same as hsm_sign_prepare(), for an RRset in canonical wire format */
+static ldns_buffer *
+hsm_sign_prepare_wire(const hsm_rrset_wire_t *rrset,
+                      const hsm_sign_params_t *sign_params,
+                      ldns_rr **signature)
+{
+    ldns_buffer *sign_buf;
+    size_t len = ldns_buffer_position(rrset->wire);
+
+    *signature = hsm_create_empty_rrsig_for(rrset->owner, rrset->type,
+                                            rrset->klass, rrset->ttl,
+                                            sign_params);
+    sign_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+    if (ldns_rrsig2buffer_wire(sign_buf, *signature) != LDNS_STATUS_OK ||
+        !ldns_buffer_reserve(sign_buf, len)) {
+        ldns_buffer_free(sign_buf);
+        ldns_rr_free(*signature);
+        *signature = NULL;
+        return NULL;
+    }
+    ldns_buffer_write(sign_buf, ldns_buffer_begin(rrset->wire), len);
+    return sign_buf;
+}
+
+/* Sign the prepared buffer and complete the signature with it */
+static ldns_rr *
+hsm_sign_finish(hsm_ctx_t *ctx,
+                ldns_buffer *sign_buf,
+                ldns_rr *signature,
+                const libhsm_key_t *key,
+                ldns_algorithm algorithm)
+{
+    ldns_rdf *b64_rdf;
+
+    b64_rdf = hsm_sign_buffer(ctx, sign_buf, key, algorithm);
 
     ldns_buffer_free(sign_buf);
     if (!b64_rdf) {
@@ -2920,6 +3250,403 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
     return signature;
 }
 
+ldns_rr*
+hsm_sign_rrset(hsm_ctx_t *ctx,
+               const ldns_rr_list* rrset,
+               const libhsm_key_t *key,
+               const hsm_sign_params_t *sign_params)
+{
+    ldns_rr *signature;
+    ldns_buffer *sign_buf;
+
+    if (!key) return NULL;
+    if (!sign_params) return NULL;
+
+    sign_buf = hsm_sign_prepare(rrset, sign_params, &signature);
+    if (!sign_buf) return NULL;
+
+    return hsm_sign_finish(ctx, sign_buf, signature, key,
+                           sign_params->algorithm);
+}
+
+hsm_rrset_wire_t*
+hsm_rrset_wire_new(const ldns_rr_list* rrset, uint32_t ttl)
+{
+    hsm_rrset_wire_t *wire;
+    const ldns_rr *rr;
+    size_t i, j, start, len = 0;
+
+    if (!rrset || ldns_rr_list_rr_count(rrset) == 0) return NULL;
+    /* The wire form is kept as long as the RRset, so allocate exactly
+     * what it takes: names are not compressed in canonical form */
+    for (i = 0; i < ldns_rr_list_rr_count(rrset); i++) {
+        rr = ldns_rr_list_rr(rrset, i);
+        len += ldns_rdf_size(ldns_rr_owner(rr)) + 10;
+        for (j = 0; j < ldns_rr_rd_count(rr); j++) {
+            len += ldns_rdf_size(ldns_rr_rdf(rr, j));
+        }
+    }
+    rr = ldns_rr_list_rr(rrset, 0);
+    CHECKALLOC(wire = malloc(sizeof(hsm_rrset_wire_t)));
+    wire->owner = ldns_rdf_clone(ldns_rr_owner(rr));
+    wire->type = ldns_rr_get_type(rr);
+    wire->klass = ldns_rr_get_class(rr);
+    wire->ttl = ttl;
+    CHECKALLOC(wire->wire = ldns_buffer_new(len));
+    for (i = 0; i < ldns_rr_list_rr_count(rrset); i++) {
+        rr = ldns_rr_list_rr(rrset, i);
+        start = ldns_buffer_position(wire->wire);
+        if (ldns_rr2buffer_wire_canonical(wire->wire, rr,
+                                          LDNS_SECTION_ANSWER)
+            != LDNS_STATUS_OK) {
+            hsm_rrset_wire_free(wire);
+            return NULL;
+        }
+        /* RFC 4034 section 6.2: the TTL is the original TTL; it
+         * follows the owner name, type and class */
+        ldns_buffer_write_u32_at(wire->wire,
+            start + ldns_rdf_size(ldns_rr_owner(rr)) + 4, ttl);
+    }
+    /* The buffer grows if the estimate was short, give back the rest */
+    if (ldns_buffer_position(wire->wire) < ldns_buffer_capacity(wire->wire)
+        && !ldns_buffer_set_capacity(wire->wire,
+                                     ldns_buffer_position(wire->wire))) {
+        hsm_rrset_wire_free(wire);
+        return NULL;
+    }
+    return wire;
+}
+
+void
+hsm_rrset_wire_free(hsm_rrset_wire_t *wire)
+{
+    if (!wire) return;
+    ldns_rdf_deep_free(wire->owner);
+    ldns_buffer_free(wire->wire);
+    free(wire);
+}
+
+ldns_rr*
+hsm_sign_rrset_wire(hsm_ctx_t *ctx,
+                    const hsm_rrset_wire_t *rrset,
+                    const libhsm_key_t *key,
+                    const hsm_sign_params_t *sign_params)
+{
+    ldns_rr *signature;
+    ldns_buffer *sign_buf;
+
+    if (!rrset || !key || !sign_params) return NULL;
+
+    sign_buf = hsm_sign_prepare_wire(rrset, sign_params, &signature);
+    if (!sign_buf) return NULL;
+
+    return hsm_sign_finish(ctx, sign_buf, signature, key,
+                           sign_params->algorithm);
+}
+
+/* Asynchronous signing.
+ *
+ * PKCS#11 calls block, so operations are handed to a pool of threads,
+ * each with a session of its own. A thread submitting operations can
+ * keep as many in flight as there are sessions in the pool.
+ */
+typedef struct hsm_sign_request_struct hsm_sign_request_t;
+struct hsm_sign_request_struct {
+    hsm_sign_request_t *next;
+    hsm_sign_queue_t *queue;
+    const libhsm_key_t *key;
+    ldns_algorithm algorithm;
+    ldns_buffer *sign_buf;
+    ldns_rr *signature;
+    char *error;
+    void *cookie;
+};
+
+struct hsm_sign_queue_struct {
+    hsm_ctx_t *ctx;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    hsm_sign_request_t *done;
+    hsm_sign_request_t **done_last;
+    size_t pending;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    hsm_sign_request_t *head;
+    hsm_sign_request_t **last;
+    pthread_t *threads;
+    hsm_ctx_t **ctxs;
+    size_t count;
+    int stop;
+} hsm_sign_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    NULL, NULL, NULL, NULL, 0, 0 };
+
+/* Sign the buffer of the request, and hand it back to its queue. */
+static void
+hsm_sign_perform(hsm_ctx_t *ctx, hsm_sign_request_t *request)
+{
+    ldns_rdf *b64_rdf;
+    hsm_sign_queue_t *queue = request->queue;
+
+    b64_rdf = hsm_sign_buffer(ctx, request->sign_buf, request->key,
+                              request->algorithm);
+    ldns_buffer_free(request->sign_buf);
+    request->sign_buf = NULL;
+    if (b64_rdf) {
+        ldns_rr_rrsig_set_sig(request->signature, b64_rdf);
+    } else {
+        ldns_rr_free(request->signature);
+        request->signature = NULL;
+        request->error = hsm_get_error(ctx);
+    }
+    pthread_mutex_lock(&queue->lock);
+    request->next = NULL;
+    *queue->done_last = request;
+    queue->done_last = &request->next;
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void *
+hsm_sign_pool_run(void *arg)
+{
+    hsm_ctx_t *ctx = arg;
+    hsm_sign_request_t *request;
+
+    while (1) {
+        pthread_mutex_lock(&hsm_sign_pool.lock);
+        while (!hsm_sign_pool.head && !hsm_sign_pool.stop) {
+            pthread_cond_wait(&hsm_sign_pool.cond, &hsm_sign_pool.lock);
+        }
+        request = hsm_sign_pool.head;
+        if (request) {
+            hsm_sign_pool.head = request->next;
+            if (!hsm_sign_pool.head) {
+                hsm_sign_pool.last = &hsm_sign_pool.head;
+            }
+        }
+        pthread_mutex_unlock(&hsm_sign_pool.lock);
+        if (!request) {
+            /* stopped, and nothing left to do */
+            break;
+        }
+        hsm_sign_perform(ctx, request);
+    }
+    return NULL;
+}
+
+/* Stop the threads of the session pool, after they finished the
+ * outstanding operations. */
+static void
+hsm_sign_pool_stop(void)
+{
+    size_t i;
+
+    if (!hsm_sign_pool.count) return;
+    pthread_mutex_lock(&hsm_sign_pool.lock);
+    hsm_sign_pool.stop = 1;
+    pthread_cond_broadcast(&hsm_sign_pool.cond);
+    pthread_mutex_unlock(&hsm_sign_pool.lock);
+    for (i = 0; i < hsm_sign_pool.count; i++) {
+        pthread_join(hsm_sign_pool.threads[i], NULL);
+        hsm_destroy_context(hsm_sign_pool.ctxs[i]);
+    }
+    free(hsm_sign_pool.threads);
+    free(hsm_sign_pool.ctxs);
+    hsm_sign_pool.threads = NULL;
+    hsm_sign_pool.ctxs = NULL;
+    hsm_sign_pool.count = 0;
+    hsm_sign_pool.stop = 0;
+}
+
+int
+hsm_sign_pool_start(size_t nsessions)
+{
+    size_t i;
+
+    if (hsm_sign_pool.count) return HSM_ERROR;
+    if (!nsessions) return HSM_OK;
+    hsm_sign_pool.head = NULL;
+    hsm_sign_pool.last = &hsm_sign_pool.head;
+    hsm_sign_pool.stop = 0;
+    CHECKALLOC(hsm_sign_pool.threads = calloc(nsessions, sizeof(pthread_t)));
+    CHECKALLOC(hsm_sign_pool.ctxs = calloc(nsessions, sizeof(hsm_ctx_t*)));
+    for (i = 0; i < nsessions; i++) {
+        hsm_sign_pool.ctxs[i] = hsm_create_context();
+        if (!hsm_sign_pool.ctxs[i] ||
+            pthread_create(&hsm_sign_pool.threads[i], NULL,
+                           hsm_sign_pool_run, hsm_sign_pool.ctxs[i])) {
+            if (hsm_sign_pool.ctxs[i]) {
+                hsm_destroy_context(hsm_sign_pool.ctxs[i]);
+            }
+            hsm_ctx_set_error(_hsm_ctx, HSM_ERROR, "hsm_sign_pool_start()",
+                "unable to open session %lu of the pool",
+                (unsigned long) i + 1);
+            break;
+        }
+        hsm_sign_pool.count++;
+    }
+    if (hsm_sign_pool.count < nsessions) {
+        hsm_sign_pool_stop();
+        return HSM_ERROR;
+    }
+    return HSM_OK;
+}
+
+size_t
+hsm_sign_pool_size(void)
+{
+    return hsm_sign_pool.count;
+}
+
+hsm_sign_queue_t*
+hsm_sign_queue_new(hsm_ctx_t *ctx)
+{
+    hsm_sign_queue_t *queue;
+
+    CHECKALLOC(queue = malloc(sizeof(hsm_sign_queue_t)));
+    queue->ctx = ctx;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    queue->done = NULL;
+    queue->done_last = &queue->done;
+    queue->pending = 0;
+    return queue;
+}
+
+void
+hsm_sign_queue_free(hsm_sign_queue_t *queue)
+{
+    if (!queue) return;
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue);
+}
+
+/* Hand the prepared buffer to the session pool */
+static void
+hsm_sign_enqueue(hsm_sign_queue_t *queue,
+                 ldns_buffer *sign_buf,
+                 ldns_rr *signature,
+                 const libhsm_key_t *key,
+                 const hsm_sign_params_t *sign_params,
+                 void *cookie)
+{
+    hsm_sign_request_t *request;
+
+    CHECKALLOC(request = malloc(sizeof(hsm_sign_request_t)));
+    request->next = NULL;
+    request->queue = queue;
+    request->key = key;
+    request->algorithm = sign_params->algorithm;
+    request->sign_buf = sign_buf;
+    request->signature = signature;
+    request->error = NULL;
+    request->cookie = cookie;
+    queue->pending++;
+    if (!hsm_sign_pool.count) {
+        hsm_sign_perform(queue->ctx, request);
+        return;
+    }
+    pthread_mutex_lock(&hsm_sign_pool.lock);
+    *hsm_sign_pool.last = request;
+    hsm_sign_pool.last = &request->next;
+    pthread_cond_signal(&hsm_sign_pool.cond);
+    pthread_mutex_unlock(&hsm_sign_pool.lock);
+}
+
+int
+hsm_sign_submit(hsm_sign_queue_t *queue,
+                const ldns_rr_list* rrset,
+                const libhsm_key_t *key,
+                const hsm_sign_params_t *sign_params,
+                void *cookie)
+{
+    ldns_rr *signature;
+    ldns_buffer *sign_buf;
+
+    if (!queue || !key || !sign_params) {
+        hsm_ctx_set_error(queue ? queue->ctx : NULL, -1,
+            "hsm_sign_submit()", "Got NULL argument");
+        return HSM_ERROR;
+    }
+    sign_buf = hsm_sign_prepare(rrset, sign_params, &signature);
+    if (!sign_buf) {
+        hsm_ctx_set_error(queue->ctx, HSM_ERROR, "hsm_sign_submit()",
+            "unable to convert RRset to wireformat");
+        return HSM_ERROR;
+    }
+    hsm_sign_enqueue(queue, sign_buf, signature, key, sign_params, cookie);
+    return HSM_OK;
+}
+
+int
+hsm_sign_submit_wire(hsm_sign_queue_t *queue,
+                     const hsm_rrset_wire_t *rrset,
+                     const libhsm_key_t *key,
+                     const hsm_sign_params_t *sign_params,
+                     void *cookie)
+{
+    ldns_rr *signature;
+    ldns_buffer *sign_buf;
+
+    if (!queue || !rrset || !key || !sign_params) {
+        hsm_ctx_set_error(queue ? queue->ctx : NULL, -1,
+            "hsm_sign_submit_wire()", "Got NULL argument");
+        return HSM_ERROR;
+    }
+    sign_buf = hsm_sign_prepare_wire(rrset, sign_params, &signature);
+    if (!sign_buf) {
+        hsm_ctx_set_error(queue->ctx, HSM_ERROR, "hsm_sign_submit_wire()",
+            "unable to prepare RRset for signing");
+        return HSM_ERROR;
+    }
+    hsm_sign_enqueue(queue, sign_buf, signature, key, sign_params, cookie);
+    return HSM_OK;
+}
+
+int
+hsm_sign_complete(hsm_sign_queue_t *queue,
+                  ldns_rr **signature,
+                  void **cookie)
+{
+    hsm_sign_request_t *request;
+
+    if (!queue || !queue->pending) return 1;
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->done) {
+        pthread_cond_wait(&queue->cond, &queue->lock);
+    }
+    request = queue->done;
+    queue->done = request->next;
+    if (!queue->done) {
+        queue->done_last = &queue->done;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    queue->pending--;
+
+    *signature = request->signature;
+    *cookie = request->cookie;
+    if (request->error) {
+        hsm_ctx_set_error(queue->ctx, HSM_ERROR, "hsm_sign_complete()",
+            "%s", request->error);
+        free(request->error);
+    } else if (!request->signature) {
+        hsm_ctx_set_error(queue->ctx, HSM_ERROR, "hsm_sign_complete()",
+            "signing failed");
+    }
+    free(request);
+    return 0;
+}
+
+size_t
+hsm_sign_pending(hsm_sign_queue_t *queue)
+{
+    return queue ? queue->pending : 0;
+}
+
 int
 hsm_keytag(const char* loc, int alg, int ksk, uint16_t* keytag)
 {
@@ -3254,66 +3981,174 @@ hsm_print_tokeninfo(hsm_ctx_t *ctx)
     }
 }
 
-static int
-keycache_cmpfunc(const void* a, const void* b)
+/* Hash table of keys by locator. Lookups do not take the lock: a key
+ * is added in place by storing its key before its locator, and readers
+ * load the locator first. When the table gets half full, a copy twice
+ * the size is published. Tables that were replaced may still be read,
+ * so they are kept until the cache is destroyed; as each is half the
+ * size of the next, they take no more memory than the newest table.
+ */
+typedef struct hsm_keycache_table_struct hsm_keycache_table_t;
+struct hsm_keycache_table_struct {
+    hsm_keycache_table_t *retired;
+    size_t size;   /* power of two */
+    size_t count;  /* changed under the cache lock only */
+    struct {
+        char *locator;
+        libhsm_key_t *key;
+    } entries[1];
+};
+
+struct hsm_keycache_struct {
+    hsm_keycache_table_t *table;
+    pthread_mutex_t lock;  /* serializes additions */
+};
+
+static size_t
+keycache_hash(const char *locator)
 {
-    const char* x = (const char*)a;
-    const char* y = (const char*)b;
-    return strcmp(x, y);
+    size_t hash = 5381;
+
+    while (*locator) {
+        hash = hash * 33 + (unsigned char) *locator++;
+    }
+    return hash;
 }
 
+static hsm_keycache_table_t *
+keycache_table_new(size_t size)
+{
+    hsm_keycache_table_t *table;
+
+    CHECKALLOC(table = calloc(1, sizeof(hsm_keycache_table_t) +
+        (size - 1) * sizeof(table->entries[0])));
+    table->size = size;
+    return table;
+}
+
+/* Add to a table, with the cache lock held if it is published */
 static void
-keycache_delfunc(ldns_rbnode_t* node, void* cargo)
+keycache_table_put(hsm_keycache_table_t *table, char *locator,
+                   libhsm_key_t *key)
 {
-    (void)cargo;
-    free((void*)node->key);
-    free(((libhsm_key_t*)node->data)->modulename);
-    free((void*)node->data);
-    free((void*)node);
+    size_t i;
+
+    i = keycache_hash(locator) & (table->size - 1);
+    while (table->entries[i].locator) {
+        i = (i + 1) & (table->size - 1);
+    }
+    table->entries[i].key = key;
+    __atomic_store_n(&table->entries[i].locator, locator, __ATOMIC_RELEASE);
+    table->count++;
+}
+
+static libhsm_key_t *
+keycache_table_get(const hsm_keycache_table_t *table, const char *locator)
+{
+    const char *entry;
+    size_t i;
+
+    i = keycache_hash(locator) & (table->size - 1);
+    while ((entry = __atomic_load_n(&table->entries[i].locator,
+        __ATOMIC_ACQUIRE)) != NULL) {
+        if (!strcmp(entry, locator)) {
+            return table->entries[i].key;
+        }
+        i = (i + 1) & (table->size - 1);
+    }
+    return NULL;
 }
 
 void
 keycache_create(hsm_ctx_t* ctx)
 {
-    ctx->keycache = ldns_rbtree_create(keycache_cmpfunc);
-    CHECKALLOC(_hsm_ctx->keycache_lock = malloc(sizeof (pthread_mutex_t)));
-    pthread_mutex_init(_hsm_ctx->keycache_lock, NULL);
+    CHECKALLOC(ctx->keycache = malloc(sizeof(struct hsm_keycache_struct)));
+    ctx->keycache->table = keycache_table_new(16);
+    pthread_mutex_init(&ctx->keycache->lock, NULL);
 }
 
 void
 keycache_destroy(hsm_ctx_t* ctx)
 {
-    ldns_traverse_postorder(ctx->keycache, keycache_delfunc, NULL);
-    ldns_rbtree_free(ctx->keycache);
-    pthread_mutex_destroy(ctx->keycache_lock);
-    free(ctx->keycache_lock);
-    ctx->keycache_lock = NULL;
+    hsm_keycache_table_t *table, *retired;
+    size_t i;
+
+    if (!ctx->keycache) return;
+    table = ctx->keycache->table;
+    /* the newest table holds all keys */
+    for (i = 0; i < table->size; i++) {
+        if (table->entries[i].locator) {
+            free(table->entries[i].locator);
+            libhsm_key_free(table->entries[i].key);
+        }
+    }
+    while (table) {
+        retired = table->retired;
+        free(table);
+        table = retired;
+    }
+    pthread_mutex_destroy(&ctx->keycache->lock);
+    free(ctx->keycache);
+    ctx->keycache = NULL;
 }
 
-const libhsm_key_t*
-keycache_lookup(hsm_ctx_t* ctx, const char* locator)
+/* Add the key to the table, or return the key that was added by
+ * another thread in the meantime. */
+static libhsm_key_t *
+keycache_insert(struct hsm_keycache_struct *cache, const char *locator,
+                libhsm_key_t *key)
 {
-    ldns_rbnode_t* node;
+    hsm_keycache_table_t *table, *copy;
+    libhsm_key_t *existing;
+    size_t i;
 
-    pthread_mutex_lock(ctx->keycache_lock);
-        node = ldns_rbtree_search(ctx->keycache, locator);
-    pthread_mutex_unlock(ctx->keycache_lock);
-    if (node == LDNS_RBTREE_NULL || node == NULL) {
-        libhsm_key_t* key;
-        if ((key = hsm_find_key_by_id(ctx, locator)) == NULL) {
-            node = NULL;
-        } else {
-            CHECKALLOC(node = malloc(sizeof(ldns_rbnode_t)));
-            node->key = strdup(locator);
-            node->data = key;
-            pthread_mutex_lock(ctx->keycache_lock);
-                node = ldns_rbtree_insert(ctx->keycache, node);
-            pthread_mutex_unlock(ctx->keycache_lock);
+    pthread_mutex_lock(&cache->lock);
+    table = cache->table;
+    existing = keycache_table_get(table, locator);
+    if (existing) {
+        pthread_mutex_unlock(&cache->lock);
+        libhsm_key_free(key);
+        return existing;
+    }
+    /* keep the load factor at most one half */
+    if ((table->count + 1) * 2 > table->size) {
+        copy = keycache_table_new(table->size * 2);
+        for (i = 0; i < table->size; i++) {
+            if (table->entries[i].locator) {
+                keycache_table_put(copy, table->entries[i].locator,
+                    table->entries[i].key);
+            }
         }
-    }  
+        copy->retired = table;
+        __atomic_store_n(&cache->table, copy, __ATOMIC_RELEASE);
+        table = copy;
+    }
+    keycache_table_put(table, strdup(locator), key);
+    pthread_mutex_unlock(&cache->lock);
+    return key;
+}
+
+const libhsm_key_t*
+keycache_lookup(hsm_ctx_t* ctx, const char* locator)
+{
+    const hsm_keycache_table_t *table;
+    libhsm_key_t* key;
+    unsigned char *id_bytes;
+    size_t len;
 
-    if (node == LDNS_RBTREE_NULL || node == NULL)
+    table = __atomic_load_n(&ctx->keycache->table, __ATOMIC_ACQUIRE);
+    key = keycache_table_get(table, locator);
+    if (key) {
+        return key;
+    }
+    if ((id_bytes = hsm_hex_parse(locator, &len)) == NULL) {
+        key = NULL;
+    } else if ((key = hsm_find_key_by_id_bin(ctx, id_bytes, len)) != NULL) {
+        hsm_find_key_replicas(ctx, key, id_bytes, len);
+    }
+    free(id_bytes);
+    if (key == NULL) {
         return NULL;
-    else
-        return node->data;
+    }
+    return keycache_insert(ctx->keycache, locator, key);
 }
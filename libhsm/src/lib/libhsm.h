@@ -29,6 +29,7 @@
 #define HSM_H 1
 
 #include <stdint.h>
+#include <time.h>
 #include <ldns/rbtree.h>
 #include <pthread.h>
 
@@ -58,6 +59,9 @@
  */
 #define HSM_MAX_PIN_LENGTH 255
 
+/* Seconds before a replica that reported a device error is tried again */
+#define HSM_REPLICA_RETRY 30
+
 /*! Return codes for some of the functions */
 /*! These should be different than the list of CKR_ values defined
  * by pkcs11 (for easier debugging purposes of calling applications)
@@ -82,6 +86,8 @@ typedef struct {
     unsigned int allow_extract;  /*!< Generate CKA_EXTRACTABLE private keys */
 } hsm_config_t;
 
+struct metrics_struct;
+
 /*! Data type to describe an HSM */
 typedef struct {
     unsigned int id;             /*!< HSM numerical identifier */
@@ -91,6 +97,12 @@ typedef struct {
     void         *handle;        /*!< handle from dlopen()*/
     void         *sym;           /*!< Function list from dlsym */
     hsm_config_t *config;        /*!< optional per HSM configuration */
+    char         *group;         /*!< replica group, NULL if none */
+    unsigned long inflight;      /*!< signatures in progress, all contexts */
+    unsigned long signatures;    /*!< signatures made, all contexts */
+    time_t        failed;        /*!< time of last device error, 0 if healthy */
+    struct metrics_struct *sign_latency; /*!< time per signature */
+    struct metrics_struct *sign_errors;  /*!< failed signatures */
 } hsm_module_t;
 
 /*! HSM Session */
@@ -100,11 +112,13 @@ typedef struct {
 } hsm_session_t;
 
 /*! HSM Key Pair */
-typedef struct {
+typedef struct libhsm_key_struct libhsm_key_t;
+struct libhsm_key_struct {
     char *modulename;   /*!< name of the module, as in hsm_session_t.module.name */
     unsigned long      private_key;  /*!< private key within module */
     unsigned long      public_key;   /*!< public key within module */
-} libhsm_key_t;
+    libhsm_key_t      *replica;      /*!< same key in the next replica */
+};
 
 /*! HSM Key Pair Information */
 typedef struct {
@@ -125,6 +139,7 @@ struct hsm_repository_struct {
     uint8_t require_backup; /*!< require a backup of keys before using new keys */
     uint8_t use_pubkey;     /*!< use public keys in repository? */
     unsigned int allow_extract;  /*!< Generate CKA_EXTRACTABLE private keys */
+    char    *group;         /*!< replica group, repositories holding the same keys */
 };
 
 /*! HSM context to keep track of sessions */
@@ -141,9 +156,12 @@ typedef struct {
 
     /*!< static string describing the first error */
     char error_message[HSM_ERROR_MSGSIZE];
-    
-    ldns_rbtree_t* keycache;
-    pthread_mutex_t *keycache_lock;
+
+    /*!< non-zero if a PKCS#11 call failed because of the device */
+    int device_error;
+
+    /*!< keys looked up so far, shared by all contexts */
+    struct hsm_keycache_struct *keycache;
 } hsm_ctx_t;
 
 
@@ -192,11 +210,13 @@ hsm_open2(hsm_repository_t* rlist,
 \param tokenlabel     PKCS#11 token label.
 \param pin            PKCS#11 login credentials.
 \param use_pubkey     Whether to store the public key in the HSM.
+\param group          Replica group, or NULL.
 \return The created repository.
 */
 hsm_repository_t *
 hsm_repository_new(char* name, char* module, char* tokenlabel, char* pin,
-    uint8_t use_pubkey, uint8_t allowextract, uint8_t require_backup);
+    uint8_t use_pubkey, uint8_t allowextract, uint8_t require_backup,
+    char* group);
 
 /*! Free configured repositories.
 
@@ -539,8 +559,13 @@ void hsm_print_key(hsm_ctx_t *ctx, libhsm_key_t *key);
 void hsm_print_error(hsm_ctx_t *ctx);
 void hsm_print_tokeninfo(hsm_ctx_t *ctx);
 
-/* implementation of a key cache per context, needs changing see
+/* implementation of a key cache shared by all contexts, see
  * OPENDNSSEC-799.
+ * Lookups take no lock: the cache is a hash table that is copied when a
+ * key is added, and the copy is published with an atomic pointer swap.
+ * Keys found in a repository with a replica group are looked up in the
+ * other repositories of the group too, and signing is spread over them.
+ * The keys returned stay valid until hsm_close().
  */
 extern void keycache_create(hsm_ctx_t* ctx);
 extern void keycache_destroy(hsm_ctx_t* ctx);
@@ -81,6 +81,140 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
                const hsm_sign_params_t *sign_params);
 
 
+/*! RRset in the canonical form and order of RFC 4034 section 6, in wire
+format, ready to be signed repeatedly */
+typedef struct {
+    ldns_rdf *owner;      /*!< owner name, as given */
+    ldns_rr_type type;    /*!< type covered */
+    ldns_rr_class klass;  /*!< class */
+    uint32_t ttl;         /*!< original TTL */
+    ldns_buffer *wire;    /*!< the RRs, up to the buffer position */
+} hsm_rrset_wire_t;
+
+/*! Encode RRset in canonical wire format
+
+The RRs must be sorted in canonical order, they are not changed.
+
+\param rrset RRset to encode
+\param ttl original TTL to encode all RRs with
+\return hsm_rrset_wire_t* encoded RRset, NULL on failure
+*/
+hsm_rrset_wire_t*
+hsm_rrset_wire_new(const ldns_rr_list* rrset, uint32_t ttl);
+
+/*! Free RRset in canonical wire format
+
+\param wire encoded RRset to free
+*/
+void
+hsm_rrset_wire_free(hsm_rrset_wire_t *wire);
+
+/*! Sign RRset in canonical wire format using key
+
+Same as hsm_sign_rrset(), without converting the RRset.
+
+\param context HSM context
+\param rrset encoded RRset to sign
+\param key Key pair used to sign
+\return ldns_rr* Signed RRset
+*/
+ldns_rr*
+hsm_sign_rrset_wire(hsm_ctx_t *ctx,
+                    const hsm_rrset_wire_t *rrset,
+                    const libhsm_key_t *key,
+                    const hsm_sign_params_t *sign_params);
+
+
+/*! Queue of asynchronous sign operations, one per thread submitting */
+typedef struct hsm_sign_queue_struct hsm_sign_queue_t;
+
+/*! Start the session pool for asynchronous signing
+
+Opens nsessions sessions, each served by its own thread, that perform the
+operations submitted with hsm_sign_submit(). Without a pool the operations
+are performed synchronously by hsm_sign_submit(). The pool is stopped by
+hsm_close().
+
+\param nsessions number of sessions in the pool
+\return HSM_OK if successful
+*/
+int
+hsm_sign_pool_start(size_t nsessions);
+
+/*! Number of sessions in the session pool, 0 if there is none */
+size_t
+hsm_sign_pool_size(void);
+
+/*! Create queue for asynchronous sign operations
+
+\param ctx HSM context of the submitting thread, used for key lookups,
+           errors and for signing when there is no session pool
+\return hsm_sign_queue_t* created queue
+*/
+hsm_sign_queue_t*
+hsm_sign_queue_new(hsm_ctx_t *ctx);
+
+/*! Free queue, all submitted operations must have been completed
+
+\param queue queue to free
+*/
+void
+hsm_sign_queue_free(hsm_sign_queue_t *queue);
+
+/*! Submit RRset to be signed using key
+
+The RRset and params may be freed or changed once this returns, the key
+must remain valid until the operation completed.
+
+\param queue queue of the submitting thread
+\param rrset RRset to sign
+\param key Key pair used to sign
+\param sign_params the signing parameters
+\param cookie returned with the signature by hsm_sign_complete()
+\return HSM_OK if submitted
+*/
+int
+hsm_sign_submit(hsm_sign_queue_t *queue,
+                const ldns_rr_list* rrset,
+                const libhsm_key_t *key,
+                const hsm_sign_params_t *sign_params,
+                void *cookie);
+
+/*! Submit RRset in canonical wire format to be signed using key
+
+Same as hsm_sign_submit(), without converting the RRset.
+*/
+int
+hsm_sign_submit_wire(hsm_sign_queue_t *queue,
+                     const hsm_rrset_wire_t *rrset,
+                     const libhsm_key_t *key,
+                     const hsm_sign_params_t *sign_params,
+                     void *cookie);
+
+/*! Wait for a submitted operation to complete
+
+Operations complete in any order. On failure the signature is NULL and
+the error is set in the context of the queue.
+
+\param queue queue of the submitting thread
+\param[out] signature the signature, free with ldns_rr_free()
+\param[out] cookie cookie given to hsm_sign_submit()
+\return 0 if an operation completed, 1 if none was outstanding
+*/
+int
+hsm_sign_complete(hsm_sign_queue_t *queue,
+                  ldns_rr **signature,
+                  void **cookie);
+
+/*! Number of submitted operations that have not been completed
+
+\param queue queue of the submitting thread
+\return size_t number of outstanding operations
+*/
+size_t
+hsm_sign_pending(hsm_sign_queue_t *queue);
+
+
 /*! Get DNSKEY RR
 
 The returned ldns_rr structure can be freed with ldns_rr_free()
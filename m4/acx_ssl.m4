@@ -45,7 +45,7 @@ AC_DEFUN([ACX_SSL], [
             ] )
             SSL_LIBS="$SSL_LIBS -lcrypto";
             LIBS="$SSL_LIBS $LIBS"
-            AC_CHECK_FUNCS([EVP_sha1 EVP_sha256])
+            AC_CHECK_FUNCS([EVP_sha1 EVP_sha256 EVP_sha384 EVP_sha512 HMAC_CTX_copy])
             LIBS=$saveLIBS
         fi
         AC_SUBST(HAVE_SSL)
@@ -505,6 +505,7 @@ dnsin_create(void)
     CHECKALLOC(addns = (dnsin_type*) malloc(sizeof(dnsin_type)));
     addns->request_xfr = NULL;
     addns->allow_notify = NULL;
+    addns->allow_notify_index = NULL;
     addns->tsig = NULL;
     return addns;
 }
@@ -520,6 +521,7 @@ dnsout_create(void)
     dnsout_type* addns = NULL;
     CHECKALLOC(addns = (dnsout_type*) malloc(sizeof(dnsout_type)));
     addns->provide_xfr = NULL;
+    addns->provide_xfr_index = NULL;
     addns->do_notify = NULL;
     addns->tsig = NULL;
     return addns;
@@ -551,6 +553,7 @@ dnsin_read(dnsin_type* addns, const char* filename)
         addns->tsig = parse_addns_tsig(filename);
         addns->request_xfr = parse_addns_request_xfr(filename, addns->tsig);
         addns->allow_notify = parse_addns_allow_notify(filename, addns->tsig);
+        addns->allow_notify_index = acl_index_create(addns->allow_notify);
         ods_fclose(fd);
         return ODS_STATUS_OK;
     }
@@ -609,6 +612,7 @@ dnsout_read(dnsout_type* addns, const char* filename)
     if (fd) {
         addns->tsig = parse_addns_tsig(filename);
         addns->provide_xfr = parse_addns_provide_xfr(filename, addns->tsig);
+        addns->provide_xfr_index = acl_index_create(addns->provide_xfr);
         addns->do_notify = parse_addns_do_notify(filename, addns->tsig);
         ods_fclose(fd);
         return ODS_STATUS_OK;
@@ -897,6 +901,7 @@ dnsin_cleanup(dnsin_type* addns)
     }
     acl_cleanup(addns->request_xfr);
     acl_cleanup(addns->allow_notify);
+    acl_index_cleanup(addns->allow_notify_index);
     tsig_cleanup(addns->tsig);
     free(addns);
 }
@@ -913,6 +918,7 @@ dnsout_cleanup(dnsout_type* addns)
         return;
     }
     acl_cleanup(addns->provide_xfr);
+    acl_index_cleanup(addns->provide_xfr_index);
     acl_cleanup(addns->do_notify);
     tsig_cleanup(addns->tsig);
     free(addns);
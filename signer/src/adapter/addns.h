@@ -49,6 +49,7 @@ typedef struct dnsin_struct dnsin_type;
 struct dnsin_struct {
     acl_type* request_xfr;
     acl_type* allow_notify;
+    acl_index_type* allow_notify_index;
     tsig_type* tsig;
     time_t last_modified;
 };
@@ -60,6 +61,7 @@ struct dnsin_struct {
 typedef struct dnsout_struct dnsout_type;
 struct dnsout_struct {
     acl_type* provide_xfr;
+    acl_index_type* provide_xfr_index;
     acl_type* do_notify;
     tsig_type* tsig;
     time_t last_modified;
@@ -46,7 +46,6 @@
 #include <stdlib.h>
 
 static const char* adapter_str = "adapter";
-static ods_status adfile_read_file(FILE* fd, zone_type* zone);
 
 
 /**
@@ -191,9 +190,10 @@ adfile_read_rr:
  * Read zone file.
  *
  */
-static ods_status
-adfile_read_file(FILE* fd, zone_type* zone)
+ods_status
+adfile_read_file(FILE* fd, void* adzone)
 {
+    zone_type* zone = (zone_type*) adzone;
     ods_status result = ODS_STATUS_OK;
     ldns_rr* rr = NULL;
     ldns_rdf* prev = NULL;
@@ -43,6 +43,15 @@
  */
 /** NULL */
 
+/**
+ * Read zone from an open zonefile, without applying the differences.
+ * \param[in] fd file descriptor
+ * \param[in] zone zone reference
+ * \return ods_status status
+ *
+ */
+ods_status adfile_read_file(FILE* fd, void* zone);
+
 /**
  * Read zone from input file adapter.
  * \param[in] zone zone reference
@@ -81,8 +81,11 @@ engine_config(const char* cfgfile, int cmdline_verbosity)
         ecfg->group = parse_conf_group(cfgfile);
         ecfg->chroot = parse_conf_chroot(cfgfile);
         ecfg->use_syslog = parse_conf_use_syslog(cfgfile);
+        ecfg->log_async = parse_conf_log_async(cfgfile);
         ecfg->num_worker_threads = parse_conf_worker_threads(cfgfile);
         ecfg->num_signer_threads = parse_conf_signer_threads(cfgfile);
+        ecfg->num_signer_sessions = parse_conf_signer_sessions(cfgfile);
+        ecfg->num_xfr_threads = parse_conf_xfr_threads(cfgfile);
         /* If any verbosity has been specified at cmd line we will use that */
         if (cmdline_verbosity > 0) {
         	ecfg->verbosity = cmdline_verbosity;
@@ -219,6 +222,10 @@ engine_config_print(FILE* out, engineconfig_type* config)
             config->num_worker_threads);
         fprintf(out, "\t\t<SignerThreads>%i</SignerThreads>\n",
             config->num_signer_threads);
+        fprintf(out, "\t\t<SignerSessions>%i</SignerSessions>\n",
+            config->num_signer_sessions);
+        fprintf(out, "\t\t<TransferThreads>%i</TransferThreads>\n",
+            config->num_xfr_threads);
         if (config->notify_command) {
             fprintf(out, "\t\t<NotifyCommand>%s</NotifyCommand>\n",
                 config->notify_command);
@@ -56,8 +56,11 @@ struct engineconfig_struct {
     const char* group;
     const char* chroot;
     int use_syslog;
+    int log_async;
     int num_worker_threads;
     int num_signer_threads;
+    int num_signer_sessions;
+    int num_xfr_threads;
     int verbosity;
 };
 
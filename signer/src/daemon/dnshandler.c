@@ -59,6 +59,10 @@ dnshandler_create(listener_type* interfaces)
     dnsh->netio = NULL;
     dnsh->query = NULL;
     dnsh->tcp_accept_handlers = NULL;
+    dnsh->xfrpool = NULL;
+    dnsh->xfrpoolhandler.fd = -1;
+    dnsh->notify_received = metrics_counter("ods_notify_received_total",
+        "NOTIFY messages received from primaries.", NULL, NULL);
     /* setup */
     CHECKALLOC(dnsh->socklist = (socklist_type*) malloc(sizeof(socklist_type)));
     dnsh->netio = netio_create();
@@ -142,6 +146,21 @@ dnshandler_start(dnshandler_type* dnshandler)
             (unsigned) handler->fd);
         netio_add_handler(dnshandler->netio, handler);
     }
+    /* zone transfers */
+    if (dnshandler->engine->config->num_xfr_threads > 0) {
+        dnshandler->xfrpool = xfrpool_create(dnshandler->engine,
+            (size_t) dnshandler->engine->config->num_xfr_threads);
+    }
+    if (dnshandler->xfrpool) {
+        netio_handler_type* handler = &dnshandler->xfrpoolhandler;
+        handler->fd = dnshandler->xfrpool->wakeup[0];
+        handler->timeout = NULL;
+        handler->user_data = dnshandler->xfrpool;
+        handler->event_types = NETIO_EVENT_READ;
+        handler->event_handler = sock_handle_xfr_done;
+        handler->free_handler = 0;
+        netio_add_handler(dnshandler->netio, handler);
+    }
     /* service */
     while (dnshandler->need_to_exit == 0) {
         ods_log_deeebug("[%s] netio dispatch", dnsh_str);
@@ -155,6 +174,11 @@ dnshandler_start(dnshandler_type* dnshandler)
     }
     /* shutdown */
     ods_log_debug("[%s] shutdown", dnsh_str);
+    if (dnshandler->xfrpool) {
+        netio_remove_handler(dnshandler->netio, &dnshandler->xfrpoolhandler);
+    }
+    xfrpool_cleanup(dnshandler->xfrpool);
+    dnshandler->xfrpool = NULL;
 }
 
 
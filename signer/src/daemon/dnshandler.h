@@ -39,11 +39,13 @@ typedef struct dnshandler_struct dnshandler_type;
 
 #include "status.h"
 #include "locks.h"
+#include "metrics.h"
 #include "status.h"
 #include "wire/listener.h"
 #include "wire/netio.h"
 #include "wire/query.h"
 #include "wire/sock.h"
+#include "wire/xfrstream.h"
 
 #define ODS_SE_NOTIFY_CMD "NOTIFY"
 #define ODS_SE_MAX_HANDLERS 5
@@ -58,6 +60,9 @@ struct dnshandler_struct {
     netio_handler_type xfrhandler;
     unsigned need_to_exit;
     netio_handler_type *tcp_accept_handlers;
+    xfrpool_type* xfrpool;
+    netio_handler_type xfrpoolhandler;
+    metrics_type* notify_received;
 };
 
 /**
@@ -432,6 +432,8 @@ engine_setup(void)
         }
     }
     engine->pid = getpid();
+    /* the log writer thread would not survive the fork */
+    ods_log_async(engine->config->log_async);
     /* write pidfile */
     if (util_write_pidfile(engine->config->pid_filename, engine->pid) == -1) {
         if (engine->daemonize) {
@@ -630,6 +632,92 @@ dnsconfig_zone(engine_type* engine, zone_type* zone)
 }
 
 
+/**
+ * Commit the zone list changes for a single zone.
+ * Must be called with the zone list locked. Returns non-zero if the zone
+ * uses dns adapters.
+ *
+ */
+static int
+engine_update_zone_locked(engine_type* engine, zone_type* zone,
+    ods_status zl_changed, unsigned* wake_up)
+{
+    ods_status status = ODS_STATUS_OK;
+    int warnings = 0;
+
+    if (zone->zl_status == ZONE_ZL_REMOVED) {
+        pthread_mutex_lock(&zone->zone_lock);
+        zonelist_del_zone(engine->zonelist, zone);
+        schedule_unscheduletask(engine->taskq, schedule_WHATEVER, zone->name);
+        pthread_mutex_unlock(&zone->zone_lock);
+        netio_remove_handler(engine->xfrhandler->netio,
+            &zone->xfrd->handler);
+        netio_remove_handler(engine->xfrhandler->netio,
+            &zone->notify->handler);
+        zone_cleanup(zone);
+        return 0;
+    } else if (zone->zl_status == ZONE_ZL_ADDED) {
+        pthread_mutex_lock(&zone->zone_lock);
+        /* set notify nameserver command */
+        if (engine->config->notify_command && !zone->notify_ns) {
+            set_notify_ns(zone, engine->config->notify_command);
+        }
+        pthread_mutex_unlock(&zone->zone_lock);
+    }
+    /* load adapter config */
+    status = adapter_load_config(zone->adinbound);
+    if (status != ODS_STATUS_OK) {
+        ods_log_error("[%s] unable to load config for inbound adapter "
+            "for zone %s: %s", engine_str, zone->name,
+            ods_status2str(status));
+    }
+    status = adapter_load_config(zone->adoutbound);
+    if (status != ODS_STATUS_OK) {
+        ods_log_error("[%s] unable to load config for outbound adapter "
+            "for zone %s: %s", engine_str, zone->name,
+            ods_status2str(status));
+    }
+    /* for dns adapters */
+    warnings += dnsconfig_zone(engine, zone);
+
+    if (zone->zl_status == ZONE_ZL_ADDED) {
+        schedule_scheduletask(engine->taskq, TASK_SIGNCONF, zone->name, zone, &zone->zone_lock, 0);
+    } else if (zl_changed == ODS_STATUS_OK) {
+        schedule_scheduletask(engine->taskq, TASK_FORCESIGNCONF, zone->name, zone, &zone->zone_lock, 0);
+    }
+    if (status != ODS_STATUS_OK) {
+        ods_log_crit("[%s] unable to schedule task for zone %s: %s",
+            engine_str, zone->name, ods_status2str(status));
+    } else {
+        *wake_up = 1;
+        zone->zl_status = ZONE_ZL_OK;
+    }
+    return warnings;
+}
+
+
+/**
+ * Forward the zone list changes to the listener and the workers.
+ *
+ */
+static void
+engine_update_zones_done(engine_type* engine, int warnings, unsigned wake_up)
+{
+    if (engine->dnshandler) {
+        ods_log_debug("[%s] forward notify for all zones", engine_str);
+        dnshandler_fwd_notify(engine->dnshandler,
+            (uint8_t*) ODS_SE_NOTIFY_CMD, strlen(ODS_SE_NOTIFY_CMD));
+    } else if (warnings) {
+        ods_log_warning("[%s] no dnshandler/listener configured, but zones "
+         "are configured with dns adapters: notify and zone transfer "
+         "requests will not work properly", engine_str);
+    }
+    if (wake_up) {
+        engine_wakeup_workers(engine);
+    }
+}
+
+
 /**
  * Update zones.
  *
@@ -639,7 +727,6 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
 {
     ldns_rbnode_t* node = LDNS_RBTREE_NULL;
     zone_type* zone = NULL;
-    ods_status status = ODS_STATUS_OK;
     unsigned wake_up = 0;
     int warnings = 0;
 
@@ -652,70 +739,43 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
     node = ldns_rbtree_first(engine->zonelist->zones);
     while (node && node != LDNS_RBTREE_NULL) {
         zone = (zone_type*) node->data;
-
-        if (zone->zl_status == ZONE_ZL_REMOVED) {
-            node = ldns_rbtree_next(node);
-            pthread_mutex_lock(&zone->zone_lock);
-            zonelist_del_zone(engine->zonelist, zone);
-            schedule_unscheduletask(engine->taskq, schedule_WHATEVER, zone->name);
-            pthread_mutex_unlock(&zone->zone_lock);
-            netio_remove_handler(engine->xfrhandler->netio,
-                &zone->xfrd->handler);
-            netio_remove_handler(engine->xfrhandler->netio,
-                &zone->notify->handler);
-            zone_cleanup(zone);
-            zone = NULL;
-            continue;
-        } else if (zone->zl_status == ZONE_ZL_ADDED) {
-            pthread_mutex_lock(&zone->zone_lock);
-            /* set notify nameserver command */
-            if (engine->config->notify_command && !zone->notify_ns) {
-                set_notify_ns(zone, engine->config->notify_command);
-            }
-            pthread_mutex_unlock(&zone->zone_lock);
-        }
-        /* load adapter config */
-        status = adapter_load_config(zone->adinbound);
-        if (status != ODS_STATUS_OK) {
-            ods_log_error("[%s] unable to load config for inbound adapter "
-                "for zone %s: %s", engine_str, zone->name,
-                ods_status2str(status));
-        }
-        status = adapter_load_config(zone->adoutbound);
-        if (status != ODS_STATUS_OK) {
-            ods_log_error("[%s] unable to load config for outbound adapter "
-                "for zone %s: %s", engine_str, zone->name,
-                ods_status2str(status));
-        }
-        /* for dns adapters */
-        warnings += dnsconfig_zone(engine, zone);
-
-        if (zone->zl_status == ZONE_ZL_ADDED) {
-            schedule_scheduletask(engine->taskq, TASK_SIGNCONF, zone->name, zone, &zone->zone_lock, 0);
-        } else if (zl_changed == ODS_STATUS_OK) {
-            schedule_scheduletask(engine->taskq, TASK_FORCESIGNCONF, zone->name, zone, &zone->zone_lock, 0);
-        }
-        if (status != ODS_STATUS_OK) {
-            ods_log_crit("[%s] unable to schedule task for zone %s: %s",
-                engine_str, zone->name, ods_status2str(status));
-        } else {
-            wake_up = 1;
-            zone->zl_status = ZONE_ZL_OK;
-        }
+        /* fetch the successor first, the zone may be removed */
         node = ldns_rbtree_next(node);
+        warnings += engine_update_zone_locked(engine, zone, zl_changed,
+            &wake_up);
     }
     pthread_mutex_unlock(&engine->zonelist->zl_lock);
-    if (engine->dnshandler) {
-        ods_log_debug("[%s] forward notify for all zones", engine_str);
-        dnshandler_fwd_notify(engine->dnshandler,
-            (uint8_t*) ODS_SE_NOTIFY_CMD, strlen(ODS_SE_NOTIFY_CMD));
-    } else if (warnings) {
-        ods_log_warning("[%s] no dnshandler/listener configured, but zones "
-         "are configured with dns adapters: notify and zone transfer "
-         "requests will not work properly", engine_str);
+    engine_update_zones_done(engine, warnings, wake_up);
+}
+
+
+/**
+ * Update a single zone.
+ *
+ */
+void
+engine_update_zone(engine_type* engine, const char* zonename)
+{
+    zone_type* zone = NULL;
+    unsigned wake_up = 0;
+    int warnings = 0;
+
+    if (!engine || !engine->zonelist || !engine->zonelist->zones) {
+        return;
     }
-    if (wake_up) {
-        engine_wakeup_workers(engine);
+
+    ods_log_debug("[%s] commit zone list changes for zone %s", engine_str,
+        zonename);
+    pthread_mutex_lock(&engine->zonelist->zl_lock);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, zonename,
+        LDNS_RR_CLASS_IN);
+    if (zone) {
+        warnings = engine_update_zone_locked(engine, zone, ODS_STATUS_OK,
+            &wake_up);
+    }
+    pthread_mutex_unlock(&engine->zonelist->zl_lock);
+    if (zone) {
+        engine_update_zones_done(engine, warnings, wake_up);
     }
 }
 
@@ -870,6 +930,17 @@ engine_start(const char* cfgfile, int cmdline_verbosity, int daemonize, int info
             status = ODS_STATUS_HSM_ERR;
             break;
         }
+        if (engine->config->num_signer_sessions > 0 &&
+            hsm_sign_pool_start(engine->config->num_signer_sessions) != HSM_OK) {
+            char* error =  hsm_get_error(NULL);
+            if (error != NULL) {
+                ods_log_error("[%s] %s", "hsm", error);
+                free(error);
+            }
+            ods_log_warning("[%s] unable to open %i signer sessions, "
+                "signing synchronously", engine_str,
+                engine->config->num_signer_sessions);
+        }
         engine_run(engine);
         hsm_close();
     }
@@ -100,6 +100,14 @@ void engine_wakeup_workers(engine_type* engine);
  */
 void engine_update_zones(engine_type* engine, ods_status zl_changed);
 
+/**
+ * Update a single zone, without walking the zone list.
+ * \param[in] engine engine
+ * \param[in] zonename name of the zone that was added, updated or removed
+ *
+ */
+void engine_update_zone(engine_type* engine, const char* zonename);
+
 /**
  * Clean up engine.
  * \param[in] engine engine
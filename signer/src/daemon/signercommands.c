@@ -1,9 +1,12 @@
 #include "config.h"
 
+#include <getopt.h>
+
 #include "file.h"
 #include "str.h"
 #include "locks.h"
 #include "log.h"
+#include "metrics.h"
 #include "status.h"
 #include "util.h"
 #include "daemon/engine.h"
@@ -61,9 +64,15 @@ cmdhandler_handle_cmd_help(int sockfd, cmdhandler_ctx_type* context, char *cmd)
                                     "zone.\n"
         "                            All signatures will be regenerated "
                                     "on the next re-sign.\n"
-        "queue                       Show the current task queue.\n"
+        "queue                       Show the current task queue, how long "
+                                    "due tasks\n"
+        "                            have been waiting and the deadlines of "
+                                    "sign tasks.\n"
         "flush                       Execute all scheduled tasks "
                                     "immediately.\n"
+        "metrics                     Show counters and latencies in the "
+                                    "Prometheus text\n"
+        "                            format.\n"
     );
     client_printf(sockfd, buf);
 
@@ -72,6 +81,13 @@ cmdhandler_handle_cmd_help(int sockfd, cmdhandler_ctx_type* context, char *cmd)
                                     "configurations.\n"
         "update [--all]              Update zone list and all signer "
                                     "configurations.\n"
+        "update <zone> --policy <name> --signconf <file> [--in-type <type>]\n"
+        "       --input <uri> [--out-type <type>] --output <uri>\n"
+        "                            Add or update only this zone, without "
+                                    "reading the zone list.\n"
+        "                            Adapter types are File (default) or "
+                                    "DNS.\n"
+        "update <zone> --remove      Remove only this zone.\n"
         "retransfer <zone>           Retransfer the zone from the master.\n"
         "start                       Start the engine.\n"
         "running                     Check if the engine is running.\n"
@@ -123,6 +139,116 @@ cmdhandler_handle_cmd_zones(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 }
 
 
+/**
+ * Create a zone from the settings passed with the 'update' command.
+ *
+ */
+static zone_type*
+cmdhandler_update_zone_create(char* zonename, const char* policy,
+    const char* signconf, const char* intype, const char* input,
+    const char* outtype, const char* output)
+{
+    zone_type* zone = NULL;
+    adapter_mode inmode, outmode;
+
+    if (!policy || !signconf || !input || !output) {
+        return NULL;
+    }
+    if (!ods_strcmp(intype, "File")) {
+        inmode = ADAPTER_FILE;
+    } else if (!ods_strcmp(intype, "DNS")) {
+        inmode = ADAPTER_DNS;
+    } else {
+        return NULL;
+    }
+    if (!ods_strcmp(outtype, "File")) {
+        outmode = ADAPTER_FILE;
+    } else if (!ods_strcmp(outtype, "DNS")) {
+        outmode = ADAPTER_DNS;
+    } else {
+        return NULL;
+    }
+    zone = zone_create(zonename, LDNS_RR_CLASS_IN);
+    if (!zone) {
+        return NULL;
+    }
+    zone->policy_name = strdup(policy);
+    zone->signconf_filename = strdup(signconf);
+    zone->adinbound = adapter_create(input, inmode, 1);
+    zone->adoutbound = adapter_create(output, outmode, 0);
+    if (!zone->policy_name || !zone->signconf_filename ||
+        !zone->adinbound || !zone->adoutbound) {
+        zone_cleanup(zone);
+        return NULL;
+    }
+    return zone;
+}
+
+
+/**
+ * Handle the 'update' command for a single zone whose settings are passed
+ * along, or that is to be removed. Only this zone is reconciled, the zone
+ * list file is not read.
+ *
+ */
+static int
+cmdhandler_handle_cmd_update_zone(int sockfd, engine_type* engine,
+    char* zonename, int remove, const char* policy, const char* signconf,
+    const char* intype, const char* input, const char* outtype,
+    const char* output)
+{
+    char buf[ODS_SE_MAXLINE];
+    zone_type* zone = NULL;
+
+    if (remove) {
+        pthread_mutex_lock(&engine->zonelist->zl_lock);
+        zone = zonelist_lookup_zone_by_name(engine->zonelist, zonename,
+            LDNS_RR_CLASS_IN);
+        if (zone && zone->zl_status != ZONE_ZL_REMOVED) {
+            zone->zl_status = ZONE_ZL_REMOVED;
+            engine->zonelist->just_removed++;
+        }
+        pthread_mutex_unlock(&engine->zonelist->zl_lock);
+        if (!zone) {
+            (void)snprintf(buf, ODS_SE_MAXLINE, "Error: Zone %s not found.\n",
+                zonename);
+            client_printf(sockfd, buf);
+            return 1;
+        }
+        engine_update_zone(engine, zonename);
+        (void)snprintf(buf, ODS_SE_MAXLINE, "Zone %s removed.\n", zonename);
+        client_printf(sockfd, buf);
+        ods_log_verbose("[%s] zone %s removed", cmdh_str, zonename);
+        return 0;
+    }
+
+    zone = cmdhandler_update_zone_create(zonename, policy, signconf, intype,
+        input, outtype, output);
+    if (!zone) {
+        (void)snprintf(buf, ODS_SE_MAXLINE, "Error: Incomplete or invalid "
+            "settings for zone %s.\n", zonename);
+        client_printf(sockfd, buf);
+        return 1;
+    }
+    pthread_mutex_lock(&engine->zonelist->zl_lock);
+    zone = zonelist_update_zone(engine->zonelist, zone);
+    pthread_mutex_unlock(&engine->zonelist->zl_lock);
+    if (!zone) {
+        (void)snprintf(buf, ODS_SE_MAXLINE, "Error: Unable to update zone "
+            "%s.\n", zonename);
+        client_printf(sockfd, buf);
+        return 1;
+    }
+    engine_update_zone(engine, zonename);
+    (void)snprintf(buf, ODS_SE_MAXLINE, "Zone %s config being updated.\n",
+        zonename);
+    client_printf(sockfd, buf);
+    ods_log_verbose("[%s] zone %s updated, scheduled for signconf", cmdh_str,
+        zonename);
+    return 0;
+}
+
+
 /**
  * Handle the 'update' command.
  *
@@ -130,11 +256,31 @@ cmdhandler_handle_cmd_zones(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 static int
 cmdhandler_handle_cmd_update(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 {
+    #define NARGV 16
     engine_type* engine;
     char buf[ODS_SE_MAXLINE];
-    ods_status status = ODS_STATUS_OK;
     zone_type* zone = NULL;
     ods_status zl_changed = ODS_STATUS_OK;
+    const char* argv[NARGV];
+    int argc, opt, long_index = 0;
+    int remove = 0, settings = 0;
+    char* zonename = NULL;
+    const char* policy = NULL;
+    const char* signconf = NULL;
+    const char* intype = "File";
+    const char* input = NULL;
+    const char* outtype = "File";
+    const char* output = NULL;
+    static struct option long_options[] = {
+        {"policy", required_argument, 0, 'p'},
+        {"signconf", required_argument, 0, 's'},
+        {"in-type", required_argument, 0, 'j'},
+        {"input", required_argument, 0, 'i'},
+        {"out-type", required_argument, 0, 'q'},
+        {"output", required_argument, 0, 'o'},
+        {"remove", no_argument, 0, 'r'},
+        {0, 0, 0, 0}
+    };
     engine = getglobalcontext(context);
     ods_log_assert(engine->taskq);
     if (cmdargument(cmd, "--all", NULL)) {
@@ -169,38 +315,71 @@ cmdhandler_handle_cmd_update(int sockfd, cmdhandler_ctx_type* context, char *cmd
               */
             engine_update_zones(engine, ODS_STATUS_OK);
         }
-    } else {
-        /* look up zone */
-        pthread_mutex_lock(&engine->zonelist->zl_lock);
-        zone = zonelist_lookup_zone_by_name(engine->zonelist, cmdargument(cmd, NULL, ""),
-            LDNS_RR_CLASS_IN);
-        /* If this zone is just added, don't update (it might not have a
-         * task yet) */
-        if (zone && zone->zl_status == ZONE_ZL_ADDED) {
-            zone = NULL;
-        }
-        pthread_mutex_unlock(&engine->zonelist->zl_lock);
+        return 0;
+    }
 
-        if (!zone) {
-            (void)snprintf(buf, ODS_SE_MAXLINE, "Error: Zone %s not found.\n",
-                cmdargument(cmd, NULL, ""));
-            client_printf(sockfd, buf);
-            /* update all */
-            cmdhandler_handle_cmd_update(sockfd, context, "update --all");
-            return 1;
+    argc = ods_str_explode(cmd, NARGV, argv);
+    if (argc == -1) {
+        client_printf(sockfd, "Error: Too many arguments.\n");
+        return 1;
+    }
+    optind = 0;
+    while ((opt = getopt_long(argc, (char* const*)argv, "p:s:j:i:q:o:r",
+        long_options, &long_index)) != -1) {
+        switch (opt) {
+            case 'p': policy = optarg; settings = 1; break;
+            case 's': signconf = optarg; settings = 1; break;
+            case 'j': intype = optarg; settings = 1; break;
+            case 'i': input = optarg; settings = 1; break;
+            case 'q': outtype = optarg; settings = 1; break;
+            case 'o': output = optarg; settings = 1; break;
+            case 'r': remove = 1; break;
+            default:
+                client_printf(sockfd, "Error: Unknown arguments.\n");
+                return 1;
         }
+    }
+    if (optind != argc - 1 || (remove && settings)) {
+        client_printf(sockfd, "Error: Expected a single zone and either "
+            "its settings or --remove.\n");
+        return 1;
+    }
+    zonename = (char*) argv[optind];
+    if (remove || settings) {
+        return cmdhandler_handle_cmd_update_zone(sockfd, engine, zonename,
+            remove, policy, signconf, intype, input, outtype, output);
+    }
 
-        pthread_mutex_lock(&zone->zone_lock);
-        schedule_scheduletask(engine->taskq, TASK_FORCESIGNCONF, zone->name, zone, &zone->zone_lock, schedule_PROMPTLY);
-        pthread_mutex_unlock(&zone->zone_lock);
+    /* look up zone */
+    pthread_mutex_lock(&engine->zonelist->zl_lock);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, zonename,
+        LDNS_RR_CLASS_IN);
+    /* If this zone is just added, don't update (it might not have a
+     * task yet) */
+    if (zone && zone->zl_status == ZONE_ZL_ADDED) {
+        zone = NULL;
+    }
+    pthread_mutex_unlock(&engine->zonelist->zl_lock);
 
-        (void)snprintf(buf, ODS_SE_MAXLINE, "Zone %s config being updated.\n",
-        cmdargument(cmd, NULL, ""));
+    if (!zone) {
+        (void)snprintf(buf, ODS_SE_MAXLINE, "Error: Zone %s not found.\n",
+            zonename);
         client_printf(sockfd, buf);
-        ods_log_verbose("[%s] zone %s scheduled for immediate update signconf",
-            cmdh_str, cmdargument(cmd, NULL, ""));
-        engine_wakeup_workers(engine);
+        /* update all */
+        cmdhandler_handle_cmd_update(sockfd, context, "update --all");
+        return 1;
     }
+
+    pthread_mutex_lock(&zone->zone_lock);
+    schedule_scheduletask(engine->taskq, TASK_FORCESIGNCONF, zone->name, zone, &zone->zone_lock, schedule_PROMPTLY);
+    pthread_mutex_unlock(&zone->zone_lock);
+
+    (void)snprintf(buf, ODS_SE_MAXLINE, "Zone %s config being updated.\n",
+        zonename);
+    client_printf(sockfd, buf);
+    ods_log_verbose("[%s] zone %s scheduled for immediate update signconf",
+        cmdh_str, zonename);
+    engine_wakeup_workers(engine);
     return 0;
 }
 
@@ -438,6 +617,45 @@ cmdhandler_handle_cmd_clear(int sockfd, cmdhandler_ctx_type* context, char *cmd)
 }
 
 
+/**
+ * Print a scheduled task.
+ *
+ */
+static void
+cmdhandler_print_task(task_type* task, void* arg)
+{
+    int sockfd = *(int*) arg;
+    char* taskdesc;
+    char ctimebuf[32]; /* at least 26 according to docs */
+    char* strtime = NULL;
+    size_t len;
+    time_t now = time_now();
+    taskdesc = schedule_describetask(task);
+    if (!taskdesc) {
+        return;
+    }
+    len = strlen(taskdesc);
+    if (len && taskdesc[len-1] == '\n') {
+        taskdesc[--len] = '\0';
+    }
+    /* how long a due task has been waiting for a worker */
+    if (task->due_date <= now && task->due_date > schedule_PROMPTLY) {
+        len += snprintf(taskdesc + len, ODS_SE_MAXLINE - len,
+            ", waiting %lds", (long) (now - task->due_date));
+    }
+    if (task->deadline && len < ODS_SE_MAXLINE) {
+        strtime = ctime_r(&task->deadline, ctimebuf);
+        if (strtime) {
+            strtime[strlen(strtime)-1] = '\0';
+        }
+        len += snprintf(taskdesc + len, ODS_SE_MAXLINE - len,
+            ", deadline %s", strtime?strtime:"(null)");
+    }
+    client_printf(sockfd, "%s\n", taskdesc);
+    free(taskdesc);
+}
+
+
 /**
  * Handle the 'queue' command.
  *
@@ -449,13 +667,10 @@ cmdhandler_handle_cmd_queue(int sockfd, cmdhandler_ctx_type* context, char *cmd)
     char* strtime = NULL;
     char ctimebuf[32]; /* at least 26 according to docs */
     char buf[ODS_SE_MAXLINE];
-    char* taskdesc;
-    size_t i = 0;
     time_t now = 0;
-    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
-    task_type* task = NULL;
+    int count = 0;
     engine = getglobalcontext(context);
-    if (!engine->taskq || !engine->taskq->tasks) {
+    if (!engine->taskq) {
         (void)snprintf(buf, ODS_SE_MAXLINE, "There are no tasks scheduled.\n");
         client_printf(sockfd, buf);
         return 0;
@@ -466,25 +681,45 @@ cmdhandler_handle_cmd_queue(int sockfd, cmdhandler_ctx_type* context, char *cmd)
     (void)snprintf(buf, ODS_SE_MAXLINE, "It is now %s",
         strtime?strtime:"(null)");
     client_printf(sockfd, buf);
-    /* current work */
-    pthread_mutex_lock(&engine->taskq->schedule_lock);
     /* how many tasks */
+    schedule_info(engine->taskq, NULL, NULL, &count);
     (void)snprintf(buf, ODS_SE_MAXLINE, "\nThere are %i tasks scheduled.\n",
-        (int) engine->taskq->tasks->count);
+        count);
     client_printf(sockfd, buf);
     /* list tasks */
-    node = ldns_rbtree_first(engine->taskq->tasks);
-    while (node && node != LDNS_RBTREE_NULL) {
-        task = (task_type*) node->data;
-        for (i=0; i < ODS_SE_MAXLINE; i++) {
-            buf[i] = 0;
-        }
-        taskdesc = schedule_describetask(task);
-        client_printf(sockfd, taskdesc);
-        free(taskdesc);
-        node = ldns_rbtree_next(node);
+    schedule_walk(engine->taskq, cmdhandler_print_task, &sockfd);
+    return 0;
+}
+
+
+/**
+ * Handle the 'metrics' command.
+ *
+ */
+static int
+cmdhandler_handle_cmd_metrics(int sockfd, cmdhandler_ctx_type* context, char *cmd)
+{
+    engine_type* engine;
+    time_t first = 0, now = 0;
+    int idle = 0;
+    int count = 0;
+    engine = getglobalcontext(context);
+    metrics_export(sockfd);
+    if (!engine->taskq) {
+        return 0;
     }
-    pthread_mutex_unlock(&engine->taskq->schedule_lock);
+    now = time_now();
+    schedule_info(engine->taskq, &first, &idle, &count);
+    metrics_export_value(sockfd, "ods_scheduler_tasks",
+        "Tasks in the schedule.", "gauge", count);
+    metrics_export_value(sockfd, "ods_scheduler_idle_workers",
+        "Workers waiting for a task.", "gauge", idle);
+    metrics_export_value(sockfd, "ods_scheduler_overdue_seconds",
+        "How long the first task in the schedule has been due.", "gauge",
+        (first > 0 && first < now) ? (double) (now - first) : 0.0);
+    metrics_export_value(sockfd, "ods_signer_queue_depth",
+        "RRsets waiting in the drudger queue.", "gauge",
+        (double) fifoq_count(engine->taskq->signq));
     return 0;
 }
 
@@ -628,6 +863,7 @@ struct cmd_func_block signCmdDef = { "sign", NULL, NULL, NULL, &cmdhandler_handl
 struct cmd_func_block clearCmdDef = { "clear", NULL, NULL, NULL, &cmdhandler_handle_cmd_clear };
 struct cmd_func_block queueCmdDef = { "queue", NULL, NULL, NULL, &cmdhandler_handle_cmd_queue };
 struct cmd_func_block flushCmdDef = { "flush", NULL, NULL, NULL, &cmdhandler_handle_cmd_flush };
+struct cmd_func_block metricsCmdDef = { "metrics", NULL, NULL, NULL, &cmdhandler_handle_cmd_metrics };
 struct cmd_func_block updateCmdDef = { "update", NULL, NULL, NULL, &cmdhandler_handle_cmd_update };
 struct cmd_func_block stopCmdDef = { "stop", NULL, NULL, NULL, &cmdhandler_handle_cmd_stop };
 struct cmd_func_block startCmdDef = { "start", NULL, NULL, NULL, &cmdhandler_handle_cmd_start };
@@ -643,6 +879,7 @@ struct cmd_func_block* signcommands[] = {
     &clearCmdDef,
     &queueCmdDef,
     &flushCmdDef,
+    &metricsCmdDef,
     &updateCmdDef,
     &stopCmdDef,
     &startCmdDef,
@@ -42,38 +42,82 @@
 #include "signertasks.h"
 
 /**
- * Queue RRset for signing.
+ * RRsets to be queued for signing.
+ *
+ */
+struct worker_batch {
+    void* rrsets[FIFOQ_BATCH_COUNT];
+    size_t count;
+};
+
+
+/**
+ * Number of RRsets a worker may have outstanding with the drudgers.
+ *
+ */
+static long
+worker_queue_share(struct worker_context* context)
+{
+    long share = FIFOQ_MAX_COUNT;
+    if (context->engine->config->num_worker_threads > 1) {
+        share /= context->engine->config->num_worker_threads;
+    }
+    if (share < 2 * FIFOQ_BATCH_COUNT) {
+        share = 2 * FIFOQ_BATCH_COUNT;
+    }
+    return share;
+}
+
+
+/**
+ * Queue batch of RRsets for signing.
  *
  */
 static void
-worker_queue_rrset(struct worker_context* context, fifoq_type* q, rrset_type* rrset, long* nsubtasks)
+worker_queue_flush(struct worker_context* context, fifoq_type* q, struct worker_batch* batch, long* nsubtasks)
 {
-    ods_status status = ODS_STATUS_UNCHANGED;
-    int tries = 0;
+    size_t pushed = 0;
     ods_log_assert(q);
-    ods_log_assert(rrset);
-
-    pthread_mutex_lock(&q->q_lock);
-    status = fifoq_push(q, (void*) rrset, context, &tries);
-    while (status == ODS_STATUS_UNCHANGED) {
-        tries++;
-        if (context->worker->need_to_exit) {
-            pthread_mutex_unlock(&q->q_lock);
-            return;
+    ods_log_assert(batch);
+    while (pushed < batch->count) {
+        pushed += fifoq_push_batch(q, &batch->rrsets[pushed],
+            batch->count - pushed, context);
+        if (pushed < batch->count) {
+            if (context->worker->need_to_exit) {
+                break;
+            }
+            /**
+             * Apparently the queue is full. Lets take a small break to not
+             * hog CPU. The worker will wake up when the queue is nonfull.
+             * Queue is nonfull at 10% of the queue size.
+             */
+            fifoq_wait_nonfull(q, context->worker);
         }
-        /**
-         * Apparently the queue is full. Lets take a small break to not hog CPU.
-         * The worker will release the signq lock while sleeping and will
-         * automatically grab the lock when the queue is nonfull.
-         * Queue is nonfull at 10% of the queue size.
-         */
-        ods_thread_wait(&q->q_nonfull, &q->q_lock, 5);
-        status = fifoq_push(q, (void*) rrset, context, &tries);
     }
-    pthread_mutex_unlock(&q->q_lock);
+    *nsubtasks += pushed;
+    batch->count = 0;
+    /**
+     * Sign the zone in slices: keep no more than a share of the queue
+     * outstanding for this zone, so the drudgers get to the RRsets that
+     * other workers queue for their zones in between.
+     */
+    fifoq_waitfor_share(q, context->worker, *nsubtasks,
+        worker_queue_share(context));
+}
 
-    ods_log_assert(status == ODS_STATUS_OK);
-    *nsubtasks += 1;
+
+/**
+ * Queue RRset for signing.
+ *
+ */
+static void
+worker_queue_rrset(struct worker_context* context, fifoq_type* q, struct worker_batch* batch, rrset_type* rrset, long* nsubtasks)
+{
+    ods_log_assert(rrset);
+    batch->rrsets[batch->count++] = (void*) rrset;
+    if (batch->count == FIFOQ_BATCH_COUNT) {
+        worker_queue_flush(context, q, batch, nsubtasks);
+    }
 }
 
 
@@ -82,21 +126,19 @@ worker_queue_rrset(struct worker_context* context, fifoq_type* q, rrset_type* rr
  *
  */
 static void
-worker_queue_domain(struct worker_context* context, fifoq_type* q, domain_type* domain, long* nsubtasks)
+worker_queue_domain(struct worker_context* context, fifoq_type* q, struct worker_batch* batch, domain_type* domain, long* nsubtasks)
 {
-    rrset_type* rrset = NULL;
     denial_type* denial = NULL;
+    uint16_t i;
     ods_log_assert(context);
     ods_log_assert(q);
     ods_log_assert(domain);
-    rrset = domain->rrsets;
-    while (rrset) {
-        worker_queue_rrset(context, q, rrset, nsubtasks);
-        rrset = rrset->next;
+    for (i = 0; i < domain->rrset_count; i++) {
+        worker_queue_rrset(context, q, batch, domain->rrsets[i], nsubtasks);
     }
     denial = (denial_type*) domain->denial;
     if (denial && denial->rrset) {
-        worker_queue_rrset(context, q, denial->rrset, nsubtasks);
+        worker_queue_rrset(context, q, batch, denial->rrset, nsubtasks);
     }
 }
 
@@ -110,20 +152,23 @@ worker_queue_zone(struct worker_context* context, fifoq_type* q, zone_type* zone
 {
     ldns_rbnode_t* node = LDNS_RBTREE_NULL;
     domain_type* domain = NULL;
+    struct worker_batch batch;
     ods_log_assert(context);
     ods_log_assert(q);
     ods_log_assert(zone);
     if (!zone->db || !zone->db->domains) {
         return;
     }
+    batch.count = 0;
     if (zone->db->domains->root != LDNS_RBTREE_NULL) {
         node = ldns_rbtree_first(zone->db->domains);
     }
     while (node && node != LDNS_RBTREE_NULL) {
         domain = (domain_type*) node->data;
-        worker_queue_domain(context, q, domain, nsubtasks);
+        worker_queue_domain(context, q, &batch, domain, nsubtasks);
         node = ldns_rbtree_next(node);
     }
+    worker_queue_flush(context, q, &batch, nsubtasks);
 }
 
 
@@ -148,63 +193,194 @@ worker_check_jobs(worker_type* worker, task_type* task, int ntasks, long ntasksf
     return ODS_STATUS_OK;
 }
 
+/**
+ * RRset of which the signatures are in flight.
+ *
+ */
+struct drudge_job {
+    rrset_type* rrset;
+    struct worker_context* superior;
+    int pending;
+    ods_status status;
+};
+
+
+/**
+ * Report failure to create an HSM context, and instruct the signer to
+ * reload.
+ *
+ */
+static void
+drudge_hsm_failed(worker_type* worker, struct worker_context* superior)
+{
+    engine_type* engine = superior->engine;
+    ods_log_crit("[%s] error creating libhsm context", worker->name);
+    engine->need_to_reload = 1;
+    pthread_mutex_lock(&engine->signal_lock);
+    pthread_cond_signal(&engine->signal_cond);
+    pthread_mutex_unlock(&engine->signal_lock);
+    ods_log_error("signer instructed to reload due to hsm reset while signing");
+}
+
+
+/**
+ * Wait for one signature in flight, and report its RRset when it was
+ * the last one.
+ *
+ */
+static void
+drudge_complete(worker_type* worker, hsm_ctx_t* ctx, hsm_sign_queue_t* queue,
+    size_t* inflight)
+{
+    struct drudge_job* job = NULL;
+    ods_status status;
+    status = rrset_sign_complete(ctx, queue, (void**) &job);
+    if (!job) {
+        *inflight = 0;
+        return;
+    }
+    (*inflight)--;
+    if (status != ODS_STATUS_OK) {
+        job->status = status;
+    }
+    if (--job->pending == 0) {
+        fifoq_report(worker->taskq->signq, job->superior->worker, job->status);
+        free(job);
+    }
+}
+
+
+/**
+ * Sign an RRset, submitting its signatures to the session pool.
+ *
+ */
+static void
+drudge_submit(worker_type* worker, hsm_ctx_t* ctx, hsm_sign_queue_t* queue,
+    rrset_type* rrset, struct worker_context* superior, size_t* inflight)
+{
+    struct drudge_job* job = NULL;
+    int nsubmitted = 0;
+    ods_status status;
+    CHECKALLOC(job = (struct drudge_job*) malloc(sizeof(struct drudge_job)));
+    job->rrset = rrset;
+    job->superior = superior;
+    job->pending = 0;
+    job->status = ODS_STATUS_OK;
+    status = rrset_sign_submit(ctx, queue, rrset, superior->clock_in, job,
+        &nsubmitted);
+    if (nsubmitted == 0) {
+        /* nothing in flight, report right away */
+        fifoq_report(worker->taskq->signq, superior->worker, status);
+        free(job);
+        return;
+    }
+    /* the completions of earlier submissions can not touch this job */
+    job->pending = nsubmitted;
+    job->status = status;
+    *inflight += nsubmitted;
+}
+
+
 void
 drudge(worker_type* worker)
 {
+    void* rrsets[FIFOQ_BATCH_COUNT];
+    void* superiors[FIFOQ_BATCH_COUNT];
     rrset_type* rrset;
     ods_status status;
     struct worker_context* superior;
     hsm_ctx_t* ctx = NULL;
-    engine_type* engine;
+    hsm_sign_queue_t* queue = NULL;
     fifoq_type* signq = worker->taskq->signq;
+    size_t count, i, max;
+    size_t depth = 0;
+    size_t inflight = 0;
 
     while (worker->need_to_exit == 0) {
         ods_log_deeebug("[%s] report for duty", worker->name);
-        pthread_mutex_lock(&signq->q_lock);
-        superior = NULL;
-        rrset = (rrset_type*) fifoq_pop(signq, (void**)&superior);
-        if (!rrset) {
+        if (queue && inflight >= depth) {
+            /* enough signatures in flight, collect one */
+            drudge_complete(worker, ctx, queue, &inflight);
+            continue;
+        }
+        max = FIFOQ_BATCH_COUNT;
+        if (queue && depth - inflight < max) {
+            max = depth - inflight;
+        }
+        count = fifoq_pop_batch(signq, rrsets, superiors, max);
+        if (!count) {
+            if (inflight) {
+                drudge_complete(worker, ctx, queue, &inflight);
+                continue;
+            }
             ods_log_deeebug("[%s] nothing to do, wait", worker->name);
             /**
              * Apparently the queue is empty. Wait until new work is queued.
-             * The drudger will release the signq lock while sleeping and
-             * will automatically grab the lock when the threshold is reached.
-             * Threshold is at 1 and MAX (after a number of tries).
              */
-            pthread_cond_wait(&signq->q_threshold, &signq->q_lock);
-            if(worker->need_to_exit == 0)
-                rrset = (rrset_type*) fifoq_pop(signq, (void**)&superior);
+            fifoq_wait_nonempty(signq, worker);
+            continue;
         }
-        pthread_mutex_unlock(&signq->q_lock);
         /* do some work */
-        if (rrset) {
+        for (i = 0; i < count; i++) {
+            rrset = (rrset_type*) rrsets[i];
+            superior = (struct worker_context*) superiors[i];
+            ods_log_assert(rrset);
             ods_log_assert(superior);
             if (!ctx) {
                 ods_log_debug("[%s] create hsm context", worker->name);
                 ctx = hsm_create_context();
+                if (ctx && hsm_sign_pool_size()) {
+                    /**
+                     * Keep enough signatures in flight to keep the sessions
+                     * of the pool busy, shared with the other drudgers.
+                     */
+                    queue = hsm_sign_queue_new(ctx);
+                    depth = 2 * hsm_sign_pool_size() /
+                        superior->engine->config->num_signer_threads;
+                    if (depth < 1) {
+                        depth = 1;
+                    }
+                    ods_log_debug("[%s] keep up to %lu signatures in flight",
+                        worker->name, (unsigned long) depth);
+                }
             }
             if (!ctx) {
-                engine = superior->engine;
-                ods_log_crit("[%s] error creating libhsm context", worker->name);
-                engine->need_to_reload = 1;
-                pthread_mutex_lock(&engine->signal_lock);
-                pthread_cond_signal(&engine->signal_cond);
-                pthread_mutex_unlock(&engine->signal_lock);
-                ods_log_error("signer instructed to reload due to hsm reset while signing");
-                status = ODS_STATUS_HSM_ERR;
+                drudge_hsm_failed(worker, superior);
+                fifoq_report(signq, superior->worker, ODS_STATUS_HSM_ERR);
+            } else if (queue) {
+                drudge_submit(worker, ctx, queue, rrset, superior, &inflight);
             } else {
                 status = rrset_sign(ctx, rrset, superior->clock_in);
+                fifoq_report(signq, superior->worker, status);
             }
-            fifoq_report(signq, superior->worker, status);
         }
         /* done work */
     }
+    /* collect signatures still in flight */
+    while (inflight) {
+        drudge_complete(worker, ctx, queue, &inflight);
+    }
+    if (queue) {
+        hsm_sign_queue_free(queue);
+    }
     /* cleanup open HSM sessions */
     if (ctx) {
         hsm_destroy_context(ctx);
     }
 }
 
+/**
+ * Schedule the sign task of a zone, it is due at when and has to be done
+ * before the first of its RRSIGs needs a refresh.
+ *
+ */
+static void
+schedule_signzone(engine_type* engine, zone_type* zone, time_t when)
+{
+    schedule_scheduletask_deadline(engine->taskq, TASK_SIGN, zone->name, zone,
+        &zone->zone_lock, when, zone->sig_deadline);
+}
+
 time_t
 do_readsignconf(task_type* task, const char* zonename, void* zonearg, void *contextarg)
 {
@@ -295,6 +471,7 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
         zone->stats->sig_soa_count = 0;
         zone->stats->sig_reuse = 0;
         zone->stats->sig_time = 0;
+        zone->stats->sig_expire = 0;
         pthread_mutex_unlock(&zone->stats->stats_lock);
     }
     /* check the HSM connection before queuing sign operations */
@@ -327,6 +504,11 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
     if (status == ODS_STATUS_OK && zone->stats) {
         pthread_mutex_lock(&zone->stats->stats_lock);
         zone->stats->sig_time = (end - start);
+        zone->sig_deadline = 0;
+        if (zone->stats->sig_expire) {
+            zone->sig_deadline = (time_t) zone->stats->sig_expire -
+                duration2time(zone->signconf->sig_refresh_interval);
+        }
         pthread_mutex_unlock(&zone->stats->stats_lock);
     }
     if (status != ODS_STATUS_OK) {
@@ -379,7 +561,7 @@ do_readzone(task_type* task, const char* zonename, void* zonearg, void *contexta
          * The read task can then continue, finding the just created sign task in its path.
          */
         schedule_unscheduletask(engine->taskq, TASK_SIGN, zone->name);
-        schedule_scheduletask(engine->taskq, TASK_SIGN, zone->name, zone, &zone->zone_lock, schedule_PROMPTLY);
+        schedule_signzone(engine, zone, schedule_PROMPTLY);
         return schedule_SUCCESS;
     }
 }
@@ -417,7 +599,7 @@ do_forcereadzone(task_type* task, const char* zonename, void* zonearg, void *con
         schedule_unscheduletask(engine->taskq, TASK_READ, zone->name);
         schedule_unscheduletask(engine->taskq, TASK_SIGN, zone->name);
         schedule_unscheduletask(engine->taskq, TASK_WRITE, zone->name);
-        schedule_scheduletask(engine->taskq, TASK_SIGN, zone->name, zone, &zone->zone_lock, schedule_PROMPTLY);
+        schedule_signzone(engine, zone, schedule_PROMPTLY);
         return schedule_SUCCESS;
     }
 }
@@ -459,6 +641,6 @@ do_writezone(task_type* task, const char* zonename, void* zonearg, void *context
         /* just a warning */
         status = ODS_STATUS_OK;
     }
-    schedule_scheduletask(engine->taskq, TASK_SIGN, zone->name, zone, &zone->zone_lock, resign);
+    schedule_signzone(engine, zone, resign);
     return schedule_SUCCESS;
 }
@@ -70,6 +70,13 @@ xfrhandler_create()
     xfrh->notify_waiting_first = NULL;
     xfrh->notify_waiting_last = NULL;
     xfrh->notify_udp_num = 0;
+    /* metrics */
+    xfrh->xfr_bytes = metrics_counter("ods_xfr_in_bytes_total",
+        "Bytes received in zone transfers.", NULL, NULL);
+    xfrh->xfr_latency = metrics_histogram("ods_xfr_in_seconds",
+        "Time from zone transfer request to the last packet.", NULL, NULL);
+    xfrh->notify_sent = metrics_counter("ods_notify_sent_total",
+        "NOTIFY messages sent to secondaries.", NULL, NULL);
     /* setup */
     xfrh->netio = netio_create();
     xfrh->packet = buffer_create(PACKET_BUFFER_SIZE);
@@ -38,6 +38,7 @@ typedef struct xfrhandler_struct xfrhandler_type;
 
 #include "status.h"
 #include "locks.h"
+#include "metrics.h"
 #include "wire/buffer.h"
 #include "wire/netio.h"
 #include "wire/notify.h"
@@ -68,6 +69,10 @@ struct xfrhandler_struct {
     notify_type* notify_waiting_last;
     int notify_udp_num;
     netio_handler_type dnshandler;
+    /* Metrics */
+    metrics_type* xfr_bytes;
+    metrics_type* xfr_latency;
+    metrics_type* notify_sent;
     unsigned got_time : 1;
     unsigned need_to_exit : 1;
     unsigned started : 1;
@@ -54,6 +54,7 @@ lhsm_clear_key_cache(key_type* key)
         hsm_sign_params_free(key->params);
         key->params = NULL;
     }
+    key->hsmkey = NULL;
 }
 
 static const libhsm_key_t*
@@ -107,9 +108,11 @@ llibhsm_key_start:
     }
     if (skip_hsm_access) return ODS_STATUS_OK;
 
+    /* resolve key, so that signing does not have to look it up */
+    key_id->hsmkey = keylookup(ctx, key_id->locator);
     /* get dnskey */
     if (!key_id->dnskey) {
-        key_id->dnskey = hsm_get_dnskey(ctx, keylookup(ctx, key_id->locator), key_id->params);
+        key_id->dnskey = hsm_get_dnskey(ctx, key_id->hsmkey, key_id->params);
     }
     if (!key_id->dnskey) {
         error = hsm_get_error(ctx);
@@ -130,12 +133,31 @@ llibhsm_key_start:
 }
 
 
+/**
+ * Create signature parameters for the key.
+ *
+ */
+static hsm_sign_params_t*
+lhsm_sign_params(key_type* key_id, time_t inception, time_t expiration)
+{
+    hsm_sign_params_t* params = NULL;
+    params = hsm_sign_params_new();
+    params->owner = ldns_rdf_clone(key_id->params->owner);
+    params->algorithm = key_id->algorithm;
+    params->flags = key_id->flags;
+    params->inception = inception;
+    params->expiration = expiration;
+    params->keytag = key_id->params->keytag;
+    return params;
+}
+
+
 /**
  * Get RRSIG from one of the HSMs, given a RRset and a key.
  *
  */
 ldns_rr*
-lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
+lhsm_sign(hsm_ctx_t* ctx, hsm_rrset_wire_t* rrset, key_type* key_id,
     ldns_rdf* owner, time_t inception, time_t expiration)
 {
     char* error = NULL;
@@ -150,18 +172,83 @@ lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
     ods_log_assert(key_id->dnskey);
     ods_log_assert(key_id->params);
     /* adjust parameters */
-    params = hsm_sign_params_new();
-    params->owner = ldns_rdf_clone(key_id->params->owner);
-    params->algorithm = key_id->algorithm;
-    params->flags = key_id->flags;
-    params->inception = inception;
-    params->expiration = expiration;
-    params->keytag = key_id->params->keytag;
+    params = lhsm_sign_params(key_id, inception, expiration);
     ods_log_deeebug("[%s] sign RRset[%i] with key %s tag %u", hsm_str,
-        ldns_rr_get_type(ldns_rr_list_rr(rrset, 0)),
-        key_id->locator?key_id->locator:"(null)", params->keytag);
-    result = hsm_sign_rrset(ctx, rrset, keylookup(ctx, key_id->locator), params);
+        rrset->type, key_id->locator?key_id->locator:"(null)",
+        params->keytag);
+    result = hsm_sign_rrset_wire(ctx, rrset, key_id->hsmkey ? key_id->hsmkey :
+        keylookup(ctx, key_id->locator), params);
+    hsm_sign_params_free(params);
+    if (!result) {
+        error = hsm_get_error(ctx);
+        if (error) {
+            ods_log_error("[%s] %s", hsm_str, error);
+            free((void*)error);
+        }
+        ods_log_crit("[%s] error signing rrset with libhsm", hsm_str);
+    }
+    return result;
+}
+
+
+/**
+ * Submit RRset to be signed with a key.
+ *
+ */
+ods_status
+lhsm_sign_submit(hsm_sign_queue_t* queue, hsm_ctx_t* ctx,
+    hsm_rrset_wire_t* rrset, key_type* key_id, ldns_rdf* owner,
+    time_t inception, time_t expiration, void* cookie)
+{
+    char* error = NULL;
+    const libhsm_key_t* key;
+    hsm_sign_params_t* params = NULL;
+    int result;
+
+    if (!queue || !owner || !key_id || !rrset || !inception || !expiration) {
+        ods_log_error("[%s] unable to sign: missing required elements",
+            hsm_str);
+        return ODS_STATUS_ASSERT_ERR;
+    }
+    ods_log_assert(key_id->dnskey);
+    ods_log_assert(key_id->params);
+    key = key_id->hsmkey ? key_id->hsmkey : keylookup(ctx, key_id->locator);
+    if (!key) {
+        return ODS_STATUS_HSM_ERR;
+    }
+    params = lhsm_sign_params(key_id, inception, expiration);
+    ods_log_deeebug("[%s] submit RRset[%i] for key %s tag %u", hsm_str,
+        rrset->type, key_id->locator?key_id->locator:"(null)",
+        params->keytag);
+    result = hsm_sign_submit_wire(queue, rrset, key, params, cookie);
     hsm_sign_params_free(params);
+    if (result != HSM_OK) {
+        error = hsm_get_error(ctx);
+        if (error) {
+            ods_log_error("[%s] %s", hsm_str, error);
+            free((void*)error);
+        }
+        ods_log_crit("[%s] error submitting rrset to libhsm", hsm_str);
+        return ODS_STATUS_HSM_ERR;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Wait for a submitted signature.
+ *
+ */
+ldns_rr*
+lhsm_sign_complete(hsm_sign_queue_t* queue, hsm_ctx_t* ctx, void** cookie)
+{
+    char* error = NULL;
+    ldns_rr* result = NULL;
+
+    *cookie = NULL;
+    if (hsm_sign_complete(queue, &result, cookie)) {
+        return NULL;
+    }
     if (!result) {
         error = hsm_get_error(ctx);
         if (error) {
@@ -56,7 +56,7 @@ ods_status lhsm_get_key(hsm_ctx_t* ctx, ldns_rdf* owner, key_type* key_id, int s
 /**
  * Get RRSIG from one of the HSMs, given a RRset and a key.
  * \param[in] ctx HSM context
- * \param[in] rrset RRset to be signed
+ * \param[in] rrset RRset to be signed, in canonical wire format
  * \param[in] key_id key credentials
  * \param[in] owner owner of the keys
  * \param[in] inception signature inception
@@ -64,7 +64,36 @@ ods_status lhsm_get_key(hsm_ctx_t* ctx, ldns_rdf* owner, key_type* key_id, int s
  * \return ldns_rr* RRSIG record
  *
  */
-ldns_rr* lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
+ldns_rr* lhsm_sign(hsm_ctx_t* ctx, hsm_rrset_wire_t* rrset, key_type* key_id,
     ldns_rdf* owner, time_t inception, time_t expiration);
 
+/**
+ * Submit RRset to be signed with a key, see hsm_sign_submit().
+ * \param[in] queue queue of the submitting thread
+ * \param[in] ctx HSM context of the submitting thread
+ * \param[in] rrset RRset to be signed, in canonical wire format
+ * \param[in] key_id key credentials
+ * \param[in] owner owner of the keys
+ * \param[in] inception signature inception
+ * \param[in] expiration signature expiration
+ * \param[in] cookie returned by lhsm_sign_complete()
+ * \return ods_status status
+ *
+ */
+ods_status lhsm_sign_submit(hsm_sign_queue_t* queue, hsm_ctx_t* ctx,
+    hsm_rrset_wire_t* rrset, key_type* key_id, ldns_rdf* owner,
+    time_t inception, time_t expiration, void* cookie);
+
+/**
+ * Wait for a submitted signature, see hsm_sign_complete().
+ * \param[in] queue queue of the submitting thread
+ * \param[in] ctx HSM context of the submitting thread
+ * \param[out] cookie cookie given to lhsm_sign_submit(), NULL if
+ *              nothing was outstanding
+ * \return ldns_rr* RRSIG record, NULL on failure
+ *
+ */
+ldns_rr* lhsm_sign_complete(hsm_sign_queue_t* queue, hsm_ctx_t* ctx,
+    void** cookie);
+
 #endif /* SHARED_HSM_H */
@@ -153,6 +153,7 @@ parse_conf_repositories(const char* cfgfile)
     char* module;
     char* tokenlabel;
     char* pin;
+    char* group;
     uint8_t use_pubkey;
     uint8_t allowextract;
     int require_backup;
@@ -192,6 +193,7 @@ parse_conf_repositories(const char* cfgfile)
             module = NULL;
             tokenlabel = NULL;
             pin = NULL;
+            group = NULL;
             use_pubkey = 1;
             allowextract = 0;
             require_backup = 0;
@@ -208,6 +210,8 @@ parse_conf_repositories(const char* cfgfile)
                     tokenlabel = (char *) xmlNodeGetContent(curNode);
                 if (xmlStrEqual(curNode->name, (const xmlChar *)"PIN"))
                     pin = (char *) xmlNodeGetContent(curNode);
+                if (xmlStrEqual(curNode->name, (const xmlChar *)"ReplicaGroup"))
+                    group = (char *) xmlNodeGetContent(curNode);
                 if (xmlStrEqual(curNode->name, (const xmlChar *)"SkipPublicKey"))
                     use_pubkey = 0;
                 if (xmlStrEqual(curNode->name, (const xmlChar *)"AllowExtraction"))
@@ -217,7 +221,7 @@ parse_conf_repositories(const char* cfgfile)
             }
             if (name && module && tokenlabel) {
                 repo = hsm_repository_new(name, module, tokenlabel, pin,
-                    use_pubkey, allowextract, require_backup);
+                    use_pubkey, allowextract, require_backup, group);
             }
             if (!repo) {
                ods_log_error("[%s] unable to add %s repository: "
@@ -232,6 +236,7 @@ parse_conf_repositories(const char* cfgfile)
             free((void*)module);
             free((void*)tokenlabel);
             free((void*)pin);
+            free((void*)group);
         }
     }
 
@@ -620,6 +625,19 @@ parse_conf_use_syslog(const char* cfgfile)
     return 0;
 }
 
+int
+parse_conf_log_async(const char* cfgfile)
+{
+    const char* str = parse_conf_string(cfgfile,
+        "//Configuration/Common/Logging/Async",
+        0);
+    if (str) {
+        free((void*)str);
+        return 1;
+    }
+    return 0;
+}
+
 int
 parse_conf_verbosity(const char* cfgfile)
 {
@@ -671,3 +689,37 @@ parse_conf_signer_threads(const char* cfgfile)
     /* no SignerThreads value configured, look at WorkerThreads */
     return parse_conf_worker_threads(cfgfile);
 }
+
+
+int
+parse_conf_signer_sessions(const char* cfgfile)
+{
+    int numss = ODS_SE_SIGNSESSIONS;
+    const char* str = parse_conf_string(cfgfile,
+        "//Configuration/Signer/SignerSessions",
+        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numss = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numss;
+}
+
+
+int
+parse_conf_xfr_threads(const char* cfgfile)
+{
+    int numxt = ODS_SE_XFRTHREADS;
+    const char* str = parse_conf_string(cfgfile,
+        "//Configuration/Signer/TransferThreads",
+        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numxt = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numxt;
+}
@@ -106,10 +106,13 @@ const char* parse_conf_chroot(const char* cfgfile);
 
 /** Common */
 int parse_conf_use_syslog(const char* cfgfile);
+int parse_conf_log_async(const char* cfgfile);
 int parse_conf_verbosity(const char* cfgfile);
 
 /** Signer specific */
 int parse_conf_worker_threads(const char* cfgfile);
 int parse_conf_signer_threads(const char* cfgfile);
+int parse_conf_signer_sessions(const char* cfgfile);
+int parse_conf_xfr_threads(const char* cfgfile);
 
 #endif /* PARSE_CONFPARSER_H */
@@ -33,6 +33,7 @@
 #include "parser/signconfparser.h"
 #include "duration.h"
 #include "log.h"
+#include "str.h"
 
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
@@ -515,6 +516,20 @@ parse_sc_passthrough(const char* cfgfile)
     return ret;
 }
 
+int
+parse_sc_signature_store_slab(const char* cfgfile)
+{
+    int ret = 0;
+    const char* str = parse_conf_string(cfgfile,
+        "//SignerConfiguration/Zone/SignatureStore",
+        0);
+    if (str) {
+        ret = !ods_strcmp(str, "slab");
+        free((void*)str);
+    }
+    return ret;
+}
+
 /**
  * Parse elements from the configuration file.
  *
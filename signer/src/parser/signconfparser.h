@@ -101,6 +101,13 @@ int parse_sc_nsec3_optout(const char* cfgfile);
  */
 int parse_sc_passthrough(const char* cfgfile);
 
+/**
+ * Parse elements from the configuration file.
+ * \param[in] cfgfile the configuration file name.
+ * \return boolean, whether RRSIGs are kept in a slab file
+ */
+int parse_sc_signature_store_slab(const char* cfgfile);
+
 /**
  * Parse elements from the configuration file.
  * \param[in] cfgfile the configuration file name.
@@ -35,8 +35,6 @@
 #include "signer/domain.h"
 #include "signer/zone.h"
 
-#define SE_MAX_RRTYPE_COUNT 65536
-
 static const char* denial_str = "denial";
 
 
@@ -64,36 +62,104 @@ denial_create(zone_type* zone, ldns_rdf* dname)
 
 
 /**
- * Create NSEC(3) Type Bitmaps Field.
+ * Set an RRtype in a window 0 type bitmap.
  *
  */
 static void
-denial_create_bitmap(denial_type* denial, ldns_rr_type types[],
-    size_t* types_count)
+denial_bitmap_set(uint8_t* bitmap, ldns_rr_type rrtype)
+{
+    bitmap[rrtype >> 3] |= (0x80 >> (rrtype & 7));
+}
+
+
+/**
+ * Create NSEC(3) Type Bitmaps Field.
+ *
+ * Authoritative domains list all their RRsets, delegations only NS and
+ * DS, and occluded domains none. When all RRsets fall in the first
+ * window, the field is copied from the type bitmap of the domain.
+ *
+ */
+static ldns_rdf*
+denial_create_bitmap(denial_type* denial, ldns_rr_type nsectype)
 {
     domain_type* domain = NULL;
-    rrset_type* rrset = NULL;
+    ldns_rr_type dstatus = LDNS_RR_TYPE_FIRST;
+    ldns_rr_type delegpt = LDNS_RR_TYPE_FIRST;
+    ldns_rr_type* types = NULL;
+    ldns_rdf* rdf = NULL;
+    uint8_t data[2 + DOMAIN_TYPEMAP_SIZE];
+    uint8_t* bitmap = &data[2];
+    size_t types_count = 0;
+    size_t len = 0;
+    uint16_t i;
+    int rrsig = 0;
 
     ods_log_assert(denial);
     ods_log_assert(denial->domain);
 
     domain = denial->domain;
-    rrset = domain->rrsets;
-    while (rrset) {
-        ldns_rr_type dstatus = domain_is_occluded(domain);
-        if (dstatus == LDNS_RR_TYPE_SOA) {
-            /* Authoritative or delegation */
-            dstatus = domain_is_delegpt(domain);
-            if (dstatus == LDNS_RR_TYPE_SOA ||
-                rrset->rrtype == LDNS_RR_TYPE_NS ||
-                rrset->rrtype == LDNS_RR_TYPE_DS) {
+    dstatus = domain_is_occluded(domain);
+    if (dstatus == LDNS_RR_TYPE_SOA) {
+        /* Authoritative or delegation */
+        delegpt = domain_is_delegpt(domain);
+        /* NSEC3: authoritative domain, not empty: add RRSIGs */
+        rrsig = (delegpt != LDNS_RR_TYPE_NS && domain->rrset_count);
+    }
+    if (nsectype == LDNS_RR_TYPE_NSEC) {
+        rrsig = 1;
+    }
 
-                types[*types_count] = rrset->rrtype;
-                *types_count = *types_count + 1;
+    if (domain_has_high_types(domain)) {
+        CHECKALLOC(types = (ldns_rr_type*) malloc((domain->rrset_count + 2)
+            * sizeof(ldns_rr_type)));
+        for (i = 0; dstatus == LDNS_RR_TYPE_SOA &&
+            i < domain->rrset_count; i++) {
+            if (delegpt == LDNS_RR_TYPE_SOA ||
+                domain->rrsets[i]->rrtype == LDNS_RR_TYPE_NS ||
+                domain->rrsets[i]->rrtype == LDNS_RR_TYPE_DS) {
+                types[types_count++] = domain->rrsets[i]->rrtype;
             }
         }
-        rrset = rrset->next;
+        if (rrsig) {
+            types[types_count++] = LDNS_RR_TYPE_RRSIG;
+        }
+        if (nsectype == LDNS_RR_TYPE_NSEC) {
+            types[types_count++] = LDNS_RR_TYPE_NSEC;
+        }
+        rdf = ldns_dnssec_create_nsec_bitmap(types, types_count, nsectype);
+        free(types);
+        return rdf;
     }
+
+    memset(bitmap, 0, DOMAIN_TYPEMAP_SIZE);
+    if (dstatus == LDNS_RR_TYPE_SOA) {
+        if (delegpt == LDNS_RR_TYPE_SOA) {
+            memcpy(bitmap, domain->typemap, DOMAIN_TYPEMAP_SIZE);
+        } else {
+            if (domain_lookup_rrset(domain, LDNS_RR_TYPE_NS)) {
+                denial_bitmap_set(bitmap, LDNS_RR_TYPE_NS);
+            }
+            if (domain_lookup_rrset(domain, LDNS_RR_TYPE_DS)) {
+                denial_bitmap_set(bitmap, LDNS_RR_TYPE_DS);
+            }
+        }
+    }
+    if (rrsig) {
+        denial_bitmap_set(bitmap, LDNS_RR_TYPE_RRSIG);
+    }
+    if (nsectype == LDNS_RR_TYPE_NSEC) {
+        denial_bitmap_set(bitmap, LDNS_RR_TYPE_NSEC);
+    }
+    for (len = DOMAIN_TYPEMAP_SIZE; len > 0 && !bitmap[len-1]; len--) {
+        /* strip trailing zero octets */
+    }
+    if (!len) {
+        return ldns_rdf_new(LDNS_RDF_TYPE_BITMAP, 0, NULL);
+    }
+    data[0] = 0; /* window block */
+    data[1] = (uint8_t) len;
+    return ldns_rdf_new_frm_data(LDNS_RDF_TYPE_BITMAP, len + 2, data);
 }
 
 
@@ -147,11 +213,7 @@ denial_create_nsec(denial_type* denial, denial_type* nxt, uint32_t ttl,
 {
     ldns_rr* nsec_rr = NULL;
     ldns_rr_type rrtype = LDNS_RR_TYPE_NSEC;
-    ldns_rr_type dstatus = LDNS_RR_TYPE_FIRST;
     ldns_rdf* rdf = NULL;
-    domain_type* domain = NULL;
-    ldns_rr_type types[SE_MAX_RRTYPE_COUNT];
-    size_t types_count = 0;
     int i = 0;
     ods_log_assert(denial);
     ods_log_assert(denial->dname);
@@ -200,29 +262,10 @@ denial_create_nsec(denial_type* denial, denial_type* nxt, uint32_t ttl,
     }
     ldns_rr_push_rdf(nsec_rr, rdf);
     /* Type Bit Maps */
-    denial_create_bitmap(denial, types, &types_count);
-    if (n3p) {
-        domain = (domain_type*) denial->domain;
-        dstatus = domain_is_occluded(domain);
-        if (dstatus == LDNS_RR_TYPE_SOA) {
-            dstatus = domain_is_delegpt(domain);
-            if (dstatus != LDNS_RR_TYPE_NS && domain->rrsets) {
-                 /* Authoritative domain, not empty: add RRSIGs */
-                 types[types_count] = LDNS_RR_TYPE_RRSIG;
-                 types_count++;
-            }
-        }
-        /* and don't add NSEC3 type... */
-    } else {
-        types[types_count] = LDNS_RR_TYPE_RRSIG;
-        types_count++;
-        types[types_count] = LDNS_RR_TYPE_NSEC;
-        types_count++;
-    }
-    rdf = ldns_dnssec_create_nsec_bitmap(types, types_count, rrtype);
+    rdf = denial_create_bitmap(denial, rrtype);
     if (!rdf) {
         ods_log_alert("[%s] unable to create NSEC(3) RR: "
-            "ldns_dnssec_create_nsec_bitmap() failed", denial_str);
+            "create type bitmap failed", denial_str);
         ldns_rr_free(nsec_rr);
         return NULL;
     }
@@ -48,7 +48,7 @@ void
 log_dname(ldns_rdf *rdf, const char* pre, int level)
 {
     char* str = NULL;
-    if (ods_log_get_level() < level) {
+    if (!ods_log_enabled(level)) {
         return;
     }
     str = ldns_rdf2str(rdf);
@@ -103,6 +103,9 @@ domain_create(zone_type* zone, ldns_rdf* dname)
     domain->denial = NULL; /* no reference yet */
     domain->node = NULL; /* not in db yet */
     domain->rrsets = NULL;
+    domain->rrset_count = 0;
+    domain->rrset_alloc = 0;
+    memset(domain->typemap, 0, sizeof(domain->typemap));
     domain->parent = NULL;
     domain->is_apex = 0;
     domain->is_new = 0;
@@ -117,22 +120,79 @@ domain_create(zone_type* zone, ldns_rdf* dname)
 size_t
 domain_count_rrset_is_added(domain_type* domain)
 {
-    rrset_type* rrset = NULL;
     size_t count = 0;
+    size_t i;
     if (!domain) {
         return 0;
     }
-    rrset = domain->rrsets;
-    while (rrset) {
-        if (rrset_count_rr_is_added(rrset)) {
+    for (i = 0; i < domain->rrset_count; i++) {
+        if (rrset_count_rr_is_added(domain->rrsets[i])) {
             count++;
         }
-        rrset = rrset->next;
     }
     return count;
 }
 
 
+/**
+ * Find the position of an RRtype in the RRsets of a domain.
+ * Returns whether the RRset exists; if not, pos is where it goes.
+ *
+ */
+static int
+domain_find_rrset(domain_type* domain, ldns_rr_type rrtype, uint16_t* pos)
+{
+    uint16_t lo = 0;
+    uint16_t hi = domain->rrset_count;
+    uint16_t mid;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (domain->rrsets[mid]->rrtype < rrtype) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return lo < domain->rrset_count && domain->rrsets[lo]->rrtype == rrtype;
+}
+
+
+/**
+ * Set or clear an RRtype in the type bitmap of a domain.
+ *
+ */
+static void
+domain_typemap_set(domain_type* domain, ldns_rr_type rrtype, int present)
+{
+    if (rrtype >= DOMAIN_TYPEMAP_SIZE * 8) {
+        return;
+    }
+    if (present) {
+        domain->typemap[rrtype >> 3] |= (0x80 >> (rrtype & 7));
+    } else {
+        domain->typemap[rrtype >> 3] &= ~(0x80 >> (rrtype & 7));
+    }
+}
+
+
+/**
+ * Remove the RRset at a position from a domain and clean it up.
+ *
+ */
+static void
+domain_del_rrset(domain_type* domain, uint16_t pos)
+{
+    rrset_type* rrset = domain->rrsets[pos];
+    domain->rrset_count--;
+    memmove(&domain->rrsets[pos], &domain->rrsets[pos+1],
+        (domain->rrset_count - pos) * sizeof(rrset_type*));
+    domain_typemap_set(domain, rrset->rrtype, 0);
+    log_rrset(domain->dname, rrset->rrtype, "-RRSET", LOG_DEEEBUG);
+    rrset_cleanup(rrset);
+}
+
+
 /**
  * Look up RRset at this domain.
  *
@@ -140,15 +200,33 @@ domain_count_rrset_is_added(domain_type* domain)
 rrset_type*
 domain_lookup_rrset(domain_type* domain, ldns_rr_type rrtype)
 {
-    rrset_type* rrset = NULL;
-    if (!domain || !domain->rrsets || !rrtype) {
+    uint16_t pos;
+    if (!domain || !domain->rrset_count || !rrtype) {
         return NULL;
     }
-    rrset = domain->rrsets;
-    while (rrset && rrset->rrtype != rrtype) {
-        rrset = rrset->next;
+    if (rrtype < DOMAIN_TYPEMAP_SIZE * 8) {
+        if (!(domain->typemap[rrtype >> 3] & (0x80 >> (rrtype & 7)))) {
+            return NULL;
+        }
+    }
+    if (!domain_find_rrset(domain, rrtype, &pos)) {
+        return NULL;
     }
-    return rrset;
+    return domain->rrsets[pos];
+}
+
+
+/**
+ * Check whether the domain has RRsets above the first NSEC bitmap window.
+ *
+ */
+int
+domain_has_high_types(domain_type* domain)
+{
+    ods_log_assert(domain);
+    return domain->rrset_count &&
+        domain->rrsets[domain->rrset_count-1]->rrtype >=
+        DOMAIN_TYPEMAP_SIZE * 8;
 }
 
 
@@ -159,20 +237,26 @@ domain_lookup_rrset(domain_type* domain, ldns_rr_type rrtype)
 void
 domain_add_rrset(domain_type* domain, rrset_type* rrset)
 {
-    rrset_type** p = NULL;
     denial_type* denial = NULL;
+    uint16_t pos;
     ods_log_assert(domain);
     ods_log_assert(rrset);
-    if (!domain->rrsets) {
-        domain->rrsets = rrset;
-    } else {
-        p = &domain->rrsets;
-        while(*p) {
-            p = &((*p)->next);
-        }
-        *p = rrset;
-        rrset->next = NULL;
+    if (domain_find_rrset(domain, rrset->rrtype, &pos)) {
+        ods_log_error("[%s] RRset already exists at domain", dname_str);
+        log_rrset(domain->dname, rrset->rrtype, "ERR +RRSET", LOG_ERR);
+        return;
     }
+    if (domain->rrset_count == domain->rrset_alloc) {
+        domain->rrset_alloc = domain->rrset_alloc ?
+            domain->rrset_alloc * 2 : 4;
+        CHECKALLOC(domain->rrsets = (rrset_type**) realloc(domain->rrsets,
+            domain->rrset_alloc * sizeof(rrset_type*)));
+    }
+    memmove(&domain->rrsets[pos+1], &domain->rrsets[pos],
+        (domain->rrset_count - pos) * sizeof(rrset_type*));
+    domain->rrsets[pos] = rrset;
+    domain->rrset_count++;
+    domain_typemap_set(domain, rrset->rrtype, 1);
     log_rrset(domain->dname, rrset->rrtype, "+RRSET", LOG_DEEEBUG);
     rrset->domain = (void*) domain;
     if (domain->denial) {
@@ -191,13 +275,13 @@ domain_diff(domain_type* domain, unsigned is_ixfr, unsigned more_coming)
 {
     denial_type* denial = NULL;
     rrset_type* rrset = NULL;
-    rrset_type* prev_rrset = NULL;
+    uint16_t i = 0;
 
     if (!domain) {
         return;
     }
-    rrset = domain->rrsets;
-    while (rrset) {
+    while (i < domain->rrset_count) {
+        rrset = domain->rrsets[i];
         if (rrset->rrtype == LDNS_RR_TYPE_NSEC3PARAMS ||
             rrset->rrtype == LDNS_RR_TYPE_DNSKEY) {
             /* always do full diff on NSEC3PARAMS | DNSKEY RRset */
@@ -207,27 +291,14 @@ domain_diff(domain_type* domain, unsigned is_ixfr, unsigned more_coming)
         }
         if (rrset->rr_count <= 0) {
             /* delete entire rrset */
-            if (!prev_rrset) {
-                domain->rrsets = rrset->next;
-            } else {
-                prev_rrset->next = rrset->next;
-            }
-            rrset->next = NULL;
-            log_rrset(domain->dname, rrset->rrtype, "-RRSET", LOG_DEEEBUG);
-            rrset_cleanup(rrset);
-            if (!prev_rrset) {
-                rrset = domain->rrsets;
-            } else {
-                rrset = prev_rrset->next;
-            }
+            domain_del_rrset(domain, i);
             if (domain->denial) {
                 denial = (denial_type*) domain->denial;
                 denial->bitmap_changed = 1;
             }
         } else {
             /* just go to next rrset */
-            prev_rrset = rrset;
-            rrset = rrset->next;
+            i++;
         }
     }
 }
@@ -242,20 +313,19 @@ domain_rollback(domain_type* domain, int keepsc)
 {
     denial_type* denial = NULL;
     rrset_type* rrset = NULL;
-    rrset_type* prev_rrset = NULL;
     int del_rrset = 0;
-    uint16_t i = 0;
+    uint16_t j = 0;
+    size_t i = 0;
     if (!domain) {
         return;
     }
-    rrset = domain->rrsets;
-    while (rrset) {
+    while (j < domain->rrset_count) {
+        rrset = domain->rrsets[j];
         if (keepsc) {
             /* skip rollback for NSEC3PARAM and DNSKEY RRset */
             if (rrset->rrtype == LDNS_RR_TYPE_NSEC3PARAMS ||
                 rrset->rrtype == LDNS_RR_TYPE_DNSKEY) {
-                prev_rrset = rrset;
-                rrset = rrset->next;
+                j++;
                 continue;
             }
         }
@@ -275,19 +345,7 @@ domain_rollback(domain_type* domain, int keepsc)
         /* next rrset */
         if (del_rrset) {
             /* delete entire rrset */
-            if (!prev_rrset) {
-                domain->rrsets = rrset->next;
-            } else {
-                prev_rrset->next = rrset->next;
-            }
-            rrset->next = NULL;
-            log_rrset(domain->dname, rrset->rrtype, "-RRSET", LOG_DEEEBUG);
-            rrset_cleanup(rrset);
-            if (!prev_rrset) {
-                rrset = domain->rrsets;
-            } else {
-                rrset = prev_rrset->next;
-            }
+            domain_del_rrset(domain, j);
             if (domain->denial) {
                 denial = (denial_type*) domain->denial;
                 denial->bitmap_changed = 0;
@@ -295,8 +353,7 @@ domain_rollback(domain_type* domain, int keepsc)
             del_rrset = 0;
         } else {
             /* just go to next rrset */
-            prev_rrset = rrset;
-            rrset = rrset->next;
+            j++;
         }
     }
 }
@@ -313,7 +370,7 @@ domain_ent2unsignedns(domain_type* domain)
     domain_type* d = NULL;
 
     ods_log_assert(domain);
-    if (domain->rrsets) {
+    if (domain->rrset_count) {
         return 0; /* not an empty non-terminal */
     }
     n = ldns_rbtree_next(domain->node);
@@ -322,7 +379,7 @@ domain_ent2unsignedns(domain_type* domain)
         if (!ldns_dname_is_subdomain(d->dname, domain->dname)) {
             break;
         }
-        if (d->rrsets) {
+        if (d->rrset_count) {
             if (domain_is_delegpt(d) != LDNS_RR_TYPE_NS &&
                 domain_is_occluded(d) == LDNS_RR_TYPE_SOA) {
                 /* domain has signed delegation/auth */
@@ -399,6 +456,7 @@ domain_print(FILE* fd, domain_type* domain, ods_status* status)
 {
     char* str = NULL;
     rrset_type* rrset = NULL;
+    uint16_t i;
     rrset_type* soa_rrset = NULL;
     rrset_type* cname_rrset = NULL;
     if (!domain || !fd) {
@@ -410,7 +468,7 @@ domain_print(FILE* fd, domain_type* domain, ods_status* status)
         return;
     }
     /* empty non-terminal? */
-    if (!domain->rrsets) {
+    if (!domain->rrset_count) {
         str = ldns_rdf2str(domain->dname);
         fprintf(fd, ";;Empty non-terminal %s\n", str);
         free((void*)str);
@@ -436,8 +494,8 @@ domain_print(FILE* fd, domain_type* domain, ods_status* status)
             }
         }
         /* print other RRsets */
-        rrset = domain->rrsets;
-        while (rrset) {
+        for (i = 0; i < domain->rrset_count; i++) {
+            rrset = domain->rrsets[i];
             /* skip SOA RRset */
             if (rrset->rrtype != LDNS_RR_TYPE_SOA) {
                 rrset_print(fd, rrset, 0, status);
@@ -447,7 +505,6 @@ domain_print(FILE* fd, domain_type* domain, ods_status* status)
                     dname_str, ods_status2str(*status));
                 return;
             }
-            rrset = rrset->next;
         }
     }
     /* Denial of Existence */
@@ -464,11 +521,15 @@ domain_print(FILE* fd, domain_type* domain, ods_status* status)
 void
 domain_cleanup(domain_type* domain)
 {
+    uint16_t i;
     if (!domain) {
         return;
     }
     ldns_rdf_deep_free(domain->dname);
-    rrset_cleanup(domain->rrsets);
+    for (i = 0; i < domain->rrset_count; i++) {
+        rrset_cleanup(domain->rrsets[i]);
+    }
+    free(domain->rrsets);
     free(domain);
 }
 
@@ -481,6 +542,7 @@ void
 domain_backup2(FILE* fd, domain_type* domain, int sigs)
 {
     rrset_type* rrset = NULL;
+    uint16_t i;
     if (!domain || !fd) {
         return;
     }
@@ -495,8 +557,8 @@ domain_backup2(FILE* fd, domain_type* domain, int sigs)
             }
         }
     }
-    rrset = domain->rrsets;
-    while (rrset) {
+    for (i = 0; i < domain->rrset_count; i++) {
+        rrset = domain->rrsets[i];
         /* skip SOA RRset */
         if (rrset->rrtype != LDNS_RR_TYPE_SOA) {
             if (sigs) {
@@ -505,6 +567,5 @@ domain_backup2(FILE* fd, domain_type* domain, int sigs)
                 rrset_print(fd, rrset, 1, NULL);
             }
         }
-        rrset = rrset->next;
     }
 }
@@ -45,6 +45,13 @@ typedef struct domain_struct domain_type;
 #define SE_NSEC3_RDATA_NXT         4
 #define SE_NSEC3_RDATA_BITMAP      5
 
+/**
+ * Size of the RRset type bitmap of a domain, which covers the RR types of
+ * the first NSEC bitmap window (0-255).
+ *
+ */
+#define DOMAIN_TYPEMAP_SIZE 32
+
 /**
  * Domain.
  *
@@ -55,7 +62,11 @@ struct domain_struct {
     ldns_rbnode_t* node;
     ldns_rdf* dname;
     domain_type* parent;
-    rrset_type* rrsets;
+    rrset_type** rrsets; /* sorted by RR type */
+    uint16_t rrset_count;
+    uint16_t rrset_alloc;
+    uint8_t typemap[DOMAIN_TYPEMAP_SIZE]; /* RRset types 0-255, in NSEC
+                                           * window 0 bit order */
     unsigned is_new : 1;
     unsigned is_apex : 1; /* apex */
 };
@@ -95,6 +106,15 @@ size_t domain_count_rrset_is_added(domain_type* domain);
  */
 rrset_type* domain_lookup_rrset(domain_type* domain, ldns_rr_type rrtype);
 
+/**
+ * Check whether the domain has RRsets of types above the first NSEC
+ * bitmap window, so that the type bitmap does not cover all its RRsets.
+ * \param[in] domain the domain
+ * \return int yes or no
+ *
+ */
+int domain_has_high_types(domain_type* domain);
+
 /**
  * Add RRset to domain.
  * \param[in] domain domain
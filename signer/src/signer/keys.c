@@ -110,6 +110,7 @@ keylist_push(keylist_type* kl, const char* locator, const char* resourcerecord,
     kl->keys[kl->count -1].zsk = zsk;
     kl->keys[kl->count -1].dnskey = NULL;
     kl->keys[kl->count -1].params = NULL;
+    kl->keys[kl->count -1].hsmkey = NULL;
     return &kl->keys[kl->count -1];
 }
 
@@ -50,6 +50,7 @@ typedef struct keylist_struct keylist_type;
 struct key_struct {
     ldns_rr* dnskey;
     hsm_sign_params_t* params;
+    const libhsm_key_t* hsmkey;
     const char* locator;
     const char* resourcerecord;
     uint8_t algorithm;
@@ -376,7 +376,7 @@ namedb_del_domain(namedb_type* db, domain_type* domain)
         ods_log_error("[%s] unable to delete domain: !db || !domain", db_str);
         return NULL;
     }
-    if (domain->rrsets || domain->denial) {
+    if (domain->rrset_count || domain->denial) {
         ods_log_error("[%s] unable to delete domain: domain in use", db_str);
         log_dname(domain->dname, "ERR -DOMAIN", LOG_ERR);
         return NULL;
@@ -384,7 +384,7 @@ namedb_del_domain(namedb_type* db, domain_type* domain)
     node = ldns_rbtree_delete(db->domains, (const void*)domain->dname);
     if (node) {
         ods_log_assert(domain->node == node);
-        ods_log_assert(!domain->rrsets);
+        ods_log_assert(!domain->rrset_count);
         ods_log_assert(!domain->denial);
         free((void*)node);
         domain->node = NULL;
@@ -424,7 +424,7 @@ domain_is_empty_terminal(domain_type* domain)
     if (domain->is_apex) {
         return 0;
     }
-    if (domain->rrsets) {
+    if (domain->rrset_count) {
         return 0;
     }
     n = ldns_rbtree_next(domain->node);
@@ -467,7 +467,7 @@ namedb_add_nsec_trigger(namedb_type* db, domain_type* domain)
     if (dstatus == LDNS_RR_TYPE_DNAME || dstatus == LDNS_RR_TYPE_A) {
        return; /* don't do occluded/glue domain */
     }
-    if (!domain->rrsets) {
+    if (!domain->rrset_count) {
        return; /* don't do empty domain */
     }
     /* ok, nsecify this domain */
@@ -555,7 +555,7 @@ namedb_del_nsec_trigger(namedb_type* db, domain_type* domain)
     ods_log_assert(domain->denial);
     dstatus = domain_is_occluded(domain);
     if (dstatus == LDNS_RR_TYPE_DNAME || dstatus == LDNS_RR_TYPE_A ||
-        domain_is_empty_terminal(domain) || !domain->rrsets) {
+        domain_is_empty_terminal(domain) || !domain->rrset_count) {
        /* domain has become occluded/glue or empty non-terminal*/
        denial_diff((denial_type*) domain->denial);
        denial = namedb_del_denial(db, domain->denial);
@@ -942,6 +942,44 @@ namedb_examine(namedb_type* db)
 }
 
 
+/**
+ * Move the RRSIGs of all RRsets to another store.
+ *
+ */
+void
+namedb_move_rrsigs(namedb_type* db, collection_class klass)
+{
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    domain_type* domain = NULL;
+    denial_type* denial = NULL;
+    uint16_t i;
+
+    if (!db) {
+        return;
+    }
+    if (db->domains) {
+        node = ldns_rbtree_first(db->domains);
+        while (node && node != LDNS_RBTREE_NULL) {
+            domain = (domain_type*) node->data;
+            for (i = 0; i < domain->rrset_count; i++) {
+                collection_move(domain->rrsets[i]->rrsigs, klass);
+            }
+            node = ldns_rbtree_next(node);
+        }
+    }
+    if (db->denials) {
+        node = ldns_rbtree_first(db->denials);
+        while (node && node != LDNS_RBTREE_NULL) {
+            denial = (denial_type*) node->data;
+            if (denial->rrset) {
+                collection_move(denial->rrset->rrsigs, klass);
+            }
+            node = ldns_rbtree_next(node);
+        }
+    }
+}
+
+
 /**
  * Wipe out all NSEC RRsets.
  *
@@ -196,6 +196,14 @@ void namedb_nsecify(namedb_type* db, uint32_t* num_added);
  */
 void namedb_export(FILE* fd, namedb_type* db, ods_status* status);
 
+/**
+ * Move the RRSIGs of all RRsets to another store.
+ * \param[in] db namedb
+ * \param[in] klass RRSIG store
+ *
+ */
+void namedb_move_rrsigs(namedb_type* db, collection_class klass);
+
 /**
  * Wipe out all NSEC(3) RRsets.
  * \param[in] db namedb
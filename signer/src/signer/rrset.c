@@ -33,12 +33,30 @@
 #include "file.h"
 #include "hsm.h"
 #include "log.h"
+#include "metrics.h"
 #include "util.h"
 #include "compat.h"
 #include "signer/rrset.h"
 #include "signer/zone.h"
 
 static const char* rrset_str = "rrset";
+static pthread_once_t rrset_metrics_once = PTHREAD_ONCE_INIT;
+static metrics_type* rrset_signatures = NULL;
+static metrics_type* rrset_reused = NULL;
+
+
+/**
+ * Register the signature counters.
+ *
+ */
+static void
+rrset_metrics_init(void)
+{
+    rrset_signatures = metrics_counter("ods_signer_signatures_total",
+        "Signatures made.", NULL, NULL);
+    rrset_reused = metrics_counter("ods_signer_signatures_reused_total",
+        "Signatures kept from an earlier run.", NULL, NULL);
+}
 
 /**
  * Log RR.
@@ -50,7 +68,7 @@ log_rr(ldns_rr* rr, const char* pre, int level)
     char* str = NULL;
     size_t i = 0;
 
-    if (ods_log_get_level() < level) {
+    if (!ods_log_enabled(level)) {
         return;
     }
     str = ldns_rr2str(rr);
@@ -101,7 +119,7 @@ log_rrset(ldns_rdf* dname, ldns_rr_type type, const char* pre, int level)
     char* str = NULL;
     size_t i = 0;
 
-    if (ods_log_get_level() < level) {
+    if (!ods_log_enabled(level)) {
         return;
     }
     str = ldns_rdf2str(dname);
@@ -203,17 +221,99 @@ rrset_create(zone_type* zone, ldns_rr_type type)
         return NULL;
     }
     CHECKALLOC(rrset = (rrset_type*) malloc(sizeof(rrset_type)));
-    rrset->next = NULL;
     rrset->rrs = NULL;
     rrset->domain = NULL;
     rrset->zone = zone;
     rrset->rrtype = type;
     rrset->rr_count = 0;
+    rrset->rr_alloc = 0;
+    rrset->rr_index = NULL;
+    rrset->rr_index_size = 0;
     collection_create_array(&rrset->rrsigs, sizeof(rrsig_type), rrset->zone->rrstore);
+    rrset->wire = NULL;
     rrset->needs_signing = 0;
     return rrset;
 }
 
+/**
+ * Encode RRSIG for the slab store: key flags, owner, key locator and the
+ * RR in wire format.
+ *
+ */
+static int
+memberencode(void* dummy, void* member, uint8_t* buf, size_t size)
+{
+    rrsig_type* sig = (rrsig_type*) member;
+    uint8_t* wire = NULL;
+    size_t wiresize = 0;
+    size_t locatorlen = 0;
+    size_t len;
+    uint16_t len16;
+    (void)dummy;
+    if (ldns_rr2wire(&wire, sig->rr, LDNS_SECTION_ANSWER, &wiresize)
+        != LDNS_STATUS_OK) {
+        return -1;
+    }
+    if (sig->key_locator) {
+        locatorlen = strlen(sig->key_locator);
+    }
+    len = sizeof(uint32_t) + sizeof(domain_type*) + sizeof(uint16_t) +
+        locatorlen + wiresize;
+    if (len <= size) {
+        memcpy(buf, &sig->key_flags, sizeof(uint32_t));
+        buf += sizeof(uint32_t);
+        memcpy(buf, &sig->owner, sizeof(domain_type*));
+        buf += sizeof(domain_type*);
+        /* UINT16_MAX for no locator */
+        len16 = (sig->key_locator ? (uint16_t) locatorlen : UINT16_MAX);
+        memcpy(buf, &len16, sizeof(uint16_t));
+        buf += sizeof(uint16_t);
+        memcpy(buf, sig->key_locator, locatorlen);
+        buf += locatorlen;
+        memcpy(buf, wire, wiresize);
+    }
+    free(wire);
+    return (int) len;
+}
+
+/**
+ * Decode RRSIG from the slab store.
+ *
+ */
+static int
+memberdecode(void* dummy, void* member, const uint8_t* buf, size_t len)
+{
+    rrsig_type* sig = (rrsig_type*) member;
+    size_t pos = sizeof(uint32_t) + sizeof(domain_type*) + sizeof(uint16_t);
+    uint16_t len16;
+    char* locator = NULL;
+    (void)dummy;
+    if (len < pos) {
+        return 1;
+    }
+    memcpy(&sig->key_flags, buf, sizeof(uint32_t));
+    memcpy(&sig->owner, buf + sizeof(uint32_t), sizeof(domain_type*));
+    memcpy(&len16, buf + sizeof(uint32_t) + sizeof(domain_type*),
+        sizeof(uint16_t));
+    if (len16 != UINT16_MAX) {
+        if (len < pos + len16) {
+            return 1;
+        }
+        CHECKALLOC(locator = malloc(len16 + 1));
+        memcpy(locator, buf + pos, len16);
+        locator[len16] = '\0';
+        pos += len16;
+    }
+    sig->rr = NULL;
+    if (ldns_wire2rr(&sig->rr, buf, len, &pos, LDNS_SECTION_ANSWER)
+        != LDNS_STATUS_OK) {
+        free(locator);
+        return 1;
+    }
+    sig->key_locator = locator;
+    return 0;
+}
+
 collection_class
 rrset_store_initialize()
 {
@@ -222,6 +322,112 @@ rrset_store_initialize()
     return klass;
 }
 
+/**
+ * Create a slab file backed store for RRSIGs.
+ *
+ */
+collection_class
+rrset_store_initialize_slab(const char* filename)
+{
+    collection_class klass;
+    if (collection_class_slab(&klass, filename, RRSET_STORE_SLOTSIZE, NULL,
+        memberdestroy, memberencode, memberdecode)) {
+        return NULL;
+    }
+    return klass;
+}
+
+
+/**
+ * Drop the index of the RRset. It is rebuilt when needed.
+ *
+ */
+static void
+rrset_index_clear(rrset_type* rrset)
+{
+    free(rrset->rr_index);
+    rrset->rr_index = NULL;
+    rrset->rr_index_size = 0;
+}
+
+
+/**
+ * Put RR in the index of the RRset.
+ *
+ */
+static void
+rrset_index_put(rrset_type* rrset, size_t rrnum)
+{
+    size_t mask = rrset->rr_index_size - 1;
+    size_t i = rrset->rrs[rrnum].hash & mask;
+    while (rrset->rr_index[i]) {
+        i = (i + 1) & mask;
+    }
+    rrset->rr_index[i] = rrnum + 1;
+}
+
+
+/**
+ * Index the RRset, if it is large enough.
+ *
+ */
+static ods_status
+rrset_index_build(rrset_type* rrset)
+{
+    ldns_status lstatus = LDNS_STATUS_OK;
+    size_t size = 64;
+    size_t i = 0;
+
+    rrset_index_clear(rrset);
+    if (rrset->rr_count < RRSET_INDEX_THRESHOLD) {
+        return ODS_STATUS_OK;
+    }
+    /* keep the load factor at most one half */
+    while (size < rrset->rr_count * 2) {
+        size *= 2;
+    }
+    for (i=0; i < rrset->rr_count; i++) {
+        lstatus = util_dnssec_rdata_hash(rrset->rrs[i].rr,
+            &rrset->rrs[i].hash);
+        if (lstatus != LDNS_STATUS_OK) {
+            ods_log_error("[%s] unable to index RRset: hash failed (%s)",
+                rrset_str, ldns_get_errorstr_by_id(lstatus));
+            return ODS_STATUS_ERR;
+        }
+    }
+    CHECKALLOC(rrset->rr_index = (size_t*) calloc(size, sizeof(size_t)));
+    rrset->rr_index_size = size;
+    for (i=0; i < rrset->rr_count; i++) {
+        rrset_index_put(rrset, i);
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Add the last RR of the RRset to its index.
+ *
+ */
+static void
+rrset_index_add(rrset_type* rrset)
+{
+    ldns_status lstatus = LDNS_STATUS_OK;
+    size_t rrnum = rrset->rr_count - 1;
+
+    if (!rrset->rr_index || rrset->rr_count * 2 > rrset->rr_index_size) {
+        /* (re)build, or leave unindexed if it fails */
+        (void) rrset_index_build(rrset);
+        return;
+    }
+    lstatus = util_dnssec_rdata_hash(rrset->rrs[rrnum].rr,
+        &rrset->rrs[rrnum].hash);
+    if (lstatus != LDNS_STATUS_OK) {
+        rrset_index_clear(rrset);
+        return;
+    }
+    rrset_index_put(rrset, rrnum);
+}
+
 
 /**
  * Lookup RR in RRset.
@@ -233,10 +439,37 @@ rrset_lookup_rr(rrset_type* rrset, ldns_rr* rr)
     ldns_status lstatus = LDNS_STATUS_OK;
     int cmp = 0;
     size_t i = 0;
+    size_t n = 0;
+    size_t mask = 0;
+    uint32_t hash = 0;
 
     if (!rrset || !rr || rrset->rr_count <= 0) {
        return NULL;
     }
+    if (!rrset->rr_index && rrset->rr_count >= RRSET_INDEX_THRESHOLD) {
+        (void) rrset_index_build(rrset);
+    }
+    if (rrset->rr_index &&
+        util_dnssec_rdata_hash(rr, &hash) == LDNS_STATUS_OK) {
+        /* equal RRs are found in the order they were added */
+        mask = rrset->rr_index_size - 1;
+        for (i = hash & mask; rrset->rr_index[i]; i = (i + 1) & mask) {
+            n = rrset->rr_index[i] - 1;
+            if (rrset->rrs[n].hash != hash) {
+                continue;
+            }
+            lstatus = util_dnssec_rrs_compare(rrset->rrs[n].rr, rr, &cmp);
+            if (lstatus != LDNS_STATUS_OK) {
+                ods_log_error("[%s] unable to lookup RR: compare failed (%s)",
+                    rrset_str, ldns_get_errorstr_by_id(lstatus));
+                return NULL;
+            }
+            if (!cmp) { /* equal */
+                return &rrset->rrs[n];
+            }
+        }
+        return NULL;
+    }
     for (i=0; i < rrset->rr_count; i++) {
         lstatus = util_dnssec_rrs_compare(rrset->rrs[i].rr, rr, &cmp);
         if (lstatus != LDNS_STATUS_OK) {
@@ -286,6 +519,18 @@ rrset_count_rr_is_added(rrset_type* rrset)
 }
 
 
+/**
+ * Forget the wire format of the RRset, after its RRs changed.
+ *
+ */
+static void
+rrset_wire_clear(rrset_type* rrset)
+{
+    hsm_rrset_wire_free(rrset->wire);
+    rrset->wire = NULL;
+}
+
+
 /**
  * Add RR to RRset.
  *
@@ -293,27 +538,52 @@ rrset_count_rr_is_added(rrset_type* rrset)
 rr_type*
 rrset_add_rr(rrset_type* rrset, ldns_rr* rr)
 {
-    rr_type* rrs_old = NULL;
+    rr_type* record = NULL;
 
     ods_log_assert(rrset);
     ods_log_assert(rr);
     ods_log_assert(rrset->rrtype == ldns_rr_get_type(rr));
 
-    rrs_old = rrset->rrs;
-    CHECKALLOC(rrset->rrs = (rr_type*) malloc((rrset->rr_count + 1) * sizeof(rr_type)));
-    if (rrs_old) {
-        memcpy(rrset->rrs, rrs_old, (rrset->rr_count) * sizeof(rr_type));
+    if (rrset->rr_count == rrset->rr_alloc) {
+        /* grow geometrically, so that adding n RRs takes O(n) copies */
+        rrset->rr_alloc = rrset->rr_alloc ? rrset->rr_alloc * 2 : 1;
+        CHECKALLOC(rrset->rrs = (rr_type*) realloc(rrset->rrs,
+            rrset->rr_alloc * sizeof(rr_type)));
     }
-    free(rrs_old);
     rrset->rr_count++;
-    rrset->rrs[rrset->rr_count - 1].owner = rrset->domain;
-    rrset->rrs[rrset->rr_count - 1].rr = rr;
-    rrset->rrs[rrset->rr_count - 1].exists = 0;
-    rrset->rrs[rrset->rr_count - 1].is_added = 1;
-    rrset->rrs[rrset->rr_count - 1].is_removed = 0;
+    record = &rrset->rrs[rrset->rr_count - 1];
+    record->owner = rrset->domain;
+    record->rr = rr;
+    record->hash = 0;
+    record->exists = 0;
+    record->is_added = 1;
+    record->is_removed = 0;
+    if (rrset->rr_index || rrset->rr_count >= RRSET_INDEX_THRESHOLD) {
+        rrset_index_add(rrset);
+    }
     rrset->needs_signing = 1;
+    rrset_wire_clear(rrset);
     log_rr(rr, "+RR", LOG_DEEEBUG);
-    return &rrset->rrs[rrset->rr_count -1];
+    return record;
+}
+
+
+/**
+ * Shrink the RR array of the RRset after RRs were deleted.
+ *
+ */
+static void
+rrset_shrink(rrset_type* rrset)
+{
+    if (rrset->rr_count == 0) {
+        free(rrset->rrs);
+        rrset->rrs = NULL;
+        rrset->rr_alloc = 0;
+    } else if (rrset->rr_count * 4 <= rrset->rr_alloc) {
+        rrset->rr_alloc = rrset->rr_count * 2;
+        CHECKALLOC(rrset->rrs = (rr_type*) realloc(rrset->rrs,
+            rrset->rr_alloc * sizeof(rr_type)));
+    }
 }
 
 
@@ -322,27 +592,23 @@ rrset_add_rr(rrset_type* rrset, ldns_rr* rr)
  *
  */
 void
-rrset_del_rr(rrset_type* rrset, uint16_t rrnum)
+rrset_del_rr(rrset_type* rrset, size_t rrnum)
 {
-    rr_type* rrs_orig = NULL;
-
     ods_log_assert(rrset);
     ods_log_assert(rrnum < rrset->rr_count);
 
     log_rr(rrset->rrs[rrnum].rr, "-RR", LOG_DEEEBUG);
     rrset->rrs[rrnum].owner = NULL; /* who owns owner? */
     ldns_rr_free(rrset->rrs[rrnum].rr);
-    while (rrnum < rrset->rr_count-1) {
-        rrset->rrs[rrnum] = rrset->rrs[rrnum+1];
-        rrnum++;
-    }
+    memmove(&rrset->rrs[rrnum], &rrset->rrs[rrnum+1],
+        (rrset->rr_count - rrnum - 1) * sizeof(rr_type));
     memset(&rrset->rrs[rrset->rr_count-1], 0, sizeof(rr_type));
-    rrs_orig = rrset->rrs;
-    CHECKALLOC(rrset->rrs = (rr_type*) malloc((rrset->rr_count - 1) * sizeof(rr_type)));
-    memcpy(rrset->rrs, rrs_orig, (rrset->rr_count -1) * sizeof(rr_type));
-    free(rrs_orig);
     rrset->rr_count--;
+    rrset_shrink(rrset);
+    /* RR numbers changed, rebuild the index when it is needed */
+    rrset_index_clear(rrset);
     rrset->needs_signing = 1;
+    rrset_wire_clear(rrset);
 }
 
 /**
@@ -353,14 +619,15 @@ void
 rrset_diff(rrset_type* rrset, unsigned is_ixfr, unsigned more_coming)
 {
     zone_type* zone = NULL;
-    uint16_t i = 0;
+    size_t i = 0;
+    size_t kept = 0;
     uint8_t del_sigs = 0;
     if (!rrset) {
         return;
     }
     zone = (zone_type*) rrset->zone;
-    /* CAUTION: both iterator and condition (implicit) are changed
-     * within the loop. */
+    /* Deleted RRs are dropped while walking the RRs, the others are
+     * moved down in place, so that this is linear in the size. */
     for (i=0; i < rrset->rr_count; i++) {
         if (rrset->rrs[i].is_added) {
             if (!rrset->rrs[i].exists) {
@@ -373,10 +640,9 @@ rrset_diff(rrset_type* rrset, unsigned is_ixfr, unsigned more_coming)
                 del_sigs = 1;
             }
             rrset->rrs[i].exists = 1;
-            if ((rrset->rrtype == LDNS_RR_TYPE_DNSKEY) && more_coming) {
-                continue;
+            if ((rrset->rrtype != LDNS_RR_TYPE_DNSKEY) || !more_coming) {
+                rrset->rrs[i].is_added = 0;
             }
-            rrset->rrs[i].is_added = 0;
         } else if (!is_ixfr || rrset->rrs[i].is_removed) {
             if (rrset->rrs[i].exists && zone->db->is_initialized) {
                 /* ixfr -RR */
@@ -384,14 +650,28 @@ rrset_diff(rrset_type* rrset, unsigned is_ixfr, unsigned more_coming)
                 ixfr_del_rr(zone->ixfr, rrset->rrs[i].rr);
                 pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
             }
-            rrset->rrs[i].exists = 0;
-            rrset_del_rr(rrset, i);
+            log_rr(rrset->rrs[i].rr, "-RR", LOG_DEEEBUG);
+            ldns_rr_free(rrset->rrs[i].rr);
             del_sigs = 1;
-            i--;
+            continue;
+        }
+        if (kept != i) {
+            rrset->rrs[kept] = rrset->rrs[i];
         }
+        kept++;
+    }
+    if (kept < rrset->rr_count) {
+        memset(&rrset->rrs[kept], 0,
+            (rrset->rr_count - kept) * sizeof(rr_type));
+        rrset->rr_count = kept;
+        rrset_shrink(rrset);
+        /* RR numbers changed, rebuild the index when it is needed */
+        rrset_index_clear(rrset);
+        rrset->needs_signing = 1;
     }
     if (del_sigs) {
         rrset_drop_rrsigs(zone, rrset);
+        rrset_wire_clear(rrset);
     }
 }
 
@@ -434,12 +714,13 @@ rrset_add_rrsig(rrset_type* rrset, ldns_rr* rr,
 }
 
 /**
- * Recycle signatures from RRset and drop unreusable signatures.
+ * Recycle signatures from RRset and drop unreusable signatures. The
+ * earliest expiration of the recycled signatures is kept in expire.
  *
  */
 static uint32_t
 rrset_recycle(rrset_type* rrset, time_t signtime, ldns_rr_type dstatus,
-    ldns_rr_type delegpt)
+    ldns_rr_type delegpt, uint32_t* expire)
 {
     uint32_t refresh = 0;
     uint32_t expiration = 0;
@@ -510,6 +791,9 @@ recycle_drop_sig:
         } else {
             /* All rules ok, recycle signature */
             reusedsigs += 1;
+            if (!*expire || expiration < *expire) {
+                *expire = expiration;
+            }
         }
     }
     return reusedsigs;
@@ -606,6 +890,62 @@ rrset2rrlist(rrset_type* rrset)
 }
 
 
+/**
+ * Get the canonical wire format of the RRset to sign, encoding it if
+ * it is not cached or the TTLs changed. Returns NULL if nothing is to
+ * be signed, with status set on failure.
+ *
+ */
+static hsm_rrset_wire_t*
+rrset2wire(rrset_type* rrset, ods_status* status)
+{
+    ldns_rr_list* rr_list = NULL;
+    uint32_t min_ttl = 0;
+    int found = 0;
+    size_t i = 0;
+
+    *status = ODS_STATUS_OK;
+    /* All RRs are signed with the same TTL, the smallest, as other
+     * software seems to do this. We do not need to publish these TTLs.
+     * TTLs may be changed without changing the RRs, so check it. */
+    for (i=0; i < rrset->rr_count; i++) {
+        if (!rrset->rrs[i].exists) {
+            continue;
+        }
+        if (!found || ldns_rr_ttl(rrset->rrs[i].rr) < min_ttl) {
+            min_ttl = ldns_rr_ttl(rrset->rrs[i].rr);
+        }
+        found = 1;
+        if (rrset->rrtype == LDNS_RR_TYPE_CNAME ||
+            rrset->rrtype == LDNS_RR_TYPE_DNAME) {
+            /* singleton types */
+            break;
+        }
+    }
+    if (rrset->wire && rrset->wire->ttl == min_ttl) {
+        return rrset->wire;
+    }
+    rrset_wire_clear(rrset);
+    /* Transmogrify rrset */
+    rr_list = rrset2rrlist(rrset);
+    if (!rr_list) {
+        *status = ODS_STATUS_MALLOC_ERR;
+        return NULL;
+    }
+    if (ldns_rr_list_rr_count(rr_list) <= 0) {
+        /* Empty RRset, no signatures needed */
+        ldns_rr_list_free(rr_list);
+        return NULL;
+    }
+    rrset->wire = hsm_rrset_wire_new(rr_list, min_ttl);
+    ldns_rr_list_free(rr_list);
+    if (!rrset->wire) {
+        *status = ODS_STATUS_ERR;
+    }
+    return rrset->wire;
+}
+
+
 /**
  * Calculate the signature validation period.
  *
@@ -646,23 +986,57 @@ rrset_sigvalid_period(signconf_type* sc, ldns_rr_type rrtype, time_t signtime,
 }
 
 
+/**
+ * Add new signature to RRset, and to the outgoing IXFR.
+ *
+ */
+static void
+rrset_add_signature(zone_type* zone, rrset_type* rrset, key_type* key,
+    ldns_rr* rrsig)
+{
+    const char* locator = NULL;
+    /* ixfr +RRSIG, before the RRset owns the signature */
+    if (zone->db->is_initialized) {
+        pthread_mutex_lock(&zone->ixfr->ixfr_lock);
+        ixfr_add_rr(zone->ixfr, rrsig);
+        pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
+    }
+    locator = strdup(key->locator);
+    rrset_add_rrsig(rrset, rrsig, locator, key->flags);
+}
+
+
 /**
  * Sign RRset.
  *
  */
 ods_status
 rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
+{
+    return rrset_sign_submit(ctx, NULL, rrset, signtime, NULL, NULL);
+}
+
+
+/**
+ * Sign RRset, or submit its signatures.
+ *
+ */
+ods_status
+rrset_sign_submit(hsm_ctx_t* ctx, hsm_sign_queue_t* queue, rrset_type* rrset,
+    time_t signtime, void* arg, int* nsubmitted)
 {
     ods_status status;
     zone_type* zone = NULL;
     uint32_t newsigs = 0;
     uint32_t reusedsigs = 0;
     ldns_rr* rrsig = NULL;
-    ldns_rr_list* rr_list = NULL;
-    ldns_rr_list* rr_list_clone = NULL;
-    const char* locator = NULL;
+    hsm_rrset_wire_t* wire = NULL;
+    rrsig_request_type* request = NULL;
+    uint16_t queued[256];
     time_t inception = 0;
     time_t expiration = 0;
+    uint32_t expire = 0;
+    uint32_t keysigs = 0;
     size_t i = 0, j;
     domain_type* domain = NULL;
     ldns_rr_type dstatus = LDNS_RR_TYPE_FIRST;
@@ -672,6 +1046,13 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
 
     ods_log_assert(ctx);
     ods_log_assert(rrset);
+    if (nsubmitted) {
+        *nsubmitted = 0;
+    }
+    if (queue) {
+        /* signatures not added yet, by algorithm */
+        memset(queued, 0, sizeof(queued));
+    }
     zone = (zone_type*) rrset->zone;
     ods_log_assert(zone);
     ods_log_assert(zone->signconf);
@@ -685,7 +1066,7 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
         dstatus = domain_is_occluded(domain);
         delegpt = domain_is_delegpt(domain);
     }
-    reusedsigs = rrset_recycle(rrset, signtime, dstatus, delegpt);
+    reusedsigs = rrset_recycle(rrset, signtime, dstatus, delegpt, &expire);
     rrset->needs_signing = 0;
 
     ods_log_assert(rrset->rrs);
@@ -707,28 +1088,14 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
         "sign RRset", LOG_DEEEBUG);
     ods_log_assert(dstatus == LDNS_RR_TYPE_SOA ||
         (delegpt == LDNS_RR_TYPE_SOA || rrset->rrtype == LDNS_RR_TYPE_DS));
-    /* Transmogrify rrset */
-    rr_list = rrset2rrlist(rrset);
-    if (ldns_rr_list_rr_count(rr_list) <= 0) {
-        /* Empty RRset, no signatures needed */
-        ldns_rr_list_free(rr_list);
-        return ODS_STATUS_OK;
-    }
-    /* Use rr_list_clone for signing, keep the original rr_list untouched for case preservation */
-    rr_list_clone = ldns_rr_list_clone(rr_list);
-
-    /* Further in the code the ORIG_TTL field for the signature will be set
-     * to the TTL of the first RR in the list. We must make sure all RR's
-     * have the same TTL when signing. We do not need to publish these TTLs.
-     * We find the smallest TTL as other software seems to do this.
-     **/
-    uint32_t min_ttl = ldns_rr_ttl(ldns_rr_list_rr(rr_list_clone, 0));
-    for (i = 1; i < ldns_rr_list_rr_count(rr_list_clone); i++) {
-        uint32_t rr_ttl = ldns_rr_ttl(ldns_rr_list_rr(rr_list_clone, i));
-        if (rr_ttl < min_ttl) min_ttl = rr_ttl;
-    }
-    for (i = 0; i < ldns_rr_list_rr_count(rr_list_clone); i++) {
-        ldns_rr_set_ttl(ldns_rr_list_rr(rr_list_clone, i), min_ttl);
+    /* Canonical wire format, kept with the RRset until it changes */
+    wire = rrset2wire(rrset, &status);
+    if (!wire) {
+        if (status != ODS_STATUS_OK) {
+            ods_log_crit("[%s] unable to sign RRset[%i]: failed to convert "
+                "to wire format", rrset_str, rrset->rrtype);
+        }
+        return status;
     }
 
     /* Calculate signature validity */
@@ -766,6 +1133,9 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
             }
         }
         sigcount = rrset_sigalgo_count(rrset, algorithm);
+        if (queue) {
+            sigcount += queued[algorithm];
+        }
         if (rrset->rrtype != LDNS_RR_TYPE_DNSKEY && sigcount >= keycount)
             continue;
 
@@ -774,29 +1144,45 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
             continue;
         }
 
+        if (queue) {
+            /* Submit the RRset to be signed with this key */
+            ods_log_deeebug("[%s] submitting RRset[%i] for key %s",
+                rrset_str, rrset->rrtype,
+                zone->signconf->keys->keys[i].locator);
+            CHECKALLOC(request = (rrsig_request_type*)
+                malloc(sizeof(rrsig_request_type)));
+            request->rrset = rrset;
+            request->key = &zone->signconf->keys->keys[i];
+            request->arg = arg;
+            status = lhsm_sign_submit(queue, ctx, wire,
+                &zone->signconf->keys->keys[i], zone->apex, inception,
+                expiration, request);
+            if (status != ODS_STATUS_OK) {
+                ods_log_crit("[%s] unable to sign RRset[%i]: "
+                    "lhsm_sign_submit() failed", rrset_str, rrset->rrtype);
+                free(request);
+                return ODS_STATUS_HSM_ERR;
+            }
+            queued[algorithm]++;
+            *nsubmitted += 1;
+            keysigs++;
+            continue;
+        }
         /* Sign the RRset with this key */
         ods_log_deeebug("[%s] signing RRset[%i] with key %s", rrset_str,
             rrset->rrtype, zone->signconf->keys->keys[i].locator);
-        rrsig = lhsm_sign(ctx, rr_list_clone, &zone->signconf->keys->keys[i],
+        rrsig = lhsm_sign(ctx, wire, &zone->signconf->keys->keys[i],
             zone->apex, inception, expiration);
         if (!rrsig) {
             ods_log_crit("[%s] unable to sign RRset[%i]: lhsm_sign() failed",
                 rrset_str, rrset->rrtype);
-            ldns_rr_list_free(rr_list);
-            ldns_rr_list_free(rr_list_clone);
             return ODS_STATUS_HSM_ERR;
         }
         /* Add signature */
-        locator = strdup(zone->signconf->keys->keys[i].locator);
-        rrset_add_rrsig(rrset, rrsig, locator,
-            zone->signconf->keys->keys[i].flags);
+        rrset_add_signature(zone, rrset, &zone->signconf->keys->keys[i],
+            rrsig);
         newsigs++;
-        /* ixfr +RRSIG */
-        if (zone->db->is_initialized) {
-            pthread_mutex_lock(&zone->ixfr->ixfr_lock);
-            ixfr_add_rr(zone->ixfr, rrsig);
-            pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
-        }
+        keysigs++;
     }
     if(rrset->rrtype == LDNS_RR_TYPE_DNSKEY && zone->signconf->dnskey_signature) {
         for(i=0; zone->signconf->dnskey_signature[i]; i++) {
@@ -804,30 +1190,77 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
             if ((status = rrset_getliteralrr(&rrsig, zone->signconf->dnskey_signature[i], duration2time(zone->signconf->dnskey_ttl), zone->apex)) != ODS_STATUS_OK) {
                     ods_log_error("[%s] unable to publish dnskeys for zone %s: "
                             "error decoding literal dnskey", rrset_str, zone->name);
-                    ldns_rr_list_deep_free(rr_list_clone);
                     return status;
             }
-            /* Add signature */
-            rrset_add_rrsig(rrset, rrsig, NULL, 0);
-            newsigs++;
             /* ixfr +RRSIG */
             if (zone->db->is_initialized) {
                 pthread_mutex_lock(&zone->ixfr->ixfr_lock);
                 ixfr_add_rr(zone->ixfr, rrsig);
                 pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
             }
+            /* Add signature */
+            rrset_add_rrsig(rrset, rrsig, NULL, 0);
+            newsigs++;
         }
     }
     /* RRset signing completed */
-    ldns_rr_list_free(rr_list);
-    ldns_rr_list_deep_free(rr_list_clone);
+    if (keysigs && (!expire || (uint32_t) expiration < expire)) {
+        expire = (uint32_t) expiration;
+    }
     pthread_mutex_lock(&zone->stats->stats_lock);
     if (rrset->rrtype == LDNS_RR_TYPE_SOA) {
         zone->stats->sig_soa_count += newsigs;
     }
     zone->stats->sig_count += newsigs;
     zone->stats->sig_reuse += reusedsigs;
+    if (expire && (!zone->stats->sig_expire ||
+        expire < zone->stats->sig_expire)) {
+        zone->stats->sig_expire = expire;
+    }
     pthread_mutex_unlock(&zone->stats->stats_lock);
+    (void) pthread_once(&rrset_metrics_once, rrset_metrics_init);
+    metrics_count(rrset_signatures, newsigs);
+    metrics_count(rrset_reused, reusedsigs);
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Wait for a submitted signature, and add it to its RRset.
+ *
+ */
+ods_status
+rrset_sign_complete(hsm_ctx_t* ctx, hsm_sign_queue_t* queue, void** arg)
+{
+    rrsig_request_type* request = NULL;
+    zone_type* zone = NULL;
+    ldns_rr* rrsig = NULL;
+
+    ods_log_assert(ctx);
+    ods_log_assert(queue);
+    *arg = NULL;
+    rrsig = lhsm_sign_complete(queue, ctx, (void**) &request);
+    if (!request) {
+        return ODS_STATUS_UNCHANGED;
+    }
+    *arg = request->arg;
+    if (!rrsig) {
+        ods_log_crit("[%s] unable to sign RRset[%i]: lhsm_sign_complete() "
+            "failed", rrset_str, request->rrset->rrtype);
+        free(request);
+        return ODS_STATUS_HSM_ERR;
+    }
+    zone = (zone_type*) request->rrset->zone;
+    rrset_add_signature(zone, request->rrset, request->key, rrsig);
+    pthread_mutex_lock(&zone->stats->stats_lock);
+    if (request->rrset->rrtype == LDNS_RR_TYPE_SOA) {
+        zone->stats->sig_soa_count++;
+    }
+    zone->stats->sig_count++;
+    pthread_mutex_unlock(&zone->stats->stats_lock);
+    (void) pthread_once(&rrset_metrics_once, rrset_metrics_init);
+    metrics_count(rrset_signatures, 1);
+    free(request);
     return ODS_STATUS_OK;
 }
 
@@ -856,7 +1289,7 @@ rrset_print(FILE* fd, rrset_type* rrset, int skip_rrsigs,
     ods_status* status)
 {
     rrsig_type* rrsig;
-    uint16_t i = 0;
+    size_t i = 0;
     ods_status result = ODS_STATUS_OK;
 
     if (!rrset || !fd) {
@@ -911,18 +1344,18 @@ rrset_print(FILE* fd, rrset_type* rrset, int skip_rrsigs,
 void
 rrset_cleanup(rrset_type* rrset)
 {
-    uint16_t i = 0;
+    size_t i = 0;
     if (!rrset) {
        return;
     }
-    rrset_cleanup(rrset->next);
-    rrset->next = NULL;
     rrset->domain = NULL;
     for (i=0; i < rrset->rr_count; i++) {
         ldns_rr_free(rrset->rrs[i].rr);
         rrset->rrs[i].owner = NULL;
     }
     collection_destroy(&rrset->rrsigs);
+    hsm_rrset_wire_free(rrset->wire);
+    free(rrset->rr_index);
     free(rrset->rrs);
     free(rrset);
 }
@@ -33,10 +33,12 @@
 typedef struct rrsig_struct rrsig_type;
 typedef struct rr_struct rr_type;
 typedef struct rrset_struct rrset_type;
+typedef struct rrsig_request_struct rrsig_request_type;
 
 #include "status.h"
 #include "signer/stats.h"
 #include "libhsm.h"
+#include "libhsmdns.h"
 #include "domain.h"
 #include "zone.h"
 #include "datastructure.h"
@@ -48,22 +50,49 @@ struct rrsig_struct {
     uint32_t key_flags;
 };
 
+/**
+ * Signature submitted for an RRset.
+ *
+ */
+struct rrsig_request_struct {
+    rrset_type* rrset;
+    struct key_struct* key;
+    void* arg;
+};
+
+/**
+ * RRsets with at least this many RRs are looked up through a hash index.
+ *
+ */
+#define RRSET_INDEX_THRESHOLD 32
+
+/**
+ * Slot size of the slab RRSIG store. Fits an RRSIG of an RSA-2048 or
+ * ECDSA key with its locator; larger ones take more slots.
+ *
+ */
+#define RRSET_STORE_SLOTSIZE 512
+
 struct rr_struct {
     ldns_rr* rr;
     domain_type* owner;
+    uint32_t hash; /* RDATA hash, only set when the RRset is indexed */
     unsigned exists : 1;
     unsigned is_added : 1;
     unsigned is_removed : 1;
 };
 
 struct rrset_struct {
-    rrset_type* next;
     zone_type* zone;
     domain_type* domain;
     ldns_rr_type rrtype;
     rr_type* rrs;
     size_t rr_count;
+    size_t rr_alloc;
+    size_t* rr_index; /* open addressing, RR number + 1, 0 if empty */
+    size_t rr_index_size;
     collection_t rrsigs;
+    hsm_rrset_wire_t* wire;
     unsigned needs_signing : 1;
 };
 
@@ -141,10 +170,11 @@ rr_type* rrset_add_rr(rrset_type* rrset, ldns_rr* rr);
  * \param[in] rrnum position of RR
  *
  */
-void rrset_del_rr(rrset_type* rrset, uint16_t rrnum);
+void rrset_del_rr(rrset_type* rrset, size_t rrnum);
 
 /**
- * Add RRSIG to RRset.
+ * Add RRSIG to RRset. The RRset owns the RRSIG and the locator afterwards,
+ * a slab store frees them right away.
  * \param[in] rrset RRset
  * \param[in] rr RRSIG
  * \param[in] locator key locator
@@ -181,6 +211,33 @@ void rrset_diff(rrset_type* rrset, unsigned is_ixfr, unsigned more_coming);
  */
 ods_status rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime);
 
+/**
+ * Sign RRset, submitting the signatures to the queue instead of waiting
+ * for them. They are added to the RRset by rrset_sign_complete().
+ * \param[in] ctx HSM context
+ * \param[in] queue sign queue, NULL to sign synchronously
+ * \param[in] rrset RRset
+ * \param[in] signtime time when the zone is being signed
+ * \param[in] arg returned by rrset_sign_complete() for each signature
+ * \param[out] nsubmitted number of signatures submitted
+ * \return ods_status status
+ *
+ */
+ods_status rrset_sign_submit(hsm_ctx_t* ctx, hsm_sign_queue_t* queue,
+    rrset_type* rrset, time_t signtime, void* arg, int* nsubmitted);
+
+/**
+ * Wait for a submitted signature and add it to its RRset.
+ * \param[in] ctx HSM context
+ * \param[in] queue sign queue
+ * \param[out] arg arg given to rrset_sign_submit(), NULL if no
+ *              signature was outstanding
+ * \return ods_status status
+ *
+ */
+ods_status rrset_sign_complete(hsm_ctx_t* ctx, hsm_sign_queue_t* queue,
+    void** arg);
+
 /**
  * Obtain a resource record (containing a signature of a dnskeyset or
  * a dnskeyset, but that is not a hard requirement), from a raw string
@@ -217,6 +274,19 @@ void rrset_cleanup(rrset_type* rrset);
  */
 void rrset_backup2(FILE* fd, rrset_type* rrset);
 
+/**
+ * Create an in memory store for RRSIGs.
+ * \return collection_class the store
+ *
+ */
 collection_class rrset_store_initialize(void);
 
+/**
+ * Create a store that keeps RRSIGs in a memory mapped slab file.
+ * \param[in] filename slab file
+ * \return collection_class the store, NULL if the file could not be created
+ *
+ */
+collection_class rrset_store_initialize_slab(const char* filename);
+
 #endif /* SIGNER_RRSET_H */
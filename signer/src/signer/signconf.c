@@ -50,6 +50,7 @@ signconf_create(void)
     CHECKALLOC(sc = (signconf_type*) malloc(sizeof(signconf_type)));
     sc->filename = NULL;
     sc->passthrough = 0;
+    sc->slab_store = 0;
     /* Signatures */
     sc->sig_resign_interval = NULL;
     sc->sig_refresh_interval = NULL;
@@ -106,6 +107,7 @@ signconf_read(signconf_type* signconf, const char* scfile)
     if (fd) {
         signconf->filename = strdup(scfile);
         signconf->passthrough = parse_sc_passthrough(scfile);
+        signconf->slab_store = parse_sc_signature_store_slab(scfile);
         signconf->sig_resign_interval = parse_sc_sig_resign_interval(scfile);
         signconf->sig_refresh_interval = parse_sc_sig_refresh_interval(scfile);
         signconf->sig_validity_default = parse_sc_sig_validity_default(scfile);
@@ -236,6 +238,8 @@ signconf_backup(FILE* fd, signconf_type* sc, const char* version)
     fprintf(fd, "serial %s ", sc->soa_serial?sc->soa_serial:"(null)");
     if (strcmp(version, ODS_SE_FILE_MAGIC_V2) == 0) {
         fprintf(fd, "audit 0");
+    } else if (strcmp(version, ODS_SE_FILE_MAGIC_V1)) {
+        fprintf(fd, "store %s ", sc->slab_store?"slab":"memory");
     }
     fprintf(fd, "\n");
 }
@@ -415,13 +419,14 @@ signconf_log(signconf_type* sc, const char* name)
         soamin = duration2string(sc->soa_min);
         /* signconf */
         ods_log_info("[%s] zone %s signconf: RESIGN[%s] REFRESH[%s] "
-            "%sVALIDITY[%s] DENIAL[%s] KEYSET[%s] JITTER[%s] OFFSET[%s] NSEC[%i] "
+            "%s%sVALIDITY[%s] DENIAL[%s] KEYSET[%s] JITTER[%s] OFFSET[%s] NSEC[%i] "
             "DNSKEYTTL[%s] SOATTL[%s] MINIMUM[%s] SERIAL[%s]",
             sc_str,
             name?name:"(null)",
             resign?resign:"(null)",
             refresh?refresh:"(null)",
             sc->passthrough?"PASSTHROUGH ":"",
+            sc->slab_store?"SLABSTORE ":"",
             validity?validity:"(null)",
             denial?denial:"(null)",
             keyset?keyset:"(null)",
@@ -42,6 +42,7 @@ struct signconf_struct {
     /* Zone */
     const char* name;
     int passthrough;
+    int slab_store; /* keep RRSIGs in a slab file */
     /* Signatures */
     duration_type* sig_resign_interval;
     duration_type* sig_refresh_interval;
@@ -63,6 +63,7 @@ stats_clear(stats_type* stats)
     stats->sig_soa_count = 0;
     stats->sig_reuse = 0;
     stats->sig_time = 0;
+    stats->sig_expire = 0;
     stats->start_time = 0;
     stats->end_time = 0;
 }
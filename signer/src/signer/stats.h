@@ -57,6 +57,7 @@ struct stats_struct {
     uint32_t    sig_soa_count;
     uint32_t    sig_reuse;
     time_t      sig_time;
+    uint32_t    sig_expire; /* earliest expiration of the RRSIGs, 0 if none */
     time_t      audit_time;
     time_t      start_time;
     time_t      end_time;
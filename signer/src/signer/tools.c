@@ -76,6 +76,7 @@ tools_signconf(zone_type* zone)
             zone->name);
         zone->signconf = new_signconf;
         signconf_log(zone->signconf, zone->name);
+        zone_switch_rrstore(zone);
         zone->default_ttl = (uint32_t) duration2time(zone->signconf->soa_min);
     } else if (status != ODS_STATUS_UNCHANGED) {
         ods_log_error("[%s] unable to load signconf for zone %s: %s",
@@ -237,7 +238,7 @@ tools_output(zone_type* zone, engine_type* engine)
                 /** error */
                 ods_log_error("[%s] notify nameserver failed: execv() failed "
                     "(%s)", tools_str, strerror(errno));
-                exit(1);
+                _exit(1);
                 break;
             default: /* parent */
                 ods_log_debug("[%s] notify nameserver process forked",
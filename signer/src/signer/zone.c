@@ -113,6 +113,7 @@ zone_create(char* name, ldns_rr_class klass)
         return NULL;
     }
     zone->zoneconfigvalid = 0;
+    zone->sig_deadline = 0;
     zone->signconf = signconf_create();
     if (!zone->signconf) {
         ods_log_error("[%s] unable to create zone %s: signconf_create() "
@@ -122,9 +123,49 @@ zone_create(char* name, ldns_rr_class klass)
     }
     zone->stats = stats_create();
     zone->rrstore = rrset_store_initialize();
+    zone->rrstore_slab = 0;
     return zone;
 }
 
+
+/**
+ * Switch the RRSIG store of the zone.
+ *
+ */
+void
+zone_switch_rrstore(zone_type* zone)
+{
+    collection_class klass = NULL;
+    char* filename = NULL;
+    int slab;
+
+    ods_log_assert(zone);
+    ods_log_assert(zone->signconf);
+    slab = zone->signconf->slab_store;
+    if (slab == zone->rrstore_slab) {
+        return;
+    }
+    if (slab) {
+        filename = ods_build_path(zone->name, ".rrsigs", 0, 1);
+        klass = rrset_store_initialize_slab(filename);
+        free(filename);
+        if (!klass) {
+            ods_log_error("[%s] unable to create slab signature store for "
+                "zone %s, keeping signatures in memory", zone_str,
+                zone->name);
+            return;
+        }
+    } else {
+        klass = rrset_store_initialize();
+    }
+    namedb_move_rrsigs(zone->db, klass);
+    collection_class_destroy(&zone->rrstore);
+    zone->rrstore = klass;
+    zone->rrstore_slab = slab;
+    ods_log_info("[%s] zone %s keeps signatures %s", zone_str, zone->name,
+        slab ? "in a slab file" : "in memory");
+}
+
 /**
  * Load signer configuration for zone.
  *
@@ -412,7 +453,7 @@ zone_prepare_keys(zone_type* zone)
     for (i=0; i < zone->signconf->keys->count; i++) {
         if(zone->signconf->dnskey_signature != NULL && zone->signconf->keys->keys[i].ksk)
             continue;
-        /* get dnskey */
+        /* resolve key and get dnskey */
         status = lhsm_get_key(ctx, zone->apex, &zone->signconf->keys->keys[i], 0);
         if (status != ODS_STATUS_OK) {
             ods_log_error("[%s] unable to prepare signing keys for zone %s: "
@@ -803,6 +844,7 @@ zone_recover2(engine_type* engine, zone_type* zone)
     uint32_t inbound = 0, internal = 0, outbound = 0;
     /* signconf part */
     time_t lastmod = 0;
+    long offset = 0;
     /* nsec3params part */
     const char* salt = NULL;
 
@@ -891,6 +933,22 @@ zone_recover2(engine_type* engine, zone_type* zone)
                 "error", zone_str, zone->name);
             goto recover_error2;
         }
+        /* signature store, absent in older backup files */
+        offset = ftell(fd);
+        if (backup_read_check_str(fd, "store")) {
+            if (!backup_read_str(fd, &token)) {
+                ods_log_error("[%s] corrupted backup file zone %s: read "
+                    "signature store error", zone_str, zone->name);
+                goto recover_error2;
+            }
+            zone->signconf->slab_store = (ods_strcmp(token, "slab") == 0);
+            free((void*) token);
+            token = NULL;
+        } else if (offset < 0 || fseek(fd, offset, SEEK_SET) != 0) {
+            ods_log_error("[%s] corrupted backup file zone %s: read signconf "
+                "error", zone_str, zone->name);
+            goto recover_error2;
+        }
         /* nsec3params part */
         if (zone->signconf->nsec_type == LDNS_RR_TYPE_NSEC3) {
             if (!backup_read_check_str(fd, ";;Nsec3parameters:") |
@@ -962,6 +1020,8 @@ zone_recover2(engine_type* engine, zone_type* zone)
                 ods_status2str(status));
             goto recover_error2;
         }
+        /* the signatures read below go to the configured store */
+        zone_switch_rrstore(zone);
         /* publish other records */
         status = backup_read_namedb(fd, zone);
         if (status != ODS_STATUS_OK) {
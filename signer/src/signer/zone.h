@@ -87,7 +87,9 @@ struct zone_struct {
     pthread_mutex_t xfr_lock;
     /* backing store for rrsigs (both domain as denial) */
     collection_class rrstore;
+    int rrstore_slab; /* rrstore is a slab file */
     int zoneconfigvalid; /* flag indicating whether the signconf has at least once been read */
+    time_t sig_deadline; /* first RRSIG refresh after the last sign, 0 if unknown */
 };
 
 
@@ -100,6 +102,14 @@ struct zone_struct {
  */
 zone_type* zone_create(char* name, ldns_rr_class klass);
 
+/**
+ * Switch the RRSIG store of the zone to the one its signer configuration
+ * asks for, moving over the RRSIGs the zone has.
+ * \param[in] zone zone
+ *
+ */
+void zone_switch_rrstore(zone_type* zone);
+
 /**
  * Load signer configuration for zone.
  * \param[in] zone zone
@@ -154,7 +164,8 @@ ods_status zone_publish_nsec3param(zone_type* zone);
 void zone_rollback_nsec3param(zone_type* zone);
 
 /**
- * Prepare keys for signing.
+ * Prepare keys for signing. This resolves the keys in the HSM, so that
+ * the drudgers sign without looking them up.
  * \param[in] zone zone
  * \return ods_status status
  *
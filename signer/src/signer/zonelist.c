@@ -219,6 +219,37 @@ zonelist_add_zone(zonelist_type* zlist, zone_type* zone)
 }
 
 
+/**
+ * Add or update zone.
+ *
+ */
+zone_type*
+zonelist_update_zone(zonelist_type* zlist, zone_type* zone)
+{
+    zone_type* z1 = NULL;
+    if (!zone) {
+        return NULL;
+    }
+    if (!zlist || !zlist->zones) {
+        zone_cleanup(zone);
+        return NULL;
+    }
+    z1 = zonelist_lookup_zone(zlist, zone);
+    if (!z1) {
+        return zonelist_add_zone(zlist, zone);
+    }
+    zone_merge(z1, zone);
+    zone_cleanup(zone);
+    if (z1->zl_status == ZONE_ZL_UPDATED) {
+        zlist->just_updated++;
+    }
+    if (z1->zl_status != ZONE_ZL_ADDED) {
+        z1->zl_status = ZONE_ZL_UPDATED;
+    }
+    return z1;
+}
+
+
 /**
  * Delete zone.
  *
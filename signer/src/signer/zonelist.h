@@ -89,6 +89,15 @@ zone_type* zonelist_lookup_zone_by_dname(zonelist_type* zonelist,
  */
 zone_type* zonelist_add_zone(zonelist_type* zl, zone_type* zone);
 
+/**
+ * Add zone, or merge its settings into the zone already present.
+ * \param[in] zl zone list
+ * \param[in] zone zone, owned by the zone list after the call
+ * \return zone_type* added or updated zone
+ *
+ */
+zone_type* zonelist_update_zone(zonelist_type* zl, zone_type* zone);
+
 /**
  * Delete zone.
  * \param[in] zl zone list
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/**
+ * ACL lookup benchmark.
+ *
+ * Builds a large ACL of single addresses, subnets and ranges, checks that
+ * the compiled ACL gives the same answers as the list and reports the
+ * lookups per second of both.
+ *
+ */
+
+#include "config.h"
+#include "log.h"
+#include "wire/acl.h"
+#include "test/bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define ACLBENCH_ENTRIES 1000
+#define ACLBENCH_LOOKUPS 1000000
+
+static acl_type*
+aclbench_create_acl(int entries)
+{
+    acl_type* head = NULL;
+    acl_type* tail = NULL;
+    acl_type* acl = NULL;
+    char address[64];
+    int i;
+    for (i = 0; i < entries; i++) {
+        switch (i % 4) {
+            case 0:
+                snprintf(address, sizeof(address), "192.0.%d.%d",
+                    (i/256)%256, i%256);
+                break;
+            case 1:
+                snprintf(address, sizeof(address), "10.%d.%d.0/24",
+                    (i/256)%256, i%256);
+                break;
+            case 2:
+                snprintf(address, sizeof(address),
+                    "172.16.%d.10-172.16.%d.200", i%256, i%256);
+                break;
+            case 3:
+            default:
+                snprintf(address, sizeof(address), "2001:db8::%x", i);
+                break;
+        }
+        acl = acl_create(address, NULL, NULL, NULL);
+        if (!acl) {
+            fprintf(stderr, "unable to create acl %s\n", address);
+            exit(1);
+        }
+        if (tail) {
+            tail->next = acl;
+        } else {
+            head = acl;
+        }
+        tail = acl;
+    }
+    return head;
+}
+
+static void
+aclbench_create_addr(struct sockaddr_storage* addr, int i)
+{
+    char ip[64];
+    memset(addr, 0, sizeof(struct sockaddr_storage));
+    if (i % 4 == 3) {
+        struct sockaddr_in6* addr6 = (struct sockaddr_in6*) addr;
+        snprintf(ip, sizeof(ip), "2001:db8::%x", i);
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(53);
+        inet_pton(AF_INET6, ip, &addr6->sin6_addr);
+    } else {
+        struct sockaddr_in* addr4 = (struct sockaddr_in*) addr;
+        switch (i % 4) {
+            case 0:
+                snprintf(ip, sizeof(ip), "192.0.%d.%d", (i/256)%256, i%256);
+                break;
+            case 1:
+                snprintf(ip, sizeof(ip), "10.%d.%d.%d", (i/256)%256, i%256,
+                    i%251);
+                break;
+            case 2:
+            default:
+                snprintf(ip, sizeof(ip), "172.16.%d.%d", i%256, i%256);
+                break;
+        }
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(53);
+        inet_pton(AF_INET, ip, &addr4->sin_addr);
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    acl_type* acl = NULL;
+    acl_index_type* index = NULL;
+    tsig_rr_type* trr = NULL;
+    struct sockaddr_storage* addrs = NULL;
+    struct timeval start;
+    int entries = ACLBENCH_ENTRIES;
+    int lookups = ACLBENCH_LOOKUPS;
+    int naddrs, i, mismatch = 0;
+    size_t found = 0;
+    double secs;
+
+    if (argc > 1) {
+        entries = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        lookups = atoi(argv[2]);
+    }
+    if (entries <= 0 || lookups <= 0) {
+        fprintf(stderr, "usage: %s [entries [lookups]]\n", argv[0]);
+        return 1;
+    }
+    ods_log_init("aclbench", 0, NULL, 0);
+    acl = aclbench_create_acl(entries);
+    /* every other address misses */
+    naddrs = entries * 2;
+    CHECKALLOC(addrs = (struct sockaddr_storage*) malloc(naddrs *
+        sizeof(struct sockaddr_storage)));
+    for (i = 0; i < naddrs; i++) {
+        aclbench_create_addr(&addrs[i], i);
+    }
+    trr = tsig_rr_create();
+
+    gettimeofday(&start, NULL);
+    index = acl_index_create(acl);
+    printf("compile %d entries: %.3f ms\n", entries,
+        bench_elapsed(&start) * 1000.0);
+
+    for (i = 0; i < naddrs; i++) {
+        if (acl_find(acl, &addrs[i], trr) !=
+            acl_index_find(index, &addrs[i], trr)) {
+            mismatch++;
+        }
+    }
+    if (mismatch) {
+        fprintf(stderr, "%d lookups differ between list and index\n",
+            mismatch);
+        return 1;
+    }
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < lookups; i++) {
+        if (acl_find(acl, &addrs[i % naddrs], trr)) {
+            found++;
+        }
+    }
+    secs = bench_elapsed(&start);
+    printf("acl_find:       %12.0f lookups/s (%lu hits)\n",
+        lookups / secs, (unsigned long) found);
+
+    found = 0;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < lookups; i++) {
+        if (acl_index_find(index, &addrs[i % naddrs], trr)) {
+            found++;
+        }
+    }
+    secs = bench_elapsed(&start);
+    printf("acl_index_find: %12.0f lookups/s (%lu hits)\n",
+        lookups / secs, (unsigned long) found);
+
+    tsig_rr_cleanup(trr);
+    acl_index_cleanup(index);
+    acl_cleanup(acl);
+    free(addrs);
+    return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+/**
+ * Large RRset benchmark.
+ *
+ * Loads a zone with a single TXT RRset of many RRs, loads it again
+ * unchanged, and removes half of it as an IXFR would, reporting the time
+ * each step takes. Every step looks up each RR in the RRset.
+ *
+ */
+
+#include "config.h"
+#include "log.h"
+#include "signer/zone.h"
+#include "test/bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define RRSETBENCH_RECORDS 50000
+
+static ldns_rr*
+rrsetbench_create_rr(int i)
+{
+    ldns_rr* rr = NULL;
+    char str[128];
+    snprintf(str, sizeof(str),
+        "big.example.com. 3600 IN TXT \"record %d of the large rrset\"", i);
+    if (ldns_rr_new_frm_str(&rr, str, 0, NULL, NULL) != LDNS_STATUS_OK) {
+        fprintf(stderr, "unable to create rr %s\n", str);
+        exit(1);
+    }
+    return rr;
+}
+
+static void
+rrsetbench_report(const char* step, int records, struct timeval* start)
+{
+    double secs = bench_elapsed(start);
+    printf("%-16s %8d RRs %10.3f s %12.0f RRs/s\n", step, records, secs,
+        records / secs);
+}
+
+static size_t
+rrsetbench_count(zone_type* zone, ldns_rdf* owner)
+{
+    rrset_type* rrset = zone_lookup_rrset(zone, owner, LDNS_RR_TYPE_TXT);
+    return rrset ? rrset->rr_count : 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+    char name[] = "example.com";
+    zone_type* zone = NULL;
+    ldns_rdf* owner = NULL;
+    ldns_rr* rr = NULL;
+    struct timeval start;
+    int records = RRSETBENCH_RECORDS;
+    int i;
+    ods_status status;
+
+    if (argc > 1) {
+        records = atoi(argv[1]);
+    }
+    if (records <= 0) {
+        fprintf(stderr, "usage: %s [records]\n", argv[0]);
+        return 1;
+    }
+    ods_log_init("rrsetbench", 0, NULL, 0);
+    zone = zone_create(name, LDNS_RR_CLASS_IN);
+    owner = ldns_dname_new_frm_str("big.example.com.");
+    if (!zone || !owner) {
+        fprintf(stderr, "unable to create zone\n");
+        return 1;
+    }
+
+    /* initial load */
+    gettimeofday(&start, NULL);
+    for (i = 0; i < records; i++) {
+        status = zone_add_rr(zone, rrsetbench_create_rr(i), 1);
+        if (status != ODS_STATUS_OK) {
+            fprintf(stderr, "unable to add rr %d: %s\n", i,
+                ods_status2str(status));
+            return 1;
+        }
+    }
+    namedb_diff(zone->db, 0, 0);
+    rrsetbench_report("load", records, &start);
+
+    /* reload, every RR already exists */
+    gettimeofday(&start, NULL);
+    for (i = 0; i < records; i++) {
+        rr = rrsetbench_create_rr(i);
+        status = zone_add_rr(zone, rr, 1);
+        if (status != ODS_STATUS_UNCHANGED) {
+            fprintf(stderr, "rr %d not found on reload: %s\n", i,
+                ods_status2str(status));
+            return 1;
+        }
+        ldns_rr_free(rr);
+    }
+    namedb_diff(zone->db, 0, 0);
+    rrsetbench_report("reload", records, &start);
+    if (rrsetbench_count(zone, owner) != (size_t) records) {
+        fprintf(stderr, "rrset has %lu RRs after reload, expected %d\n",
+            (unsigned long) rrsetbench_count(zone, owner), records);
+        return 1;
+    }
+
+    /* ixfr, remove every other RR */
+    gettimeofday(&start, NULL);
+    for (i = 0; i < records; i += 2) {
+        rr = rrsetbench_create_rr(i);
+        status = zone_del_rr(zone, rr, 1);
+        if (status != ODS_STATUS_OK) {
+            fprintf(stderr, "unable to delete rr %d: %s\n", i,
+                ods_status2str(status));
+            return 1;
+        }
+        ldns_rr_free(rr);
+    }
+    namedb_diff(zone->db, 1, 0);
+    rrsetbench_report("ixfr delete", (records + 1) / 2, &start);
+    if (rrsetbench_count(zone, owner) != (size_t) records / 2) {
+        fprintf(stderr, "rrset has %lu RRs after ixfr, expected %d\n",
+            (unsigned long) rrsetbench_count(zone, owner), records / 2);
+        return 1;
+    }
+
+    ldns_rdf_deep_free(owner);
+    zone_cleanup(zone);
+    return 0;
+}
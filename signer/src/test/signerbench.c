@@ -0,0 +1,458 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * End-to-end signer benchmark.
+ *
+ * Loads a zonefile (for example one made by generate-zonefile), adds
+ * NSEC or NSEC3 records, signs it and writes it out, all in-process and
+ * against the HSM of the given configuration. A software keystore
+ * repository keeps the HSM out of the measurement. Prints the time and
+ * number of allocations of each phase, the signing rate and the peak
+ * resident set size as key=value lines.
+ *
+ */
+
+#include "config.h"
+#include "log.h"
+#include "duration.h"
+#include "libhsm.h"
+#include "adapter/adapter.h"
+#include "adapter/adfile.h"
+#include "parser/confparser.h"
+#include "signer/zone.h"
+#include "test/bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+struct signerbench_thread {
+    pthread_t thread;
+    rrset_type** rrsets;
+    size_t count;
+    size_t first;
+    size_t step;
+    time_t signtime;
+    ods_status status;
+};
+
+static unsigned long signerbench_allocs = 0;
+
+#ifdef __GLIBC__
+/**
+ * Count allocations, passing them on to the C library.
+ *
+ */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+void*
+malloc(size_t size)
+{
+    __atomic_fetch_add(&signerbench_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void*
+calloc(size_t nmemb, size_t size)
+{
+    __atomic_fetch_add(&signerbench_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void*
+realloc(void* ptr, size_t size)
+{
+    __atomic_fetch_add(&signerbench_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void
+free(void* ptr)
+{
+    __libc_free(ptr);
+}
+#endif
+
+static unsigned long
+signerbench_allocations(void)
+{
+    return __atomic_load_n(&signerbench_allocs, __ATOMIC_RELAXED);
+}
+
+static void
+signerbench_begin(struct timeval* start, unsigned long* allocs)
+{
+    *allocs = signerbench_allocations();
+    gettimeofday(start, NULL);
+}
+
+static double
+signerbench_report(const char* phase, struct timeval* start,
+    unsigned long allocs)
+{
+    double secs = bench_elapsed(start);
+    printf("%s_seconds=%.6f\n", phase, secs);
+    printf("%s_allocations=%lu\n", phase, signerbench_allocations() - allocs);
+    return secs;
+}
+
+static void
+usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s -c conf.xml [-r repository] [-a 8|13] "
+        "[-b bits] [-3] [-O] [-i iterations] [-t threads] [-o output] "
+        "zonefile zonename\n", prog);
+}
+
+static duration_type*
+signerbench_duration(const char* str)
+{
+    duration_type* duration = duration_create_from_string(str);
+    if (!duration) {
+        fprintf(stderr, "unable to create duration %s\n", str);
+        exit(1);
+    }
+    return duration;
+}
+
+/**
+ * Generate a key and push it on the key list of the signconf.
+ *
+ */
+static void
+signerbench_key(hsm_ctx_t* ctx, const char* repository, signconf_type* sc,
+    uint8_t algorithm, unsigned long bits, int ksk, libhsm_key_t** key)
+{
+    if (algorithm == LDNS_ECDSAP256SHA256) {
+        *key = hsm_generate_ecdsa_key(ctx, repository, "P-256");
+    } else {
+        *key = hsm_generate_rsa_key(ctx, repository, bits);
+    }
+    if (!*key) {
+        fprintf(stderr, "unable to generate key in repository %s\n",
+            repository);
+        exit(1);
+    }
+    keylist_push(sc->keys, hsm_get_key_id(ctx, *key), NULL, algorithm,
+        (ksk ? LDNS_KEY_ZONE_KEY | LDNS_KEY_SEP_KEY : LDNS_KEY_ZONE_KEY), 1,
+        ksk, !ksk);
+}
+
+/**
+ * Collect the RRsets to sign, in the order the signer queues them.
+ *
+ */
+static rrset_type**
+signerbench_rrsets(zone_type* zone, size_t* count)
+{
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    domain_type* domain = NULL;
+    denial_type* denial = NULL;
+    rrset_type** rrsets = NULL;
+    size_t size = 1024;
+    uint16_t i;
+    *count = 0;
+    CHECKALLOC(rrsets = (rrset_type**) malloc(size * sizeof(rrset_type*)));
+    if (zone->db->domains->root != LDNS_RBTREE_NULL) {
+        node = ldns_rbtree_first(zone->db->domains);
+    }
+    while (node && node != LDNS_RBTREE_NULL) {
+        domain = (domain_type*) node->data;
+        if (*count + domain->rrset_count + 1 > size) {
+            size = 2 * (*count + domain->rrset_count + 1);
+            CHECKALLOC(rrsets = (rrset_type**) realloc(rrsets,
+                size * sizeof(rrset_type*)));
+        }
+        for (i = 0; i < domain->rrset_count; i++) {
+            rrsets[(*count)++] = domain->rrsets[i];
+        }
+        denial = (denial_type*) domain->denial;
+        if (denial && denial->rrset) {
+            rrsets[(*count)++] = denial->rrset;
+        }
+        node = ldns_rbtree_next(node);
+    }
+    return rrsets;
+}
+
+static void*
+signerbench_sign(void* arg)
+{
+    struct signerbench_thread* thread = (struct signerbench_thread*) arg;
+    hsm_ctx_t* ctx = hsm_create_context();
+    ods_status status;
+    size_t i;
+    thread->status = ODS_STATUS_OK;
+    if (!ctx) {
+        thread->status = ODS_STATUS_HSM_ERR;
+        return NULL;
+    }
+    for (i = thread->first; i < thread->count; i += thread->step) {
+        status = rrset_sign(ctx, thread->rrsets[i], thread->signtime);
+        if (status != ODS_STATUS_OK) {
+            thread->status = status;
+            break;
+        }
+    }
+    hsm_destroy_context(ctx);
+    return NULL;
+}
+
+int
+main(int argc, char* argv[])
+{
+    const char* cfgfile = NULL;
+    const char* repository = NULL;
+    const char* output = NULL;
+    char* outfile = NULL;
+    char name[256];
+    hsm_repository_t* repositories = NULL;
+    hsm_ctx_t* ctx = NULL;
+    libhsm_key_t* ksk = NULL;
+    libhsm_key_t* zsk = NULL;
+    zone_type* zone = NULL;
+    signconf_type* sc = NULL;
+    struct signerbench_thread* threads = NULL;
+    rrset_type** rrsets = NULL;
+    size_t count = 0;
+    struct timeval start;
+    struct rusage usage_self;
+    unsigned long allocs;
+    unsigned long bits = 2048;
+    uint8_t algorithm = LDNS_RSASHA256;
+    int nsec3 = 0, optout = 0, iterations = 5;
+    int nthreads = 1;
+    uint32_t nadded = 0;
+    double secs;
+    FILE* fd = NULL;
+    ods_status status;
+    int ch, i;
+
+    while ((ch = getopt(argc, argv, "3a:b:c:i:o:Or:t:")) != -1) {
+        switch (ch) {
+            case '3':
+                nsec3 = 1;
+                break;
+            case 'a':
+                algorithm = (uint8_t) atoi(optarg);
+                break;
+            case 'b':
+                bits = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                cfgfile = optarg;
+                break;
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'O':
+                optout = 1;
+                break;
+            case 'r':
+                repository = optarg;
+                break;
+            case 't':
+                nthreads = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (!cfgfile || argc - optind != 2 || nthreads < 1 ||
+        (algorithm != LDNS_RSASHA256 && algorithm != LDNS_ECDSAP256SHA256)) {
+        usage(argv[0]);
+        return 1;
+    }
+    ods_log_init("signerbench", 0, NULL, 0);
+
+    /* open the hsm and generate the keys */
+    repositories = parse_conf_repositories(cfgfile);
+    if (!repositories || hsm_open2(repositories, hsm_prompt_pin) != HSM_OK) {
+        char* error = hsm_get_error(NULL);
+        fprintf(stderr, "unable to open hsm: %s\n", error ? error : "");
+        free(error);
+        return 1;
+    }
+    if (!repository) {
+        repository = repositories->name;
+    }
+    ctx = hsm_create_context();
+    if (!ctx) {
+        fprintf(stderr, "unable to create hsm context\n");
+        return 1;
+    }
+
+    /* a signconf as the enforcer would write it */
+    snprintf(name, sizeof(name), "%s", argv[optind + 1]);
+    zone = zone_create(name, LDNS_RR_CLASS_IN);
+    if (!zone) {
+        fprintf(stderr, "unable to create zone %s\n", argv[optind + 1]);
+        return 1;
+    }
+    sc = zone->signconf;
+    sc->sig_resign_interval = signerbench_duration("PT2H");
+    sc->sig_refresh_interval = signerbench_duration("P3D");
+    sc->sig_validity_default = signerbench_duration("P7D");
+    sc->sig_validity_denial = signerbench_duration("P7D");
+    sc->sig_jitter = signerbench_duration("PT12H");
+    sc->sig_inception_offset = signerbench_duration("PT3600S");
+    sc->dnskey_ttl = signerbench_duration("PT3600S");
+    sc->soa_ttl = signerbench_duration("PT3600S");
+    sc->soa_min = signerbench_duration("PT3600S");
+    CHECKALLOC(sc->soa_serial = strdup("unixtime"));
+    sc->nsec_type = LDNS_RR_TYPE_NSEC;
+    if (nsec3) {
+        sc->nsec_type = LDNS_RR_TYPE_NSEC3;
+        sc->nsec3param_ttl = signerbench_duration("PT0S");
+        sc->nsec3_optout = optout;
+        sc->nsec3_algo = 1;
+        sc->nsec3_iterations = iterations;
+        CHECKALLOC(sc->nsec3_salt = strdup("aabbccdd"));
+        sc->nsec3params = nsec3params_create((void*) sc,
+            (uint8_t) sc->nsec3_algo, (uint8_t) sc->nsec3_optout,
+            (uint16_t) sc->nsec3_iterations, sc->nsec3_salt);
+        if (!sc->nsec3params) {
+            fprintf(stderr, "unable to create nsec3 parameters\n");
+            return 1;
+        }
+    }
+    sc->keys = keylist_create((void*) sc);
+    signerbench_key(ctx, repository, sc, algorithm, bits, 1, &ksk);
+    signerbench_key(ctx, repository, sc, algorithm, bits, 0, &zsk);
+    sc->last_modified = time(NULL);
+    if (output) {
+        CHECKALLOC(outfile = strdup(output));
+    } else {
+        outfile = ods_build_path(argv[optind], ".signed", 0, 0);
+    }
+    zone->adinbound = adapter_create(argv[optind], ADAPTER_FILE, 1);
+    zone->adoutbound = adapter_create(outfile, ADAPTER_FILE, 0);
+    printf("zone=%s\n", zone->name);
+    printf("algorithm=%u\n", (unsigned) algorithm);
+    printf("denial=%s\n", nsec3 ? "nsec3" : "nsec");
+    printf("threads=%d\n", nthreads);
+
+    /* load */
+    signerbench_begin(&start, &allocs);
+    status = zone_publish_dnskeys(zone, 0);
+    if (status == ODS_STATUS_OK) {
+        status = zone_publish_nsec3param(zone);
+    }
+    if (status == ODS_STATUS_OK) {
+        fd = ods_fopen(argv[optind], NULL, "r");
+        status = fd ? adfile_read_file(fd, zone) : ODS_STATUS_FOPEN_ERR;
+        ods_fclose(fd);
+    }
+    if (status != ODS_STATUS_OK) {
+        fprintf(stderr, "unable to load zone: %s\n", ods_status2str(status));
+        return 1;
+    }
+    namedb_diff(zone->db, 0, 0);
+    signerbench_report("load", &start, allocs);
+
+    /* nsecify */
+    signerbench_begin(&start, &allocs);
+    namedb_nsecify(zone->db, &nadded);
+    signerbench_report("nsecify", &start, allocs);
+    printf("denial_records=%lu\n", (unsigned long) nadded);
+
+    /* sign */
+    signerbench_begin(&start, &allocs);
+    status = zone_update_serial(zone);
+    if (status == ODS_STATUS_OK) {
+        status = zone_prepare_keys(zone);
+    }
+    if (status != ODS_STATUS_OK) {
+        fprintf(stderr, "unable to prepare zone for signing: %s\n",
+            ods_status2str(status));
+        return 1;
+    }
+    rrsets = signerbench_rrsets(zone, &count);
+    CHECKALLOC(threads = (struct signerbench_thread*) calloc(nthreads,
+        sizeof(struct signerbench_thread)));
+    for (i = 0; i < nthreads; i++) {
+        threads[i].rrsets = rrsets;
+        threads[i].count = count;
+        threads[i].first = i;
+        threads[i].step = nthreads;
+        threads[i].signtime = time(NULL);
+        pthread_create(&threads[i].thread, NULL, signerbench_sign,
+            &threads[i]);
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        if (threads[i].status != ODS_STATUS_OK) {
+            status = threads[i].status;
+        }
+    }
+    if (status != ODS_STATUS_OK) {
+        fprintf(stderr, "unable to sign zone: %s\n", ods_status2str(status));
+        return 1;
+    }
+    secs = signerbench_report("sign", &start, allocs);
+    printf("rrsets=%lu\n", (unsigned long) count);
+    printf("signatures=%lu\n", (unsigned long) zone->stats->sig_count);
+    printf("signatures_per_second=%.0f\n",
+        secs > 0 ? zone->stats->sig_count / secs : 0.0);
+
+    /* write */
+    signerbench_begin(&start, &allocs);
+    status = adfile_write(zone, outfile);
+    if (status != ODS_STATUS_OK) {
+        fprintf(stderr, "unable to write zone: %s\n", ods_status2str(status));
+        return 1;
+    }
+    signerbench_report("write", &start, allocs);
+
+    getrusage(RUSAGE_SELF, &usage_self);
+    printf("peak_rss_kb=%ld\n", (long) usage_self.ru_maxrss);
+
+    /* remove the keys again */
+    hsm_remove_key(ctx, ksk);
+    hsm_remove_key(ctx, zsk);
+    libhsm_key_free(ksk);
+    libhsm_key_free(zsk);
+    hsm_destroy_context(ctx);
+    free(threads);
+    free(rrsets);
+    free(outfile);
+    zone_cleanup(zone);
+    hsm_close();
+    hsm_repository_free(repositories);
+    return 0;
+}
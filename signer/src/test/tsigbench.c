@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/**
+ * TSIG throughput benchmark.
+ *
+ * Signs a stream of messages the way an outgoing zone transfer does,
+ * for every HMAC algorithm that is available, and reports the number
+ * of signed messages per second. Before that, it checks that digests
+ * computed from the cached key state match a one-shot HMAC.
+ *
+ */
+
+#include "config.h"
+#include "log.h"
+#include "wire/buffer.h"
+#include "wire/tsig.h"
+#include "wire/tsig-openssl.h"
+#include "test/bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#ifdef HAVE_SSL
+
+#define TSIGBENCH_MESSAGES 100000
+#define TSIGBENCH_MSGSIZE 16384
+#define TSIGBENCH_SECRET "K2tf3TRjvQkVCmJF3/Z9vA=="
+
+static const char* tsigbench_algos[] = {
+    "hmac-md5", "hmac-sha1", "hmac-sha256", "hmac-sha384", "hmac-sha512",
+    NULL
+};
+
+/**
+ * Compare digests from the algorithm interface with a one-shot HMAC.
+ *
+ */
+static int
+tsigbench_check(tsig_algo_type* algo, tsig_key_type* key,
+    buffer_type* buffer)
+{
+    uint8_t digest[EVP_MAX_MD_SIZE];
+    uint8_t expect[EVP_MAX_MD_SIZE];
+    unsigned int expect_size = 0;
+    size_t size;
+    void* context = NULL;
+    int i;
+    HMAC((const EVP_MD*) algo->data, key->data, (int) key->size,
+        buffer_begin(buffer), buffer_limit(buffer), expect, &expect_size);
+    for (i = 0; i < 3; i++) {
+        context = algo->hmac_create();
+        algo->hmac_init(context, algo, key);
+        algo->hmac_update(context, buffer_begin(buffer),
+            buffer_limit(buffer));
+        size = sizeof(digest);
+        algo->hmac_final(context, digest, &size);
+        algo->hmac_release(context);
+        if (size != expect_size || memcmp(digest, expect, size) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+main(int argc, char* argv[])
+{
+    tsig_type* tsig = NULL;
+    tsig_algo_type* algo = NULL;
+    tsig_rr_type* trr = NULL;
+    buffer_type* buffer = NULL;
+    struct timeval start;
+    int messages = TSIGBENCH_MESSAGES;
+    int msgsize = TSIGBENCH_MSGSIZE;
+    int i, j;
+    double secs;
+
+    if (argc > 1) {
+        messages = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        msgsize = atoi(argv[2]);
+    }
+    if (messages <= 0 || msgsize < 12 || msgsize > 65535) {
+        fprintf(stderr, "usage: %s [messages [message size]]\n", argv[0]);
+        return 1;
+    }
+    ods_log_init("tsigbench", 0, NULL, 0);
+    if (tsig_handler_init() != ODS_STATUS_OK) {
+        fprintf(stderr, "unable to initialize tsig handler\n");
+        return 1;
+    }
+    buffer = buffer_create(msgsize);
+    for (i = 0; i < msgsize; i++) {
+        buffer_write_u8(buffer, (uint8_t) i);
+    }
+    buffer_flip(buffer);
+    buffer_pkt_set_qr(buffer);
+
+    for (i = 0; tsigbench_algos[i]; i++) {
+        algo = tsig_lookup_algo(tsigbench_algos[i]);
+        if (!algo) {
+            printf("%-12s not available\n", tsigbench_algos[i]);
+            continue;
+        }
+        tsig = tsig_create("bench.key.", (char*) tsigbench_algos[i],
+            TSIGBENCH_SECRET);
+        if (!tsig) {
+            fprintf(stderr, "unable to create tsig key\n");
+            return 1;
+        }
+        if (!tsigbench_check(algo, tsig->key, buffer)) {
+            fprintf(stderr, "%s: digest mismatch\n", tsigbench_algos[i]);
+            return 1;
+        }
+        trr = tsig_rr_create();
+        gettimeofday(&start, NULL);
+        for (j = 0; j < messages; j++) {
+            if (j % 100 == 0) {
+                /* new transfer */
+                tsig_rr_reset(trr, algo, tsig->key);
+                trr->key_name = ldns_rdf_clone(tsig->key->dname);
+                trr->algo_name = ldns_rdf_clone(algo->wf_name);
+                trr->status = TSIG_OK;
+            }
+            tsig_rr_prepare(trr);
+            tsig_rr_update(trr, buffer, buffer_limit(buffer));
+            tsig_rr_sign(trr);
+        }
+        secs = bench_elapsed(&start);
+        printf("%-12s %10.0f messages/s %8.1f MB/s\n", tsigbench_algos[i],
+            messages / secs, messages / secs * msgsize / (1024.0*1024.0));
+        tsig_rr_cleanup(trr);
+        tsig_cleanup(tsig);
+    }
+    buffer_cleanup(buffer);
+    tsig_handler_cleanup();
+    return 0;
+}
+
+#else /* HAVE_SSL */
+
+int
+main(void)
+{
+    fprintf(stderr, "tsigbench: built without OpenSSL\n");
+    return 0;
+}
+
+#endif /* HAVE_SSL */
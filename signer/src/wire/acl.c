@@ -243,22 +243,26 @@ acl_addr_matches_range(uint32_t* minval, uint32_t* x, uint32_t* maxval,
     size_t i = 0;
     uint8_t checkmin = 1;
     uint8_t checkmax = 1;
+    uint32_t lo, hi, val;
     ods_log_assert(sz % 4 == 0);
-    /* check treats x as one huge number */
+    /* check treats x as one huge number, in network byte order */
     sz /= 4;
     for (i=0; i<sz; ++i) {
+        lo = ntohl(minval[i]);
+        hi = ntohl(maxval[i]);
+        val = ntohl(x[i]);
         /* if outside bounds, we are done */
-        if (checkmin && minval[i] > x[i]) {
+        if (checkmin && lo > val) {
             return 0;
         }
-        if (checkmax && maxval[i] < x[i]) {
+        if (checkmax && hi < val) {
             return 0;
         }
         /* if x is equal to a bound, that bound needs further checks */
-        if (checkmin && minval[i] != x[i]) {
+        if (checkmin && lo != val) {
             checkmin = 0;
         }
-        if (checkmax && maxval[i]!=x[i]) {
+        if (checkmax && hi != val) {
             checkmax = 0;
         }
         if (!checkmin && !checkmax) {
@@ -448,6 +452,366 @@ acl_find(acl_type* acl, struct sockaddr_storage* addr, tsig_rr_type* trr)
 }
 
 
+/**
+ * Compiled ACL.
+ *
+ * Every address family gets a binary trie on the address bits. An ACL
+ * entry hangs off the node at the depth of its prefix, together with its
+ * position in the original list, so that a lookup only has to visit the
+ * nodes on the path of the remote address and can still return the first
+ * entry that acl_find() would return. Masks that are not a prefix can not
+ * be put in the trie, those entries are matched the old way.
+ *
+ */
+typedef struct acl_entry_struct acl_entry_type;
+struct acl_entry_struct {
+    acl_entry_type* next;
+    acl_type* acl;
+    size_t order;
+};
+
+typedef struct acl_node_struct acl_node_type;
+struct acl_node_struct {
+    acl_node_type* child[2];
+    acl_entry_type* entries;
+    acl_entry_type* last;
+};
+
+struct acl_index_struct {
+    acl_type* acl;
+    acl_node_type* root4;
+    acl_node_type* root6;
+    acl_entry_type* other;
+    acl_entry_type* other_last;
+    size_t count;
+    size_t nodes;
+};
+
+#define ACL_ADDR_BIT(a, i) (((a)[(i)/8] >> (7 - ((i)%8))) & 1)
+
+
+/**
+ * Create compiled ACL entry.
+ *
+ */
+static acl_entry_type*
+acl_entry_create(acl_type* acl, size_t order)
+{
+    acl_entry_type* entry = NULL;
+    CHECKALLOC(entry = (acl_entry_type*) malloc(sizeof(acl_entry_type)));
+    entry->next = NULL;
+    entry->acl = acl;
+    entry->order = order;
+    return entry;
+}
+
+
+/**
+ * Create compiled ACL node.
+ *
+ */
+static acl_node_type*
+acl_node_create(acl_index_type* index)
+{
+    acl_node_type* node = NULL;
+    CHECKALLOC(node = (acl_node_type*) calloc(1, sizeof(acl_node_type)));
+    index->nodes++;
+    return node;
+}
+
+
+/**
+ * Add prefix to compiled ACL. Entries are added in list order, so the
+ * entries on a node stay sorted.
+ *
+ */
+static void
+acl_index_add_prefix(acl_index_type* index, acl_node_type* root,
+    const uint8_t* prefix, int len, acl_type* acl, size_t order)
+{
+    acl_node_type* node = root;
+    acl_entry_type* entry = NULL;
+    int i, bit;
+    for (i = 0; i < len; i++) {
+        bit = ACL_ADDR_BIT(prefix, i);
+        if (!node->child[bit]) {
+            node->child[bit] = acl_node_create(index);
+        }
+        node = node->child[bit];
+    }
+    if (node->last && node->last->acl == acl) {
+        return;
+    }
+    entry = acl_entry_create(acl, order);
+    if (node->last) {
+        node->last->next = entry;
+    } else {
+        node->entries = entry;
+    }
+    node->last = entry;
+}
+
+
+/**
+ * Length of contiguous mask, -1 if the mask is not a prefix.
+ *
+ */
+static int
+acl_mask_prefixlen(const uint8_t* mask, int bits)
+{
+    int len = 0;
+    int i;
+    while (len < bits && ACL_ADDR_BIT(mask, len)) {
+        len++;
+    }
+    for (i = len; i < bits; i++) {
+        if (ACL_ADDR_BIT(mask, i)) {
+            return -1;
+        }
+    }
+    return len;
+}
+
+
+/**
+ * Add address range to compiled ACL, broken up in prefixes.
+ *
+ */
+static void
+acl_index_add_range(acl_index_type* index, acl_node_type* root,
+    const uint8_t* lo, const uint8_t* hi, int bits, acl_type* acl,
+    size_t order)
+{
+    uint8_t cur[16];
+    uint8_t end[16];
+    uint8_t next[16];
+    int bytes = bits/8;
+    int host, i;
+    if (memcmp(lo, hi, bytes) > 0) {
+        return;
+    }
+    memcpy(cur, lo, bytes);
+    while (1) {
+        /* largest aligned block starting at cur that does not pass hi */
+        memcpy(end, cur, bytes);
+        host = 0;
+        while (host < bits && !ACL_ADDR_BIT(cur, bits-1-host)) {
+            memcpy(next, end, bytes);
+            i = bits-1-host;
+            next[i/8] |= (uint8_t) (1 << (7 - (i%8)));
+            if (memcmp(next, hi, bytes) > 0) {
+                break;
+            }
+            memcpy(end, next, bytes);
+            host++;
+        }
+        acl_index_add_prefix(index, root, cur, bits-host, acl, order);
+        if (memcmp(end, hi, bytes) >= 0) {
+            return;
+        }
+        /* cur = end + 1 */
+        memcpy(cur, end, bytes);
+        for (i = bytes-1; i >= 0; i--) {
+            if (++cur[i] != 0) {
+                break;
+            }
+        }
+    }
+}
+
+
+/**
+ * Add entry to the list of entries that are matched linearly.
+ *
+ */
+static void
+acl_index_add_other(acl_index_type* index, acl_type* acl, size_t order)
+{
+    acl_entry_type* entry = acl_entry_create(acl, order);
+    if (index->other_last) {
+        index->other_last->next = entry;
+    } else {
+        index->other = entry;
+    }
+    index->other_last = entry;
+}
+
+
+/**
+ * Compile ACL.
+ *
+ */
+acl_index_type*
+acl_index_create(acl_type* acl)
+{
+    acl_index_type* index = NULL;
+    acl_node_type* root = NULL;
+    acl_type* walk = NULL;
+    const uint8_t* addr = NULL;
+    const uint8_t* mask = NULL;
+    size_t order = 0;
+    int bits, len;
+    CHECKALLOC(index = (acl_index_type*) malloc(sizeof(acl_index_type)));
+    index->acl = acl;
+    index->other = NULL;
+    index->other_last = NULL;
+    index->count = 0;
+    index->nodes = 0;
+    index->root4 = acl_node_create(index);
+    index->root6 = acl_node_create(index);
+    for (walk = acl; walk; walk = walk->next, order++) {
+        index->count++;
+        if (!walk->address) {
+            /* all addresses match */
+            acl_index_add_prefix(index, index->root4, NULL, 0, walk, order);
+            acl_index_add_prefix(index, index->root6, NULL, 0, walk, order);
+            continue;
+        }
+        if (walk->family == AF_INET6) {
+            root = index->root6;
+            addr = (const uint8_t*) &walk->addr.addr6;
+            mask = (const uint8_t*) &walk->range_mask.addr6;
+            bits = 128;
+        } else {
+            root = index->root4;
+            addr = (const uint8_t*) &walk->addr.addr;
+            mask = (const uint8_t*) &walk->range_mask.addr;
+            bits = 32;
+        }
+        switch (walk->range_type) {
+            case ACL_RANGE_MASK:
+            case ACL_RANGE_SUBNET:
+                len = acl_mask_prefixlen(mask, bits);
+                if (len < 0) {
+                    acl_index_add_other(index, walk, order);
+                } else {
+                    acl_index_add_prefix(index, root, addr, len, walk, order);
+                }
+                break;
+            case ACL_RANGE_MINMAX:
+                acl_index_add_range(index, root, addr, mask, bits, walk,
+                    order);
+                break;
+            case ACL_RANGE_SINGLE:
+            default:
+                acl_index_add_prefix(index, root, addr, bits, walk, order);
+                break;
+        }
+    }
+    ods_log_debug("[%s] compiled %lu acl entries into %lu nodes", acl_str,
+        (unsigned long) index->count, (unsigned long) index->nodes);
+    return index;
+}
+
+
+/**
+ * Find ACL in compiled ACL.
+ *
+ */
+acl_type*
+acl_index_find(acl_index_type* index, struct sockaddr_storage* addr,
+    tsig_rr_type* trr)
+{
+    acl_node_type* node = NULL;
+    acl_entry_type* entry = NULL;
+    acl_type* best = NULL;
+    size_t best_order = 0;
+    const uint8_t* ip = NULL;
+    unsigned int port = 0;
+    int bits, i;
+    if (!index || !addr) {
+        return NULL;
+    }
+    if (addr->ss_family == AF_INET6) {
+        struct sockaddr_in6* addr6 = (struct sockaddr_in6*) addr;
+        node = index->root6;
+        ip = (const uint8_t*) &addr6->sin6_addr;
+        port = ntohs(addr6->sin6_port);
+        bits = 128;
+    } else if (addr->ss_family == AF_INET) {
+        struct sockaddr_in* addr4 = (struct sockaddr_in*) addr;
+        node = index->root4;
+        ip = (const uint8_t*) &addr4->sin_addr;
+        port = ntohs(addr4->sin_port);
+        bits = 32;
+    } else {
+        return acl_find(index->acl, addr, trr);
+    }
+    best_order = index->count;
+    for (i = 0; node; i++) {
+        for (entry = node->entries; entry && entry->order < best_order;
+            entry = entry->next) {
+            if (entry->acl->address && entry->acl->port != 0 &&
+                entry->acl->port != port) {
+                continue;
+            }
+            if (acl_tsig_matches(entry->acl, trr)) {
+                best = entry->acl;
+                best_order = entry->order;
+                break;
+            }
+        }
+        node = (i < bits ? node->child[ACL_ADDR_BIT(ip, i)] : NULL);
+    }
+    for (entry = index->other; entry && entry->order < best_order;
+        entry = entry->next) {
+        if (acl_addr_matches(entry->acl, addr) &&
+            acl_tsig_matches(entry->acl, trr)) {
+            best = entry->acl;
+            break;
+        }
+    }
+    if (best) {
+        ods_log_debug("[%s] match %s", acl_str, best->address);
+    }
+    return best;
+}
+
+
+/**
+ * Clean up compiled ACL node.
+ *
+ */
+static void
+acl_node_cleanup(acl_node_type* node)
+{
+    acl_entry_type* entry = NULL;
+    if (!node) {
+        return;
+    }
+    acl_node_cleanup(node->child[0]);
+    acl_node_cleanup(node->child[1]);
+    while (node->entries) {
+        entry = node->entries;
+        node->entries = entry->next;
+        free(entry);
+    }
+    free(node);
+}
+
+
+/**
+ * Clean up compiled ACL.
+ *
+ */
+void
+acl_index_cleanup(acl_index_type* index)
+{
+    acl_entry_type* entry = NULL;
+    if (!index) {
+        return;
+    }
+    acl_node_cleanup(index->root4);
+    acl_node_cleanup(index->root6);
+    while (index->other) {
+        entry = index->other;
+        index->other = entry->next;
+        free(entry);
+    }
+    free(index);
+}
+
+
 /**
  * Clean up ACL.
  *
@@ -71,6 +71,12 @@ struct acl_struct {
     time_t ixfr_disabled;
 };
 
+/**
+ * Compiled ACL.
+ *
+ */
+typedef struct acl_index_struct acl_index_type;
+
 /**
  * Create ACL.
  * \param[in] allocator memory allocator
@@ -95,6 +101,34 @@ acl_type* acl_create(char* address,
 acl_type* acl_find(acl_type* acl, struct sockaddr_storage* addr,
     tsig_rr_type* tsig);
 
+/**
+ * Compile ACL into a prefix trie per address family. Ranges are broken
+ * into prefixes, addresses with a non-contiguous mask are kept aside.
+ * \param[in] acl ACL
+ * \return acl_index_type* compiled ACL
+ *
+ */
+acl_index_type* acl_index_create(acl_type* acl);
+
+/**
+ * Find ACL in compiled ACL. Returns the same ACL as acl_find() would on
+ * the list it was compiled from.
+ * \param[in] index compiled ACL
+ * \param[in] addr remote address storage
+ * \param[in] tsig tsig credentials
+ * \return acl_type* ACL that matches
+ *
+ */
+acl_type* acl_index_find(acl_index_type* index,
+    struct sockaddr_storage* addr, tsig_rr_type* tsig);
+
+/**
+ * Clean up compiled ACL.
+ * \param[in] index compiled ACL
+ *
+ */
+void acl_index_cleanup(acl_index_type* index);
+
 /**
  * Parse family from address.
  * \param[in] a address in string format
@@ -447,6 +447,7 @@ notify_send(notify_type* notify)
             zone->name, notify->secondary->address);
         return;
     }
+    metrics_count(xfrhandler->notify_sent, 1);
     ods_log_verbose("[%s] notify retry %u for zone %s sent to %s", notify_str,
         notify->retry, zone->name, notify->secondary->address);
 }
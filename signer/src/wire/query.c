@@ -37,6 +37,8 @@
 #include "wire/axfr.h"
 #include "wire/query.h"
 
+#include <string.h>
+
 const char* query_str = "query";
 
 
@@ -275,6 +277,7 @@ query_process_notify(query_type* q, ldns_rr_type qtype, engine_type* engine)
     }
     ods_log_assert(engine->dnshandler);
     ods_log_assert(q->zone->name);
+    metrics_count(engine->dnshandler->notify_received, 1);
     ods_log_verbose("[%s] incoming notify for zone %s", query_str,
         q->zone->name);
     if (buffer_pkt_rcode(q->buffer) != LDNS_RCODE_NOERROR ||
@@ -297,7 +300,7 @@ query_process_notify(query_type* q, ldns_rr_type qtype, engine_type* engine)
     }
     ods_log_assert(q->zone->adinbound->config);
     dnsin = (dnsin_type*) q->zone->adinbound->config;
-    if (!acl_find(dnsin->allow_notify, &q->addr, q->tsig_rr)) {
+    if (!acl_index_find(dnsin->allow_notify_index, &q->addr, q->tsig_rr)) {
         if (addr2ip(q->addr, address, sizeof(address))) {
             ods_log_info("[%s] unauthorized notify for zone %s from %s: "
                 "no acl matches", query_str, q->zone->name, address);
@@ -661,7 +664,7 @@ query_process_query(query_type* q, ldns_rr_type qtype, engine_type* engine)
     ods_log_assert(q->zone->adoutbound->config);
     dnsout = (dnsout_type*) q->zone->adoutbound->config;
     /* acl also in use for soa and other queries */
-    if (!acl_find(dnsout->provide_xfr, &q->addr, q->tsig_rr)) {
+    if (!acl_index_find(dnsout->provide_xfr_index, &q->addr, q->tsig_rr)) {
         ods_log_debug("[%s] zone %s acl query refused", query_str,
             q->zone->name);
         return query_refused(q);
@@ -956,6 +959,7 @@ void
 query_add_optional(query_type* q, engine_type* engine)
 {
     edns_data_type* edns = NULL;
+    unsigned char opt[OPT_LEN];
     if (!q || !engine) {
         return;
     }
@@ -967,12 +971,10 @@ query_add_optional(query_type* q, engine_type* engine)
                 break;
             case EDNS_OK:
                 ods_log_debug("[%s] add edns opt ok", query_str);
-                if (q->edns_rr->dnssec_ok) {
-                    edns->ok[7] = 0x80;
-                } else {
-                    edns->ok[7] = 0x00;
-                }
-                buffer_write(q->buffer, edns->ok, OPT_LEN);
+                /* local copy, responses are built on several threads */
+                memcpy(opt, edns->ok, OPT_LEN);
+                opt[7] = q->edns_rr->dnssec_ok ? 0x80 : 0x00;
+                buffer_write(q->buffer, opt, OPT_LEN);
                 /* fill with NULLs */
                 buffer_write(q->buffer, edns->rdata_none, OPT_RDATA);
                 buffer_pkt_set_arcount(q->buffer,
@@ -980,12 +982,9 @@ query_add_optional(query_type* q, engine_type* engine)
                 break;
             case EDNS_ERROR:
                 ods_log_debug("[%s] add edns opt err", query_str);
-                if (q->edns_rr->dnssec_ok) {
-                    edns->ok[7] = 0x80;
-                } else {
-                    edns->ok[7] = 0x00;
-                }
-                buffer_write(q->buffer, edns->error, OPT_LEN);
+                memcpy(opt, edns->error, OPT_LEN);
+                opt[7] = q->edns_rr->dnssec_ok ? 0x80 : 0x00;
+                buffer_write(q->buffer, opt, OPT_LEN);
                 buffer_write(q->buffer, edns->rdata_none, OPT_RDATA);
                 buffer_pkt_set_arcount(q->buffer,
                     buffer_pkt_arcount(q->buffer) + 1);
@@ -612,6 +612,14 @@ sock_handle_tcp_read(netio_type* netio, netio_handler_type* handler,
     ods_log_debug("[%s] TCP_READ: new tcplen %u", sock_str,
         data->query->tcplen);
     data->bytes_transmitted = 0;
+    if ((qstate == QUERY_AXFR || qstate == QUERY_IXFR) &&
+        data->engine->dnshandler->xfrpool) {
+        /* stream the zone transfer from the transfer pool. */
+        netio_remove_handler(netio, handler);
+        xfrpool_submit(data->engine->dnshandler->xfrpool, handler,
+            data->query, qstate);
+        return;
+    }
     handler->timeout->tv_sec = XFRD_TCP_TIMEOUT;
     handler->timeout->tv_nsec = 0L;
     timespec_add(handler->timeout, netio_current_time(netio));
@@ -620,6 +628,41 @@ sock_handle_tcp_read(netio_type* netio, netio_handler_type* handler,
 }
 
 
+/**
+ * Take back tcp connections from the transfer pool.
+ *
+ */
+void
+sock_handle_xfr_done(netio_type* netio, netio_handler_type* handler,
+    netio_events_type event_types)
+{
+    xfrpool_type* pool = (xfrpool_type*) handler->user_data;
+    xfrjob_type* job = NULL;
+    xfrjob_type* next = NULL;
+    netio_handler_type* tcp_handler = NULL;
+    struct tcp_data* data = NULL;
+
+    if (!(event_types & NETIO_EVENT_READ)) {
+        return;
+    }
+    for (job = xfrpool_finished(pool); job; job = next) {
+        next = job->next;
+        tcp_handler = job->handler;
+        data = (struct tcp_data*) tcp_handler->user_data;
+        /* transfer done, wait for the next request. */
+        data->qstate = QUERY_PROCESSED;
+        data->bytes_transmitted = 0;
+        tcp_handler->timeout->tv_sec = XFRD_TCP_TIMEOUT;
+        tcp_handler->timeout->tv_nsec = 0L;
+        timespec_add(tcp_handler->timeout, netio_current_time(netio));
+        tcp_handler->event_types = NETIO_EVENT_READ | NETIO_EVENT_TIMEOUT;
+        tcp_handler->event_handler = sock_handle_tcp_read;
+        netio_add_handler(netio, tcp_handler);
+        free(job);
+    }
+}
+
+
 /**
  * Handle outgoing tcp responses.
  *
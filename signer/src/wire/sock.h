@@ -131,6 +131,17 @@ void sock_handle_tcp_accept(netio_type* netio, netio_handler_type* handler,
 void sock_handle_tcp_read(netio_type* netio, netio_handler_type* handler,
     netio_events_type event_types);
 
+/**
+ * Take back tcp connections from the transfer pool once their zone
+ * transfer is done, and wait for the next query on them.
+ * \param[in] netio network I/O event handler
+ * \param[in] handler event handler, with the transfer pool as user data
+ * \param[in] event_types the types of events that should be checked for
+ *
+ */
+void sock_handle_xfr_done(netio_type* netio, netio_handler_type* handler,
+    netio_events_type event_types);
+
 /**
  * Handle outgoing tcp responses.
  * \param[in] netio network I/O event handler
@@ -32,6 +32,7 @@
 #include "config.h"
 
 #ifdef HAVE_SSL
+#include "locks.h"
 #include "log.h"
 #include "wire/tsig.h"
 #include "wire/tsig-openssl.h"
@@ -39,18 +40,41 @@
 static const char* tsig_str = "tsig-ssl";
 /** helper funcgtions */
 static void *create_context();
+static void release_context(void *context);
 static void init_context(void *context,
                          tsig_algo_type *algorithm,
                          tsig_key_type *key);
 static void update(void *context, const void *data, size_t size);
 static void final(void *context, uint8_t *digest, size_t *size);
 
-typedef struct tsig_cleanup_table_struct tsig_cleanup_table_type;
-struct tsig_cleanup_table_struct {
-    tsig_cleanup_table_type* next;
-    void* cleanup;
+/**
+ * Keyed HMAC state, computed once per key and algorithm. Contexts are
+ * initialized by copying this state, instead of hashing the key pads
+ * for every message.
+ *
+ */
+typedef struct tsig_key_state_struct tsig_key_state_type;
+struct tsig_key_state_struct {
+    tsig_key_state_type* next;
+    tsig_key_state_type* table_next;
+    const EVP_MD* md;
+    HMAC_CTX* context;
+};
+static tsig_key_state_type* tsig_key_state_table = NULL;
+static pthread_mutex_t tsig_key_state_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Released HMAC contexts, kept per thread.
+ *
+ */
+#define TSIG_CONTEXT_POOL_SIZE 8
+typedef struct tsig_context_pool_struct tsig_context_pool_type;
+struct tsig_context_pool_struct {
+    size_t count;
+    HMAC_CTX* contexts[TSIG_CONTEXT_POOL_SIZE];
 };
-static tsig_cleanup_table_type* tsig_cleanup_table = NULL;
+static pthread_key_t tsig_context_pool_key;
+static pthread_once_t tsig_context_pool_once = PTHREAD_ONCE_INIT;
 
 
 /**
@@ -82,6 +106,7 @@ tsig_openssl_init_algorithm(const char* digest, const char* name, const char* wi
     algorithm->max_digest_size = EVP_MAX_MD_SIZE;
     algorithm->data = hmac_algorithm;
     algorithm->hmac_create = create_context;
+    algorithm->hmac_release = release_context;
     algorithm->hmac_init = init_context;
     algorithm->hmac_update = update;
     algorithm->hmac_final = final;
@@ -97,7 +122,6 @@ tsig_openssl_init_algorithm(const char* digest, const char* name, const char* wi
 ods_status
 tsig_handler_openssl_init()
 {
-    tsig_cleanup_table = NULL;
     OpenSSL_add_all_digests();
     ods_log_debug("[%s] add md5", tsig_str);
     if (!tsig_openssl_init_algorithm("md5", "hmac-md5",
@@ -119,46 +143,134 @@ tsig_handler_openssl_init()
         return ODS_STATUS_ERR;
     }
 #endif /* HAVE_EVP_SHA256 */
+
+#ifdef HAVE_EVP_SHA384
+    ods_log_debug("[%s] add sha384", tsig_str);
+    if (!tsig_openssl_init_algorithm("sha384", "hmac-sha384",
+        "hmac-sha384.")) {
+        return ODS_STATUS_ERR;
+    }
+#endif /* HAVE_EVP_SHA384 */
+
+#ifdef HAVE_EVP_SHA512
+    ods_log_debug("[%s] add sha512", tsig_str);
+    if (!tsig_openssl_init_algorithm("sha512", "hmac-sha512",
+        "hmac-sha512.")) {
+        return ODS_STATUS_ERR;
+    }
+#endif /* HAVE_EVP_SHA512 */
     return ODS_STATUS_OK;
 }
 
+static HMAC_CTX*
+new_context(void)
+{
+    HMAC_CTX* context;
+#ifdef HAVE_SSL_NEW_HMAC
+    CHECKALLOC(context = HMAC_CTX_new());
+    HMAC_CTX_reset(context);
+#else
+    CHECKALLOC(context = (HMAC_CTX*) malloc(sizeof(HMAC_CTX)));
+    HMAC_CTX_init(context);
+#endif
+    return context;
+}
+
 static void
-cleanup_context(void *data)
+cleanup_context(HMAC_CTX* context)
 {
-    HMAC_CTX* context = (HMAC_CTX*) data;
 #ifdef HAVE_SSL_NEW_HMAC
     HMAC_CTX_free(context);
 #else
     HMAC_CTX_cleanup(context);
+    free(context);
 #endif
 }
 
 static void
-context_add_cleanup(void* context)
+context_pool_destroy(void* data)
 {
-    tsig_cleanup_table_type* entry = NULL;
-    if (!context) {
-        return;
+    tsig_context_pool_type* pool = (tsig_context_pool_type*) data;
+    while (pool->count > 0) {
+        cleanup_context(pool->contexts[--pool->count]);
+    }
+    free(pool);
+}
+
+static void
+context_pool_init(void)
+{
+    if (pthread_key_create(&tsig_context_pool_key, context_pool_destroy)) {
+        ods_fatal_exit("[%s] unable to create context pool key", tsig_str);
     }
-    CHECKALLOC(entry = (tsig_cleanup_table_type *) malloc(sizeof(tsig_cleanup_table_type)));
-    entry->cleanup = context;
-    entry->next = tsig_cleanup_table;
-    tsig_cleanup_table = entry;
+}
+
+static tsig_context_pool_type*
+context_pool(void)
+{
+    tsig_context_pool_type* pool = NULL;
+    pthread_once(&tsig_context_pool_once, context_pool_init);
+    pool = (tsig_context_pool_type*) pthread_getspecific(tsig_context_pool_key);
+    if (!pool) {
+        CHECKALLOC(pool = (tsig_context_pool_type*) calloc(1, sizeof(tsig_context_pool_type)));
+        pthread_setspecific(tsig_context_pool_key, pool);
+    }
+    return pool;
 }
 
 static void*
 create_context()
 {
-    HMAC_CTX* context;
-#ifdef HAVE_SSL_NEW_HMAC
-    CHECKALLOC(context = HMAC_CTX_new());
-    HMAC_CTX_reset(context);
-#else
-    CHECKALLOC(context = (HMAC_CTX*) malloc(sizeof(HMAC_CTX)));
-    HMAC_CTX_init(context);
-#endif
-    context_add_cleanup(context);
-    return context;
+    tsig_context_pool_type* pool = context_pool();
+    if (pool->count > 0) {
+        return pool->contexts[--pool->count];
+    }
+    return new_context();
+}
+
+static void
+release_context(void* context)
+{
+    tsig_context_pool_type* pool = NULL;
+    if (!context) {
+        return;
+    }
+    pool = context_pool();
+    if (pool->count < TSIG_CONTEXT_POOL_SIZE) {
+        pool->contexts[pool->count++] = (HMAC_CTX*) context;
+        return;
+    }
+    cleanup_context((HMAC_CTX*) context);
+}
+
+/**
+ * Look up the keyed HMAC state of key and digest, compute it if this is
+ * the first time the key is used with this digest.
+ *
+ */
+static HMAC_CTX*
+key_state(tsig_key_type* key, const EVP_MD* md)
+{
+    tsig_key_state_type* state = NULL;
+    pthread_mutex_lock(&tsig_key_state_lock);
+    for (state = (tsig_key_state_type*) key->hmac_state; state;
+        state = state->next) {
+        if (state->md == md) {
+            break;
+        }
+    }
+    if (!state) {
+        CHECKALLOC(state = (tsig_key_state_type*) malloc(sizeof(tsig_key_state_type)));
+        state->md = md;
+        state->context = new_context();
+        HMAC_Init_ex(state->context, key->data, key->size, md, NULL);
+        state->next = (tsig_key_state_type*) key->hmac_state;
+        key->hmac_state = state;
+        state->table_next = tsig_key_state_table;
+        tsig_key_state_table = state;
+    }
+    pthread_mutex_unlock(&tsig_key_state_lock);
+    return state->context;
 }
 
 static void
@@ -166,6 +278,11 @@ init_context(void* context, tsig_algo_type *algorithm, tsig_key_type *key)
 {
     HMAC_CTX* ctx = (HMAC_CTX*) context;
     const EVP_MD* md = (const EVP_MD*) algorithm->data;
+#ifdef HAVE_HMAC_CTX_COPY
+    if (HMAC_CTX_copy(ctx, key_state(key, md))) {
+        return;
+    }
+#endif
     HMAC_Init_ex(ctx, key->data, key->size, md, NULL);
 }
 
@@ -193,11 +310,23 @@ final(void* context, uint8_t* digest, size_t* size)
 void
 tsig_handler_openssl_finalize(void)
 {
-    tsig_cleanup_table_type* entry = tsig_cleanup_table;
+    tsig_key_state_type* state = NULL;
+    tsig_context_pool_type* pool = NULL;
 
-    while (entry) {
-        cleanup_context(entry->cleanup);
-        entry = entry->next;
+    pthread_mutex_lock(&tsig_key_state_lock);
+    while (tsig_key_state_table) {
+        state = tsig_key_state_table;
+        tsig_key_state_table = state->table_next;
+        cleanup_context(state->context);
+        free(state);
+    }
+    pthread_mutex_unlock(&tsig_key_state_lock);
+    /* the pools of other threads are freed when those threads exit */
+    pthread_once(&tsig_context_pool_once, context_pool_init);
+    pool = (tsig_context_pool_type*) pthread_getspecific(tsig_context_pool_key);
+    if (pool) {
+        pthread_setspecific(tsig_context_pool_key, NULL);
+        context_pool_destroy(pool);
     }
     EVP_cleanup();
 }
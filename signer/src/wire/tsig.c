@@ -191,6 +191,7 @@ tsig_key_create(tsig_type* tsig)
     key->dname = dname;
     key->size = size;
     key->data = data;
+    key->hmac_state = NULL;
     tsig_handler_add_key(key);
     return key;
 }
@@ -275,11 +276,34 @@ tsig_rr_create()
     trr->algo_name = NULL;
     trr->mac_data = NULL;
     trr->other_data = NULL;
+    trr->context = NULL;
+    trr->algo = NULL;
+    trr->prior_mac_data = NULL;
     tsig_rr_reset(trr, NULL, NULL);
     return trr;
 }
 
 
+/**
+ * Give back the HMAC context of a TSIG RR.
+ *
+ */
+static void
+tsig_rr_release_context(tsig_rr_type* trr)
+{
+    if (trr->context && trr->algo && trr->algo->hmac_release) {
+        trr->algo->hmac_release(trr->context);
+    }
+    if (trr->mac_data == trr->prior_mac_data) {
+        /* signed, mac points to our digest */
+        trr->mac_data = NULL;
+    }
+    free(trr->prior_mac_data);
+    trr->context = NULL;
+    trr->prior_mac_data = NULL;
+}
+
+
 /**
  * Reset TSIG RR.
  *
@@ -290,16 +314,15 @@ tsig_rr_reset(tsig_rr_type* trr, tsig_algo_type* algo, tsig_key_type* key)
     if (!trr) {
         return;
     }
+    tsig_rr_release_context(trr);
     tsig_rr_free(trr);
     trr->status = TSIG_NOT_PRESENT;
     trr->position = 0;
     trr->response_count = 0;
     trr->update_since_last_prepare = 0;
-    trr->context = NULL;
     trr->algo = algo;
     trr->key = key;
     trr->prior_mac_size = 0;
-    trr->prior_mac_data = NULL;
     trr->signed_time_high = 0;
     trr->signed_time_low = 0;
     trr->signed_time_fudge = 0;
@@ -830,6 +853,7 @@ tsig_rr_cleanup(tsig_rr_type* trr)
     if (!trr) {
         return;
     }
+    tsig_rr_release_context(trr);
     tsig_rr_free(trr);
     free(trr);
 }
@@ -79,6 +79,8 @@ struct tsig_key_struct {
     ldns_rdf* dname;
     size_t size;
     const uint8_t* data;
+    /* keyed HMAC state, owned by the HMAC implementation */
+    void* hmac_state;
 };
 
 /**
@@ -93,6 +95,8 @@ struct tsig_algo_struct {
     const void* data;
     /* create a new HMAC context */
     void*(*hmac_create)(void);
+    /* give back an HMAC context that is no longer used */
+    void(*hmac_release)(void* context);
     /* initialize an HMAC context */
     void(*hmac_init)(void* context, tsig_algo_type* algo,
         tsig_key_type* key);
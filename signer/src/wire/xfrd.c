@@ -345,6 +345,7 @@ xfrd_create(xfrhandler_type* xfrhandler, zone_type* zone)
     xfrd->msg_new_serial = 0;
     xfrd->msg_is_ixfr = 0;
     xfrd->msg_do_retransfer = 0;
+    xfrd->msg_started = 0;
     xfrd->udp_waiting = 0;
     xfrd->udp_waiting_next = NULL;
     xfrd->tcp_waiting = 0;
@@ -1178,6 +1179,7 @@ static xfrd_pkt_status
 xfrd_handle_packet(xfrd_type* xfrd, buffer_type* buffer)
 {
     xfrd_pkt_status res = XFRD_PKT_BAD;
+    xfrhandler_type* xfrhandler = NULL;
     zone_type* zone = NULL;
     ods_log_assert(xfrd);
     ods_log_assert(xfrd->master);
@@ -1185,6 +1187,8 @@ xfrd_handle_packet(xfrd_type* xfrd, buffer_type* buffer)
     zone = (zone_type*) xfrd->zone;
     ods_log_assert(zone);
     ods_log_assert(zone->name);
+    xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
+    metrics_count(xfrhandler->xfr_bytes, buffer_limit(buffer));
     res = xfrd_parse_packet(xfrd, buffer);
     ods_log_debug("[%s] zone %s xfr packet parsed (res %d)", xfrd_str,
         zone->name, res);
@@ -1224,6 +1228,7 @@ xfrd_handle_packet(xfrd_type* xfrd, buffer_type* buffer)
     buffer_flip(buffer);
     /* commit packet */
     xfrd_commit_packet(xfrd);
+    metrics_since(xfrhandler->xfr_latency, xfrd->msg_started);
     /* next time */
     pthread_mutex_lock(&xfrd->serial_lock);
 
@@ -1499,6 +1504,7 @@ xfrd_tcp_xfr(xfrd_type* xfrd, tcp_set_type* set)
     xfrd->msg_old_serial = 0;
     xfrd->msg_new_serial = 0;
     xfrd->msg_is_ixfr = 0;
+    xfrd->msg_started = metrics_clock();
     xfrd_tsig_sign(xfrd, tcp->packet);
     buffer_flip(tcp->packet);
     tcp->msglen = buffer_limit(tcp->packet);
@@ -1712,6 +1718,7 @@ xfrd_udp_send_request_ixfr(xfrd_type* xfrd)
     xfrd->msg_old_serial = 0;
     xfrd->msg_new_serial = 0;
     xfrd->msg_is_ixfr = 0;
+    xfrd->msg_started = metrics_clock();
     buffer_pkt_set_nscount(xfrhandler->packet, 1);
     xfrd_write_soa(xfrd, xfrhandler->packet);
     xfrd_tsig_sign(xfrd, xfrhandler->packet);
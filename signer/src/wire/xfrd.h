@@ -131,6 +131,7 @@ struct xfrd_struct
     size_t msg_rr_count;
     uint8_t msg_is_ixfr;
     uint8_t msg_do_retransfer;
+    uint64_t msg_started;
     tsig_rr_type* tsig_rr;
 
     xfrd_type* tcp_waiting_next;
@@ -0,0 +1,539 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/**
+ * Streaming zone transfers.
+ *
+ */
+
+#include "config.h"
+#include "daemon/engine.h"
+#include "log.h"
+#include "wire/acl.h"
+#include "wire/axfr.h"
+#include "wire/xfrd.h"
+#include "wire/xfrstream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char* xfrstream_str = "xfrstream";
+
+
+/**
+ * Initialize batch.
+ *
+ */
+static void
+xfrbatch_init(xfrbatch_type* batch)
+{
+    size_t i = 0;
+    for (i=0; i < XFRSTREAM_BATCH_SIZE; i++) {
+        CHECKALLOC(batch->packets[i] = buffer_create(PACKET_BUFFER_SIZE));
+    }
+    batch->count = 0;
+    batch->iov_first = 0;
+    batch->iov_count = 0;
+}
+
+
+/**
+ * Reset batch.
+ *
+ */
+static void
+xfrbatch_reset(xfrbatch_type* batch)
+{
+    batch->count = 0;
+    batch->iov_first = 0;
+    batch->iov_count = 0;
+}
+
+
+/**
+ * Move the finished message in the query buffer into the batch. The query
+ * continues with the spare buffer of the batch slot, so the message itself
+ * is never copied. The header is carried over because the next message is
+ * built on top of it.
+ *
+ */
+static void
+xfrbatch_take(xfrbatch_type* batch, query_type* q)
+{
+    buffer_type* packet = q->buffer;
+    size_t i = batch->count;
+    size_t hdrlen = BUFFER_PKT_HEADER_SIZE;
+    ods_log_assert(i < XFRSTREAM_BATCH_SIZE);
+    q->buffer = batch->packets[i];
+    batch->packets[i] = packet;
+    batch->tcplen[i] = htons((uint16_t) buffer_remaining(packet));
+    batch->iov[2*i].iov_base = &batch->tcplen[i];
+    batch->iov[2*i].iov_len = sizeof(uint16_t);
+    batch->iov[2*i+1].iov_base = buffer_current(packet);
+    batch->iov[2*i+1].iov_len = buffer_remaining(packet);
+    batch->count++;
+    batch->iov_count += 2;
+    if (q->startpos > hdrlen && q->startpos <= buffer_capacity(packet)) {
+        hdrlen = q->startpos;
+    }
+    buffer_clear(q->buffer);
+    memcpy(buffer_begin(q->buffer), buffer_begin(packet), hdrlen);
+}
+
+
+/**
+ * Prepare the next messages of the transfer.
+ *
+ */
+static void
+xfrbatch_fill(xfrbatch_type* batch, query_type* q, engine_type* engine,
+    query_state* qstate)
+{
+    while (batch->count < XFRSTREAM_BATCH_SIZE &&
+        *qstate != QUERY_PROCESSED) {
+        if (*qstate == QUERY_IXFR) {
+            *qstate = ixfr(q, engine);
+        } else {
+            *qstate = axfr(q, engine, 0);
+        }
+        if (*qstate == QUERY_PROCESSED) {
+            break;
+        }
+        /* edns, tsig */
+        query_add_optional(q, engine);
+        buffer_flip(q->buffer);
+        xfrbatch_take(batch, q);
+    }
+}
+
+
+/**
+ * Create transfer stream.
+ *
+ */
+static xfrstream_type*
+xfrstream_create(void)
+{
+    xfrstream_type* stream = NULL;
+    CHECKALLOC(stream = (xfrstream_type*) malloc(sizeof(xfrstream_type)));
+    xfrbatch_init(&stream->batch[0]);
+    xfrbatch_init(&stream->batch[1]);
+    stream->active = &stream->batch[0];
+    stream->standby = &stream->batch[1];
+    stream->bytes = 0;
+    stream->messages = 0;
+    stream->writes = 0;
+    return stream;
+}
+
+
+/**
+ * Cork or uncork the connection, so that the kernel sends full segments.
+ *
+ */
+static void
+xfrstream_cork(int fd, int on)
+{
+#if defined(TCP_CORK)
+    if (setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on)) != 0) {
+        ods_log_debug("[%s] unable to set TCP_CORK: %s", xfrstream_str,
+            strerror(errno));
+    }
+#elif defined(TCP_NOPUSH)
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NOPUSH, &on, sizeof(on)) != 0) {
+        ods_log_debug("[%s] unable to set TCP_NOPUSH: %s", xfrstream_str,
+            strerror(errno));
+    }
+#else
+    (void) fd;
+    (void) on;
+#endif
+}
+
+
+/**
+ * Write the active batch.
+ * \return int 1 if the batch is written, 0 if the write would block,
+ *             -1 on error.
+ *
+ */
+static int
+xfrstream_write(xfrstream_type* stream, int fd)
+{
+    xfrbatch_type* batch = stream->active;
+    struct iovec* iov = NULL;
+    ssize_t sent = 0;
+    while (batch->iov_first < batch->iov_count) {
+        sent = writev(fd, &batch->iov[batch->iov_first],
+            (int) (batch->iov_count - batch->iov_first));
+        if (sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            ods_log_error("[%s] unable to handle outgoing tcp response: "
+                "writev() failed (%s)", xfrstream_str, strerror(errno));
+            return -1;
+        } else if (sent == 0) {
+            return -1;
+        }
+        stream->writes++;
+        stream->bytes += (uint64_t) sent;
+        while (sent > 0) {
+            iov = &batch->iov[batch->iov_first];
+            if ((size_t) sent >= iov->iov_len) {
+                sent -= iov->iov_len;
+                iov->iov_len = 0;
+                batch->iov_first++;
+            } else {
+                iov->iov_base = (uint8_t*) iov->iov_base + sent;
+                iov->iov_len -= sent;
+                sent = 0;
+            }
+        }
+    }
+    stream->messages += batch->count;
+    return 1;
+}
+
+
+/**
+ * Log transfer throughput. Returns the time taken in microseconds.
+ *
+ */
+static uint64_t
+xfrstream_log(xfrstream_type* stream, query_type* q, const char* xfr,
+    int done)
+{
+    char address[INET6_ADDRSTRLEN];
+    const char* from = address;
+    struct timeval end;
+    uint64_t usec = 0;
+    uint64_t rate = 0;
+    if (!addr2ip(q->addr, address, sizeof(address))) {
+        from = "unknown";
+    }
+    gettimeofday(&end, NULL);
+    usec = (uint64_t) (end.tv_sec - stream->start.tv_sec) * 1000000 +
+        (end.tv_usec - stream->start.tv_usec);
+    if (usec > 0) {
+        rate = (stream->bytes * 1000000) / usec;
+    }
+    ods_log_info("[%s] %s zone %s to %s %s: %lu messages, %llu bytes in "
+        "%llu.%03llu seconds (%llu bytes/sec, %lu writes)", xfrstream_str,
+        xfr, q->zone?q->zone->name:"(null)", from,
+        done?"done":"aborted", (unsigned long) stream->messages,
+        (unsigned long long) stream->bytes,
+        (unsigned long long) (usec / 1000000),
+        (unsigned long long) ((usec % 1000000) / 1000),
+        (unsigned long long) rate, (unsigned long) stream->writes);
+    return usec;
+}
+
+
+/**
+ * Serve a zone transfer.
+ *
+ */
+static int
+xfrstream_serve(xfrpool_type* pool, xfrstream_type* stream, xfrjob_type* job)
+{
+    query_type* q = job->query;
+    query_state qstate = job->qstate;
+    const char* xfr = (qstate == QUERY_IXFR) ? "ixfr" : "axfr";
+    xfrbatch_type* tmp = NULL;
+    struct pollfd pfd;
+    uint64_t usec = 0;
+    int waited = 0;
+    int status = 0;
+    int done = 0;
+
+    gettimeofday(&stream->start, NULL);
+    stream->bytes = 0;
+    stream->messages = 0;
+    stream->writes = 0;
+    xfrbatch_reset(stream->active);
+    xfrbatch_reset(stream->standby);
+    xfrstream_cork(job->fd, 1);
+    /* the first message was built by the dns handler */
+    xfrbatch_take(stream->active, q);
+    xfrbatch_fill(stream->active, q, pool->engine, &qstate);
+    while (!pool->need_to_exit) {
+        status = xfrstream_write(stream, job->fd);
+        if (status < 0) {
+            break;
+        } else if (status == 0) {
+            /* socket buffer is full, prepare ahead while it drains */
+            if (stream->standby->count == 0 && qstate != QUERY_PROCESSED) {
+                xfrbatch_fill(stream->standby, q, pool->engine, &qstate);
+                continue;
+            }
+            pfd.fd = job->fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            status = poll(&pfd, 1, XFRSTREAM_POLL_INTERVAL);
+            if (status < 0 && errno != EINTR) {
+                ods_log_error("[%s] unable to handle outgoing tcp response: "
+                    "poll() failed (%s)", xfrstream_str, strerror(errno));
+                break;
+            } else if (status == 0) {
+                waited += XFRSTREAM_POLL_INTERVAL;
+                if (waited >= XFRD_TCP_TIMEOUT * 1000) {
+                    ods_log_warning("[%s] %s zone %s timed out",
+                        xfrstream_str, xfr, q->zone->name);
+                    break;
+                }
+            } else {
+                waited = 0;
+            }
+            continue;
+        }
+        /* active batch is written, continue with the standby batch */
+        waited = 0;
+        xfrbatch_reset(stream->active);
+        tmp = stream->active;
+        stream->active = stream->standby;
+        stream->standby = tmp;
+        if (stream->active->count == 0) {
+            xfrbatch_fill(stream->active, q, pool->engine, &qstate);
+            if (stream->active->count == 0) {
+                done = 1;
+                break;
+            }
+        }
+    }
+    xfrstream_cork(job->fd, 0);
+    usec = xfrstream_log(stream, q, xfr, done);
+    metrics_count(pool->xfr_bytes, (unsigned long) stream->bytes);
+    if (done) {
+        metrics_observe(pool->xfr_latency, usec);
+    }
+    return done;
+}
+
+
+/**
+ * Close the connection of a transfer and free it.
+ *
+ */
+static void
+xfrjob_discard(xfrjob_type* job)
+{
+    close(job->fd);
+    query_cleanup(job->query);
+    /* the tcp data holds nothing but the query */
+    free(job->handler->user_data);
+    free(job->handler->timeout);
+    free(job->handler);
+    free(job);
+}
+
+
+/**
+ * Transfer thread.
+ *
+ */
+static void
+xfrpool_run(xfrpool_type* pool)
+{
+    xfrstream_type* stream = xfrstream_create();
+    xfrjob_type* job = NULL;
+    size_t i = 0;
+    while (1) {
+        pthread_mutex_lock(&pool->pool_lock);
+        while (!pool->first && !pool->need_to_exit) {
+            pthread_cond_wait(&pool->pool_cond, &pool->pool_lock);
+        }
+        if (pool->need_to_exit) {
+            pthread_mutex_unlock(&pool->pool_lock);
+            break;
+        }
+        job = pool->first;
+        pool->first = job->next;
+        if (!pool->first) {
+            pool->last = NULL;
+        }
+        pthread_mutex_unlock(&pool->pool_lock);
+        if (!xfrstream_serve(pool, stream, job)) {
+            xfrjob_discard(job);
+            continue;
+        }
+        /* hand the connection back for the next query */
+        pthread_mutex_lock(&pool->pool_lock);
+        job->next = pool->finished;
+        pool->finished = job;
+        pthread_mutex_unlock(&pool->pool_lock);
+        if (write(pool->wakeup[1], "", 1) == -1 && errno != EAGAIN) {
+            ods_log_error("[%s] unable to wake up dns handler: write() "
+                "failed (%s)", xfrstream_str, strerror(errno));
+        }
+    }
+    for (i=0; i < XFRSTREAM_BATCH_SIZE; i++) {
+        buffer_cleanup(stream->batch[0].packets[i]);
+        buffer_cleanup(stream->batch[1].packets[i]);
+    }
+    free(stream);
+}
+
+
+/**
+ * Create transfer pool.
+ *
+ */
+xfrpool_type*
+xfrpool_create(engine_type* engine, size_t num_threads)
+{
+    xfrpool_type* pool = NULL;
+    size_t i = 0;
+    if (!engine || !num_threads) {
+        return NULL;
+    }
+    CHECKALLOC(pool = (xfrpool_type*) malloc(sizeof(xfrpool_type)));
+    if (pipe(pool->wakeup) == -1) {
+        ods_log_error("[%s] unable to create transfer pool: pipe() failed "
+            "(%s)", xfrstream_str, strerror(errno));
+        free(pool);
+        return NULL;
+    }
+    fcntl(pool->wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(pool->wakeup[1], F_SETFL, O_NONBLOCK);
+    pool->engine = engine;
+    pool->num_threads = num_threads;
+    pool->first = NULL;
+    pool->last = NULL;
+    pool->finished = NULL;
+    pool->need_to_exit = 0;
+    pool->xfr_bytes = metrics_counter("ods_xfr_out_bytes_total",
+        "Bytes sent in zone transfers.", NULL, NULL);
+    pool->xfr_latency = metrics_histogram("ods_xfr_out_seconds",
+        "Time to serve a zone transfer.", NULL, NULL);
+    pthread_mutex_init(&pool->pool_lock, NULL);
+    pthread_cond_init(&pool->pool_cond, NULL);
+    CHECKALLOC(pool->threads = (janitor_thread_t*) calloc(num_threads,
+        sizeof(janitor_thread_t)));
+    for (i=0; i < num_threads; i++) {
+        janitor_thread_create(&pool->threads[i], workerthreadclass,
+            (janitor_runfn_t)xfrpool_run, pool);
+    }
+    ods_log_debug("[%s] started %lu transfer threads", xfrstream_str,
+        (unsigned long) num_threads);
+    return pool;
+}
+
+
+/**
+ * Hand over a zone transfer to the pool.
+ *
+ */
+void
+xfrpool_submit(xfrpool_type* pool, netio_handler_type* handler,
+    query_type* q, query_state qstate)
+{
+    xfrjob_type* job = NULL;
+    ods_log_assert(pool);
+    ods_log_assert(handler);
+    ods_log_assert(q);
+    CHECKALLOC(job = (xfrjob_type*) malloc(sizeof(xfrjob_type)));
+    job->next = NULL;
+    job->handler = handler;
+    job->fd = handler->fd;
+    job->query = q;
+    job->qstate = qstate;
+    pthread_mutex_lock(&pool->pool_lock);
+    if (pool->last) {
+        pool->last->next = job;
+    } else {
+        pool->first = job;
+    }
+    pool->last = job;
+    pthread_cond_signal(&pool->pool_cond);
+    pthread_mutex_unlock(&pool->pool_lock);
+}
+
+
+/**
+ * Take the finished transfers.
+ *
+ */
+xfrjob_type*
+xfrpool_finished(xfrpool_type* pool)
+{
+    xfrjob_type* jobs = NULL;
+    char buf[64];
+    ods_log_assert(pool);
+    while (read(pool->wakeup[0], buf, sizeof(buf)) > 0) {
+        ;
+    }
+    pthread_mutex_lock(&pool->pool_lock);
+    jobs = pool->finished;
+    pool->finished = NULL;
+    pthread_mutex_unlock(&pool->pool_lock);
+    return jobs;
+}
+
+
+/**
+ * Clean up transfer pool.
+ *
+ */
+void
+xfrpool_cleanup(xfrpool_type* pool)
+{
+    xfrjob_type* job = NULL;
+    size_t i = 0;
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->pool_lock);
+    pool->need_to_exit = 1;
+    pthread_cond_broadcast(&pool->pool_cond);
+    pthread_mutex_unlock(&pool->pool_lock);
+    for (i=0; i < pool->num_threads; i++) {
+        janitor_thread_join(pool->threads[i]);
+    }
+    while (pool->first) {
+        job = pool->first;
+        pool->first = job->next;
+        xfrjob_discard(job);
+    }
+    while (pool->finished) {
+        job = pool->finished;
+        pool->finished = job->next;
+        xfrjob_discard(job);
+    }
+    close(pool->wakeup[0]);
+    close(pool->wakeup[1]);
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->pool_lock);
+    pthread_cond_destroy(&pool->pool_cond);
+    free(pool);
+}
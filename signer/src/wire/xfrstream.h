@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2017 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/**
+ * Streaming zone transfers.
+ *
+ */
+
+#ifndef WIRE_XFRSTREAM_H
+#define WIRE_XFRSTREAM_H
+
+#include "config.h"
+#include "locks.h"
+#include "metrics.h"
+#include "status.h"
+#include "wire/buffer.h"
+#include "wire/netio.h"
+#include "wire/query.h"
+
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#define XFRSTREAM_BATCH_SIZE 8 /* messages per writev() */
+#define XFRSTREAM_POLL_INTERVAL 1000 /* milliseconds */
+
+/**
+ * Batch of prepared transfer messages, written with one writev().
+ *
+ */
+typedef struct xfrbatch_struct xfrbatch_type;
+struct xfrbatch_struct {
+    buffer_type* packets[XFRSTREAM_BATCH_SIZE];
+    uint16_t tcplen[XFRSTREAM_BATCH_SIZE];
+    struct iovec iov[2*XFRSTREAM_BATCH_SIZE];
+    size_t count;
+    size_t iov_first;
+    size_t iov_count;
+};
+
+/**
+ * Transfer stream. While the active batch drains into the socket, the
+ * standby batch is filled with the next messages.
+ *
+ */
+typedef struct xfrstream_struct xfrstream_type;
+struct xfrstream_struct {
+    xfrbatch_type batch[2];
+    xfrbatch_type* active;
+    xfrbatch_type* standby;
+    /* statistics */
+    struct timeval start;
+    uint64_t bytes;
+    size_t messages;
+    size_t writes;
+};
+
+/**
+ * Pending transfer.
+ *
+ */
+typedef struct xfrjob_struct xfrjob_type;
+struct xfrjob_struct {
+    xfrjob_type* next;
+    netio_handler_type* handler;
+    int fd;
+    query_type* query;
+    query_state qstate;
+};
+
+/**
+ * Pool of transfer threads.
+ *
+ */
+typedef struct xfrpool_struct xfrpool_type;
+struct xfrpool_struct {
+    engine_type* engine;
+    janitor_thread_t* threads;
+    size_t num_threads;
+    xfrjob_type* first;
+    xfrjob_type* last;
+    xfrjob_type* finished;
+    int wakeup[2];
+    pthread_mutex_t pool_lock;
+    pthread_cond_t pool_cond;
+    metrics_type* xfr_bytes;
+    metrics_type* xfr_latency;
+    unsigned need_to_exit;
+};
+
+/**
+ * Create transfer pool and start its threads.
+ * \param[in] engine signer engine
+ * \param[in] num_threads number of transfer threads
+ * \return xfrpool_type* transfer pool
+ *
+ */
+xfrpool_type* xfrpool_create(engine_type* engine, size_t num_threads);
+
+/**
+ * Hand over a tcp connection with an outgoing zone transfer to the pool.
+ * The first response message must be ready in the query buffer. The pool
+ * takes ownership of the tcp handler, which must be removed from netio,
+ * its user data and the query. If the transfer fails, the pool closes
+ * the connection; otherwise it returns the handler through
+ * xfrpool_finished() and signals the wakeup pipe.
+ * \param[in] pool transfer pool
+ * \param[in] handler tcp handler
+ * \param[in] q query
+ * \param[in] qstate QUERY_AXFR or QUERY_IXFR
+ *
+ */
+void xfrpool_submit(xfrpool_type* pool, netio_handler_type* handler,
+    query_type* q, query_state qstate);
+
+/**
+ * Take the transfers that finished cleanly and drain the wakeup pipe.
+ * The caller owns the returned jobs and their tcp handlers again.
+ * \param[in] pool transfer pool
+ * \return xfrjob_type* list of finished jobs
+ *
+ */
+xfrjob_type* xfrpool_finished(xfrpool_type* pool);
+
+/**
+ * Stop the transfer threads and clean up the pool.
+ * \param[in] pool transfer pool
+ *
+ */
+void xfrpool_cleanup(xfrpool_type* pool);
+
+#endif /* WIRE_XFRSTREAM_H */
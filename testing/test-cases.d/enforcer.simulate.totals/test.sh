@@ -0,0 +1,85 @@
+#!/usr/bin/env bash
+#
+#TEST: Simulate a small KASP and check the totals the simulate command
+#TEST: reports. Two zones are on a policy of their own and two share
+#TEST: keys. The ZSKs roll every 10 days and the KSKs every year, so over
+#TEST: 30 days every zone has its DS submitted once, no DS is retracted
+#TEST: and every zone rolls its ZSK at least twice.
+
+# Sum the dated rows of a simulate log and compare them with its Total row.
+function check_simulate_totals() {
+	log_grep -o "$1" stdout "^[0-9-]\{10\} \|^Total " | awk '
+		$1 == "Total" { for (i = 2; i <= 7; i++) total[i] = $i; next }
+		{ for (i = 2; i <= 7; i++) sum[i] += $i }
+		END {
+			for (i = 2; i <= 7; i++) {
+				if (sum[i] + 0 != total[i] + 0) {
+					print "column " i ": sum " sum[i] " total " total[i]
+					exit 1
+				}
+			}
+		}'
+}
+
+# Print one column of the Total row of a simulate log.
+function simulate_total() {
+	log_grep -o "$1" stdout "^Total " | awk -v column="$2" '{ print $column }'
+}
+
+if [ -n "$HAVE_MYSQL" ]; then
+	ods_setup_conf conf.xml conf-mysql.xml
+fi &&
+
+ods_reset_env &&
+
+ods_start_enforcer &&
+
+log_this ods-enforcer-zone-add ods-enforcer zone add -z ods1 &&
+log_this ods-enforcer-zone-add ods-enforcer zone add -z ods2 &&
+log_this ods-enforcer-zone-add ods-enforcer zone add -z shared1 -p bill &&
+log_this ods-enforcer-zone-add ods-enforcer zone add -z shared2 -p bill &&
+ods_enforcer_idle &&
+
+log_this ods-enforcer-key-list-before ods-enforcer key list -d &&
+
+## All zones, in one thread
+log_this ods-enforcer-simulate-1 ods-enforcer simulate --days 30 --threads 1 &&
+log_grep ods-enforcer-simulate-1 stdout "Simulated 4 zones over 30 days" &&
+check_simulate_totals ods-enforcer-simulate-1 &&
+test "`simulate_total ods-enforcer-simulate-1 5`" -eq 4 &&
+test "`simulate_total ods-enforcer-simulate-1 6`" -eq 0 &&
+test "`simulate_total ods-enforcer-simulate-1 3`" -ge 8 &&
+
+## The same totals when the zones are spread over threads
+log_this ods-enforcer-simulate-4 ods-enforcer simulate --days 30 --threads 4 &&
+log_grep ods-enforcer-simulate-4 stdout "Simulated 4 zones over 30 days" &&
+check_simulate_totals ods-enforcer-simulate-4 &&
+test "`log_grep -o ods-enforcer-simulate-1 stdout '^Total '`" = \
+	"`log_grep -o ods-enforcer-simulate-4 stdout '^Total '`" &&
+
+## Rows of 10 days add up to the same totals
+log_this ods-enforcer-simulate-interval ods-enforcer simulate --days 30 --interval 10 &&
+check_simulate_totals ods-enforcer-simulate-interval &&
+test "`log_grep -o ods-enforcer-simulate-1 stdout '^Total '`" = \
+	"`log_grep -o ods-enforcer-simulate-interval stdout '^Total '`" &&
+
+## Only the zones of one policy
+log_this ods-enforcer-simulate-policy ods-enforcer simulate --days 30 --policy bill &&
+log_grep ods-enforcer-simulate-policy stdout "Simulated 2 zones over 30 days" &&
+check_simulate_totals ods-enforcer-simulate-policy &&
+test "`simulate_total ods-enforcer-simulate-policy 5`" -eq 2 &&
+
+## Bad arguments
+! log_this ods-enforcer-simulate-bad ods-enforcer simulate --days 0 &&
+log_grep ods-enforcer-simulate-bad stderr "must be positive" &&
+
+## Nothing was written to the database
+log_this ods-enforcer-key-list-after ods-enforcer key list -d &&
+diff "_log.$BUILD_TAG.ods-enforcer-key-list-before.stdout" \
+	"_log.$BUILD_TAG.ods-enforcer-key-list-after.stdout" &&
+
+ods_stop_enforcer &&
+return 0
+
+ods_kill
+return 1
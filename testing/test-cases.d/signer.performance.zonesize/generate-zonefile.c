@@ -6,7 +6,8 @@
 int
 main(int argc, char* argv[])
 {
-  int i, j;
+  int i, j, k;
+  int maxrrsetsize, rrsetsize;
   int numzones, zonesize, numhosts, numdelegations, numinsecuredelegations, numsecuredelegations;
   double delegationfraction, optoutfraction;
   FILE *fp = NULL;
@@ -19,6 +20,11 @@ main(int argc, char* argv[])
   zonesize = strtol(argv[2],NULL,10);
   delegationfraction = strtod(argv[3],NULL);
   optoutfraction = strtod(argv[4],NULL);
+  /* optional fifth argument: maximum number of A records per host */
+  maxrrsetsize = (argc > 5 ? strtol(argv[5],NULL,10) : 1);
+  if(maxrrsetsize < 1) {
+    maxrrsetsize = 1;
+  }
   numdelegations = round(zonesize * delegationfraction);
   numhosts = zonesize - numdelegations;
   numinsecuredelegations = round(numdelegations * optoutfraction);
@@ -32,7 +38,11 @@ main(int argc, char* argv[])
     }
     fprintf(fp,"$ORIGIN z%d.\n$TTL 60\nz%d. 600 IN SOA ns1. postmaster.z%d. 1000 1200 180 1209600 3600\n",(numzones==-1?zonesize:i),(numzones==-1?zonesize:i),(numzones==-1?zonesize:i));
     for(j=0; j<numhosts; j++) {
-      fprintf(fp,"a%d IN A 127.0.0.1\n",j);
+      /* deterministic, skewed towards small RRsets with a long tail */
+      rrsetsize = 1 + (int)floor(pow((((unsigned)j * 2654435761u) % 1000) / 1000.0, 4) * maxrrsetsize);
+      for(k=0; k<rrsetsize; k++) {
+        fprintf(fp,"a%d IN A 127.0.%d.%d\n",j,(k+1)/256,(k+1)%256);
+      }
     }
     for(j=0; j<numsecuredelegations; j++) {
       //fprintf(fp,"b%d IN NS 127.0.0.1\nb%d IN DS 0\n",j,j);
@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+
+#TEST: Add, update and remove a single zone in the signer with
+#TEST: 'ods-signer update <zone>' without rereading the zone list
+
+SIGNCONF=$INSTALL_ROOT/var/opendnssec/signconf/ods.xml
+UNSIGNED=$INSTALL_ROOT/var/opendnssec/unsigned
+SIGNED=$INSTALL_ROOT/var/opendnssec/signed
+
+if [ -n "$HAVE_MYSQL" ]; then
+	ods_setup_conf conf.xml conf-mysql.xml
+fi &&
+
+ods_reset_env &&
+
+ods_start_ods-control &&
+
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods ' &&
+test -f "$SIGNED/ods" &&
+
+## Add a zone that is not in the zone list
+log_this ods-signer-update-add ods-signer update ods1 --policy default \
+	--signconf "$SIGNCONF" --input "$UNSIGNED/ods1" --output "$SIGNED/ods1" &&
+log_grep ods-signer-update-add stdout "Zone ods1 config being updated." &&
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods1 ' &&
+test -f "$SIGNED/ods1" &&
+log_this ods-signer-zones-add ods-signer zones &&
+log_grep ods-signer-zones-add stdout "There are 2 zones configured" &&
+log_grep ods-signer-zones-add stdout "^- ods1$" &&
+
+## Update the adapters of that zone
+log_this ods-signer-update-adapters ods-signer update ods1 --policy default \
+	--signconf "$SIGNCONF" --in-type File --input "$UNSIGNED/ods1" \
+	--out-type File --output "$SIGNED/ods1.alt" &&
+log_grep ods-signer-update-adapters stdout "Zone ods1 config being updated." &&
+log_this ods-signer-sign-adapters ods-signer sign ods1 &&
+syslog_waitfor_count 60 2 'ods-signerd: .*\[STATS\] ods1 ' &&
+test -f "$SIGNED/ods1.alt" &&
+
+## Update the policy and signconf of that zone
+cp -- "$SIGNCONF" "$INSTALL_ROOT/var/opendnssec/signconf/ods1.xml" &&
+log_this ods-signer-update-signconf ods-signer update ods1 --policy other \
+	--signconf "$INSTALL_ROOT/var/opendnssec/signconf/ods1.xml" \
+	--input "$UNSIGNED/ods1" --output "$SIGNED/ods1.alt" &&
+log_grep ods-signer-update-signconf stdout "Zone ods1 config being updated." &&
+log_this ods-signer-sign-signconf ods-signer sign ods1 &&
+syslog_waitfor_count 60 3 'ods-signerd: .*\[STATS\] ods1 ' &&
+
+## Remove only that zone
+log_this ods-signer-update-remove ods-signer update ods1 --remove &&
+log_grep ods-signer-update-remove stdout "Zone ods1 removed." &&
+log_this ods-signer-zones-remove ods-signer zones &&
+log_grep ods-signer-zones-remove stdout "There are 1 zones configured" &&
+! log_grep ods-signer-zones-remove stdout "^- ods1$" &&
+log_grep ods-signer-zones-remove stdout "^- ods$" &&
+
+## Unknown zones
+! log_this ods-signer-update-unknown ods-signer update ods2 --remove &&
+log_grep ods-signer-update-unknown stdout "Error: Zone ods2 not found." &&
+! log_this ods-signer-update-unknown-plain ods-signer update ods2 &&
+log_grep ods-signer-update-unknown-plain stdout "Error: Zone ods2 not found." &&
+
+## Invalid option combinations
+! log_this ods-signer-update-bad-remove ods-signer update ods --remove --policy default &&
+log_grep ods-signer-update-bad-remove stdout "Error: Expected a single zone and either its settings or --remove." &&
+! log_this ods-signer-update-bad-zones ods-signer update ods ods1 --remove &&
+log_grep ods-signer-update-bad-zones stdout "Error: Expected a single zone and either its settings or --remove." &&
+! log_this ods-signer-update-incomplete ods-signer update ods2 --policy default &&
+log_grep ods-signer-update-incomplete stdout "Error: Incomplete or invalid settings for zone ods2." &&
+! log_this ods-signer-update-bad-type ods-signer update ods2 --policy default \
+	--signconf "$SIGNCONF" --in-type Bogus --input "$UNSIGNED/ods1" --output "$SIGNED/ods2" &&
+log_grep ods-signer-update-bad-type stdout "Error: Incomplete or invalid settings for zone ods2." &&
+log_this ods-signer-zones-end ods-signer zones &&
+log_grep ods-signer-zones-end stdout "There are 1 zones configured" &&
+
+ods_stop_ods-control &&
+return 0
+
+ods_kill
+return 1